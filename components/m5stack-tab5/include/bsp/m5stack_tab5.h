@@ -311,6 +311,8 @@ typedef struct {
         unsigned int buff_spiram : 1; /*!< Allocated LVGL buffer will be in PSRAM */
         unsigned int
             sw_rotate : 1; /*!< Use software rotation (slower), The feature is unavailable under avoid-tear mode */
+        unsigned int
+            no_touch_indev : 1; /*!< Create the touch controller only, the application adds its own LVGL input device */
     } flags;
 } bsp_display_cfg_t;
 
@@ -345,6 +347,13 @@ lv_display_t *bsp_display_start_with_config(const bsp_display_cfg_t *cfg);
  */
 lv_indev_t *bsp_display_get_input_dev(void);
 
+/**
+ * @brief Get the MIPI-DSI (DPI) panel handle used by LVGL
+ *
+ * @return Panel handle or NULL before bsp_display_start()
+ */
+esp_lcd_panel_handle_t bsp_display_get_panel_handle(void);
+
 /**
  * @brief Take LVGL mutex
  *
@@ -371,8 +380,142 @@ void bsp_display_unlock(void);
 void bsp_display_rotate(lv_display_t *disp, lv_disp_rotation_t rotation);
 #endif  // BSP_CONFIG_NO_GRAPHIC_LIB == 0
 
+/**************************************************************************************************
+ *
+ * I/O expanders
+ *
+ * The board has two PI4IOE5V6408 expanders on the internal I2C bus. Their output and direction
+ * registers are cached in RAM: reads come from the cache and writes are merged and flushed to
+ * the chip by a background task one tick after the first change.
+ **************************************************************************************************/
+typedef enum {
+    BSP_IO_EXPANDER_1 = 0, /*!< PI4IOE5V6408 @ 0x43: antenna, speaker, 5V out, LCD/TP/camera reset */
+    BSP_IO_EXPANDER_2,     /*!< PI4IOE5V6408 @ 0x44: WLAN power, USB 5V, poweroff, charger */
+    BSP_IO_EXPANDER_NUM,
+} bsp_io_expander_t;
+
+/**
+ * @brief Init both I/O expanders and start the flush task
+ *
+ * Safe to call more than once; only the first call touches the hardware.
+ *
+ * @param[in] bus_handle Internal I2C bus handle
+ */
 void bsp_io_expander_pi4ioe_init(i2c_master_bus_handle_t bus_handle);
 
+/**
+ * @brief Set or clear output pins in the cached output register
+ *
+ * The change reaches the chip on the next flush.
+ *
+ * @param[in] exp Expander
+ * @param[in] mask Pins to change
+ * @param[in] level New level of the masked pins
+ */
+void bsp_io_expander_set_output(bsp_io_expander_t exp, uint8_t mask, bool level);
+
+/**
+ * @brief Get the cached output register
+ *
+ * @param[in] exp Expander
+ * @return Output register value as last set, without an I2C read
+ */
+uint8_t bsp_io_expander_get_output(bsp_io_expander_t exp);
+
+/**
+ * @brief Switch pins between input and output in the cached direction register
+ *
+ * @param[in] exp Expander
+ * @param[in] mask Pins to change
+ * @param[in] output true for output, false for input
+ */
+void bsp_io_expander_set_direction(bsp_io_expander_t exp, uint8_t mask, bool output);
+
+/**
+ * @brief Get the cached direction register
+ *
+ * @param[in] exp Expander
+ * @return Direction register value, 1 means output
+ */
+uint8_t bsp_io_expander_get_direction(bsp_io_expander_t exp);
+
+/**
+ * @brief Write all pending cached changes to the chips now
+ *
+ * Use when the caller needs the pin to have changed before continuing, e.g. reset pulses.
+ * With a flush hook set the writes run through the hook, see bsp_io_expander_flush_hook_t.
+ *
+ * @return
+ *      - ESP_OK                On success
+ *      - ESP_ERR_INVALID_STATE Expanders not initialized
+ */
+esp_err_t bsp_io_expander_flush(void);
+
+/**
+ * @brief Write the pending cached changes of one expander to the chip
+ *
+ * Talks to the chip directly, meant to be called by a flush hook.
+ *
+ * @param[in] exp Expander
+ * @return
+ *      - ESP_OK                On success
+ *      - ESP_ERR_INVALID_ARG   Unknown expander
+ *      - ESP_ERR_INVALID_STATE Expanders not initialized
+ */
+esp_err_t bsp_io_expander_flush_one(bsp_io_expander_t exp);
+
+/**
+ * @brief Read an expander register directly from the chip
+ *
+ * Meant for input status, interrupt status and other registers that are not cached.
+ *
+ * @param[in] exp Expander
+ * @param[in] reg Register address
+ * @param[out] value Register value
+ * @return ESP_OK on success, otherwise the I2C error
+ */
+esp_err_t bsp_io_expander_read_reg(bsp_io_expander_t exp, uint8_t reg, uint8_t *value);
+
+/**
+ * @brief Write an uncached expander register directly to the chip
+ *
+ * Output and direction registers are rejected with ESP_ERR_INVALID_ARG, use
+ * bsp_io_expander_set_output() and bsp_io_expander_set_direction() for those.
+ *
+ * @param[in] exp Expander
+ * @param[in] reg Register address
+ * @param[in] value Register value
+ * @return ESP_OK on success, otherwise the error
+ */
+esp_err_t bsp_io_expander_write_reg(bsp_io_expander_t exp, uint8_t reg, uint8_t value);
+
+/**
+ * @brief Flush scheduler hook
+ *
+ * Called instead of waking the built-in flush task whenever the cache of an expander becomes
+ * dirty, with wait false: the hook must arrange for bsp_io_expander_flush_one() to run soon,
+ * e.g. on an I2C bus arbiter. bsp_io_expander_flush() calls it with wait true: the hook must
+ * run bsp_io_expander_flush_one() before returning and return its result.
+ */
+typedef esp_err_t (*bsp_io_expander_flush_hook_t)(bsp_io_expander_t exp, bool wait);
+
+/**
+ * @brief Hand flush scheduling over to the application
+ *
+ * @param[in] hook Hook, NULL to go back to the built-in flush task
+ */
+void bsp_io_expander_set_flush_hook(bsp_io_expander_flush_hook_t hook);
+
+/**
+ * @brief Get the I2C device handle of an expander
+ *
+ * @param[in] exp Expander
+ * @return Device handle, NULL before bsp_io_expander_pi4ioe_init()
+ */
+i2c_master_dev_handle_t bsp_io_expander_get_dev_handle(bsp_io_expander_t exp);
+
+void bsp_set_speaker_enable(bool en);
+
 void bsp_set_charge_qc_en(bool en);
 
 void bsp_set_charge_en(bool en);
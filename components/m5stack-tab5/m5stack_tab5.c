@@ -18,6 +18,7 @@
 #include "usb/usb_host.h"
 #include "sd_pwr_ctrl_by_on_chip_ldo.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "sdmmc_cmd.h"
 #include "esp_lcd_st7703.h"
 #include "esp_lcd_ili9881c.h"
@@ -222,9 +223,6 @@ esp_err_t bsp_i2c_scan()
 #define I2C_DEV_ADDR_PI4IOE2  0x44  // addr pin high
 #define I2C_MASTER_TIMEOUT_MS 50
 
-static i2c_master_dev_handle_t i2c_dev_handle_pi4ioe1;
-static i2c_master_dev_handle_t i2c_dev_handle_pi4ioe2;
-
 // PI4IO registers
 #define PI4IO_REG_CHIP_RESET 0x01
 #define PI4IO_REG_IO_DIR     0x03
@@ -237,196 +235,335 @@ static i2c_master_dev_handle_t i2c_dev_handle_pi4ioe2;
 #define PI4IO_REG_INT_MASK   0x11
 #define PI4IO_REG_IRQ_STA    0x13
 
-#define setbit(x, y) x |= (0x01 << y)
-#define clrbit(x, y) x &= ~(0x01 << y)
+/*
+ * The output and direction registers of both expanders are shadowed in RAM:
+ * reads never touch the bus, and bit changes only mark the register dirty.
+ * A flush task writes every dirty register once, one tick after the first
+ * change, so several changes made back to back cost a single I2C write.
+ */
+typedef struct {
+    i2c_master_dev_handle_t dev;
+    uint8_t out;     // OUT_SET shadow
+    uint8_t dir;     // IO_DIR shadow
+    uint8_t out_hw;  // Last OUT_SET value written to the chip
+    uint8_t dir_hw;  // Last IO_DIR value written to the chip
+} pi4ioe_shadow_t;
+
+static pi4ioe_shadow_t pi4ioe[BSP_IO_EXPANDER_NUM];
+static bool pi4ioe_initialized            = false;
+static portMUX_TYPE pi4ioe_lock           = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t pi4ioe_io_mutex  = NULL;  // Serializes flushes
+static TaskHandle_t pi4ioe_flush_task     = NULL;
+static volatile bool pi4ioe_flush_pending[BSP_IO_EXPANDER_NUM];
+static bsp_io_expander_flush_hook_t pi4ioe_flush_hook = NULL;
+
+static esp_err_t pi4ioe_write(pi4ioe_shadow_t* exp, uint8_t reg, uint8_t value)
+{
+    uint8_t write_buf[2] = {reg, value};
+    return i2c_master_transmit(exp->dev, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+}
 
-void bsp_io_expander_pi4ioe_init(i2c_master_bus_handle_t bus_handle)
+static void pi4ioe_request_flush(bsp_io_expander_t exp)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    bool notify = false;
 
-    /* */
-    i2c_device_config_t dev_cfg1 = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address  = I2C_DEV_ADDR_PI4IOE1,
-        .scl_speed_hz    = 400000,
-    };
-    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg1, &i2c_dev_handle_pi4ioe1));
-
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    write_buf[1] = 0xFF;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe1, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_IO_DIR;
-    write_buf[1] = 0b01111111;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);  // 0: input 1: output
-    write_buf[0] = PI4IO_REG_OUT_H_IM;
-    write_buf[1] = 0b00000000;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // 使用到的引脚关闭 High-Impedance
-    write_buf[0] = PI4IO_REG_PULL_SEL;
-    write_buf[1] = 0b01111111;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // pull up/down select, 0 down, 1 up
-    write_buf[0] = PI4IO_REG_PULL_EN;
-    write_buf[1] = 0b01111111;
-
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // P7 中断使能 0 enable, 1 disable
-    /* Output Port Register P1(SPK_EN), P2(EXT5V_EN), P4(LCD_RST), P5(TP_RST), P6(CAM)RST 输出高电平 */
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = 0b01110110;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    taskENTER_CRITICAL(&pi4ioe_lock);
+    if (!pi4ioe_flush_pending[exp]) {
+        pi4ioe_flush_pending[exp] = true;
+        notify                    = true;
+    }
+    taskEXIT_CRITICAL(&pi4ioe_lock);
 
-    /* */
-    i2c_device_config_t dev_cfg2 = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address  = I2C_DEV_ADDR_PI4IOE2,
-        .scl_speed_hz    = 400000,
-    };
-    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg2, &i2c_dev_handle_pi4ioe2));
-
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    write_buf[1] = 0xFF;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_IO_DIR;
-    write_buf[1] = 0b10111001;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);  // 0: input 1: output
-    write_buf[0] = PI4IO_REG_OUT_H_IM;
-    write_buf[1] = 0b00000110;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // 使用到的引脚关闭 High-Impedance
-    write_buf[0] = PI4IO_REG_PULL_SEL;
-    write_buf[1] = 0b10111001;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // pull up/down select, 0 down, 1 up
-    write_buf[0] = PI4IO_REG_PULL_EN;
-    write_buf[1] = 0b11111001;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // pull up/down enable, 0 disable, 1 enable
-    write_buf[0] = PI4IO_REG_IN_DEF_STA;
-    write_buf[1] = 0b01000000;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);  // P6 默认高电平
-    write_buf[0] = PI4IO_REG_INT_MASK;
-    write_buf[1] = 0b10111111;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2,
-                        I2C_MASTER_TIMEOUT_MS);  // P6 中断使能 0 enable, 1 disable
-    /* Output Port Register P0(WLAN_PWR_EN), P3(USB5V_EN), P7(CHG_EN) 输出高电平 */
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    // write_buf[1] = 0b10001001;
-    write_buf[1] = 0b00001001;
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    if (!notify) {
+        return;
+    }
+    if (pi4ioe_flush_hook) {
+        // Not scheduled, let the next change try again
+        if (pi4ioe_flush_hook(exp, false) != ESP_OK) {
+            pi4ioe_flush_pending[exp] = false;
+        }
+    } else if (pi4ioe_flush_task) {
+        xTaskNotifyGive(pi4ioe_flush_task);
+    }
 }
 
-void bsp_set_charge_qc_en(bool en)
+static void pi4ioe_flush_task_fn(void* arg)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Let changes made within the same tick pile up before writing
+        vTaskDelay(1);
+        bsp_io_expander_flush();
+    }
+}
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+esp_err_t bsp_io_expander_flush_one(bsp_io_expander_t exp_id)
+{
+    esp_err_t ret = ESP_OK;
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    if (en) {
-        clrbit(write_buf[1], 5);
-    } else {
-        setbit(write_buf[1], 5);
+    if (!pi4ioe_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (exp_id >= BSP_IO_EXPANDER_NUM) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    pi4ioe_shadow_t* exp = &pi4ioe[exp_id];
+
+    xSemaphoreTake(pi4ioe_io_mutex, portMAX_DELAY);
+
+    // Anything changed from here on schedules another flush
+    taskENTER_CRITICAL(&pi4ioe_lock);
+    pi4ioe_flush_pending[exp_id] = false;
+    uint8_t out    = exp->out;
+    uint8_t dir    = exp->dir;
+    bool out_dirty = (out != exp->out_hw);
+    bool dir_dirty = (dir != exp->dir_hw);
+    taskEXIT_CRITICAL(&pi4ioe_lock);
+
+    // Drive the new level before turning a pin into an output
+    if (out_dirty) {
+        esp_err_t err = pi4ioe_write(exp, PI4IO_REG_OUT_SET, out);
+        if (err == ESP_OK) {
+            exp->out_hw = out;
+        }
+        ret |= err;
+    }
+    if (dir_dirty) {
+        esp_err_t err = pi4ioe_write(exp, PI4IO_REG_IO_DIR, dir);
+        if (err == ESP_OK) {
+            exp->dir_hw = dir;
+        }
+        ret |= err;
+    }
+    xSemaphoreGive(pi4ioe_io_mutex);
+
+    return ret;
 }
 
-void bsp_set_charge_en(bool en)
+esp_err_t bsp_io_expander_flush(void)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    esp_err_t ret = ESP_OK;
+
+    if (!pi4ioe_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+    // Synchronous flushes go through the hook too, so they queue behind the bus owner's traffic
+    for (int i = 0; i < BSP_IO_EXPANDER_NUM; i++) {
+        if (pi4ioe_flush_hook) {
+            ret |= pi4ioe_flush_hook((bsp_io_expander_t)i, true);
+        } else {
+            ret |= bsp_io_expander_flush_one((bsp_io_expander_t)i);
+        }
+    }
+
+    return ret;
+}
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    if (en) {
-        setbit(write_buf[1], 7);
+void bsp_io_expander_set_output(bsp_io_expander_t exp, uint8_t mask, bool level)
+{
+    if (exp >= BSP_IO_EXPANDER_NUM) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&pi4ioe_lock);
+    if (level) {
+        pi4ioe[exp].out |= mask;
     } else {
-        clrbit(write_buf[1], 7);
+        pi4ioe[exp].out &= ~mask;
     }
+    taskEXIT_CRITICAL(&pi4ioe_lock);
 
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    pi4ioe_request_flush(exp);
 }
 
-void bsp_set_usb_5v_en(bool en)
+uint8_t bsp_io_expander_get_output(bsp_io_expander_t exp)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    if (exp >= BSP_IO_EXPANDER_NUM) {
+        return 0;
+    }
+    return pi4ioe[exp].out;
+}
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+void bsp_io_expander_set_direction(bsp_io_expander_t exp, uint8_t mask, bool output)
+{
+    if (exp >= BSP_IO_EXPANDER_NUM) {
+        return;
+    }
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    if (en) {
-        setbit(write_buf[1], 3);
+    taskENTER_CRITICAL(&pi4ioe_lock);
+    if (output) {
+        pi4ioe[exp].dir |= mask;
     } else {
-        clrbit(write_buf[1], 3);
+        pi4ioe[exp].dir &= ~mask;
     }
+    taskEXIT_CRITICAL(&pi4ioe_lock);
 
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    pi4ioe_request_flush(exp);
 }
 
-void bsp_set_ext_5v_en(bool en)
+uint8_t bsp_io_expander_get_direction(bsp_io_expander_t exp)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    if (exp >= BSP_IO_EXPANDER_NUM) {
+        return 0;
+    }
+    return pi4ioe[exp].dir;
+}
+
+esp_err_t bsp_io_expander_read_reg(bsp_io_expander_t exp, uint8_t reg, uint8_t* value)
+{
+    if (exp >= BSP_IO_EXPANDER_NUM || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!pi4ioe_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe1, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+    uint8_t write_buf[1] = {reg};
+    return i2c_master_transmit_receive(pi4ioe[exp].dev, write_buf, 1, value, 1, I2C_MASTER_TIMEOUT_MS);
+}
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    if (en) {
-        setbit(write_buf[1], 2);
-    } else {
-        clrbit(write_buf[1], 2);
+esp_err_t bsp_io_expander_write_reg(bsp_io_expander_t exp, uint8_t reg, uint8_t value)
+{
+    if (exp >= BSP_IO_EXPANDER_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!pi4ioe_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Shadowed registers must go through set_output()/set_direction()
+    if (reg == PI4IO_REG_OUT_SET || reg == PI4IO_REG_IO_DIR) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    return pi4ioe_write(&pi4ioe[exp], reg, value);
 }
 
-void bsp_generate_poweroff_signal()
+void bsp_io_expander_set_flush_hook(bsp_io_expander_flush_hook_t hook)
 {
-    ESP_LOGW(TAG, "Generate poweroff signal!");
-    uint8_t write_buf[2] = {0};
+    pi4ioe_flush_hook = hook;
+}
+
+i2c_master_dev_handle_t bsp_io_expander_get_dev_handle(bsp_io_expander_t exp)
+{
+    if (exp >= BSP_IO_EXPANDER_NUM) {
+        return NULL;
+    }
+    return pi4ioe[exp].dev;
+}
+
+static void pi4ioe_add_device(pi4ioe_shadow_t* exp, i2c_master_bus_handle_t bus_handle, uint16_t addr)
+{
+    uint8_t write_buf[1] = {PI4IO_REG_CHIP_RESET};
     uint8_t read_buf[1]  = {0};
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address  = addr,
+        .scl_speed_hz    = 400000,
+    };
+    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg, &exp->dev));
+
+    pi4ioe_write(exp, PI4IO_REG_CHIP_RESET, 0xFF);
+    i2c_master_transmit_receive(exp->dev, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+}
+
+void bsp_io_expander_pi4ioe_init(i2c_master_bus_handle_t bus_handle)
+{
+    if (pi4ioe_initialized) {
+        return;
+    }
+
+    pi4ioe_shadow_t* exp1 = &pi4ioe[BSP_IO_EXPANDER_1];
+    pi4ioe_shadow_t* exp2 = &pi4ioe[BSP_IO_EXPANDER_2];
+
+    /* */
+    pi4ioe_add_device(exp1, bus_handle, I2C_DEV_ADDR_PI4IOE1);
+    exp1->dir = 0b01111111;  // 0: input 1: output
+    pi4ioe_write(exp1, PI4IO_REG_IO_DIR, exp1->dir);
+    pi4ioe_write(exp1, PI4IO_REG_OUT_H_IM, 0b00000000);  // 使用到的引脚关闭 High-Impedance
+    pi4ioe_write(exp1, PI4IO_REG_PULL_SEL, 0b01111111);  // pull up/down select, 0 down, 1 up
+    pi4ioe_write(exp1, PI4IO_REG_PULL_EN, 0b01111111);   // P7 中断使能 0 enable, 1 disable
+    /* Output Port Register P1(SPK_EN), P2(EXT5V_EN), P4(LCD_RST), P5(TP_RST), P6(CAM)RST 输出高电平 */
+    exp1->out = 0b01110110;
+    pi4ioe_write(exp1, PI4IO_REG_OUT_SET, exp1->out);
+
+    /* */
+    pi4ioe_add_device(exp2, bus_handle, I2C_DEV_ADDR_PI4IOE2);
+    exp2->dir = 0b10111001;  // 0: input 1: output
+    pi4ioe_write(exp2, PI4IO_REG_IO_DIR, exp2->dir);
+    pi4ioe_write(exp2, PI4IO_REG_OUT_H_IM, 0b00000110);    // 使用到的引脚关闭 High-Impedance
+    pi4ioe_write(exp2, PI4IO_REG_PULL_SEL, 0b10111001);    // pull up/down select, 0 down, 1 up
+    pi4ioe_write(exp2, PI4IO_REG_PULL_EN, 0b11111001);     // pull up/down enable, 0 disable, 1 enable
+    pi4ioe_write(exp2, PI4IO_REG_IN_DEF_STA, 0b01000000);  // P6 默认高电平
+    pi4ioe_write(exp2, PI4IO_REG_INT_MASK, 0b10111111);    // P6 中断使能 0 enable, 1 disable
+    /* Output Port Register P0(WLAN_PWR_EN), P3(USB5V_EN), P7(CHG_EN) 输出高电平 */
+    // exp2->out = 0b10001001;
+    exp2->out = 0b00001001;
+    pi4ioe_write(exp2, PI4IO_REG_OUT_SET, exp2->out);
+
+    for (int i = 0; i < BSP_IO_EXPANDER_NUM; i++) {
+        pi4ioe[i].out_hw = pi4ioe[i].out;
+        pi4ioe[i].dir_hw = pi4ioe[i].dir;
+    }
 
-    write_buf[1] = read_buf[0];
+    pi4ioe_io_mutex = xSemaphoreCreateMutex();
+    assert(pi4ioe_io_mutex);
+    if (xTaskCreate(pi4ioe_flush_task_fn, "io_exp", 3072, NULL, 5, &pi4ioe_flush_task) != pdPASS) {
+        ESP_LOGE(TAG, "Creating IO expander flush task failed");
+        abort();
+    }
+
+    pi4ioe_initialized = true;
+}
+
+void bsp_set_charge_qc_en(bool en)
+{
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_2, BIT(5), !en);
+}
+
+void bsp_set_charge_en(bool en)
+{
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_2, BIT(7), en);
+}
+
+void bsp_set_usb_5v_en(bool en)
+{
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_2, BIT(3), en);
+}
+
+void bsp_set_ext_5v_en(bool en)
+{
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_1, BIT(2), en);
+}
+
+void bsp_set_speaker_enable(bool en)
+{
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_1, BIT(1), en);
+}
+
+void bsp_generate_poweroff_signal()
+{
+    ESP_LOGW(TAG, "Generate poweroff signal!");
 
     // Try to generate poweroff signal 3 times to make sure it works :)
     for (int i = 0; i < 3; i++) {
-        setbit(write_buf[1], 4);
-        i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+        bsp_io_expander_set_output(BSP_IO_EXPANDER_2, BIT(4), true);
+        bsp_io_expander_flush();
         vTaskDelay(100 / portTICK_PERIOD_MS);
 
-        clrbit(write_buf[1], 4);
-        i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+        bsp_io_expander_set_output(BSP_IO_EXPANDER_2, BIT(4), false);
+        bsp_io_expander_flush();
         vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 }
 
 bool bsp_headphone_detect()
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    uint8_t read_buf[1] = {0};
 
-    write_buf[0] = PI4IO_REG_IN_STA;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe1, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+    bsp_io_expander_read_reg(BSP_IO_EXPANDER_1, PI4IO_REG_IN_STA, read_buf);
 
     // printf("get %02x\n", read_buf[0]);
 
@@ -441,11 +578,9 @@ bool bsp_headphone_detect()
 
 bool bsp_usb_c_detect()
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
+    uint8_t read_buf[1] = {0};
 
-    write_buf[0] = PI4IO_REG_IN_STA;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
+    bsp_io_expander_read_reg(BSP_IO_EXPANDER_2, PI4IO_REG_IN_STA, read_buf);
 
     // printf("get %02x\n", read_buf[0]);
 
@@ -460,46 +595,13 @@ bool bsp_usb_c_detect()
 
 void bsp_set_ext_antenna_enable(bool en)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe1, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    if (en) {
-        setbit(write_buf[1], 0);
-    } else {
-        clrbit(write_buf[1], 0);
-    }
-
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_1, BIT(0), en);
 }
 
 void bsp_set_wifi_power_enable(bool en)
 {
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
-
     ESP_LOGI(TAG, "set_wifi_power_enable: %d", en);
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    if (en) {
-        setbit(write_buf[1], 0);
-    } else {
-        clrbit(write_buf[1], 0);
-    }
-
-    i2c_master_transmit(i2c_dev_handle_pi4ioe2, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe2, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-    printf("0x%02X: %02x\n", PI4IO_REG_OUT_SET, read_buf[0]);
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_2, BIT(0), en);
 }
 
 void bsp_reset_tp()
@@ -509,24 +611,13 @@ void bsp_reset_tp()
     ESP_LOGI(TAG, "reset gpio %d", GPIO_NUM_23);
     gpio_reset_pin(GPIO_NUM_23);
 
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1]  = {0};
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    i2c_master_transmit_receive(i2c_dev_handle_pi4ioe1, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    clrbit(write_buf[1], 4);
-    clrbit(write_buf[1], 5);
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    // Pulses must hit the pins in order, so flush synchronously around the delays
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_1, BIT(4) | BIT(5), false);
+    bsp_io_expander_flush();
     vTaskDelay(100 / portTICK_PERIOD_MS);
 
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = read_buf[0];
-    setbit(write_buf[1], 4);
-    setbit(write_buf[1], 5);
-    i2c_master_transmit(i2c_dev_handle_pi4ioe1, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
+    bsp_io_expander_set_output(BSP_IO_EXPANDER_1, BIT(4) | BIT(5), true);
+    bsp_io_expander_flush();
     vTaskDelay(100 / portTICK_PERIOD_MS);
 }
 
@@ -1131,7 +1222,7 @@ esp_err_t bsp_display_new_with_handles(const bsp_display_config_t* config, bsp_l
         .dpi_clk_src        = MIPI_DSI_DPI_CLK_SRC_DEFAULT,
         .dpi_clock_freq_mhz = 60,  // 720*1280 RGB24 60Hz RGB24 // 80,
         .pixel_format       = LCD_COLOR_PIXEL_FORMAT_RGB565,
-        .num_fbs            = 1,
+        .num_fbs            = CONFIG_BSP_LCD_DPI_BUFFER_NUMS,
         .video_timing =
             {
                 .h_size            = BSP_LCD_H_RES,
@@ -1177,7 +1268,7 @@ esp_err_t bsp_display_new_with_handles(const bsp_display_config_t* config, bsp_l
         .dpi_clk_src = MIPI_DSI_DPI_CLK_SRC_DEFAULT,
         .dpi_clock_freq_mhz = 60,                       // LCD_MIPI_DSI_DPI_CLK_MHZ_ST7703,
         .pixel_format = LCD_COLOR_PIXEL_FORMAT_RGB565,  // LCD_COLOR_PIXEL_FORMAT_RGB888,
-        .num_fbs = 1,
+        .num_fbs = CONFIG_BSP_LCD_DPI_BUFFER_NUMS,
         .video_timing =
             {
                 .h_size = BSP_LCD_H_RES,  // lcd_param.width,
@@ -1266,11 +1357,14 @@ esp_err_t bsp_touch_new(const bsp_touch_config_t* config, esp_lcd_touch_handle_t
 }
 
 #if (BSP_CONFIG_NO_GRAPHIC_LIB == 0)
+static esp_lcd_panel_handle_t _lcd_panel_handle = NULL;
+
 static lv_display_t* bsp_display_lcd_init(const bsp_display_cfg_t* cfg)
 {
     assert(cfg != NULL);
     bsp_lcd_handles_t lcd_panels;
     BSP_ERROR_CHECK_RETURN_NULL(bsp_display_new_with_handles(NULL, &lcd_panels));
+    _lcd_panel_handle = lcd_panels.panel;
 
     /* Add LCD screen */
     ESP_LOGD(TAG, "Add LCD screen");
@@ -1335,13 +1429,23 @@ esp_lcd_touch_handle_t bsp_display_get_touch_handle(void)
 
 esp_lcd_touch_handle_t _lcd_touch_handle;
 
-static lv_indev_t* bsp_display_indev_init(lv_display_t* disp)
+static esp_err_t bsp_display_touch_init(esp_lcd_touch_handle_t* ret_touch)
 {
     esp_lcd_touch_handle_t tp;
-    BSP_ERROR_CHECK_RETURN_NULL(bsp_touch_new(NULL, &tp));
+    BSP_ERROR_CHECK_RETURN_ERR(bsp_touch_new(NULL, &tp));
     esp_lcd_touch_exit_sleep(tp);  // !!!
     assert(tp);
     _lcd_touch_handle = tp;
+    _touch_handle     = tp;
+
+    *ret_touch = tp;
+    return ESP_OK;
+}
+
+static lv_indev_t* bsp_display_indev_init(lv_display_t* disp)
+{
+    esp_lcd_touch_handle_t tp;
+    BSP_ERROR_CHECK_RETURN_NULL(bsp_display_touch_init(&tp));
 
     /* Add touch input (for selected screen) */
     const lvgl_port_touch_cfg_t touch_cfg = {
@@ -1379,7 +1483,12 @@ lv_display_t* bsp_display_start_with_config(const bsp_display_cfg_t* cfg)
     BSP_ERROR_CHECK_RETURN_NULL(bsp_display_brightness_init());
 
     BSP_NULL_CHECK(disp = bsp_display_lcd_init(cfg), NULL);
-    BSP_NULL_CHECK(disp_indev = bsp_display_indev_init(disp), NULL);
+    if (cfg->flags.no_touch_indev) {
+        esp_lcd_touch_handle_t tp;
+        BSP_ERROR_CHECK_RETURN_NULL(bsp_display_touch_init(&tp));
+    } else {
+        BSP_NULL_CHECK(disp_indev = bsp_display_indev_init(disp), NULL);
+    }
     return disp;
 }
 
@@ -1388,6 +1497,11 @@ lv_indev_t* bsp_display_get_input_dev(void)
     return disp_indev;
 }
 
+esp_lcd_panel_handle_t bsp_display_get_panel_handle(void)
+{
+    return _lcd_panel_handle;
+}
+
 void bsp_display_rotate(lv_display_t* disp, lv_disp_rotation_t rotation)
 {
     lv_disp_set_rotation(disp, rotation);
@@ -1,6 +1,9 @@
 #include "apps/file_manager/file_manager.h"
 #include "managers/window_manager.h"
+#include "managers/event_bus.h"
 #include "hals/hal_sdcard.h"
+#include "perf/perf_trace.h"
+#include "perf/perf_watchdog.h"
 #include "theme/theme_engine.h"
 #include "lvgl.h"
 #include <stdio.h>
@@ -27,6 +30,7 @@ static void refresh_btn_event_cb(lv_event_t *e);
 static bool is_directory(const char *path);
 static void navigate_to_directory(const char *path);
 static void show_file_info(const char *filepath);
+static void sd_event_cb(const event_t *event, void *ctx);
 
 static void file_manager_launch(void)
 {
@@ -52,6 +56,25 @@ static void file_manager_launch(void)
     
     // Initial file list refresh
     refresh_file_list();
+    
+    // Re-list when the card is inserted or removed while the window is open
+    static bool subscribed = false;
+    if (!subscribed) {
+        subscribed = event_bus_subscribe(EVENT_SD_MOUNT, sd_event_cb, NULL);
+    }
+}
+
+static void sd_event_cb(const event_t *event, void *ctx)
+{
+    LV_UNUSED(ctx);
+    
+    // The subscription outlives the window
+    if (!fm_state.file_list || !lv_obj_is_valid(fm_state.file_list)) return;
+    
+    if (event->sd.mounted) {
+        strcpy(fm_state.current_path, hal_sdcard_get_mount_point());
+    }
+    refresh_file_list();
 }
 
 static void create_file_manager_ui(lv_obj_t *parent)
@@ -151,9 +174,13 @@ static void refresh_file_list(void)
     }
     
     // Open directory
+    PERF_TRACE_BEGIN("fm_list");
+    PERF_WATCHDOG_ENTER("fm_list", NULL);
     DIR *dir = opendir(fm_state.current_path);
     if (!dir) {
         lv_label_set_text(fm_state.status_label, "Cannot open directory");
+        PERF_TRACE_END("fm_list");
+        PERF_WATCHDOG_LEAVE();
         return;
     }
     
@@ -198,6 +225,8 @@ static void refresh_file_list(void)
     }
     
     closedir(dir);
+    PERF_TRACE_END("fm_list");
+    PERF_WATCHDOG_LEAVE();
     
     // Update status
     char status_text[100];
@@ -1,16 +1,32 @@
 #include "apps/launcher/launcher.h"
 #include "managers/window_manager.h"
 #include "managers/app_manager.h"
+#include "managers/metrics.h"
 #include "theme/theme_engine.h"
+#include "perf/perf_profile.h"
+#include "perf/perf_watchdog.h"
 #include "lvgl.h"
 #include <string.h>
+#include "esp_timer.h"
+
+// Time app->launch() takes to build the window
+METRIC_HISTOGRAM(s_launch_us, "app.launch_time", "us", 5000, 10000, 20000, 50000, 100000, 200000, 500000)
 
 static void app_btn_event(lv_event_t *e)
 {
     if(lv_event_get_code(e) != LV_EVENT_CLICKED) return;
     const app_t *app = (const app_t*)lv_event_get_user_data(e);
     if(app && app->launch) {
+#if PERF_PROFILE_ENABLE
+        if(strcmp(app->id, PERF_PROFILE_APP) == 0) {
+            perf_profile_capture(app->id, PERF_PROFILE_WINDOW_MS);
+        }
+#endif
+        int64_t start = esp_timer_get_time();
+        PERF_WATCHDOG_ENTER(app->id, app->launch);
         app->launch();
+        PERF_WATCHDOG_LEAVE();
+        metric_observe(&s_launch_us, (uint32_t)(esp_timer_get_time() - start));
     }
 }
 // Hello
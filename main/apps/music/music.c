@@ -1,7 +1,12 @@
 #include "apps/music/music.h"
 #include "managers/window_manager.h"
+#include "managers/event_bus.h"
+#include "managers/ui_dispatch.h"
+#include "hals/hal.h"
 #include "hals/hal_audio.h"
 #include "hals/hal_sdcard.h"
+#include "perf/perf_trace.h"
+#include "perf/perf_watchdog.h"
 #include "theme/theme_engine.h"
 #include "lvgl.h"
 #include <stdio.h>
@@ -86,10 +91,14 @@ void music_scan_files(music_player_data_t* data) {
     data->is_scanning = true;
     
     const char* mount_point = hal_sdcard_get_mount_point();
+    PERF_TRACE_BEGIN("music_scan");
+    PERF_WATCHDOG_ENTER("music_scan", NULL);
     DIR* dir = opendir(mount_point);
     if (!dir) {
         printf("Failed to open SD card directory\n");
         data->is_scanning = false;
+        PERF_TRACE_END("music_scan");
+        PERF_WATCHDOG_LEAVE();
         return;
     }
     
@@ -107,6 +116,8 @@ void music_scan_files(music_player_data_t* data) {
         printf("No MP3 files found\n");
         closedir(dir);
         data->is_scanning = false;
+        PERF_TRACE_END("music_scan");
+        PERF_WATCHDOG_LEAVE();
         return;
     }
     
@@ -116,6 +127,8 @@ void music_scan_files(music_player_data_t* data) {
         printf("Failed to allocate memory for MP3 files\n");
         closedir(dir);
         data->is_scanning = false;
+        PERF_TRACE_END("music_scan");
+        PERF_WATCHDOG_LEAVE();
         return;
     }
     
@@ -141,6 +154,8 @@ void music_scan_files(music_player_data_t* data) {
     
     closedir(dir);
     data->is_scanning = false;
+    PERF_TRACE_END("music_scan");
+    PERF_WATCHDOG_LEAVE();
     
     printf("Found %lu MP3 files\n", (unsigned long)data->file_count);
 }
@@ -381,6 +396,51 @@ static void create_music_ui(lv_obj_t* parent) {
     lv_obj_set_flex_grow(g_file_list, 1);
 }
 
+// Playback events, delivered on the LVGL task
+static void playback_event_cb(const event_t* event, void* ctx) {
+    LV_UNUSED(ctx);
+
+    // Only the end of a track is news here, pause and play are set by the buttons
+    if (!event->playback.playing && g_music_data.play_state == PLAY_STATE_PLAYING) {
+        g_music_data.play_state = PLAY_STATE_STOPPED;
+    }
+
+    // The subscription outlives the window, which may have been closed
+    if (g_current_song_label && lv_obj_is_valid(g_current_song_label)) {
+        update_current_song_display();
+    }
+}
+
+// One hal_boot_when() callback at a time, however often the app is opened
+static bool g_ready_pending = false;
+
+// Audio and SD card are up, on the LVGL task
+static void music_ready_cb(void* arg, const void* msg) {
+    LV_UNUSED(arg);
+    LV_UNUSED(msg);
+    g_ready_pending = false;
+
+    // Normally done by the audio boot stage already, then this returns at once
+    hal_audio_init();
+
+    // The window may have been closed while the stages were still running
+    if (!g_file_list || !lv_obj_is_valid(g_file_list)) {
+        return;
+    }
+    music_scan_files(&g_music_data);
+    refresh_file_list();
+    update_current_song_display();
+}
+
+// On the boot stage task that finished last, which must not touch LVGL
+static void music_boot_done(void* arg) {
+    LV_UNUSED(arg);
+    if (!ui_dispatch_post(music_ready_cb, NULL)) {
+        printf("Music: UI dispatch queue full, file list not loaded\n");
+        g_ready_pending = false;
+    }
+}
+
 // Main launch function
 static void music_launch(void) {
     // Create window with red background color #F05C5E
@@ -391,13 +451,22 @@ static void music_launch(void) {
     // Create UI
     create_music_ui(content);
     
-    // Initialize audio HAL
-    hal_audio_init();
-    
-    // Scan for MP3 files
-    music_scan_files(&g_music_data);
-    refresh_file_list();
-    update_current_song_display();
+    static bool subscribed = false;
+    if (!subscribed) {
+        subscribed = event_bus_subscribe(EVENT_PLAYBACK, playback_event_cb, NULL);
+    }
+
+    // Audio and SD card may still be starting in the background right after
+    // boot; the file list fills in once they are done
+    lv_obj_clean(g_file_list);
+    lv_obj_t* item = lv_list_add_text(g_file_list, "Loading...");
+    lv_obj_set_style_text_color(item, lv_palette_main(LV_PALETTE_GREY), 0);
+    if (!g_ready_pending) {
+        g_ready_pending = true;
+        if (!hal_boot_when(HAL_BOOT_BIT(HAL_STAGE_AUDIO) | HAL_BOOT_BIT(HAL_STAGE_SDCARD), music_boot_done, NULL)) {
+            g_ready_pending = false;
+        }
+    }
 }
 // App definition
 const app_t APP_MUSIC = {
@@ -1,5 +1,6 @@
 #include "apps/settings/settings.h"
 #include "managers/window_manager.h"
+#include "managers/metrics.h"
 #include "theme/theme_engine.h"
 #include "lvgl.h"
 
@@ -114,6 +115,13 @@ static void create_settings_menu(lv_obj_t *parent)
     cont = create_text(section, NULL, "法律信息", LV_MENU_ITEM_BUILDER_VARIANT_1);
     lv_menu_set_load_page_event(settings_menu, cont, sub_legal_info_page);
     
+    // Create Performance page, live metrics of every subsystem
+    lv_obj_t *sub_perf_page = lv_menu_page_create(settings_menu, NULL);
+    lv_obj_set_style_pad_hor(sub_perf_page, lv_obj_get_style_pad_left(lv_menu_get_main_header(settings_menu), 0), 0);
+    lv_menu_separator_create(sub_perf_page);
+    section = lv_menu_section_create(sub_perf_page);
+    metrics_view_create(section);
+
     // Create Menu Mode page
     lv_obj_t *sub_menu_mode_page = lv_menu_page_create(settings_menu, NULL);
     lv_obj_set_style_pad_hor(sub_menu_mode_page, lv_obj_get_style_pad_left(lv_menu_get_main_header(settings_menu), 0), 0);
@@ -140,6 +148,8 @@ static void create_settings_menu(lv_obj_t *parent)
     section = lv_menu_section_create(root_page);
     cont = create_text(section, LV_SYMBOL_FILE, "关于", LV_MENU_ITEM_BUILDER_VARIANT_1);
     lv_menu_set_load_page_event(settings_menu, cont, sub_about_page);
+    cont = create_text(section, LV_SYMBOL_LIST, "性能", LV_MENU_ITEM_BUILDER_VARIANT_1);
+    lv_menu_set_load_page_event(settings_menu, cont, sub_perf_page);
     cont = create_text(section, LV_SYMBOL_SETTINGS, "菜单模式", LV_MENU_ITEM_BUILDER_VARIANT_1);
     lv_menu_set_load_page_event(settings_menu, cont, sub_menu_mode_page);
     
@@ -0,0 +1,482 @@
+#include "apps/task_manager/task_manager.h"
+#include "managers/window_manager.h"
+#include "managers/metrics.h"
+#include "hals/hal_mutex.h"
+#include "theme/theme_engine.h"
+#include "lvgl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+// How often the numbers are refreshed
+#ifndef TASK_MANAGER_PERIOD_MS
+#define TASK_MANAGER_PERIOD_MS 1000
+#endif
+
+// Tasks that have come within this many bytes of the end of their stack are shown in red
+#ifndef TASK_MANAGER_STACK_WARN
+#define TASK_MANAGER_STACK_WARN 1024
+#endif
+
+// Tasks remembered between refreshes to work out their CPU share
+#define MAX_TASKS 48
+
+#define CELL_LOW_STACK LV_TABLE_CELL_CTRL_CUSTOM_1
+
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t run_time;
+} task_sample_t;
+
+typedef struct {
+    const TaskStatus_t *status;
+    uint32_t permille;      // Of one core
+} task_row_t;
+
+static const struct {
+    const char *name;
+    uint32_t caps;
+} s_heaps[] = {
+    {"内部", MALLOC_CAP_INTERNAL},
+    {"PSRAM", MALLOC_CAP_SPIRAM},
+    {"DMA", MALLOC_CAP_DMA},
+};
+
+#define HEAP_COUNT (sizeof(s_heaps) / sizeof(s_heaps[0]))
+
+// One per open window, freed with it
+typedef struct {
+    lv_obj_t *cpu[portNUM_PROCESSORS];
+    lv_obj_t *fps;
+    lv_obj_t *lvgl_mem;
+    lv_obj_t *heaps;
+    lv_obj_t *mutexes;
+    lv_obj_t *mutex_window;
+    lv_obj_t *tasks;
+    lv_timer_t *timer;
+    uint32_t prev_total;
+    int64_t prev_time_us;
+    int32_t prev_frames;
+    size_t prev_count;
+    task_sample_t prev[MAX_TASKS];
+} task_manager_t;
+
+static void task_manager_launch(void);
+static void create_task_manager_ui(lv_obj_t *parent, task_manager_t *tm);
+static void refresh(task_manager_t *tm);
+
+// Setting a label or cell redraws it even when the text is the same, and most
+// numbers here stay put from one second to the next
+static void set_label(lv_obj_t *label, const char *text)
+{
+    if (strcmp(lv_label_get_text(label), text) != 0) {
+        lv_label_set_text(label, text);
+    }
+}
+
+static void set_cell(lv_obj_t *table, uint32_t row, uint32_t col, const char *text)
+{
+    const char *cur = lv_table_get_cell_value(table, row, col);
+    if (!cur || strcmp(cur, text) != 0) {
+        lv_table_set_cell_value(table, row, col, text);
+    }
+}
+
+static void set_cell_low_stack(lv_obj_t *table, uint32_t row, bool low)
+{
+    if (lv_table_has_cell_ctrl(table, row, 4, CELL_LOW_STACK) == low) {
+        return;
+    }
+    if (low) {
+        lv_table_set_cell_ctrl(table, row, 4, CELL_LOW_STACK);
+    } else {
+        lv_table_clear_cell_ctrl(table, row, 4, CELL_LOW_STACK);
+    }
+    lv_obj_invalidate(table);
+}
+
+static void format_bytes(char *buf, size_t len, size_t bytes)
+{
+    if (bytes >= 1024 * 1024) {
+        snprintf(buf, len, "%u.%u MB", (unsigned)(bytes >> 20), (unsigned)((bytes & 0xFFFFF) * 10 >> 20));
+    } else if (bytes >= 1024) {
+        snprintf(buf, len, "%u KB", (unsigned)(bytes >> 10));
+    } else {
+        snprintf(buf, len, "%u B", (unsigned)bytes);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Window                                   */
+/* -------------------------------------------------------------------------- */
+
+static void task_manager_launch(void)
+{
+    task_manager_t *tm = calloc(1, sizeof(*tm));
+    if (!tm) {
+        printf("Failed to allocate task manager\n");
+        return;
+    }
+
+    wm_window_t *window = wm_open_window("任务管理器", true, LV_PCT(70), LV_PCT(80));
+    if (!window) {
+        printf("Failed to create task manager window\n");
+        free(tm);
+        return;
+    }
+
+    lv_obj_t *content = wm_get_content(window);
+    if (!content) {
+        printf("Failed to get window content\n");
+        free(tm);
+        return;
+    }
+
+    create_task_manager_ui(content, tm);
+
+    // First refresh covers everything since boot, then each one the last period
+    refresh(tm);
+}
+
+static void timer_cb(lv_timer_t *timer)
+{
+    refresh(lv_timer_get_user_data(timer));
+}
+
+static void delete_cb(lv_event_t *e)
+{
+    task_manager_t *tm = lv_event_get_user_data(e);
+    lv_timer_delete(tm->timer);
+    free(tm);
+}
+
+static void mutex_reset_cb(lv_event_t *e)
+{
+    LV_UNUSED(e);
+    hal_mutex_reset_stats();
+}
+
+static void mutex_print_cb(lv_event_t *e)
+{
+    LV_UNUSED(e);
+    hal_mutex_print_stats();
+}
+
+// Low stack cells are marked with a control bit, coloured here as they are drawn
+static void tasks_draw_cb(lv_event_t *e)
+{
+    lv_draw_task_t *task = lv_event_get_draw_task(e);
+    lv_draw_dsc_base_t *base = lv_draw_task_get_draw_dsc(task);
+    if (base->part != LV_PART_ITEMS || lv_draw_task_get_type(task) != LV_DRAW_TASK_TYPE_LABEL) {
+        return;
+    }
+    if (lv_table_has_cell_ctrl(lv_event_get_target(e), base->id1, base->id2, CELL_LOW_STACK)) {
+        lv_draw_label_dsc_t *label = lv_draw_task_get_label_dsc(task);
+        label->color = lv_palette_main(LV_PALETTE_RED);
+    }
+}
+
+static lv_obj_t *create_table(lv_obj_t *parent, const char *const *headers, uint32_t cols, const lv_coord_t *widths)
+{
+    lv_obj_t *table = lv_table_create(parent);
+    lv_obj_set_width(table, LV_PCT(100));
+    lv_obj_set_style_text_font(table, &yinpin_hm_light_20, 0);
+    lv_table_set_column_count(table, cols);
+    for (uint32_t i = 0; i < cols; i++) {
+        lv_table_set_column_width(table, i, widths[i]);
+        lv_table_set_cell_value(table, 0, i, headers[i]);
+    }
+    return table;
+}
+
+static void create_task_manager_ui(lv_obj_t *parent, task_manager_t *tm)
+{
+    lv_obj_set_flex_flow(parent, LV_FLEX_FLOW_COLUMN);
+    lv_obj_set_style_pad_all(parent, 10, 0);
+    lv_obj_set_style_pad_row(parent, 10, 0);
+
+    // Overview: load per core, frame rate, LVGL heap
+    lv_obj_t *overview = lv_obj_create(parent);
+    lv_obj_set_size(overview, LV_PCT(100), LV_SIZE_CONTENT);
+    lv_obj_set_flex_flow(overview, LV_FLEX_FLOW_ROW_WRAP);
+    lv_obj_set_style_pad_all(overview, 5, 0);
+    lv_obj_set_style_pad_column(overview, 30, 0);
+    lv_obj_set_style_bg_opa(overview, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_border_width(overview, 0, 0);
+    lv_obj_remove_flag(overview, LV_OBJ_FLAG_SCROLLABLE);
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        tm->cpu[core] = lv_label_create(overview);
+        theme_apply_label_style(tm->cpu[core]);
+        lv_label_set_text(tm->cpu[core], "");
+    }
+    tm->fps = lv_label_create(overview);
+    theme_apply_label_style(tm->fps);
+    lv_label_set_text(tm->fps, "");
+    tm->lvgl_mem = lv_label_create(overview);
+    theme_apply_label_style(tm->lvgl_mem);
+    lv_label_set_text(tm->lvgl_mem, "");
+
+    static const char *const heap_headers[] = {"堆", "空闲", "最大块", "最低空闲"};
+    static const lv_coord_t heap_widths[] = {140, 160, 160, 160};
+    tm->heaps = create_table(parent, heap_headers, 4, heap_widths);
+    lv_table_set_row_count(tm->heaps, HEAP_COUNT + 1);
+    for (size_t i = 0; i < HEAP_COUNT; i++) {
+        lv_table_set_cell_value(tm->heaps, i + 1, 0, s_heaps[i].name);
+    }
+
+    // Mutex contention since the last reset, with the task that took each one last
+    lv_obj_t *mutex_bar = lv_obj_create(parent);
+    lv_obj_set_size(mutex_bar, LV_PCT(100), LV_SIZE_CONTENT);
+    lv_obj_set_flex_flow(mutex_bar, LV_FLEX_FLOW_ROW);
+    lv_obj_set_flex_align(mutex_bar, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+    lv_obj_set_style_pad_all(mutex_bar, 5, 0);
+    lv_obj_set_style_pad_column(mutex_bar, 20, 0);
+    lv_obj_set_style_bg_opa(mutex_bar, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_border_width(mutex_bar, 0, 0);
+    lv_obj_remove_flag(mutex_bar, LV_OBJ_FLAG_SCROLLABLE);
+
+    tm->mutex_window = lv_label_create(mutex_bar);
+    theme_apply_label_style(tm->mutex_window);
+    lv_label_set_text(tm->mutex_window, "");
+
+    static const struct {
+        const char *text;
+        lv_event_cb_t cb;
+    } mutex_buttons[] = {
+        {"重置", mutex_reset_cb},
+        {"打印到串口", mutex_print_cb},
+    };
+    for (size_t i = 0; i < sizeof(mutex_buttons) / sizeof(mutex_buttons[0]); i++) {
+        lv_obj_t *btn = lv_btn_create(mutex_bar);
+        theme_apply_button_style(btn);
+        // The theme's fixed width is too narrow for the longer caption
+        lv_obj_set_width(btn, LV_SIZE_CONTENT);
+        lv_obj_set_style_pad_hor(btn, 15, 0);
+        lv_obj_add_event_cb(btn, mutex_buttons[i].cb, LV_EVENT_CLICKED, NULL);
+        lv_obj_t *label = lv_label_create(btn);
+        theme_apply_label_style(label);
+        lv_label_set_text(label, mutex_buttons[i].text);
+        lv_obj_center(label);
+    }
+
+    static const char *const mutex_headers[] = {"互斥锁", "获取", "争用", "超时", "最长等待", "最长持有", "最后持有者"};
+    static const lv_coord_t mutex_widths[] = {110, 100, 90, 80, 130, 130, 170};
+    tm->mutexes = create_table(parent, mutex_headers, 7, mutex_widths);
+
+    // Takes the rest of the window and scrolls
+    static const char *const task_headers[] = {"任务", "核心", "CPU", "优先级", "栈剩余"};
+    static const lv_coord_t task_widths[] = {220, 90, 110, 110, 140};
+    tm->tasks = create_table(parent, task_headers, 5, task_widths);
+    lv_obj_set_flex_grow(tm->tasks, 1);
+    lv_obj_add_flag(tm->tasks, LV_OBJ_FLAG_SEND_DRAW_TASK_EVENTS);
+    lv_obj_add_event_cb(tm->tasks, tasks_draw_cb, LV_EVENT_DRAW_TASK_ADDED, NULL);
+
+    tm->timer = lv_timer_create(timer_cb, TASK_MANAGER_PERIOD_MS, tm);
+    lv_obj_add_event_cb(overview, delete_cb, LV_EVENT_DELETE, tm);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Refresh                                   */
+/* -------------------------------------------------------------------------- */
+
+// Run time since the previous refresh; tasks not seen then count from their start
+static uint32_t run_time_delta(const task_manager_t *tm, const TaskStatus_t *status)
+{
+    for (size_t i = 0; i < tm->prev_count; i++) {
+        if (tm->prev[i].handle == status->xHandle && tm->prev[i].run_time <= status->ulRunTimeCounter) {
+            return status->ulRunTimeCounter - tm->prev[i].run_time;
+        }
+    }
+    return status->ulRunTimeCounter;
+}
+
+static void refresh_tasks(task_manager_t *tm)
+{
+    UBaseType_t n = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *status = malloc(n * sizeof(*status));
+    task_row_t *rows = malloc(n * sizeof(*rows));
+    if (!status || !rows) {
+        free(status);
+        free(rows);
+        return;
+    }
+
+    uint32_t total = 0;
+    n = uxTaskGetSystemState(status, n, &total);
+    // The run time clock counts microseconds; each core adds that much to its tasks
+    uint32_t elapsed = total - tm->prev_total;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+
+    uint32_t idle[portNUM_PROCESSORS] = {0};
+    for (UBaseType_t i = 0; i < n; i++) {
+        uint32_t delta = run_time_delta(tm, &status[i]);
+        uint32_t permille = (uint32_t)((uint64_t)delta * 1000 / elapsed);
+
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (status[i].xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+                idle[core] = permille;
+            }
+        }
+
+        // Busiest first
+        UBaseType_t j = i;
+        while (j > 0 && rows[j - 1].permille < permille) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = (task_row_t){.status = &status[i], .permille = permille};
+    }
+
+    char text[32];
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t busy = idle[core] < 1000 ? 1000 - idle[core] : 0;
+        snprintf(text, sizeof(text), "CPU%d %lu.%lu%%", core, (unsigned long)busy / 10, (unsigned long)busy % 10);
+        set_label(tm->cpu[core], text);
+    }
+
+    if (lv_table_get_row_count(tm->tasks) != n + 1) {
+        lv_table_set_row_count(tm->tasks, n + 1);
+    }
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *s = rows[i].status;
+        uint32_t row = i + 1;
+        size_t stack_free = s->usStackHighWaterMark * sizeof(StackType_t);
+
+        set_cell(tm->tasks, row, 0, s->pcTaskName);
+        if (s->xCoreID == tskNO_AFFINITY) {
+            set_cell(tm->tasks, row, 1, "-");
+        } else {
+            snprintf(text, sizeof(text), "%d", (int)s->xCoreID);
+            set_cell(tm->tasks, row, 1, text);
+        }
+        snprintf(text, sizeof(text), "%lu.%lu%%", (unsigned long)rows[i].permille / 10,
+                 (unsigned long)rows[i].permille % 10);
+        set_cell(tm->tasks, row, 2, text);
+        snprintf(text, sizeof(text), "%u", (unsigned)s->uxCurrentPriority);
+        set_cell(tm->tasks, row, 3, text);
+        format_bytes(text, sizeof(text), stack_free);
+        set_cell(tm->tasks, row, 4, text);
+        set_cell_low_stack(tm->tasks, row, stack_free < TASK_MANAGER_STACK_WARN);
+    }
+
+    tm->prev_total = total;
+    tm->prev_count = n < MAX_TASKS ? n : MAX_TASKS;
+    for (size_t i = 0; i < tm->prev_count; i++) {
+        tm->prev[i] = (task_sample_t){.handle = rows[i].status->xHandle, .run_time = rows[i].status->ulRunTimeCounter};
+    }
+
+    free(rows);
+    free(status);
+}
+
+static void refresh_heaps(task_manager_t *tm)
+{
+    char text[32];
+    for (size_t i = 0; i < HEAP_COUNT; i++) {
+        format_bytes(text, sizeof(text), heap_caps_get_free_size(s_heaps[i].caps));
+        set_cell(tm->heaps, i + 1, 1, text);
+        format_bytes(text, sizeof(text), heap_caps_get_largest_free_block(s_heaps[i].caps));
+        set_cell(tm->heaps, i + 1, 2, text);
+        format_bytes(text, sizeof(text), heap_caps_get_minimum_free_size(s_heaps[i].caps));
+        set_cell(tm->heaps, i + 1, 3, text);
+    }
+
+    // With the C library allocator LVGL keeps no pool of its own, its objects
+    // are in the heaps above
+    lv_mem_monitor_t mon;
+    lv_mem_monitor(&mon);
+    if (mon.total_size == 0) {
+        set_label(tm->lvgl_mem, "LVGL 内存: 系统堆");
+    } else {
+        char used[16];
+        char size[16];
+        format_bytes(used, sizeof(used), mon.total_size - mon.free_size);
+        format_bytes(size, sizeof(size), mon.total_size);
+        snprintf(text, sizeof(text), "LVGL %s / %s", used, size);
+        set_label(tm->lvgl_mem, text);
+    }
+}
+
+static void format_us(char *buf, size_t len, uint32_t us)
+{
+    if (us >= 1000) {
+        snprintf(buf, len, "%lu.%lu ms", (unsigned long)(us / 1000), (unsigned long)(us % 1000 / 100));
+    } else {
+        snprintf(buf, len, "%lu us", (unsigned long)us);
+    }
+}
+
+static void refresh_mutexes(task_manager_t *tm)
+{
+    hal_mutex_stats_t stats[HAL_MUTEX_MAX];
+    size_t count = 0;
+    uint64_t window_us = 0;
+    hal_mutex_get_stats(stats, &count, &window_us);
+
+    char text[32];
+    snprintf(text, sizeof(text), "互斥锁 (%llu 秒内)", window_us / 1000000);
+    set_label(tm->mutex_window, text);
+
+    if (lv_table_get_row_count(tm->mutexes) != count + 1) {
+        lv_table_set_row_count(tm->mutexes, count + 1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const hal_mutex_stats_t *m = &stats[i];
+        uint32_t row = i + 1;
+
+        set_cell(tm->mutexes, row, 0, m->name);
+        snprintf(text, sizeof(text), "%lu", (unsigned long)m->acquisitions);
+        set_cell(tm->mutexes, row, 1, text);
+        snprintf(text, sizeof(text), "%lu", (unsigned long)m->contended);
+        set_cell(tm->mutexes, row, 2, text);
+        snprintf(text, sizeof(text), "%lu", (unsigned long)m->timeouts);
+        set_cell(tm->mutexes, row, 3, text);
+        format_us(text, sizeof(text), m->max_wait_us);
+        set_cell(tm->mutexes, row, 4, text);
+        format_us(text, sizeof(text), m->max_hold_us);
+        set_cell(tm->mutexes, row, 5, text);
+        snprintf(text, sizeof(text), "%s%s", m->last_holder[0] ? m->last_holder : "-", m->held ? " *" : "");
+        set_cell(tm->mutexes, row, 6, text);
+    }
+}
+
+static void refresh_fps(task_manager_t *tm)
+{
+    metric_value_t frames;
+    if (!metrics_read("display.frames", &frames)) {
+        set_label(tm->fps, "-- fps");
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    uint32_t count = (uint32_t)(frames.value - tm->prev_frames);
+    uint32_t fps = (uint32_t)((uint64_t)count * 1000000 / (uint64_t)(now - tm->prev_time_us));
+    tm->prev_frames = frames.value;
+    tm->prev_time_us = now;
+
+    char text[16];
+    snprintf(text, sizeof(text), "%lu fps", (unsigned long)fps);
+    set_label(tm->fps, text);
+}
+
+static void refresh(task_manager_t *tm)
+{
+    refresh_tasks(tm);
+    refresh_heaps(tm);
+    refresh_mutexes(tm);
+    refresh_fps(tm);
+}
+
+// App definition
+const app_t APP_TASK_MANAGER = {
+    .id = "task_manager",
+    .name = "任务管理器",
+    .launch = task_manager_launch
+};
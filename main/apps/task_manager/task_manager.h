@@ -0,0 +1,4 @@
+#pragma once
+#include "managers/app_manager.h"
+
+extern const app_t APP_TASK_MANAGER;
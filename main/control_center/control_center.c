@@ -1,6 +1,7 @@
 #include "control_center.h"
 #include "hals/hal_audio.h"
 #include "hals/hal_display.h"
+#include "managers/event_bus.h"
 #include "lvgl.h"
 #include <stdio.h>
 
@@ -58,6 +59,27 @@ static void brightness_label_update_event(lv_event_t *e)
     lv_label_set_text_fmt(label, "%d%%", (int)value);
 }
 
+// Follow changes made elsewhere, e.g. the route volume applied when headphones are plugged in
+static void sync_slider(lv_obj_t *slider, lv_obj_t *label, int32_t value)
+{
+    if (!slider || lv_obj_has_state(slider, LV_STATE_PRESSED)) return;  // Don't fight the user's finger
+    if (lv_slider_get_value(slider) == value) return;
+    lv_slider_set_value(slider, value, LV_ANIM_OFF);
+    if (label) {
+        lv_label_set_text_fmt(label, "%d%%", (int)value);
+    }
+}
+
+static void state_event_cb(const event_t *event, void *ctx)
+{
+    LV_UNUSED(ctx);
+    if (event->topic == EVENT_VOLUME) {
+        sync_slider(g_control_center.volume_slider, g_control_center.volume_value_label, event->volume.percent);
+    } else if (event->topic == EVENT_BRIGHTNESS) {
+        sync_slider(g_control_center.brightness_slider, g_control_center.brightness_value_label, event->brightness.percent);
+    }
+}
+
 static void create_floating_bar_ui(void)
 {
     // Get screen dimensions
@@ -205,6 +227,8 @@ void control_center_init(void)
     }
     
     create_floating_bar_ui();
+    event_bus_subscribe(EVENT_VOLUME, state_event_cb, NULL);
+    event_bus_subscribe(EVENT_BRIGHTNESS, state_event_cb, NULL);
     g_control_center.is_initialized = true;
     
     printf("Control center floating bar initialized and clickable\n");
@@ -238,6 +262,9 @@ void control_center_deinit(void)
         return;
     }
     
+    event_bus_unsubscribe(EVENT_VOLUME, state_event_cb, NULL);
+    event_bus_unsubscribe(EVENT_BRIGHTNESS, state_event_cb, NULL);
+    
     if (g_control_center.floating_bar) {
         lv_obj_del(g_control_center.floating_bar);
         g_control_center.floating_bar = NULL;
@@ -1,55 +1,62 @@
 #include "hals/hal.h"
+#include "hals/hal_boot.h"
+#include "hals/hal_splash.h"
+#include "perf/perf_latency.h"
+#include "perf/perf_trace.h"
+#include "perf/perf_profile.h"
 #include <stdio.h>
 
 lv_disp_t *lvDisp = NULL;
 lv_indev_t *lvTouchpad = NULL;
 lv_indev_t *lvUsbMouse = NULL;
+lv_indev_t *lvUsbKeyboard = NULL;
 
-extern esp_lcd_touch_handle_t _lcd_touch_handle;
+static esp_err_t expander_flush_job(void *arg)
+{
+    return bsp_io_expander_flush_one((bsp_io_expander_t)(uintptr_t)arg);
+}
 
-static void lvgl_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+// Expander writes are housekeeping, they never hold up a touch read. Reset and
+// poweroff pulses wait for theirs, but still queue behind the bus owner.
+static esp_err_t expander_flush_hook(bsp_io_expander_t exp, bool wait)
 {
-    if (_lcd_touch_handle == NULL)
-    {
-        data->state = LV_INDEV_STATE_REL;
-        return;
-    }
-    uint16_t touch_x[1];
-    uint16_t touch_y[1];
-    uint16_t touch_strength[1];
-    uint8_t touch_cnt = 0;
-
-    esp_lcd_touch_read_data(_lcd_touch_handle);
-    bool touchpad_pressed =
-        esp_lcd_touch_get_coordinates(_lcd_touch_handle, touch_x, touch_y, touch_strength, &touch_cnt, 1);
-
-    if (!touchpad_pressed)
-    {
-        data->state = LV_INDEV_STATE_REL;
-    }
-    else
-    {
-        data->state = LV_INDEV_STATE_PR;
-        data->point.x = touch_x[0];
-        data->point.y = touch_y[0];
+    hal_i2c_dev_t dev = (exp == BSP_IO_EXPANDER_2) ? HAL_I2C_DEV_EXPANDER2 : HAL_I2C_DEV_EXPANDER1;
+    void *arg = (void *)(uintptr_t)exp;
+
+    if (wait) {
+        return hal_i2c_bus_run(dev, HAL_I2C_PRIO_HOUSEKEEPING, expander_flush_job, arg);
     }
+    return hal_i2c_bus_post(dev, HAL_I2C_PRIO_HOUSEKEEPING, expander_flush_job, arg,
+                            (exp == BSP_IO_EXPANDER_2) ? HAL_I2C_KEY_EXPANDER2_FLUSH
+                                                       : HAL_I2C_KEY_EXPANDER1_FLUSH);
 }
 
-void hal_init(void)
+// Power-up time of the IO expanders after the bus comes up
+#ifndef HAL_I2C_SETTLE_MS
+#define HAL_I2C_SETTLE_MS 200
+#endif
+
+static void stage_i2c(void)
 {
-    // Initialize I2C bus
     bsp_i2c_init();
-    vTaskDelay(pdMS_TO_TICKS(200));
+    vTaskDelay(pdMS_TO_TICKS(HAL_I2C_SETTLE_MS));
+}
 
+static void stage_expander(void)
+{
     // Get I2C bus handle and initialize IO expander
     i2c_master_bus_handle_t i2c_bus_handle = bsp_i2c_get_handle();
     bsp_io_expander_pi4ioe_init(i2c_bus_handle);
 
-    // Initialize audio
-    hal_audio_init();
-    // Initialize SD card
-    hal_sdcard_init();
+    // Start the I2C bus arbiter and route expander traffic through it
+    hal_i2c_bus_init();
+    hal_i2c_bus_set_device_handle(HAL_I2C_DEV_EXPANDER1, bsp_io_expander_get_dev_handle(BSP_IO_EXPANDER_1));
+    hal_i2c_bus_set_device_handle(HAL_I2C_DEV_EXPANDER2, bsp_io_expander_get_dev_handle(BSP_IO_EXPANDER_2));
+    bsp_io_expander_set_flush_hook(expander_flush_hook);
+}
 
+static void stage_display(void)
+{
     // Initialize display and touch
     bsp_reset_tp();
     // Initialize display with custom config for larger stack
@@ -67,27 +74,90 @@ void hal_init(void)
             .buff_dma = true,
             .buff_spiram = false,
             .sw_rotate = true,
+            .no_touch_indev = true,  // Touch indev is interrupt driven, see hal_touch.c
         }
     };
     
     lvDisp = bsp_display_start_with_config(&display_cfg);
+
+    // The LVGL task is already running
+    bsp_display_lock(0);
     lv_display_set_rotation(lvDisp, LV_DISPLAY_ROTATION_90);
+    // Rotate into the panel's own frame buffers when the BSP gives us several
+    hal_display_tear_free_init(lvDisp);
+    // Last boot's home screen goes up first, the real one is built behind it
+    hal_splash_show(lvDisp);
+#if PERF_LATENCY_ENABLE
+    perf_latency_init(lvDisp);
+#endif
+#if PERF_TRACE_ENABLE
+    perf_trace_init(lvDisp);
+#endif
+    bsp_display_unlock();
     
     // Initialize display HAL (this will turn on backlight and set initial brightness)
     hal_display_init();
-    
-    // Initialize USB HAL
+}
+
+static void stage_touch(void)
+{
+    // Sample touch on the controller interrupt instead of polling from LVGL
+    hal_touch_init();
+}
+
+static void stage_audio(void)
+{
+    hal_audio_init();
+}
+
+static void stage_sdcard(void)
+{
+    hal_sdcard_init();
+}
+
+static void stage_usb(void)
+{
     hal_usb_init();
 }
 
+// Display and touch are all the launcher needs; the rest finishes on the other core meanwhile.
+// USB needs the expander for its 5V rail; the mouse is placed later, from hal_usb_mouse_init().
+static const hal_boot_stage_t s_boot_stages[HAL_STAGE_MAX] = {
+    [HAL_STAGE_I2C]      = {"i2c",      stage_i2c,      0,                                                 0, 3072, false},
+    [HAL_STAGE_EXPANDER] = {"expander", stage_expander, HAL_BOOT_BIT(HAL_STAGE_I2C),                       0, 3072, false},
+    [HAL_STAGE_DISPLAY]  = {"display",  stage_display,  HAL_BOOT_BIT(HAL_STAGE_EXPANDER),                  0, 6144, false},
+    [HAL_STAGE_TOUCH]    = {"touch",    stage_touch,    HAL_BOOT_BIT(HAL_STAGE_DISPLAY),                   0, 3072, false},
+    [HAL_STAGE_AUDIO]    = {"audio",    stage_audio,    HAL_BOOT_BIT(HAL_STAGE_EXPANDER),                  1, 4096, true},
+    [HAL_STAGE_SDCARD]   = {"sdcard",   stage_sdcard,   HAL_BOOT_BIT(HAL_STAGE_EXPANDER),                  1, 4096, true},
+    [HAL_STAGE_USB]      = {"usb",      stage_usb,      HAL_BOOT_BIT(HAL_STAGE_EXPANDER),                  1, 4096, true},
+};
+
+void hal_init(void)
+{
+    esp_err_t err = hal_boot_run(s_boot_stages, HAL_STAGE_MAX);
+    if (err != ESP_OK) {
+        // Fall back to the plain serial order
+        printf("Parallel boot failed (%s), initializing serially\n", esp_err_to_name(err));
+        for (int i = 0; i < HAL_STAGE_MAX; i++) {
+            s_boot_stages[i].init();
+        }
+    }
+#if PERF_PROFILE_ENABLE
+    perf_profile_init();
+#endif
+}
+
 void hal_touchpad_init(void)
 {
     // Initialize touchpad input
     lvTouchpad = lv_indev_create();
     lv_indev_set_type(lvTouchpad, LV_INDEV_TYPE_POINTER);
-    lv_indev_set_read_cb(lvTouchpad, lvgl_read_cb);
+    lv_indev_set_read_cb(lvTouchpad, lvgl_touch_read_cb);
     lv_indev_set_display(lvTouchpad, lvDisp);
     
     // Initialize USB mouse input
     hal_usb_mouse_init();
+    
+    // Initialize USB keyboard and gamepad input
+    hal_usb_keyboard_init();
 }
\ No newline at end of file
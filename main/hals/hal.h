@@ -7,16 +7,33 @@
 #include "hals/hal_sdcard.h"
 #include "hals/hal_display.h"
 #include "hals/hal_usb.h"
+#include "hals/hal_i2c_bus.h"
+#include "hals/hal_touch.h"
+#include "hals/hal_boot.h"
 
 // Display and input device handles
 extern lv_disp_t *lvDisp;
 extern lv_indev_t *lvTouchpad;
 extern lv_indev_t *lvUsbMouse;
+extern lv_indev_t *lvUsbKeyboard;
 
-// HAL initialization functions
+// Boot stages of hal_init(), in dependency order; use with HAL_BOOT_BIT() and hal_boot_wait()
+typedef enum {
+    HAL_STAGE_I2C,
+    HAL_STAGE_EXPANDER,
+    HAL_STAGE_DISPLAY,
+    HAL_STAGE_TOUCH,
+    HAL_STAGE_AUDIO,        // Background
+    HAL_STAGE_SDCARD,       // Background
+    HAL_STAGE_USB,          // Background
+    HAL_STAGE_MAX
+} hal_stage_t;
+
+// HAL initialization functions; hal_init() returns once display and touch are up
 void hal_init(void);
 void hal_touchpad_init(void);
 void hal_usb_init(void);
 void hal_usb_mouse_init(void);
+void hal_usb_keyboard_init(void);
 
 #endif // HAL_H
\ No newline at end of file
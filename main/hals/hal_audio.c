@@ -1,181 +1,49 @@
 #include "hal_audio.h"
+#include "hal_i2c_bus.h"
+#include "hal_mutex.h"
+#include "hal_sdcard.h"
+#include "managers/dlog.h"
+#include "managers/event_bus.h"
+#include "managers/metrics.h"
+#include "perf/perf_trace.h"
 #include <bsp/esp-bsp.h>
 #include <stdio.h>
 #include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/semphr.h>
 #include <audio_player.h>
 #include <esp_err.h>
-#include <driver/i2c_master.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
 
-// PI4IOE5V寄存器定义 (与参考代码保持一致)
-#define PI4IO_REG_CHIP_RESET 0x01
-#define PI4IO_REG_IO_DIR     0x03
-#define PI4IO_REG_OUT_SET    0x05
-#define PI4IO_REG_OUT_H_IM   0x07
+// PI4IOE5V寄存器定义 (输出/方向寄存器由BSP缓存, 这里只用到输入和中断相关寄存器)
 #define PI4IO_REG_IN_DEF_STA 0x09
-#define PI4IO_REG_PULL_EN    0x0B
-#define PI4IO_REG_PULL_SEL   0x0D
 #define PI4IO_REG_IN_STA     0x0F
 #define PI4IO_REG_INT_MASK   0x11
 #define PI4IO_REG_IRQ_STA    0x13
 
-// PI4IOE5V设备地址
-#define I2C_DEV_ADDR_PI4IOE1  0x43  // addr pin low
-#define I2C_DEV_ADDR_PI4IOE2  0x44  // addr pin high
-#define I2C_MASTER_TIMEOUT_MS 50
+// 耳机检测引脚定义 (PI4IOE1 P7, 输入)
+#define HEADPHONE_DETECT_PIN 7
 
-// 扬声器使能引脚定义 (PI4IOE1 P1)
-#define SPEAKER_ENABLE_PIN   1
+// 扬声器功放使能引脚 (PI4IOE1 P1, 输出)
+#define SPEAKER_ENABLE_PIN 1
 
-// 全局I2C设备句柄
-static i2c_master_bus_handle_t g_i2c_bus_handle = NULL;
-static i2c_master_dev_handle_t g_pi4ioe1_handle = NULL;
-static i2c_master_dev_handle_t g_pi4ioe2_handle = NULL;
+// PI4IOE1 中断输出所连接的 GPIO (低电平有效)
+// Tab5 的 BSP 没有引出该中断线, 未连接时改为定时轮询耳机检测引脚
+#ifndef HAL_AUDIO_EXPANDER_INT_GPIO
+#define HAL_AUDIO_EXPANDER_INT_GPIO GPIO_NUM_NC
+#endif
 
-// 位操作宏定义
-#define setbit(x, y) x |= (0x01 << y)
-#define clrbit(x, y) x &= ~(0x01 << y)
+// Detect pin poll period when the interrupt line isn't connected
+#ifndef HAL_AUDIO_HEADPHONE_POLL_MS
+#define HAL_AUDIO_HEADPHONE_POLL_MS 500
+#endif
 
-// 初始化PI4IOE5V设备
-static esp_err_t init_pi4ioe5v(void){
-    if (g_pi4ioe1_handle != NULL && g_pi4ioe2_handle != NULL) {
-        return ESP_OK; // 已经初始化
-    }
-    
-    g_i2c_bus_handle = bsp_i2c_get_handle();
-    if (g_i2c_bus_handle == NULL) {
-        printf("Failed to get I2C bus handle\n");
-        return ESP_FAIL;
-    }
-    
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1] = {0};
-    
-    // 初始化PI4IOE1 (地址0x43)
-    i2c_device_config_t dev_cfg1 = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = I2C_DEV_ADDR_PI4IOE1,
-        .scl_speed_hz = 400000,
-    };
-    
-    esp_err_t ret = i2c_master_bus_add_device(g_i2c_bus_handle, &dev_cfg1, &g_pi4ioe1_handle);
-    if (ret != ESP_OK) {
-        printf("Failed to add PI4IOE1 device: %s\n", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // 配置PI4IOE1
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    write_buf[1] = 0xFF;
-    i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    i2c_master_transmit_receive(g_pi4ioe1_handle, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_IO_DIR;
-    write_buf[1] = 0b01111111;  // 0: input 1: output
-    i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_OUT_H_IM;
-    write_buf[1] = 0b00000000;  // 使用到的引脚关闭 High-Impedance
-    i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_PULL_SEL;
-    write_buf[1] = 0b01111111;  // pull up/down select, 0 down, 1 up
-    i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_PULL_EN;
-    write_buf[1] = 0b01111111;  // P7 中断使能 0 enable, 1 disable
-    i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    /* Output Port Register P1(SPK_EN), P2(EXT5V_EN), P4(LCD_RST), P5(TP_RST), P6(CAM)RST 输出高电平 */
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = 0b01110110;
-    i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    
-    // 初始化PI4IOE2 (地址0x44)
-    i2c_device_config_t dev_cfg2 = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = I2C_DEV_ADDR_PI4IOE2,
-        .scl_speed_hz = 400000,
-    };
-    
-    ret = i2c_master_bus_add_device(g_i2c_bus_handle, &dev_cfg2, &g_pi4ioe2_handle);
-    if (ret != ESP_OK) {
-        printf("Failed to add PI4IOE2 device: %s\n", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // 配置PI4IOE2
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    write_buf[1] = 0xFF;
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_CHIP_RESET;
-    i2c_master_transmit_receive(g_pi4ioe2_handle, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_IO_DIR;
-    write_buf[1] = 0b10111001;  // 0: input 1: output
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_OUT_H_IM;
-    write_buf[1] = 0b00000110;  // 使用到的引脚关闭 High-Impedance
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_PULL_SEL;
-    write_buf[1] = 0b10111001;  // pull up/down select, 0 down, 1 up
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_PULL_EN;
-    write_buf[1] = 0b11111001;  // pull up/down enable, 0 disable, 1 enable
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_IN_DEF_STA;
-    write_buf[1] = 0b01000000;  // P6 默认高电平
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    write_buf[0] = PI4IO_REG_INT_MASK;
-    write_buf[1] = 0b10111111;  // P6 中断使能 0 enable, 1 disable
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    /* Output Port Register P0(WLAN_PWR_EN), P3(USB5V_EN), P7(CHG_EN) 输出高电平 */
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = 0b00001001;
-    i2c_master_transmit(g_pi4ioe2_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    
-    printf("PI4IOE5V initialized successfully\n");
-    return ESP_OK;
-}
+// Time to let the jack contacts settle before sampling the detect pin
+#define HEADPHONE_DEBOUNCE_MS 30
 
-// 控制扬声器使能
-static esp_err_t bsp_set_speaker_enable(bool enable){
-    esp_err_t ret = init_pi4ioe5v();
-    if (ret != ESP_OK) {
-        return ret;
-    }
-    
-    uint8_t write_buf[2] = {0};
-    uint8_t read_buf[1] = {0};
-    
-    // 读取当前输出状态
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    ret = i2c_master_transmit_receive(g_pi4ioe1_handle, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-    if (ret != ESP_OK) {
-        printf("Failed to read PI4IOE1 output state: %s\n", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    // 根据使能状态设置或清除P1位（扬声器使能）
-    uint8_t current_state = read_buf[0];
-    if (enable) {
-        // 设置P1位为高电平（扬声器开启）
-        setbit(current_state, SPEAKER_ENABLE_PIN);
-    } else {
-        // 清除P1位为低电平（扬声器关闭）
-        clrbit(current_state, SPEAKER_ENABLE_PIN);
-    }
-    
-    // 写入新的输出状态
-    write_buf[0] = PI4IO_REG_OUT_SET;
-    write_buf[1] = current_state;
-    
-    ret = i2c_master_transmit(g_pi4ioe1_handle, write_buf, 2, I2C_MASTER_TIMEOUT_MS);
-    if (ret != ESP_OK) {
-        printf("Failed to set speaker enable: %s\n", esp_err_to_name(ret));
-        return ret;
-    }
-    
-    printf("Speaker %s (P1=%d)\n", enable ? "enabled" : "disabled", (current_state >> SPEAKER_ENABLE_PIN) & 1);
-    return ESP_OK;
-}
+// A decoder write this late is an underrun, allowing for the sample rate being slightly off
+#define UNDERRUN_SLACK_US 2000
 
 // Audio state management
 typedef struct {
@@ -183,7 +51,9 @@ typedef struct {
     bool is_playing;
     uint8_t current_volume;
     bool speaker_enabled;  // 添加扬声器使能状态
-    SemaphoreHandle_t audio_mutex;
+    hal_audio_route_t route;
+    uint8_t route_volume[HAL_AUDIO_ROUTE_MAX];  // Volume profile per output route
+    hal_mutex_t *audio_mutex;
 } audio_state_t;
 
 // MP3 playback state
@@ -193,7 +63,7 @@ typedef struct {
     uint32_t start_time;
     uint32_t duration;
     char current_file[256];
-    SemaphoreHandle_t mp3_mutex;
+    hal_mutex_t *mp3_mutex;
 } mp3_state_t;
 
 // Global audio state
@@ -202,9 +72,17 @@ static audio_state_t g_audio_state = {
     .is_playing = false,
     .current_volume = 50,  // Default volume 50%
     .speaker_enabled = true,  // 默认开启扬声器
+    .route = HAL_AUDIO_ROUTE_SPEAKER,
+    .route_volume = {
+        [HAL_AUDIO_ROUTE_SPEAKER] = 50,
+        [HAL_AUDIO_ROUTE_HEADPHONE] = 30,  // Start headphones quieter than the speaker
+    },
     .audio_mutex = NULL
 };
 
+// Headphone detect task (woken by the PI4IOE1 interrupt)
+static TaskHandle_t g_route_task_handle = NULL;
+
 // Global MP3 state
 static mp3_state_t g_mp3_state = {
     .is_playing = false,
@@ -219,6 +97,12 @@ static mp3_state_t g_mp3_state = {
 static uint32_t g_expected_sample_rate = 44100;
 static bool g_override_audio_player_config = false;
 
+// When the MP3 audio handed to I2S so far runs out, 0 while not playing
+static int64_t g_mp3_queued_until_us = 0;
+
+METRIC_COUNTER(s_mp3_bytes, "audio.bytes", "bytes")
+METRIC_COUNTER(s_mp3_underruns, "audio.underruns", "underruns")
+
 // Helper function to clamp values
 static uint8_t clamp_uint8(uint8_t value, uint8_t min_val, uint8_t max_val) {
     if (value < min_val) return min_val;
@@ -226,6 +110,304 @@ static uint8_t clamp_uint8(uint8_t value, uint8_t min_val, uint8_t max_val) {
     return value;
 }
 
+/* -------------------------------------------------------------------------- */
+/*                              Codec Bus Jobs                               */
+/* -------------------------------------------------------------------------- */
+
+// Every codec and expander register access runs as an I2C arbiter job, so it
+// queues behind touch reads instead of holding the bus in front of them
+
+typedef struct {
+    uint32_t rate;
+    uint32_t bits;
+    i2s_slot_mode_t ch;
+} codec_clk_args_t;
+
+typedef struct {
+    uint8_t reg;
+    uint8_t value;
+} expander_write_args_t;
+
+// Writes the latest volume, so a coalesced job never applies a stale value
+static esp_err_t codec_volume_job(void* arg)
+{
+    bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
+    if (codec_handle && codec_handle->set_volume) {
+        codec_handle->set_volume(g_audio_state.current_volume);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t codec_mute_job(void* arg)
+{
+    return bsp_get_codec_handle()->set_mute((bool)(intptr_t)arg);
+}
+
+static esp_err_t codec_in_gain_job(void* arg)
+{
+    return bsp_get_codec_handle()->set_in_gain(*(const float*)arg);
+}
+
+// Reopens the codec with the new sample format, the longest codec job
+static esp_err_t codec_clk_job(void* arg)
+{
+    const codec_clk_args_t* clk = arg;
+    return bsp_get_codec_handle()->i2s_reconfig_clk_fn(clk->rate, clk->bits, clk->ch);
+}
+
+static esp_err_t codec_init_job(void* arg)
+{
+    bsp_codec_init();
+    return ESP_OK;
+}
+
+static esp_err_t expander_write_job(void* arg)
+{
+    const expander_write_args_t* write = arg;
+    return bsp_io_expander_write_reg(BSP_IO_EXPANDER_1, write->reg, write->value);
+}
+
+// Apply g_audio_state.current_volume and wait for it
+static void codec_set_volume(void)
+{
+    hal_i2c_bus_run(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_volume_job, NULL);
+}
+
+static esp_err_t codec_set_clk(uint32_t rate, uint32_t bits, i2s_slot_mode_t ch)
+{
+    codec_clk_args_t clk = {.rate = rate, .bits = bits, .ch = ch};
+    return hal_i2c_bus_run(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_clk_job, &clk);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Output Routing                               */
+/* -------------------------------------------------------------------------- */
+
+static esp_err_t pi4ioe1_read_reg(uint8_t reg, uint8_t* value)
+{
+    return hal_i2c_bus_read_regs(HAL_I2C_DEV_EXPANDER1, HAL_I2C_PRIO_NORMAL, reg, value, 1);
+}
+
+static esp_err_t pi4ioe1_write_reg(uint8_t reg, uint8_t value)
+{
+    expander_write_args_t write = {.reg = reg, .value = value};
+    return hal_i2c_bus_run(HAL_I2C_DEV_EXPANDER1, HAL_I2C_PRIO_NORMAL, expander_write_job, &write);
+}
+
+// Event bus notifications, sent after audio_mutex / mp3_mutex are released
+static void audio_publish_volume(uint8_t volume, hal_audio_route_t route)
+{
+    const event_t event = {
+        .topic = EVENT_VOLUME,
+        .volume = {.percent = volume, .headphone = (route == HAL_AUDIO_ROUTE_HEADPHONE)},
+    };
+    event_bus_publish(&event);
+}
+
+static void audio_publish_playback(bool playing)
+{
+    const event_t event = {.topic = EVENT_PLAYBACK, .playback.playing = playing};
+    event_bus_publish(&event);
+}
+
+// Switch amplifier and codec volume to the given route. Caller holds audio_mutex.
+static void audio_apply_route(hal_audio_route_t route)
+{
+    bool speaker = (route == HAL_AUDIO_ROUTE_SPEAKER);
+
+    g_audio_state.route = route;
+    g_audio_state.current_volume = g_audio_state.route_volume[route];
+
+    // Cached in the BSP and written by its flush task, no bus access here
+    bsp_set_speaker_enable(speaker);
+    g_audio_state.speaker_enabled = speaker;
+
+    codec_set_volume();
+
+    DLOG_I("Audio route: %s (volume %d%%)", speaker ? "speaker" : "headphone", g_audio_state.current_volume);
+}
+
+// Sample the detect pin once, re-arm the interrupt and switch route if needed
+static void audio_route_update(void)
+{
+    uint8_t input = 0;
+    if (pi4ioe1_read_reg(PI4IO_REG_IN_STA, &input) != ESP_OK) {
+        DLOG_E("Failed to read headphone detect");
+        return;
+    }
+
+    // 将默认电平设为当前电平, 下一次插拔时才会再次触发中断
+    uint8_t detect_bit = input & (1 << HEADPHONE_DETECT_PIN);
+    pi4ioe1_write_reg(PI4IO_REG_IN_DEF_STA, detect_bit);
+
+    hal_audio_route_t route = detect_bit ? HAL_AUDIO_ROUTE_HEADPHONE : HAL_AUDIO_ROUTE_SPEAKER;
+
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
+        bool changed = (route != g_audio_state.route || !g_audio_state.is_initialized);
+        if (changed) {
+            audio_apply_route(route);
+        }
+        uint8_t volume = g_audio_state.current_volume;
+        hal_mutex_give(g_audio_state.audio_mutex);
+
+        if (changed) {
+            const event_t event = {
+                .topic = EVENT_HEADPHONE,
+                .headphone.connected = (route == HAL_AUDIO_ROUTE_HEADPHONE),
+            };
+            event_bus_publish(&event);
+            audio_publish_volume(volume, route);
+        }
+    }
+}
+
+static void IRAM_ATTR audio_route_isr(void* arg)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(g_route_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+// Fallback without the interrupt line: sample the detect pin at housekeeping
+// priority and only switch once a change is still there after the debounce
+static bool audio_route_poll_changed(void)
+{
+    uint8_t input = 0;
+    if (hal_i2c_bus_read_regs(HAL_I2C_DEV_EXPANDER1, HAL_I2C_PRIO_HOUSEKEEPING, PI4IO_REG_IN_STA, &input, 1) != ESP_OK) {
+        return false;
+    }
+    hal_audio_route_t route = (input & (1 << HEADPHONE_DETECT_PIN)) ? HAL_AUDIO_ROUTE_HEADPHONE : HAL_AUDIO_ROUTE_SPEAKER;
+    return route != g_audio_state.route;
+}
+
+static void audio_route_poll_task(void* arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(HAL_AUDIO_HEADPHONE_POLL_MS));
+        if (!audio_route_poll_changed()) {
+            continue;
+        }
+        vTaskDelay(pdMS_TO_TICKS(HEADPHONE_DEBOUNCE_MS));
+        if (audio_route_poll_changed()) {
+            audio_route_update();
+        }
+    }
+}
+
+static void audio_route_task(void* arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Debounce: wait for the contacts to settle, drop edges that came in meanwhile
+        vTaskDelay(pdMS_TO_TICKS(HEADPHONE_DEBOUNCE_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        // 读取中断状态寄存器会清除中断
+        uint8_t irq_status = 0;
+        if (pi4ioe1_read_reg(PI4IO_REG_IRQ_STA, &irq_status) != ESP_OK) {
+            continue;
+        }
+        if (irq_status & (1 << HEADPHONE_DETECT_PIN)) {
+            audio_route_update();
+        }
+    }
+}
+
+static void audio_route_init(void)
+{
+    // Initial route from a single read of the detect pin
+    audio_route_update();
+
+    if (HAL_AUDIO_EXPANDER_INT_GPIO == GPIO_NUM_NC) {
+        if (xTaskCreate(audio_route_poll_task, "audio_route", 3072, NULL, 3, &g_route_task_handle) != pdPASS) {
+            // Never leave the amplifier off on a detect sample that won't be refreshed
+            printf("Failed to create audio route task, output fixed to speaker\n");
+            if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
+                audio_apply_route(HAL_AUDIO_ROUTE_SPEAKER);
+                hal_mutex_give(g_audio_state.audio_mutex);
+            }
+            return;
+        }
+        printf("Headphone detect interrupt not connected, polling every %d ms\n", HAL_AUDIO_HEADPHONE_POLL_MS);
+        return;
+    }
+
+    if (xTaskCreate(audio_route_task, "audio_route", 3072, NULL, 3, &g_route_task_handle) != pdPASS) {
+        printf("Failed to create audio route task\n");
+        return;
+    }
+
+    const gpio_config_t int_cfg = {
+        .pin_bit_mask = 1ULL << HAL_AUDIO_EXPANDER_INT_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    gpio_config(&int_cfg);
+
+    // The ISR service may already be installed by the touch driver
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        printf("Failed to install GPIO ISR service: %s\n", esp_err_to_name(ret));
+        return;
+    }
+    gpio_isr_handler_add(HAL_AUDIO_EXPANDER_INT_GPIO, audio_route_isr, NULL);
+
+    // P7 中断使能 0 enable, 1 disable; 清除上电后残留的中断状态
+    uint8_t irq_status = 0;
+    pi4ioe1_read_reg(PI4IO_REG_IRQ_STA, &irq_status);
+    pi4ioe1_write_reg(PI4IO_REG_INT_MASK, (uint8_t)~(1 << HEADPHONE_DETECT_PIN));
+
+    printf("Headphone detect interrupt on GPIO %d\n", HAL_AUDIO_EXPANDER_INT_GPIO);
+}
+
+hal_audio_route_t hal_audio_get_route(void)
+{
+    return g_audio_state.route;
+}
+
+bool hal_audio_is_headphone_connected(void)
+{
+    return g_audio_state.route == HAL_AUDIO_ROUTE_HEADPHONE;
+}
+
+void hal_audio_set_route_volume(hal_audio_route_t route, uint8_t volume)
+{
+    if (route >= HAL_AUDIO_ROUTE_MAX) {
+        return;
+    }
+
+    if (!g_audio_state.is_initialized) {
+        g_audio_state.route_volume[route] = clamp_uint8(volume, 0, 100);
+        return;
+    }
+
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
+        g_audio_state.route_volume[route] = clamp_uint8(volume, 0, 100);
+        bool active = (route == g_audio_state.route);
+        if (active) {
+            g_audio_state.current_volume = g_audio_state.route_volume[route];
+            hal_i2c_bus_post(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_volume_job, NULL, HAL_I2C_KEY_CODEC_VOLUME);
+        }
+        uint8_t current = g_audio_state.route_volume[route];
+        hal_mutex_give(g_audio_state.audio_mutex);
+
+        if (active) {
+            audio_publish_volume(current, route);
+        }
+    }
+}
+
+uint8_t hal_audio_get_route_volume(hal_audio_route_t route)
+{
+    if (route >= HAL_AUDIO_ROUTE_MAX) {
+        return 0;
+    }
+    return g_audio_state.route_volume[route];
+}
+
 void hal_audio_init(void)
 {
     if (g_audio_state.is_initialized) {
@@ -233,35 +415,27 @@ void hal_audio_init(void)
     }
 
     // Create mutex for audio operations
-    g_audio_state.audio_mutex = xSemaphoreCreateMutex();
+    g_audio_state.audio_mutex = hal_mutex_create("audio");
     if (g_audio_state.audio_mutex == NULL) {
         printf("Failed to create audio mutex\n");
         return;
     }
 
-    // Initialize PI4IOE5V first
-    esp_err_t ret = init_pi4ioe5v();
-    if (ret != ESP_OK) {
-        printf("Failed to initialize PI4IOE5V: %s\n", esp_err_to_name(ret));
-        return;
-    }
+    // PI4IOE5V is normally set up by hal_init() already, this is a no-op then
+    bsp_io_expander_pi4ioe_init(bsp_i2c_get_handle());
 
     // Initialize codec (returns void)
-    bsp_codec_init();
+    hal_i2c_bus_run(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_init_job, NULL);
     printf("Codec initialized\n");
 
     // Set initial volume
-    bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
-    if (codec_handle) {
-        codec_handle->set_volume(g_audio_state.current_volume);
-        // Set a reasonable default I2S configuration
-        // This will be overridden by audio_player when playing MP3 files
-        codec_handle->i2s_reconfig_clk_fn(44100, 16, I2S_SLOT_MODE_STEREO);
-    }
+    codec_set_volume();
+    // Set a reasonable default I2S configuration
+    // This will be overridden by audio_player when playing MP3 files
+    codec_set_clk(44100, 16, I2S_SLOT_MODE_STEREO);
 
-    // 初始化扬声器为开启状态
-    bsp_set_speaker_enable(true);
-    g_audio_state.speaker_enabled = true;
+    // 根据耳机检测结果选择输出 (扬声器功放 + 音量配置)
+    audio_route_init();
 
     g_audio_state.is_initialized = true;
     printf("Audio HAL initialized successfully\n");
@@ -270,21 +444,23 @@ void hal_audio_init(void)
 void hal_set_speaker_volume(uint8_t volume)
 {
     if (!g_audio_state.is_initialized) {
-        printf("Audio not initialized\n");
+        DLOG_E("Audio not initialized");
         return;
     }
 
-    if (xSemaphoreTake(g_audio_state.audio_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
         g_audio_state.current_volume = clamp_uint8(volume, 0, 100);
+        g_audio_state.route_volume[g_audio_state.route] = g_audio_state.current_volume;
         
-        // Set codec volume
-        bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
-        if (codec_handle) {
-            codec_handle->set_volume(g_audio_state.current_volume);
-        }
+        // Set codec volume on the bus arbiter; while a write is pending newer values replace it
+        hal_i2c_bus_post(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_volume_job, NULL, HAL_I2C_KEY_CODEC_VOLUME);
         
-        printf("Set speaker volume: %d%%\n", g_audio_state.current_volume);
-        xSemaphoreGive(g_audio_state.audio_mutex);
+        DLOG_D("Set speaker volume: %d%%", g_audio_state.current_volume);
+        uint8_t current = g_audio_state.current_volume;
+        hal_audio_route_t route = g_audio_state.route;
+        hal_mutex_give(g_audio_state.audio_mutex);
+
+        audio_publish_volume(current, route);
     }
 }
 
@@ -296,40 +472,36 @@ uint8_t hal_get_speaker_volume(void)
 bool hal_audio_play_pcm(const int16_t* data, size_t samples, uint32_t sample_rate, bool is_stereo)
 {
     if (!g_audio_state.is_initialized || !data || samples == 0) {
-        printf("Invalid audio play parameters\n");
+        DLOG_E("Invalid audio play parameters");
         return false;
     }
 
-    if (xSemaphoreTake(g_audio_state.audio_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
         if (g_audio_state.is_playing) {
-            printf("Audio already playing\n");
-            xSemaphoreGive(g_audio_state.audio_mutex);
+            DLOG_I("Audio already playing");
+            hal_mutex_give(g_audio_state.audio_mutex);
             return false;
         }
 
         g_audio_state.is_playing = true;
-        xSemaphoreGive(g_audio_state.audio_mutex);
+        hal_mutex_give(g_audio_state.audio_mutex);
 
         // Get codec handle
         bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
         if (!codec_handle) {
-            printf("Failed to get codec handle\n");
+            DLOG_E("Failed to get codec handle");
             g_audio_state.is_playing = false;
             return false;
         }
 
         // Configure codec for playback
-        codec_handle->set_volume(g_audio_state.current_volume);
+        codec_set_volume();
         
         // Configure I2S for the specified sample rate and channels
-        esp_err_t ret = codec_handle->i2s_reconfig_clk_fn(
-            sample_rate, 
-            16, 
-            is_stereo ? I2S_SLOT_MODE_STEREO : I2S_SLOT_MODE_MONO
-        );
+        esp_err_t ret = codec_set_clk(sample_rate, 16, is_stereo ? I2S_SLOT_MODE_STEREO : I2S_SLOT_MODE_MONO);
         
         if (ret != ESP_OK) {
-            printf("Failed to configure I2S: %s\n", esp_err_to_name(ret));
+            DLOG_E("Failed to configure I2S: %s", esp_err_to_name(ret));
             g_audio_state.is_playing = false;
             return false;
         }
@@ -338,25 +510,27 @@ bool hal_audio_play_pcm(const int16_t* data, size_t samples, uint32_t sample_rat
         size_t bytes_written = 0;
         size_t total_bytes = samples * sizeof(int16_t);
         
+        PERF_TRACE_BEGIN_ARG("i2s_write", (int32_t)total_bytes);
         ret = codec_handle->i2s_write(
             (void*)data,  // Cast away const to match function signature
             total_bytes, 
             &bytes_written, 
             pdMS_TO_TICKS(5000)  // 5 second timeout
         );
+        PERF_TRACE_END("i2s_write");
 
         if (ret != ESP_OK) {
-            printf("Failed to write audio data: %s\n", esp_err_to_name(ret));
+            DLOG_E("Failed to write audio data: %s", esp_err_to_name(ret));
             g_audio_state.is_playing = false;
             return false;
         }
 
-        printf("Audio playback completed: %zu bytes written\n", bytes_written);
+        DLOG_I("Audio playback completed: %zu bytes written", bytes_written);
         g_audio_state.is_playing = false;
         return true;
     }
 
-    printf("Failed to acquire audio mutex\n");
+    DLOG_E("Failed to acquire audio mutex");
     return false;
 }
 
@@ -367,31 +541,31 @@ bool hal_audio_is_playing(void)
 
 void hal_audio_stop(void)
 {
-    if (xSemaphoreTake(g_audio_state.audio_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
         g_audio_state.is_playing = false;
-        xSemaphoreGive(g_audio_state.audio_mutex);
-        printf("Audio playback stopped\n");
+        hal_mutex_give(g_audio_state.audio_mutex);
+        DLOG_I("Audio playback stopped");
     }
 }
 
 size_t hal_audio_record(int16_t* buffer, size_t buffer_size, uint32_t duration_ms, float gain)
 {
     if (!g_audio_state.is_initialized || !buffer || buffer_size == 0) {
-        printf("Invalid audio record parameters\n");
+        DLOG_E("Invalid audio record parameters");
         return 0;
     }
 
-    if (xSemaphoreTake(g_audio_state.audio_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
         // Get codec handle
         bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
         if (!codec_handle) {
-            printf("Failed to get codec handle\n");
-            xSemaphoreGive(g_audio_state.audio_mutex);
+            DLOG_E("Failed to get codec handle");
+            hal_mutex_give(g_audio_state.audio_mutex);
             return 0;
         }
 
         // Set recording gain
-        codec_handle->set_in_gain(gain);
+        hal_i2c_bus_run(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_in_gain_job, &gain);
 
         // Calculate expected data size
         // Assuming 48kHz, 4-channel (quad) recording
@@ -410,18 +584,18 @@ size_t hal_audio_record(int16_t* buffer, size_t buffer_size, uint32_t duration_m
             pdMS_TO_TICKS(duration_ms + 1000)  // Add 1 second timeout buffer
         );
 
-        xSemaphoreGive(g_audio_state.audio_mutex);
+        hal_mutex_give(g_audio_state.audio_mutex);
 
         if (ret != ESP_OK) {
-            printf("Failed to read audio data: %s\n", esp_err_to_name(ret));
+            DLOG_E("Failed to read audio data: %s", esp_err_to_name(ret));
             return 0;
         }
 
-        printf("Audio recording completed: %zu bytes read\n", bytes_read);
+        DLOG_I("Audio recording completed: %zu bytes read", bytes_read);
         return bytes_read;
     }
 
-    printf("Failed to acquire audio mutex for recording\n");
+    DLOG_E("Failed to acquire audio mutex for recording");
     return 0;
 }
 
@@ -435,18 +609,29 @@ static esp_err_t hal_audio_force_reconfig(uint32_t sample_rate, uint32_t bits_pe
 // Audio player callback for MP3 playback
 static void mp3_audio_player_callback(audio_player_cb_ctx_t* ctx)
 {
-    printf("MP3 audio event: %d\n", (int)ctx->audio_event);
+    PERF_TRACE_INSTANT("audio_player_event", (int32_t)ctx->audio_event);
+    DLOG_D("MP3 audio event: %d", (int)ctx->audio_event);
     
     audio_player_state_t state = audio_player_get_state();
-    printf("MP3 audio state: %d\n", (int)state);
+    DLOG_D("MP3 audio state: %d", (int)state);
+
+    // Paused or stopped output is not an underrun
+    if (state != AUDIO_PLAYER_STATE_PLAYING) {
+        g_mp3_queued_until_us = 0;
+    }
     
     if (state == AUDIO_PLAYER_STATE_IDLE) {
-        if (xSemaphoreTake(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        bool finished = false;
+        if (hal_mutex_take(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100))) {
+            finished = g_mp3_state.is_playing;
             g_mp3_state.is_playing = false;
             // Reset override flag when playback finishes
             g_override_audio_player_config = false;
-            printf("MP3 playback finished\n");
-            xSemaphoreGive(g_mp3_state.mp3_mutex);
+            DLOG_I("MP3 playback finished");
+            hal_mutex_give(g_mp3_state.mp3_mutex);
+        }
+        if (finished) {
+            audio_publish_playback(false);
         }
     }
 }
@@ -454,9 +639,9 @@ static void mp3_audio_player_callback(audio_player_cb_ctx_t* ctx)
 // Audio mute function for MP3 playback
 static esp_err_t mp3_audio_mute_function(AUDIO_PLAYER_MUTE_SETTING setting)
 {
-    bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
-    if (codec_handle) {
-        codec_handle->set_mute(setting == AUDIO_PLAYER_MUTE ? true : false);
+    if (bsp_get_codec_handle()) {
+        bool mute = (setting == AUDIO_PLAYER_MUTE);
+        hal_i2c_bus_run(HAL_I2C_DEV_CODEC, HAL_I2C_PRIO_NORMAL, codec_mute_job, (void*)(intptr_t)mute);
     }
     return ESP_OK;
 }
@@ -464,54 +649,76 @@ static esp_err_t mp3_audio_mute_function(AUDIO_PLAYER_MUTE_SETTING setting)
 // Force audio system reconfiguration for specific sample rate
 static esp_err_t hal_audio_force_reconfig(uint32_t sample_rate, uint32_t bits_per_sample, i2s_slot_mode_t slot_mode)
 {
-    printf("Force reconfiguring audio system: %luHz, %lubit, %s\n", 
+    DLOG_D("Force reconfiguring audio system: %luHz, %lubit, %s", 
            (unsigned long)sample_rate, (unsigned long)bits_per_sample, 
            slot_mode == I2S_SLOT_MODE_STEREO ? "stereo" : "mono");
     
     bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
     if (!codec_handle) {
-        printf("Failed to get codec handle for reconfiguration\n");
+        DLOG_E("Failed to get codec handle for reconfiguration");
         return ESP_FAIL;
     }
     
     // Force reconfigure the codec with new sample rate
-    esp_err_t ret = codec_handle->i2s_reconfig_clk_fn(sample_rate, bits_per_sample, slot_mode);
+    esp_err_t ret = codec_set_clk(sample_rate, bits_per_sample, slot_mode);
     if (ret != ESP_OK) {
-        printf("Failed to reconfigure I2S clock: %s\n", esp_err_to_name(ret));
+        DLOG_E("Failed to reconfigure I2S clock: %s", esp_err_to_name(ret));
         return ret;
     }
     
     // Small delay to let the configuration stabilize
     vTaskDelay(pdMS_TO_TICKS(50));
     
-    printf("Audio system reconfigured successfully\n");
+    DLOG_D("Audio system reconfigured successfully");
     return ESP_OK;
 }
 
 // Wrapper for the original I2S clock configuration function
 static esp_err_t mp3_clk_set_wrapper(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
 {
-    printf("audio_player calling clk_set_fn: %luHz, %lubit, %s\n", 
+    DLOG_D("audio_player calling clk_set_fn: %luHz, %lubit, %s", 
            (unsigned long)rate, (unsigned long)bits_cfg, 
            ch == I2S_SLOT_MODE_STEREO ? "stereo" : "mono");
     
     bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
     if (!codec_handle) {
-        printf("Failed to get codec handle in wrapper\n");
+        DLOG_E("Failed to get codec handle in wrapper");
         return ESP_FAIL;
     }
     
     // If we're overriding, use our expected sample rate instead
     if (g_override_audio_player_config) {
-        printf("OVERRIDING audio_player config: using %luHz instead of %luHz\n", 
+        DLOG_D("OVERRIDING audio_player config: using %luHz instead of %luHz", 
                (unsigned long)g_expected_sample_rate, (unsigned long)rate);
         rate = g_expected_sample_rate;
     }
     
-    // Call the original function
-    esp_err_t ret = codec_handle->i2s_reconfig_clk_fn(rate, bits_cfg, ch);
+    // Call the original function, on the bus arbiter
+    esp_err_t ret = codec_set_clk(rate, bits_cfg, ch);
     
-    printf("clk_set_fn result: %s\n", esp_err_to_name(ret));
+    DLOG_D("clk_set_fn result: %s", esp_err_to_name(ret));
+    return ret;
+}
+
+// The decoder blocks here while the I2S DMA queue is full. Keeps track of how
+// much audio is queued; a chunk arriving after all of it has played means the
+// output ran dry in between.
+static esp_err_t mp3_i2s_write(void* audio_buffer, size_t len, size_t* bytes_written, uint32_t timeout_ms)
+{
+    int64_t start = esp_timer_get_time();
+    if (g_mp3_queued_until_us != 0 && start > g_mp3_queued_until_us + UNDERRUN_SLACK_US) {
+        metric_inc(&s_mp3_underruns);
+    }
+
+    PERF_TRACE_BEGIN_ARG("i2s_write", (int32_t)len);
+    esp_err_t ret = bsp_get_codec_handle()->i2s_write(audio_buffer, len, bytes_written, timeout_ms);
+    PERF_TRACE_END("i2s_write");
+
+    // 16 bit stereo
+    int64_t now = esp_timer_get_time();
+    int64_t queued_until = g_mp3_queued_until_us > now ? g_mp3_queued_until_us : now;
+    g_mp3_queued_until_us = queued_until + (int64_t)*bytes_written * 1000000 / (g_expected_sample_rate * 4);
+    metric_add(&s_mp3_bytes, *bytes_written);
     return ret;
 }
 
@@ -525,7 +732,7 @@ static uint32_t hal_audio_detect_mp3_sample_rate(const char* file_path)
     
     FILE* fp = fopen(file_path, "rb");
     if (!fp) {
-        printf("Failed to open MP3 file for analysis: %s\n", file_path);
+        DLOG_E("Failed to open MP3 file for analysis: %s", file_path);
         return 44100; // Default fallback
     }
     
@@ -547,13 +754,13 @@ static uint32_t hal_audio_detect_mp3_sample_rate(const char* file_path)
             if (version == 0x03) { // MPEG-1
                 if (sample_rate_index < 3) {
                     sample_rate = mp3_sample_rates[sample_rate_index];
-                    printf("Detected MP3 sample rate: %lu Hz (MPEG-1)\n", (unsigned long)sample_rate);
+                    DLOG_D("Detected MP3 sample rate: %lu Hz (MPEG-1)", (unsigned long)sample_rate);
                     break;
                 }
             } else if (version == 0x02) { // MPEG-2
                 if (sample_rate_index < 3) {
                     sample_rate = mp3_sample_rates_v2[sample_rate_index];
-                    printf("Detected MP3 sample rate: %lu Hz (MPEG-2)\n", (unsigned long)sample_rate);
+                    DLOG_D("Detected MP3 sample rate: %lu Hz (MPEG-2)", (unsigned long)sample_rate);
                     break;
                 }
             }
@@ -566,7 +773,7 @@ static uint32_t hal_audio_detect_mp3_sample_rate(const char* file_path)
     fclose(fp);
     
     if (sample_rate == 44100) {
-        printf("Using default sample rate: %lu Hz\n", (unsigned long)sample_rate);
+        DLOG_D("Using default sample rate: %lu Hz", (unsigned long)sample_rate);
     }
     
     return sample_rate;
@@ -575,20 +782,20 @@ static uint32_t hal_audio_detect_mp3_sample_rate(const char* file_path)
 bool hal_audio_play_mp3_file(const char* file_path)
 {
     if (!file_path) {
-        printf("Invalid MP3 file path\n");
+        DLOG_E("Invalid MP3 file path");
         return false;
     }
     
     // Create MP3 mutex if not already created
     if (g_mp3_state.mp3_mutex == NULL) {
-        g_mp3_state.mp3_mutex = xSemaphoreCreateMutex();
+        g_mp3_state.mp3_mutex = hal_mutex_create("mp3");
         if (g_mp3_state.mp3_mutex == NULL) {
-            printf("Failed to create MP3 mutex\n");
+            DLOG_E("Failed to create MP3 mutex");
             return false;
         }
     }
     
-    if (xSemaphoreTake(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    if (hal_mutex_take(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(1000))) {
         // Stop any current playback
         if (g_mp3_state.is_playing) {
             hal_audio_stop_mp3();
@@ -597,14 +804,14 @@ bool hal_audio_play_mp3_file(const char* file_path)
         // Configure codec
         bsp_codec_config_t* codec_handle = bsp_get_codec_handle();
         if (!codec_handle) {
-            printf("Failed to get codec handle for MP3\n");
-            xSemaphoreGive(g_mp3_state.mp3_mutex);
+            DLOG_E("Failed to get codec handle for MP3");
+            hal_mutex_give(g_mp3_state.mp3_mutex);
             return false;
         }
         
         // Detect MP3 sample rate from file header
         uint32_t detected_sample_rate = hal_audio_detect_mp3_sample_rate(file_path);
-        printf("MP3 file analysis complete, detected sample rate: %lu Hz\n", (unsigned long)detected_sample_rate);
+        DLOG_D("MP3 file analysis complete, detected sample rate: %lu Hz", (unsigned long)detected_sample_rate);
         
         // Set global variables for the wrapper function
         g_expected_sample_rate = detected_sample_rate;
@@ -613,12 +820,12 @@ bool hal_audio_play_mp3_file(const char* file_path)
         // Force reconfigure audio system with detected sample rate
         esp_err_t reconfig_ret = hal_audio_force_reconfig(detected_sample_rate, 16, I2S_SLOT_MODE_STEREO);
         if (reconfig_ret != ESP_OK) {
-            printf("Failed to reconfigure audio system for MP3 playback\n");
-            xSemaphoreGive(g_mp3_state.mp3_mutex);
+            DLOG_E("Failed to reconfigure audio system for MP3 playback");
+            hal_mutex_give(g_mp3_state.mp3_mutex);
             return false;
         }
         
-        codec_handle->set_volume(g_audio_state.current_volume);
+        codec_set_volume();
         // Remove hardcoded sample rate - let audio_player detect and set correct rate
         // codec_handle->i2s_reconfig_clk_fn(48000, 16, I2S_SLOT_MODE_STEREO);
         
@@ -626,16 +833,16 @@ bool hal_audio_play_mp3_file(const char* file_path)
         audio_player_config_t config = {
             .mute_fn = mp3_audio_mute_function,
             .clk_set_fn = mp3_clk_set_wrapper,  // Use our wrapper function
-            .write_fn = codec_handle->i2s_write,
+            .write_fn = mp3_i2s_write,
             .priority = 8,
             .coreID = 1,
         };
         
         esp_err_t ret = audio_player_new(config);
         if (ret != ESP_OK) {
-            printf("Failed to create audio player: %s\n", esp_err_to_name(ret));
+            DLOG_E("Failed to create audio player: %s", esp_err_to_name(ret));
             g_override_audio_player_config = false;  // Reset override flag
-            xSemaphoreGive(g_mp3_state.mp3_mutex);
+            hal_mutex_give(g_mp3_state.mp3_mutex);
             return false;
         }
         
@@ -643,22 +850,23 @@ bool hal_audio_play_mp3_file(const char* file_path)
         audio_player_callback_register(mp3_audio_player_callback, NULL);
         
         // Open and play MP3 file
-        FILE* fp = fopen(file_path, "rb");
+        FILE* fp = hal_sdcard_fopen(file_path, "rb");
         if (!fp) {
-            printf("Failed to open MP3 file: %s\n", file_path);
+            DLOG_E("Failed to open MP3 file: %s", file_path);
             audio_player_delete();
             g_override_audio_player_config = false;  // Reset override flag
-            xSemaphoreGive(g_mp3_state.mp3_mutex);
+            hal_mutex_give(g_mp3_state.mp3_mutex);
             return false;
         }
         
+        g_mp3_queued_until_us = 0;
         ret = audio_player_play(fp);
         if (ret != ESP_OK) {
-            printf("Failed to start MP3 playback: %s\n", esp_err_to_name(ret));
+            DLOG_E("Failed to start MP3 playback: %s", esp_err_to_name(ret));
             fclose(fp);
             audio_player_delete();
             g_override_audio_player_config = false;  // Reset override flag
-            xSemaphoreGive(g_mp3_state.mp3_mutex);
+            hal_mutex_give(g_mp3_state.mp3_mutex);
             return false;
         }
         
@@ -667,10 +875,10 @@ bool hal_audio_play_mp3_file(const char* file_path)
         
         // Force reconfigure again after audio_player has started
         // This is to ensure our sample rate is used even if audio_player overrides it
-        printf("Force reconfiguring after audio_player start...\n");
+        DLOG_D("Force reconfiguring after audio_player start...");
         reconfig_ret = hal_audio_force_reconfig(detected_sample_rate, 16, I2S_SLOT_MODE_STEREO);
         if (reconfig_ret != ESP_OK) {
-            printf("Warning: Failed to force reconfigure after start: %s\n", esp_err_to_name(reconfig_ret));
+            DLOG_W("Failed to force reconfigure after start: %s", esp_err_to_name(reconfig_ret));
         }
         
         // Update state
@@ -681,14 +889,15 @@ bool hal_audio_play_mp3_file(const char* file_path)
         strncpy(g_mp3_state.current_file, file_path, sizeof(g_mp3_state.current_file) - 1);
         g_mp3_state.current_file[sizeof(g_mp3_state.current_file) - 1] = '\0';
         
-        printf("Started MP3 playback: %s at %lu Hz (override active: %s)\n", 
+        DLOG_I("Started MP3 playback: %s at %lu Hz (override active: %s)", 
                file_path, (unsigned long)detected_sample_rate, 
                g_override_audio_player_config ? "yes" : "no");
-        xSemaphoreGive(g_mp3_state.mp3_mutex);
+        hal_mutex_give(g_mp3_state.mp3_mutex);
+        audio_publish_playback(true);
         return true;
     }
     
-    printf("Failed to acquire MP3 mutex\n");
+    DLOG_E("Failed to acquire MP3 mutex");
     return false;
 }
 
@@ -698,16 +907,17 @@ void hal_audio_stop_mp3(void)
         return;
     }
     
-    if (xSemaphoreTake(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    if (hal_mutex_take(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(1000))) {
+        bool was_playing = g_mp3_state.is_playing;
         if (g_mp3_state.is_playing) {
-            printf("Stopping MP3 playback\n");
+            DLOG_I("Stopping MP3 playback");
             
             // Reset override flag
             g_override_audio_player_config = false;
             
             esp_err_t ret = audio_player_delete();
             if (ret != ESP_OK) {
-                printf("Failed to delete audio player: %s\n", esp_err_to_name(ret));
+                DLOG_E("Failed to delete audio player: %s", esp_err_to_name(ret));
             }
             
             g_mp3_state.is_playing = false;
@@ -716,9 +926,12 @@ void hal_audio_stop_mp3(void)
             g_mp3_state.duration = 0;
             g_mp3_state.current_file[0] = '\0';
             
-            printf("MP3 playback stopped\n");
+            DLOG_I("MP3 playback stopped");
+        }
+        hal_mutex_give(g_mp3_state.mp3_mutex);
+        if (was_playing) {
+            audio_publish_playback(false);
         }
-        xSemaphoreGive(g_mp3_state.mp3_mutex);
     }
 }
 
@@ -729,9 +942,9 @@ bool hal_audio_is_mp3_playing(void)
     }
     
     bool playing = false;
-    if (xSemaphoreTake(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100))) {
         playing = g_mp3_state.is_playing;
-        xSemaphoreGive(g_mp3_state.mp3_mutex);
+        hal_mutex_give(g_mp3_state.mp3_mutex);
     }
     
     return playing;
@@ -744,12 +957,12 @@ uint32_t hal_audio_get_mp3_position(void)
     }
     
     uint32_t position = 0;
-    if (xSemaphoreTake(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100))) {
         if (g_mp3_state.is_playing) {
             uint32_t current_time = (uint32_t)(esp_timer_get_time() / 1000000);
             position = current_time - g_mp3_state.start_time;
         }
-        xSemaphoreGive(g_mp3_state.mp3_mutex);
+        hal_mutex_give(g_mp3_state.mp3_mutex);
     }
     
     return position;
@@ -762,9 +975,9 @@ uint32_t hal_audio_get_mp3_duration(void)
     }
     
     uint32_t duration = 0;
-    if (xSemaphoreTake(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_mp3_state.mp3_mutex, pdMS_TO_TICKS(100))) {
         duration = g_mp3_state.duration;
-        xSemaphoreGive(g_mp3_state.mp3_mutex);
+        hal_mutex_give(g_mp3_state.mp3_mutex);
     }
     
     return duration;
@@ -773,43 +986,22 @@ uint32_t hal_audio_get_mp3_duration(void)
 void hal_set_speaker_enable(bool enable)
 {
     if (!g_audio_state.is_initialized) {
-        printf("Audio not initialized\n");
+        DLOG_E("Audio not initialized");
         return;
     }
 
-    if (xSemaphoreTake(g_audio_state.audio_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_audio_state.audio_mutex, pdMS_TO_TICKS(100))) {
         g_audio_state.speaker_enabled = enable;
         
         // 调用BSP函数控制扬声器功放
-        esp_err_t ret = bsp_set_speaker_enable(enable);
-        if (ret != ESP_OK) {
-            printf("Failed to set speaker enable: %s\n", esp_err_to_name(ret));
-        }
+        bsp_set_speaker_enable(enable);
         
-        xSemaphoreGive(g_audio_state.audio_mutex);
+        hal_mutex_give(g_audio_state.audio_mutex);
     }
 }
 
 bool hal_get_speaker_enable(void)
 {
-    if (!g_audio_state.is_initialized) {
-        return g_audio_state.speaker_enabled;
-    }
-    
-    // 尝试从硬件读取实际状态
-    if (g_pi4ioe1_handle != NULL) {
-        uint8_t write_buf[1] = {PI4IO_REG_OUT_SET};
-        uint8_t read_buf[1] = {0};
-        
-        esp_err_t ret = i2c_master_transmit_receive(g_pi4ioe1_handle, write_buf, 1, read_buf, 1, I2C_MASTER_TIMEOUT_MS);
-        if (ret == ESP_OK) {
-            bool hardware_enabled = (read_buf[0] & (1 << SPEAKER_ENABLE_PIN)) != 0;
-            // 同步软件状态与硬件状态
-            g_audio_state.speaker_enabled = hardware_enabled;
-            return hardware_enabled;
-        }
-    }
-    
-    // 如果无法读取硬件状态，返回软件状态
-    return g_audio_state.speaker_enabled;
-} 
\ No newline at end of file
+    // The BSP's copy of the expander output register, what was last written to the amplifier pin
+    return (bsp_io_expander_get_output(BSP_IO_EXPANDER_1) & (1 << SPEAKER_ENABLE_PIN)) != 0;
+}
\ No newline at end of file
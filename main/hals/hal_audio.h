@@ -19,6 +19,8 @@ void hal_audio_init(void);
 /**
  * @brief Set speaker volume
  * 
+ * Sets the volume of the currently active output route.
+ * 
  * @param volume Volume level (0-100)
  */
 void hal_set_speaker_volume(uint8_t volume);
@@ -40,10 +42,57 @@ void hal_set_speaker_enable(bool enable);
 /**
  * @brief Get current speaker enable state
  * 
+ * Returns the cached amplifier state, no I2C transaction is made.
+ * 
  * @return true if speaker is enabled, false if disabled
  */
 bool hal_get_speaker_enable(void);
 
+/**
+ * @brief Audio output route
+ */
+typedef enum {
+    HAL_AUDIO_ROUTE_SPEAKER = 0,    // Internal speaker through the power amplifier
+    HAL_AUDIO_ROUTE_HEADPHONE,      // Headphone jack, speaker amplifier off
+    HAL_AUDIO_ROUTE_MAX
+} hal_audio_route_t;
+
+/**
+ * @brief Get the current output route
+ * 
+ * The route is cached and updated from the headphone detect interrupt,
+ * so this never touches the I2C bus.
+ * 
+ * @return Current output route
+ */
+hal_audio_route_t hal_audio_get_route(void);
+
+/**
+ * @brief Check if headphones are plugged in
+ * 
+ * @return true if the headphone jack is occupied (cached state)
+ */
+bool hal_audio_is_headphone_connected(void);
+
+/**
+ * @brief Set the volume profile of a route
+ * 
+ * The volume is applied to the codec immediately if the route is active,
+ * otherwise it is applied the next time the route becomes active.
+ * 
+ * @param route Output route
+ * @param volume Volume level (0-100)
+ */
+void hal_audio_set_route_volume(hal_audio_route_t route, uint8_t volume);
+
+/**
+ * @brief Get the volume profile of a route
+ * 
+ * @param route Output route
+ * @return Volume level (0-100)
+ */
+uint8_t hal_audio_get_route_volume(hal_audio_route_t route);
+
 /**
  * @brief Simple audio playback function
  * 
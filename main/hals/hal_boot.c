@@ -0,0 +1,209 @@
+#include "hals/hal_boot.h"
+#include <stdio.h>
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+
+// What the timeline shows for one stage, times in microseconds since boot
+typedef struct {
+    int64_t start_us;       // Dependencies done, init called
+    int64_t end_us;
+    int core;
+} stage_record_t;
+
+typedef struct {
+    const char *name;
+    int64_t time_us;
+} boot_mark_t;
+
+static const hal_boot_stage_t *s_stages = NULL;
+static size_t s_stage_count = 0;
+static stage_record_t s_records[HAL_BOOT_MAX_STAGES];
+static EventGroupHandle_t s_done_group = NULL;
+static uint32_t s_all_bits = 0;
+static uint32_t s_remaining = 0;
+
+typedef struct {
+    uint32_t bits;
+    void (*fn)(void *arg);
+    void *arg;
+} boot_waiter_t;
+
+// Finished stages and the callbacks waiting for them, under s_waiter_lock
+static uint32_t s_done_bits = 0;
+static boot_waiter_t s_waiters[HAL_BOOT_MAX_WAITERS];
+static portMUX_TYPE s_waiter_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static boot_mark_t s_marks[HAL_BOOT_MAX_MARKS];
+static uint32_t s_mark_count = 0;
+
+static void print_timeline(void)
+{
+    printf("Boot timeline (ms since reset):\n");
+    printf("  %-10s %4s %7s %7s %7s\n", "stage", "core", "start", "end", "took");
+    for (size_t i = 0; i < s_stage_count; i++) {
+        const stage_record_t *r = &s_records[i];
+        printf("  %-10s %4d %7lld %7lld %7lld%s\n", s_stages[i].name, r->core,
+               r->start_us / 1000, r->end_us / 1000, (r->end_us - r->start_us) / 1000,
+               s_stages[i].background ? "  (background)" : "");
+    }
+
+    uint32_t marks = __atomic_load_n(&s_mark_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < marks && i < HAL_BOOT_MAX_MARKS; i++) {
+        printf("  %-10s %4s %7s %7lld\n", s_marks[i].name, "", "", s_marks[i].time_us / 1000);
+    }
+}
+
+// Called as each stage finishes; runs the callbacks whose stages are now all done
+static void notify_waiters(uint32_t done_bit)
+{
+    boot_waiter_t ready[HAL_BOOT_MAX_WAITERS];
+    size_t ready_count = 0;
+
+    portENTER_CRITICAL(&s_waiter_lock);
+    s_done_bits |= done_bit;
+    for (size_t i = 0; i < HAL_BOOT_MAX_WAITERS; i++) {
+        if (s_waiters[i].fn && (s_waiters[i].bits & s_done_bits) == s_waiters[i].bits) {
+            ready[ready_count++] = s_waiters[i];
+            s_waiters[i].fn = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&s_waiter_lock);
+
+    for (size_t i = 0; i < ready_count; i++) {
+        ready[i].fn(ready[i].arg);
+    }
+}
+
+static void run_stage(size_t index)
+{
+    const hal_boot_stage_t *stage = &s_stages[index];
+    stage_record_t *record = &s_records[index];
+
+    if (stage->deps) {
+        xEventGroupWaitBits(s_done_group, stage->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    record->core = xPortGetCoreID();
+    record->start_us = esp_timer_get_time();
+    stage->init();
+    record->end_us = esp_timer_get_time();
+
+    xEventGroupSetBits(s_done_group, HAL_BOOT_BIT(index));
+    notify_waiters(HAL_BOOT_BIT(index));
+
+    // Whoever finishes last prints the whole picture
+    if (__atomic_sub_fetch(&s_remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        print_timeline();
+    }
+}
+
+static void stage_task(void *arg)
+{
+    run_stage((size_t)arg);
+    vTaskDelete(NULL);
+}
+
+esp_err_t hal_boot_run(const hal_boot_stage_t *stages, size_t count)
+{
+    if (!stages || count == 0 || count > HAL_BOOT_MAX_STAGES || s_done_group) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t foreground_bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        // Only earlier stages may be depended on, which also rules out cycles
+        if (!stages[i].init || (stages[i].deps & ~(HAL_BOOT_BIT(i) - 1))) {
+            printf("Boot stage %s: bad dependencies\n", stages[i].name);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (!stages[i].background) {
+            foreground_bits |= HAL_BOOT_BIT(i);
+        }
+    }
+
+    s_done_group = xEventGroupCreate();
+    if (!s_done_group) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_stages = stages;
+    s_stage_count = count;
+    s_all_bits = HAL_BOOT_BIT(count) - 1;
+    s_remaining = count;
+
+    for (size_t i = 0; i < count; i++) {
+        BaseType_t core = stages[i].core;
+#if CONFIG_FREERTOS_UNICORE
+        core = tskNO_AFFINITY;
+#endif
+        if (xTaskCreatePinnedToCore(stage_task, stages[i].name, stages[i].stack_size, (void *)i,
+                                    HAL_BOOT_TASK_PRIORITY, NULL, core) != pdPASS) {
+            // Stages already started may be waiting for this one, run it here so they don't hang
+            printf("Failed to create boot task %s, running it inline\n", stages[i].name);
+            run_stage(i);
+        }
+    }
+
+    xEventGroupWaitBits(s_done_group, foreground_bits, pdFALSE, pdTRUE, portMAX_DELAY);
+    printf("Boot: foreground stages done at %lld ms\n", esp_timer_get_time() / 1000);
+    return ESP_OK;
+}
+
+bool hal_boot_wait(uint32_t stage_bits, uint32_t timeout_ms)
+{
+    if (!s_done_group) {
+        return true;    // No boot graph, everything was initialized inline
+    }
+
+    stage_bits &= s_all_bits;
+    if (stage_bits == 0) {
+        return true;
+    }
+    EventBits_t bits = xEventGroupWaitBits(s_done_group, stage_bits, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & stage_bits) == stage_bits;
+}
+
+bool hal_boot_when(uint32_t stage_bits, void (*fn)(void *arg), void *arg)
+{
+    if (!fn) {
+        return false;
+    }
+
+    bool added = false;
+    bool done = true;
+    portENTER_CRITICAL(&s_waiter_lock);
+    // Without a boot graph everything was initialized inline
+    if (s_done_group) {
+        stage_bits &= s_all_bits;
+        done = (stage_bits & s_done_bits) == stage_bits;
+    }
+    for (size_t i = 0; !done && i < HAL_BOOT_MAX_WAITERS; i++) {
+        if (!s_waiters[i].fn) {
+            s_waiters[i] = (boot_waiter_t){.bits = stage_bits, .fn = fn, .arg = arg};
+            added = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_waiter_lock);
+
+    if (done) {
+        fn(arg);
+        return true;
+    }
+    if (!added) {
+        printf("Boot: too many pending hal_boot_when() callbacks\n");
+    }
+    return added;
+}
+
+void hal_boot_mark(const char *name)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t index = __atomic_load_n(&s_mark_count, __ATOMIC_RELAXED);
+    if (index < HAL_BOOT_MAX_MARKS) {
+        // Marks come from app_main only, no need to arbitrate between writers
+        s_marks[index].name = name;
+        s_marks[index].time_us = now;
+        __atomic_store_n(&s_mark_count, index + 1, __ATOMIC_RELEASE);
+    }
+    printf("Boot: %s at %lld ms\n", name, now / 1000);
+}
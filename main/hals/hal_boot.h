@@ -0,0 +1,94 @@
+#ifndef HAL_BOOT_H
+#define HAL_BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most stages a boot graph may have (one event group bit each)
+#define HAL_BOOT_MAX_STAGES 16
+
+// Priority of the stage tasks, above app_main so stages start right away
+#ifndef HAL_BOOT_TASK_PRIORITY
+#define HAL_BOOT_TASK_PRIORITY 5
+#endif
+
+// Milestones that can be added to the timeline with hal_boot_mark()
+#ifndef HAL_BOOT_MAX_MARKS
+#define HAL_BOOT_MAX_MARKS 4
+#endif
+
+// Callbacks that can be pending in hal_boot_when() at once
+#ifndef HAL_BOOT_MAX_WAITERS
+#define HAL_BOOT_MAX_WAITERS 4
+#endif
+
+#define HAL_BOOT_BIT(stage) (1u << (stage))
+
+/**
+ * @brief One node of the boot graph
+ *
+ * Stages are identified by their index in the table passed to hal_boot_run().
+ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    uint32_t deps;          // HAL_BOOT_BIT() of every stage that must finish first
+    BaseType_t core;        // Core to run on, or tskNO_AFFINITY
+    uint32_t stack_size;
+    bool background;        // hal_boot_run() doesn't wait for it
+} hal_boot_stage_t;
+
+/**
+ * @brief Run a boot graph, each stage on its own task once its dependencies are done
+ *
+ * Independent stages run concurrently on both cores. Returns as soon as every
+ * foreground stage has finished; background stages keep going, and the
+ * timeline is printed once they are all done as well.
+ *
+ * @param stages Stage table, must stay valid until every stage has run
+ * @param count Number of stages, at most HAL_BOOT_MAX_STAGES
+ * @return ESP_OK, or an error if the graph could not be started
+ */
+esp_err_t hal_boot_run(const hal_boot_stage_t *stages, size_t count);
+
+/**
+ * @brief Wait for stages to finish, e.g. before using a background HAL
+ *
+ * @param stage_bits HAL_BOOT_BIT() of each stage to wait for
+ * @param timeout_ms How long to wait at most
+ * @return true if all of them are done
+ */
+bool hal_boot_wait(uint32_t stage_bits, uint32_t timeout_ms);
+
+/**
+ * @brief Call a function once stages have finished, without waiting for them
+ *
+ * For the LVGL task, which must not block on background stages. The function
+ * runs right away if the stages are already done, otherwise on the task of
+ * the stage finishing last; it must not block either, and should hand UI work
+ * to ui_dispatch_post().
+ *
+ * @param stage_bits HAL_BOOT_BIT() of each stage to wait for
+ * @param fn Function to call
+ * @param arg Argument for fn
+ * @return false if too many callbacks are pending, fn is not called then
+ */
+bool hal_boot_when(uint32_t stage_bits, void (*fn)(void *arg), void *arg);
+
+/**
+ * @brief Record a milestone such as "launcher" on the boot timeline
+ */
+void hal_boot_mark(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_BOOT_H
@@ -0,0 +1,404 @@
+#include "hals/hal_cursor.h"
+#include "hals/hal_display.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_cache.h"
+#include "esp_heap_caps.h"
+#include "esp_lcd_mipi_dsi.h"
+#include <bsp/esp-bsp.h>
+
+// Retry interval of a move that had to wait for a flush in flight
+#ifndef HAL_CURSOR_RETRY_MS
+#define HAL_CURSOR_RETRY_MS 2
+#endif
+
+typedef struct {
+    int32_t x1, y1, x2, y2;
+} cursor_rect_t;
+
+static bool s_active = false;
+static bool s_flipped = false;          // Drawn by the display HAL at flip time, see hal_display_set_overlay()
+static lv_display_t *s_disp = NULL;
+static uint16_t *s_fb = NULL;           // DPI frame buffer, RGB565, panel orientation; NULL when flipped
+static int32_t s_fb_w = 0;
+static int32_t s_fb_h = 0;
+static size_t s_cache_align = 64;
+
+// Cursor image and the pixels under it, both in LVGL (rotated) orientation
+static int32_t s_w = 0;
+static int32_t s_h = 0;
+static uint16_t s_sprite[HAL_CURSOR_MAX_SIZE * HAL_CURSOR_MAX_SIZE];
+static uint8_t s_alpha[HAL_CURSOR_MAX_SIZE * HAL_CURSOR_MAX_SIZE];
+static uint16_t s_under[HAL_CURSOR_MAX_SIZE * HAL_CURSOR_MAX_SIZE];
+
+// What is in the frame buffer now (the newest frame when flipped), in LVGL coordinates
+static bool s_shown = false;
+static int32_t s_shown_x = 0;
+static int32_t s_shown_y = 0;
+
+// What was asked for
+static bool s_visible = false;
+static int32_t s_x = 0;
+static int32_t s_y = 0;
+static lv_timer_t *s_retry_timer = NULL;
+
+// Set by LVGL's flush start, cleared from the DPI interrupt once the copy is done; single buffer only
+static volatile bool s_flushing = false;
+
+static inline uint16_t blend565(uint16_t fg, uint16_t bg, uint8_t a)
+{
+    if (a == 255) return fg;
+    if (a == 0) return bg;
+
+    uint32_t r = ((fg >> 11) * a + (bg >> 11) * (255 - a)) / 255;
+    uint32_t g = (((fg >> 5) & 0x3F) * a + ((bg >> 5) & 0x3F) * (255 - a)) / 255;
+    uint32_t b = ((fg & 0x1F) * a + (bg & 0x1F) * (255 - a)) / 255;
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// LVGL coordinates of a panel point, the same transform LVGL applies to pointer indevs
+static void panel_to_lvgl(int32_t px, int32_t py, int32_t *lx, int32_t *ly)
+{
+    lv_display_rotation_t rot = lv_display_get_rotation(s_disp);
+
+    if (rot == LV_DISPLAY_ROTATION_180 || rot == LV_DISPLAY_ROTATION_270) {
+        px = s_fb_w - px - 1;
+        py = s_fb_h - py - 1;
+    }
+    if (rot == LV_DISPLAY_ROTATION_90 || rot == LV_DISPLAY_ROTATION_270) {
+        int32_t tmp = py;
+        py = px;
+        px = s_fb_h - tmp - 1;
+    }
+    *lx = px;
+    *ly = py;
+}
+
+// Frame buffer pixel of an LVGL point, the inverse of the above (what the port's sw_rotate does)
+static inline int32_t fb_index(lv_display_rotation_t rot, int32_t lx, int32_t ly)
+{
+    int32_t px = lx;
+    int32_t py = ly;
+
+    if (rot == LV_DISPLAY_ROTATION_90 || rot == LV_DISPLAY_ROTATION_270) {
+        px = ly;
+        py = s_fb_h - lx - 1;
+    }
+    if (rot == LV_DISPLAY_ROTATION_180 || rot == LV_DISPLAY_ROTATION_270) {
+        px = s_fb_w - px - 1;
+        py = s_fb_h - py - 1;
+    }
+    return py * s_fb_w + px;
+}
+
+// Cursor rectangle at a hotspot, clipped to the screen; false if fully off screen
+static bool cursor_rect(int32_t x, int32_t y, cursor_rect_t *r)
+{
+    r->x1 = LV_MAX(x, 0);
+    r->y1 = LV_MAX(y, 0);
+    r->x2 = LV_MIN(x + s_w, lv_display_get_horizontal_resolution(s_disp)) - 1;
+    r->y2 = LV_MIN(y + s_h, lv_display_get_vertical_resolution(s_disp)) - 1;
+    return r->x1 <= r->x2 && r->y1 <= r->y2;
+}
+
+// Frame buffer rows and columns covered by an LVGL rectangle
+static void fb_rect(const cursor_rect_t *r, cursor_rect_t *out)
+{
+    lv_display_rotation_t rot = lv_display_get_rotation(s_disp);
+    int32_t ia = fb_index(rot, r->x1, r->y1);
+    int32_t ib = fb_index(rot, r->x2, r->y2);
+
+    out->x1 = LV_MIN(ia % s_fb_w, ib % s_fb_w);
+    out->x2 = LV_MAX(ia % s_fb_w, ib % s_fb_w);
+    out->y1 = LV_MIN(ia / s_fb_w, ib / s_fb_w);
+    out->y2 = LV_MAX(ia / s_fb_w, ib / s_fb_w);
+}
+
+// Make CPU writes to the frame buffer visible to the DPI scanout
+static void fb_writeback(const cursor_rect_t *r)
+{
+    cursor_rect_t f;
+    fb_rect(r, &f);
+    for (int32_t y = f.y1; y <= f.y2; y++) {
+        esp_cache_msync(&s_fb[y * s_fb_w + f.x1], (f.x2 - f.x1 + 1) * sizeof(uint16_t),
+                        ESP_CACHE_MSYNC_FLAG_DIR_C2M | ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+    }
+}
+
+// Drop cached lines so the CPU reads what the DMA last wrote
+static void fb_invalidate(const cursor_rect_t *r)
+{
+    cursor_rect_t f;
+    fb_rect(r, &f);
+    for (int32_t y = f.y1; y <= f.y2; y++) {
+        uintptr_t start = (uintptr_t)&s_fb[y * s_fb_w + f.x1];
+        uintptr_t end = (uintptr_t)&s_fb[y * s_fb_w + f.x2 + 1];
+        start &= ~(uintptr_t)(s_cache_align - 1);
+        end = (end + s_cache_align - 1) & ~(uintptr_t)(s_cache_align - 1);
+        esp_cache_msync((void *)start, end - start, ESP_CACHE_MSYNC_FLAG_DIR_M2C);
+    }
+}
+
+// Put back the pixels under the cursor at its shown place; false if it was off screen
+static bool restore_pixels(uint16_t *fb, cursor_rect_t *r)
+{
+    if (!s_shown || !cursor_rect(s_shown_x, s_shown_y, r)) {
+        s_shown = false;
+        return false;
+    }
+
+    lv_display_rotation_t rot = lv_display_get_rotation(s_disp);
+    for (int32_t ly = r->y1; ly <= r->y2; ly++) {
+        const uint16_t *under = &s_under[(ly - s_shown_y) * s_w];
+        for (int32_t lx = r->x1; lx <= r->x2; lx++) {
+            fb[fb_index(rot, lx, ly)] = under[lx - s_shown_x];
+        }
+    }
+    s_shown = false;
+    return true;
+}
+
+// Save the pixels under the cursor at a hotspot and blend it in; false if off screen
+static bool draw_pixels(uint16_t *fb, int32_t x, int32_t y, cursor_rect_t *r)
+{
+    s_shown_x = x;
+    s_shown_y = y;
+    s_shown = true;
+    if (!cursor_rect(x, y, r)) {
+        return false;
+    }
+
+    lv_display_rotation_t rot = lv_display_get_rotation(s_disp);
+    for (int32_t ly = r->y1; ly <= r->y2; ly++) {
+        int32_t row = (ly - y) * s_w;
+        for (int32_t lx = r->x1; lx <= r->x2; lx++) {
+            int32_t i = row + lx - x;
+            uint16_t *px = &fb[fb_index(rot, lx, ly)];
+            s_under[i] = *px;
+            *px = blend565(s_sprite[i], *px, s_alpha[i]);
+        }
+    }
+    return true;
+}
+
+static void restore_under(void)
+{
+    cursor_rect_t r;
+    if (restore_pixels(s_fb, &r)) {
+        fb_writeback(&r);
+    }
+}
+
+static void draw_at(int32_t x, int32_t y)
+{
+    cursor_rect_t r;
+    if (cursor_rect(x, y, &r)) {
+        fb_invalidate(&r);
+    }
+    if (draw_pixels(s_fb, x, y, &r)) {
+        fb_writeback(&r);
+    }
+}
+
+// Flip-time hook of the display HAL: the buffer is one the panel isn't
+// scanning and the display HAL writes its rows back, so no cache upkeep here
+static bool overlay_cb(void *fb, bool show, lv_area_t *area, void *user_ctx)
+{
+    cursor_rect_t r;
+    bool changed;
+    if (show) {
+        changed = s_visible && draw_pixels((uint16_t *)fb, s_x, s_y, &r);
+    } else {
+        changed = restore_pixels((uint16_t *)fb, &r);
+    }
+    if (!changed) {
+        return false;
+    }
+
+    cursor_rect_t f;
+    fb_rect(&r, &f);
+    area->x1 = f.x1;
+    area->y1 = f.y1;
+    area->x2 = f.x2;
+    area->y2 = f.y2;
+    return true;
+}
+
+static bool cursor_changed(void)
+{
+    return (s_visible != s_shown) || (s_visible && (s_x != s_shown_x || s_y != s_shown_y));
+}
+
+// Bring the frame buffer in line with the requested state; false if a flush is in flight
+static bool cursor_sync(void)
+{
+    if (!cursor_changed()) {
+        return true;
+    }
+
+    // The DMA copy in flight may still write the cursor at its old place
+    if (s_flushing) {
+        return false;
+    }
+
+    restore_under();
+    if (s_visible) {
+        draw_at(s_x, s_y);
+    }
+    return true;
+}
+
+static void sync_or_retry(void)
+{
+    // The next frame, or a frame of its own, picks the change up
+    if (s_flipped) {
+        if (cursor_changed()) {
+            hal_display_overlay_changed();
+        }
+        return;
+    }
+    if (cursor_sync()) {
+        lv_timer_pause(s_retry_timer);
+    } else {
+        lv_timer_resume(s_retry_timer);
+    }
+}
+
+static void retry_timer_cb(lv_timer_t *timer)
+{
+    sync_or_retry();
+}
+
+static void IRAM_ATTR flush_done_cb(void *user_ctx)
+{
+    s_flushing = false;
+}
+
+// Blend the cursor into an area LVGL is about to flush, after saving what it covers
+static void flush_start_cb(lv_event_t *e)
+{
+    const lv_area_t *area = (const lv_area_t *)lv_event_get_param(e);
+    s_flushing = true;
+
+    cursor_rect_t r;
+    if (!s_shown || area == NULL || !cursor_rect(s_shown_x, s_shown_y, &r)) {
+        return;
+    }
+
+    int32_t x1 = LV_MAX(r.x1, area->x1);
+    int32_t y1 = LV_MAX(r.y1, area->y1);
+    int32_t x2 = LV_MIN(r.x2, area->x2);
+    int32_t y2 = LV_MIN(r.y2, area->y2);
+    if (x1 > x2 || y1 > y2) {
+        return;
+    }
+
+    lv_draw_buf_t *buf = lv_display_get_buf_active(s_disp);
+    if (buf == NULL || buf->data == NULL) {
+        return;
+    }
+    uint32_t stride = buf->header.stride ? buf->header.stride : lv_area_get_width(area) * sizeof(uint16_t);
+
+    for (int32_t ly = y1; ly <= y2; ly++) {
+        uint16_t *dst = (uint16_t *)(buf->data + (ly - area->y1) * stride) + (x1 - area->x1);
+        int32_t row = (ly - s_shown_y) * s_w;
+        for (int32_t lx = x1; lx <= x2; lx++, dst++) {
+            int32_t i = row + lx - s_shown_x;
+            s_under[i] = *dst;
+            *dst = blend565(s_sprite[i], *dst, s_alpha[i]);
+        }
+    }
+}
+
+esp_err_t hal_cursor_init(lv_display_t *disp, const lv_image_dsc_t *img)
+{
+#if LV_COLOR_DEPTH != 16
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    if (disp == NULL || img == NULL || img->header.cf != LV_COLOR_FORMAT_RGB565A8 ||
+        img->header.w > HAL_CURSOR_MAX_SIZE || img->header.h > HAL_CURSOR_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret;
+    void *fb = NULL;
+    s_flipped = hal_display_is_tear_free();
+    if (s_flipped) {
+        // Each frame is composited into the buffer being flipped in
+        ret = hal_display_set_overlay(overlay_cb, NULL);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    } else {
+        esp_lcd_panel_handle_t panel = bsp_display_get_panel_handle();
+        if (panel == NULL) {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        ret = esp_lcd_dpi_panel_get_frame_buffer(panel, 1, &fb);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        ret = hal_display_add_flush_done_cb(flush_done_cb, NULL);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    s_disp = disp;
+    s_fb = (uint16_t *)fb;
+    s_fb_w = lv_display_get_physical_horizontal_resolution(disp);
+    s_fb_h = lv_display_get_physical_vertical_resolution(disp);
+    esp_cache_get_alignment(MALLOC_CAP_SPIRAM, &s_cache_align);
+    if (s_cache_align == 0) {
+        s_cache_align = 4;
+    }
+
+    // Color plane, then one alpha byte per pixel
+    s_w = img->header.w;
+    s_h = img->header.h;
+    uint32_t stride = img->header.stride ? img->header.stride : s_w * sizeof(uint16_t);
+    const uint8_t *alpha = img->data + stride * s_h;
+    for (int32_t y = 0; y < s_h; y++) {
+        memcpy(&s_sprite[y * s_w], img->data + y * stride, s_w * sizeof(uint16_t));
+        memcpy(&s_alpha[y * s_w], alpha + y * (stride / 2), s_w);
+    }
+
+    s_active = true;
+    if (s_flipped) {
+        printf("Cursor overlay composited into each flipped frame\n");
+        return ESP_OK;
+    }
+
+    s_retry_timer = lv_timer_create(retry_timer_cb, HAL_CURSOR_RETRY_MS, NULL);
+    lv_timer_pause(s_retry_timer);
+    lv_display_add_event_cb(disp, flush_start_cb, LV_EVENT_FLUSH_START, NULL);
+    printf("Cursor overlay composited into the frame buffer\n");
+    return ESP_OK;
+#endif
+}
+
+bool hal_cursor_is_active(void)
+{
+    return s_active;
+}
+
+void hal_cursor_set_visible(bool visible)
+{
+    if (!s_active) {
+        return;
+    }
+    s_visible = visible;
+    sync_or_retry();
+}
+
+void hal_cursor_set_pos(int32_t x, int32_t y)
+{
+    if (!s_active) {
+        return;
+    }
+    panel_to_lvgl(x, y, &s_x, &s_y);
+    sync_or_retry();
+}
@@ -0,0 +1,58 @@
+#ifndef HAL_CURSOR_H
+#define HAL_CURSOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest cursor image accepted, in pixels per side
+#ifndef HAL_CURSOR_MAX_SIZE
+#define HAL_CURSOR_MAX_SIZE 64
+#endif
+
+/**
+ * @brief Start the frame buffer cursor overlay
+ *
+ * The cursor is not an LVGL object, so moving it never re-renders the
+ * widgets below. With a single frame buffer it is blended into every area
+ * LVGL flushes and moved directly in the DPI frame buffer, saving and
+ * restoring the pixels under it. With tear-free rotation the display HAL
+ * composites it into each flipped frame, see hal_display_set_overlay().
+ * Unavailable in the port's avoid-tear mode.
+ *
+ * Call with the display lock held, after hal_display_tear_free_init().
+ *
+ * @param disp LVGL display
+ * @param img Cursor image, RGB565A8 with its hotspot at the top left corner
+ * @return ESP_OK, or an error if the caller should fall back to an LVGL cursor object
+ */
+esp_err_t hal_cursor_init(lv_display_t *disp, const lv_image_dsc_t *img);
+
+/**
+ * @brief Whether hal_cursor_init() succeeded
+ */
+bool hal_cursor_is_active(void);
+
+/**
+ * @brief Show or hide the cursor, LVGL task only
+ */
+void hal_cursor_set_visible(bool visible);
+
+/**
+ * @brief Move the cursor, LVGL task only
+ *
+ * @param x Hotspot in panel coordinates (unrotated), as pointer indevs report them
+ * @param y Hotspot in panel coordinates (unrotated)
+ */
+void hal_cursor_set_pos(int32_t x, int32_t y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_CURSOR_H
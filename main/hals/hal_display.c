@@ -1,15 +1,99 @@
 #include "hal_display.h"
+#include "hals/hal_flip.h"
+#include "managers/dlog.h"
+#include "managers/event_bus.h"
+#include "managers/metrics.h"
 #include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_lcd_mipi_dsi.h"
+#include "esp_lcd_panel_ops.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+// Callbacks chained on the DPI color transfer done interrupt
+#ifndef HAL_DISPLAY_MAX_FLUSH_DONE_CBS
+#define HAL_DISPLAY_MAX_FLUSH_DONE_CBS 4
+#endif
+
+// Draw rotated frames into the DPI frame buffers and flip them on vsync, see
+// hal_display_tear_free_init(). Needs two or three frame buffers from the BSP;
+// the port's own avoid-tear mode can't rotate and excludes it.
+#ifndef HAL_DISPLAY_TEAR_FREE
+#if CONFIG_BSP_LCD_DPI_BUFFER_NUMS > 1 && !CONFIG_BSP_DISPLAY_LVGL_AVOID_TEAR
+#define HAL_DISPLAY_TEAR_FREE 1
+#else
+#define HAL_DISPLAY_TEAR_FREE 0
+#endif
+#endif
+
+// Longest the LVGL task waits for a frame buffer to come off the screen
+#ifndef HAL_DISPLAY_BUFFER_WAIT_MS
+#define HAL_DISPLAY_BUFFER_WAIT_MS 100
+#endif
 
 // Current brightness level (0-100)
 static uint8_t current_brightness = 100;
 
+typedef struct {
+    hal_display_flush_done_cb_t cb;
+    void *user_ctx;
+} flush_done_entry_t;
+
+static flush_done_entry_t s_flush_done_cbs[HAL_DISPLAY_MAX_FLUSH_DONE_CBS];
+static volatile int s_flush_done_count = 0;
+static bool s_flush_done_hooked = false;
+
+static int32_t brightness_level(void)
+{
+    return current_brightness;
+}
+
+METRIC_COUNTER(s_frames, "display.frames", "frames")
+METRIC_HISTOGRAM(s_frame_us, "display.frame_time", "us", 2000, 5000, 10000, 16000, 33000, 50000, 100000)
+METRIC_GAUGE_FN(s_brightness, "display.brightness", "%", brightness_level)
+
+static int64_t s_refr_start_us = 0;
+static bool s_rendered = false;
+
+// Refresh cycles that found nothing to draw are not frames
+static void frame_metrics_cb(lv_event_t *e)
+{
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        s_refr_start_us = esp_timer_get_time();
+        s_rendered = false;
+        break;
+    case LV_EVENT_RENDER_START:
+        s_rendered = true;
+        break;
+    case LV_EVENT_REFR_READY:
+        if (s_rendered) {
+            metric_inc(&s_frames);
+            metric_observe(&s_frame_us, (uint32_t)(esp_timer_get_time() - s_refr_start_us));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 void hal_display_init(void)
 {
     // Initialize display brightness to maximum
     current_brightness = 100;
     hal_display_set_brightness(current_brightness);
     printf("Display HAL initialized with brightness: %d%%\n", current_brightness);
+
+    lv_display_t *disp = lv_display_get_default();
+    if (disp) {
+        bsp_display_lock(0);
+        lv_display_add_event_cb(disp, frame_metrics_cb, LV_EVENT_REFR_START, NULL);
+        lv_display_add_event_cb(disp, frame_metrics_cb, LV_EVENT_RENDER_START, NULL);
+        lv_display_add_event_cb(disp, frame_metrics_cb, LV_EVENT_REFR_READY, NULL);
+        bsp_display_unlock();
+    }
 }
 
 void hal_display_set_brightness(uint8_t brightness)
@@ -23,10 +107,14 @@ void hal_display_set_brightness(uint8_t brightness)
     }
     
     current_brightness = brightness;
-    printf("Setting display brightness to: %d%%\n", current_brightness);
+    // Runs for every step of a dragged slider
+    DLOG_D("Setting display brightness to: %d%%", current_brightness);
     
     // Use BSP function to set actual brightness
     bsp_display_brightness_set(current_brightness);
+
+    const event_t event = {.topic = EVENT_BRIGHTNESS, .brightness.percent = brightness};
+    event_bus_publish(&event);
 }
 
 uint8_t hal_display_get_brightness(void)
@@ -37,11 +125,353 @@ uint8_t hal_display_get_brightness(void)
 void hal_display_backlight_on(void)
 {
     bsp_display_backlight_on();
-    printf("Display backlight turned on\n");
+    DLOG_I("Display backlight turned on");
 }
 
 void hal_display_backlight_off(void)
 {
     bsp_display_backlight_off();
-    printf("Display backlight turned off\n");
-}
\ No newline at end of file
+    DLOG_I("Display backlight turned off");
+}
+
+#if HAL_DISPLAY_TEAR_FREE
+static bool s_tear_free = false;
+#endif
+
+#if !CONFIG_BSP_DISPLAY_LVGL_AVOID_TEAR
+static void IRAM_ATTR run_flush_done_cbs(void)
+{
+    int count = s_flush_done_count;
+    for (int i = 0; i < count; i++) {
+        s_flush_done_cbs[i].cb(s_flush_done_cbs[i].user_ctx);
+    }
+}
+
+static bool IRAM_ATTR flush_done_isr(esp_lcd_panel_handle_t panel, esp_lcd_dpi_panel_event_data_t *edata,
+                                     void *user_ctx)
+{
+#if HAL_DISPLAY_TEAR_FREE
+    // Flipping, the callbacks run when a frame goes on screen instead
+    if (!s_tear_free)
+#endif
+    {
+        run_flush_done_cbs();
+    }
+
+    // What the LVGL port's own callback does
+    lv_display_flush_ready((lv_display_t *)user_ctx);
+    return false;
+}
+#endif
+
+esp_err_t hal_display_add_flush_done_cb(hal_display_flush_done_cb_t cb, void *user_ctx)
+{
+#if CONFIG_BSP_DISPLAY_LVGL_AVOID_TEAR
+    // The port owns the refresh callbacks in avoid-tear mode
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_flush_done_count >= HAL_DISPLAY_MAX_FLUSH_DONE_CBS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (!s_flush_done_hooked) {
+        esp_lcd_panel_handle_t panel = bsp_display_get_panel_handle();
+        lv_display_t *disp = lv_display_get_default();
+        if (panel == NULL || disp == NULL) {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        const esp_lcd_dpi_panel_event_callbacks_t cbs = {
+            .on_color_trans_done = flush_done_isr,
+        };
+        esp_err_t ret = esp_lcd_dpi_panel_register_event_callbacks(panel, &cbs, disp);
+        if (ret != ESP_OK) {
+            printf("Failed to hook DPI flush completion\n");
+            return ret;
+        }
+        s_flush_done_hooked = true;
+    }
+
+    // Publish the entry before the interrupt can see it
+    s_flush_done_cbs[s_flush_done_count].cb = cb;
+    s_flush_done_cbs[s_flush_done_count].user_ctx = user_ctx;
+    __atomic_store_n(&s_flush_done_count, s_flush_done_count + 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/*                            Tear-free rotation                              */
+/* -------------------------------------------------------------------------- */
+
+#if HAL_DISPLAY_TEAR_FREE
+static hal_flip_t s_flip;
+static portMUX_TYPE s_flip_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_vsync_sem = NULL;
+static volatile bool s_waiting = false;
+static esp_lcd_panel_handle_t s_panel = NULL;
+static lv_display_t *s_disp = NULL;
+static int32_t s_fb_w = 0;
+static uint32_t s_bpp = 0;
+
+// Composited at flip time, see hal_display_set_overlay(); LVGL task only
+static hal_display_overlay_cb_t s_overlay_cb = NULL;
+static void *s_overlay_ctx = NULL;
+static bool s_overlay_pending = false;
+
+METRIC_HISTOGRAM(s_buffer_wait_us, "display.buffer_wait", "us", 500, 1000, 2000, 4000, 8000, 16000, 33000)
+METRIC_COUNTER(s_sync_pixels, "display.sync_pixels", "px")
+
+static void copy_area(void *dst, const void *src, const hal_flip_area_t *area, void *user_ctx)
+{
+    size_t offset = ((size_t)area->y1 * s_fb_w + area->x1) * s_bpp;
+    size_t stride = (size_t)s_fb_w * s_bpp;
+    size_t len = (size_t)(area->x2 - area->x1 + 1) * s_bpp;
+    for (int32_t y = area->y1; y <= area->y2; y++, offset += stride) {
+        memcpy((uint8_t *)dst + offset, (const uint8_t *)src + offset, len);
+    }
+}
+
+static bool IRAM_ATTR vsync_isr(esp_lcd_panel_handle_t panel, esp_lcd_dpi_panel_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t need_yield = pdFALSE;
+
+    portENTER_CRITICAL_ISR(&s_flip_lock);
+    bool shown = s_flip.queued >= 0;
+    bool changed = hal_flip_vsync(&s_flip);
+    portEXIT_CRITICAL_ISR(&s_flip_lock);
+
+    if (shown) {
+        run_flush_done_cbs();
+    }
+
+    if (changed && s_waiting) {
+        s_waiting = false;
+        xSemaphoreGiveFromISR(s_vsync_sem, &need_yield);
+    }
+    return need_yield == pdTRUE;
+}
+
+// Let the overlay take itself out of, or put itself into, the back buffer
+static void overlay_apply(bool show)
+{
+    lv_area_t area;
+    if (s_overlay_cb && s_overlay_cb(hal_flip_back_buffer(&s_flip), show, &area, s_overlay_ctx)) {
+        const hal_flip_area_t damage = {area.x1, area.y1, area.x2, area.y2};
+        hal_flip_add_damage(&s_flip, &damage);
+    }
+}
+
+// First flush of a frame: get a buffer off the screen and up to date
+static bool begin_frame(bool wait)
+{
+    int64_t start = esp_timer_get_time();
+    for (;;) {
+        portENTER_CRITICAL(&s_flip_lock);
+        bool ok = hal_flip_begin(&s_flip);
+        s_waiting = !ok && wait;
+        portEXIT_CRITICAL(&s_flip_lock);
+        if (ok) {
+            break;
+        }
+        if (!wait) {
+            return false;
+        }
+        // With two buffers this is the wait for the previous frame to go up
+        if (xSemaphoreTake(s_vsync_sem, pdMS_TO_TICKS(HAL_DISPLAY_BUFFER_WAIT_MS)) != pdTRUE) {
+            DLOG_W("display: no vsync in %d ms", HAL_DISPLAY_BUFFER_WAIT_MS);
+            return false;
+        }
+    }
+    metric_observe(&s_buffer_wait_us, (uint32_t)(esp_timer_get_time() - start));
+    metric_add(&s_sync_pixels, hal_flip_sync(&s_flip));
+    // The buffer now holds the overlay where the newest frame had it; LVGL's
+    // areas go in on top of what was under it
+    overlay_apply(false);
+    return true;
+}
+
+// Last flush of a frame: composite the overlay and queue the buffer
+static void end_frame(void)
+{
+    overlay_apply(true);
+    s_overlay_pending = false;
+
+    // Writes back the rows this frame touched and queues the buffer; the
+    // panel switches to it at the end of the frame being scanned. Done
+    // before the bookkeeping so the vsync that shows it can't be missed.
+    void *fb = hal_flip_back_buffer(&s_flip);
+    esp_lcd_panel_draw_bitmap(s_panel, 0, s_flip.rows_y1, s_fb_w, s_flip.rows_y2 + 1, fb);
+
+    portENTER_CRITICAL(&s_flip_lock);
+    hal_flip_end(&s_flip);
+    portEXIT_CRITICAL(&s_flip_lock);
+}
+
+// A refresh cycle is over. If it drew nothing the overlay still has to get on
+// screen, in a frame of its own; without a free buffer, try the next cycle.
+static void overlay_refr_ready_cb(lv_event_t *e)
+{
+    if (!s_overlay_pending || hal_flip_back_buffer(&s_flip) != NULL) {
+        return;
+    }
+    if (!begin_frame(false)) {
+        lv_timer_resume(lv_display_get_refr_timer(s_disp));
+        return;
+    }
+    end_frame();
+}
+
+// LVGL renders in its rotated coordinates into the draw buffer; each area
+// is rotated straight into the back frame buffer
+static void tear_free_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    if (hal_flip_back_buffer(&s_flip) == NULL && !begin_frame(true)) {
+        lv_display_flush_ready(disp);
+        return;
+    }
+
+    lv_area_t native = *area;
+    lv_display_rotate_area(disp, &native);
+    int32_t w = lv_area_get_width(area);
+    int32_t h = lv_area_get_height(area);
+    lv_color_format_t cf = lv_display_get_color_format(disp);
+    uint32_t src_stride = lv_draw_buf_width_to_stride(w, cf);
+    uint32_t dst_stride = s_fb_w * s_bpp;
+    uint8_t *dst = (uint8_t *)hal_flip_back_buffer(&s_flip) + native.y1 * dst_stride + native.x1 * s_bpp;
+
+    lv_display_rotation_t rotation = lv_display_get_rotation(disp);
+    if (rotation == LV_DISPLAY_ROTATION_0) {
+        for (int32_t y = 0; y < h; y++) {
+            memcpy(dst + y * dst_stride, px_map + y * src_stride, w * s_bpp);
+        }
+    } else {
+        // 90° goes through the tiled kernel, see hal_rotate_lvgl.h
+        lv_draw_sw_rotate(px_map, dst, w, h, src_stride, dst_stride, rotation, cf);
+    }
+
+    const hal_flip_area_t damage = {native.x1, native.y1, native.x2, native.y2};
+    hal_flip_add_damage(&s_flip, &damage);
+
+    if (lv_display_flush_is_last(disp)) {
+        end_frame();
+    }
+
+    // The draw buffer is free again; the wait for a frame buffer, if any,
+    // happens at the first flush of the next frame
+    lv_display_flush_ready(disp);
+}
+#endif
+
+esp_err_t hal_display_tear_free_init(lv_display_t *disp)
+{
+#if !HAL_DISPLAY_TEAR_FREE
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    esp_lcd_panel_handle_t panel = bsp_display_get_panel_handle();
+    if (disp == NULL || panel == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    void *fbs[HAL_FLIP_MAX_BUFFERS] = {NULL};
+#if CONFIG_BSP_LCD_DPI_BUFFER_NUMS == 2
+    esp_err_t ret = esp_lcd_dpi_panel_get_frame_buffer(panel, 2, &fbs[0], &fbs[1]);
+#else
+    esp_err_t ret = esp_lcd_dpi_panel_get_frame_buffer(panel, 3, &fbs[0], &fbs[1], &fbs[2]);
+#endif
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    s_vsync_sem = xSemaphoreCreateBinary();
+    if (s_vsync_sem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_panel = panel;
+    s_disp = disp;
+    s_fb_w = lv_display_get_physical_horizontal_resolution(disp);
+    s_bpp = lv_color_format_get_size(lv_display_get_color_format(disp));
+    // Everything so far went to buffer 0 through the port, which the panel scans
+    hal_flip_init(&s_flip, fbs, CONFIG_BSP_LCD_DPI_BUFFER_NUMS, s_fb_w,
+                  lv_display_get_physical_vertical_resolution(disp), copy_area, NULL);
+
+    // A flush of the port's may still be in flight and completes through
+    // flush_done_isr(), which hands it to LVGL. The driver also calls it from
+    // esp_lcd_panel_draw_bitmap() for every flip; a second flush ready is harmless.
+    const esp_lcd_dpi_panel_event_callbacks_t cbs = {
+        .on_color_trans_done = flush_done_isr,
+        .on_refresh_done = vsync_isr,
+    };
+    ret = esp_lcd_dpi_panel_register_event_callbacks(panel, &cbs, disp);
+    if (ret != ESP_OK) {
+        vSemaphoreDelete(s_vsync_sem);
+        s_vsync_sem = NULL;
+        return ret;
+    }
+
+    lv_display_set_flush_cb(disp, tear_free_flush_cb);
+    // Both interrupts are hooked now, flush done callbacks only need adding
+    s_flush_done_hooked = true;
+    s_tear_free = true;
+    printf("Display: tear-free rotation over %d frame buffers\n", CONFIG_BSP_LCD_DPI_BUFFER_NUMS);
+    return ESP_OK;
+#endif
+}
+
+esp_err_t hal_display_set_overlay(hal_display_overlay_cb_t cb, void *user_ctx)
+{
+#if HAL_DISPLAY_TEAR_FREE
+    if (!s_tear_free) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (s_overlay_cb != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_overlay_cb = cb;
+    s_overlay_ctx = user_ctx;
+    lv_display_add_event_cb(s_disp, overlay_refr_ready_cb, LV_EVENT_REFR_READY, NULL);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void hal_display_overlay_changed(void)
+{
+#if HAL_DISPLAY_TEAR_FREE
+    if (s_overlay_cb == NULL) {
+        return;
+    }
+    // The refresh timer pauses itself while nothing is invalidated
+    s_overlay_pending = true;
+    lv_timer_resume(lv_display_get_refr_timer(s_disp));
+#endif
+}
+
+bool hal_display_is_tear_free(void)
+{
+#if HAL_DISPLAY_TEAR_FREE
+    return s_tear_free;
+#else
+    return false;
+#endif
+}
+
+void *hal_display_get_frame_buffer(void)
+{
+#if HAL_DISPLAY_TEAR_FREE
+    if (s_tear_free) {
+        return hal_flip_front_buffer(&s_flip);
+    }
+#endif
+    void *fb = NULL;
+    esp_lcd_panel_handle_t panel = bsp_display_get_panel_handle();
+    if (panel == NULL || esp_lcd_dpi_panel_get_frame_buffer(panel, 1, &fb) != ESP_OK) {
+        return NULL;
+    }
+    return fb;
+}
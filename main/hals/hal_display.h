@@ -4,6 +4,15 @@
 #include <stdint.h>
 #include <bsp/esp-bsp.h>
 #include "lvgl.h"
+#include "esp_err.h"
+
+/**
+ * @brief Called when a flushed area has been copied into the panel frame buffer
+ *
+ * With tear-free rotation, called once per frame instead, at the vsync that
+ * puts the frame on screen. Runs in interrupt context, keep it short and IRAM safe.
+ */
+typedef void (*hal_display_flush_done_cb_t)(void *user_ctx);
 
 /**
  * @brief Initialize the display HAL
@@ -32,4 +41,87 @@ void hal_display_backlight_on(void);
  */
 void hal_display_backlight_off(void);
 
+/**
+ * @brief Add a callback to the DPI panel's color transfer done interrupt
+ *
+ * The display HAL owns that interrupt and still signals LVGL after the
+ * callbacks have run; with tear-free rotation they run from the vsync
+ * interrupt instead. Not available when the BSP runs in avoid-tear mode,
+ * where the LVGL port owns it.
+ *
+ * @param cb Callback, run in interrupt context
+ * @param user_ctx Passed to the callback
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED in avoid-tear mode, ESP_ERR_NO_MEM if all slots are taken
+ */
+esp_err_t hal_display_add_flush_done_cb(hal_display_flush_done_cb_t cb, void *user_ctx);
+
+/**
+ * @brief Switch LVGL output to tear-free rotated rendering
+ *
+ * Takes over the LVGL port's flush callback: flushed areas are rotated
+ * straight into one of the DPI panel's frame buffers, and a finished frame
+ * is shown from the next vsync, so a frame is never scanned out half drawn.
+ * Needs CONFIG_BSP_LCD_DPI_BUFFER_NUMS of 2 or 3. Call with the display lock
+ * held, after the rotation is set and before anything is drawn.
+ *
+ * Flush done callbacks then run once per frame, when it goes on screen.
+ *
+ * @param disp LVGL display of the DPI panel
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED with a single frame buffer
+ */
+esp_err_t hal_display_tear_free_init(lv_display_t *disp);
+
+/**
+ * @brief Overlay drawn into every flipped frame, on top of what LVGL drew
+ *
+ * Called on the LVGL task with the back frame buffer, in panel orientation.
+ * With show false, right after the buffer was brought up to the newest
+ * frame: put back the pixels the overlay covers there. With show true,
+ * after LVGL's areas went in: save what the overlay covers and draw it.
+ *
+ * @param fb Back frame buffer
+ * @param show Draw the overlay, or take it out
+ * @param area Set to the panel area changed, when returning true
+ * @param user_ctx As given to hal_display_set_overlay()
+ * @return true if pixels in area changed
+ */
+typedef bool (*hal_display_overlay_cb_t)(void *fb, bool show, lv_area_t *area, void *user_ctx);
+
+/**
+ * @brief Composite an overlay into each frame at flip time
+ *
+ * Lets something like a mouse cursor move without LVGL re-rendering what is
+ * below it: the areas the overlay changes are recorded as frame damage, so
+ * the other frame buffers pick them up like any LVGL area. Call with the
+ * display lock held.
+ *
+ * @param cb Overlay callback
+ * @param user_ctx Passed to the callback
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED without tear-free rotation,
+ *         ESP_ERR_INVALID_STATE if an overlay is already set
+ */
+esp_err_t hal_display_set_overlay(hal_display_overlay_cb_t cb, void *user_ctx);
+
+/**
+ * @brief Get the overlay onto the screen again, LVGL task only
+ *
+ * It goes in with the next LVGL frame, or in a frame of its own at the end
+ * of the next refresh cycle if that has nothing to draw.
+ */
+void hal_display_overlay_changed(void);
+
+/**
+ * @brief Whether hal_display_tear_free_init() took over the flush
+ *
+ * The buffer being scanned out then changes with every frame, so nothing
+ * may draw into a frame buffer behind LVGL's back; use hal_display_set_overlay().
+ */
+bool hal_display_is_tear_free(void);
+
+/**
+ * @brief Get the frame buffer being scanned out
+ * @return Frame buffer in panel orientation, NULL if the panel isn't up
+ */
+void *hal_display_get_frame_buffer(void);
+
 #endif // HAL_DISPLAY_H
\ No newline at end of file
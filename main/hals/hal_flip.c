@@ -0,0 +1,146 @@
+#include "hals/hal_flip.h"
+#include <string.h>
+
+static void rows_add(hal_flip_t *flip, const hal_flip_area_t *area)
+{
+    if (area->y1 < flip->rows_y1) {
+        flip->rows_y1 = area->y1;
+    }
+    if (area->y2 > flip->rows_y2) {
+        flip->rows_y2 = area->y2;
+    }
+}
+
+void hal_flip_init(hal_flip_t *flip, void *const *buffers, int count, int32_t width, int32_t height,
+                   hal_flip_copy_fn_t copy, void *user_ctx)
+{
+    memset(flip, 0, sizeof(*flip));
+    if (count > HAL_FLIP_MAX_BUFFERS) {
+        count = HAL_FLIP_MAX_BUFFERS;
+    }
+    for (int i = 0; i < count; i++) {
+        flip->buffers[i] = buffers[i];
+    }
+    flip->count = count;
+    flip->width = width;
+    flip->height = height;
+    flip->copy = copy;
+    flip->user_ctx = user_ctx;
+    flip->front = 0;
+    flip->queued = -1;
+    flip->retired = -1;
+    flip->back = -1;
+    flip->known[0] = true;
+}
+
+bool hal_flip_begin(hal_flip_t *flip)
+{
+    if (flip->back >= 0) {
+        return true;
+    }
+
+    // Of the free buffers, the one needing the least copying
+    int pick = -1;
+    for (int i = 0; i < flip->count; i++) {
+        if (i == flip->front || i == flip->queued || i == flip->retired) {
+            continue;
+        }
+        if (pick < 0 || (flip->known[i] && (!flip->known[pick] || flip->content[i] > flip->content[pick]))) {
+            pick = i;
+        }
+    }
+    if (pick < 0) {
+        return false;
+    }
+
+    flip->back = pick;
+    flip->damage.count = 0;
+    flip->rows_y1 = INT32_MAX;
+    flip->rows_y2 = -1;
+    return true;
+}
+
+static size_t copy_area(hal_flip_t *flip, int newest, const hal_flip_area_t *area)
+{
+    flip->copy(flip->buffers[flip->back], flip->buffers[newest], area, flip->user_ctx);
+    rows_add(flip, area);
+    return (size_t)(area->x2 - area->x1 + 1) * (area->y2 - area->y1 + 1);
+}
+
+size_t hal_flip_sync(hal_flip_t *flip)
+{
+    int back = flip->back;
+    if (back < 0) {
+        return 0;
+    }
+
+    int newest = -1;
+    for (int i = 0; i < flip->count; i++) {
+        if (i != back && flip->known[i] && flip->content[i] == flip->frame) {
+            newest = i;
+        }
+    }
+    if (newest < 0 || (flip->known[back] && flip->content[back] == flip->frame)) {
+        return 0;
+    }
+
+    size_t pixels = 0;
+    if (!flip->known[back] || flip->frame - flip->content[back] > HAL_FLIP_HISTORY) {
+        const hal_flip_area_t all = {0, 0, flip->width - 1, flip->height - 1};
+        pixels = copy_area(flip, newest, &all);
+    } else {
+        // Every area a newer frame changed, oldest first; overlaps are copied twice
+        for (uint32_t f = flip->content[back] + 1; f <= flip->frame; f++) {
+            const hal_flip_damage_t *damage = &flip->history[f % HAL_FLIP_HISTORY];
+            for (uint32_t i = 0; i < damage->count; i++) {
+                pixels += copy_area(flip, newest, &damage->areas[i]);
+            }
+        }
+    }
+
+    flip->content[back] = flip->frame;
+    flip->known[back] = true;
+    return pixels;
+}
+
+void hal_flip_add_damage(hal_flip_t *flip, const hal_flip_area_t *area)
+{
+    hal_flip_damage_t *damage = &flip->damage;
+    rows_add(flip, area);
+
+    if (damage->count < HAL_FLIP_MAX_AREAS) {
+        damage->areas[damage->count++] = *area;
+        return;
+    }
+
+    // Out of room: everything so far becomes one box
+    hal_flip_area_t box = *area;
+    for (uint32_t i = 0; i < damage->count; i++) {
+        const hal_flip_area_t *a = &damage->areas[i];
+        box.x1 = a->x1 < box.x1 ? a->x1 : box.x1;
+        box.y1 = a->y1 < box.y1 ? a->y1 : box.y1;
+        box.x2 = a->x2 > box.x2 ? a->x2 : box.x2;
+        box.y2 = a->y2 > box.y2 ? a->y2 : box.y2;
+    }
+    damage->areas[0] = box;
+    damage->count = 1;
+}
+
+int hal_flip_end(hal_flip_t *flip)
+{
+    int back = flip->back;
+
+    flip->frame++;
+    flip->history[flip->frame % HAL_FLIP_HISTORY] = flip->damage;
+    flip->content[back] = flip->frame;
+    flip->known[back] = true;
+
+    // A frame still waiting for its vsync is dropped, but the panel may
+    // already have switched to it
+    if (flip->queued >= 0) {
+        flip->retired = flip->queued;
+    }
+    flip->queued = back;
+    flip->back = -1;
+    return back;
+}
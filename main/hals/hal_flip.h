@@ -0,0 +1,142 @@
+#ifndef HAL_FLIP_H
+#define HAL_FLIP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Page flipping of partial updates over two or three frame buffers
+ *
+ * Bookkeeping only, no hardware: which buffer is on screen, which one is
+ * queued for the next vsync, which one is being drawn, and what has to be
+ * copied into a buffer before drawing so that it matches the newest frame.
+ * Only the areas changed since the buffer was last drawn are copied.
+ *
+ * The display HAL drives it from LVGL's flush callback and the DPI refresh
+ * interrupt; tools/flip_sim.c drives it on the host. Calls that change which
+ * buffer is where (begin, end, vsync) must not run concurrently, the caller
+ * provides the lock.
+ */
+
+#define HAL_FLIP_MAX_BUFFERS 3
+
+// Changed areas kept per frame; more are merged into their bounding box
+#ifndef HAL_FLIP_MAX_AREAS
+#define HAL_FLIP_MAX_AREAS 16
+#endif
+
+// Frames of changed areas kept; a buffer further behind is copied whole
+#define HAL_FLIP_HISTORY 4
+
+/**
+ * @brief Area in panel coordinates, inclusive
+ */
+typedef struct {
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+} hal_flip_area_t;
+
+/**
+ * @brief Copy an area from one frame buffer to another
+ */
+typedef void (*hal_flip_copy_fn_t)(void *dst, const void *src, const hal_flip_area_t *area, void *user_ctx);
+
+typedef struct {
+    hal_flip_area_t areas[HAL_FLIP_MAX_AREAS];
+    uint32_t count;
+} hal_flip_damage_t;
+
+typedef struct {
+    void *buffers[HAL_FLIP_MAX_BUFFERS];
+    int count;
+    int32_t width;
+    int32_t height;
+    hal_flip_copy_fn_t copy;
+    void *user_ctx;
+
+    int front;                  // Being scanned out
+    int queued;                 // Shown from the next vsync, -1 if none
+    int retired;                // Was queued and replaced before a vsync; may be scanned until the next one
+    int back;                   // Being drawn, -1 between frames
+    uint32_t frame;             // Frames finished
+    uint32_t content[HAL_FLIP_MAX_BUFFERS];     // Frame each buffer holds
+    bool known[HAL_FLIP_MAX_BUFFERS];           // False until a buffer has been brought up to date
+    hal_flip_damage_t history[HAL_FLIP_HISTORY];    // Areas frame n changed, at n % HAL_FLIP_HISTORY
+    hal_flip_damage_t damage;   // Areas of the frame being drawn
+    int32_t rows_y1;            // Rows written into the back buffer, copies included
+    int32_t rows_y2;
+} hal_flip_t;
+
+/**
+ * @brief Set up flipping over buffers of width x height pixels
+ *
+ * Buffer 0 must be the one on screen. The others are copied whole from the
+ * newest frame the first time they are drawn.
+ */
+void hal_flip_init(hal_flip_t *flip, void *const *buffers, int count, int32_t width, int32_t height,
+                   hal_flip_copy_fn_t copy, void *user_ctx);
+
+/**
+ * @brief Pick the buffer to draw the next frame into
+ * @return false if every buffer is on screen or queued; wait for a vsync and retry
+ */
+bool hal_flip_begin(hal_flip_t *flip);
+
+/**
+ * @brief Bring the buffer picked by hal_flip_begin() up to the newest frame
+ *
+ * Needs no lock: it only reads the newest buffer, which nothing writes.
+ *
+ * @return Pixels copied
+ */
+size_t hal_flip_sync(hal_flip_t *flip);
+
+/**
+ * @brief Record an area drawn into the back buffer
+ */
+void hal_flip_add_damage(hal_flip_t *flip, const hal_flip_area_t *area);
+
+/**
+ * @brief Queue the back buffer to be shown from the next vsync
+ * @return Index of the queued buffer
+ */
+int hal_flip_end(hal_flip_t *flip);
+
+/**
+ * @brief A frame finished scanning out: the queued buffer is now on screen
+ *
+ * Inline so the display HAL can call it from its interrupt handler.
+ *
+ * @return true if the buffer on screen changed or one was freed
+ */
+static inline bool hal_flip_vsync(hal_flip_t *flip)
+{
+    bool changed = flip->retired >= 0 || flip->queued >= 0;
+    flip->retired = -1;
+    if (flip->queued >= 0) {
+        flip->front = flip->queued;
+        flip->queued = -1;
+    }
+    return changed;
+}
+
+/**
+ * @brief Buffer being drawn, NULL between frames
+ */
+static inline void *hal_flip_back_buffer(const hal_flip_t *flip)
+{
+    return flip->back >= 0 ? flip->buffers[flip->back] : NULL;
+}
+
+/**
+ * @brief Buffer on screen
+ */
+static inline void *hal_flip_front_buffer(const hal_flip_t *flip)
+{
+    return flip->buffers[flip->front];
+}
+
+#endif // HAL_FLIP_H
@@ -0,0 +1,438 @@
+#include "hals/hal_hid_parser.h"
+#include <string.h>
+
+// Limits of the parser state, generous for keyboards, mice and gamepads
+#define MAX_USAGES          16
+#define MAX_REPORT_IDS      16
+#define MAX_GLOBAL_STACK    4
+#define MAX_COLLECTIONS     8
+
+// Item types and tags (HID 1.11, section 6.2.2)
+#define ITEM_TYPE_MAIN      0
+#define ITEM_TYPE_GLOBAL    1
+#define ITEM_TYPE_LOCAL     2
+
+#define MAIN_INPUT          0x8
+#define MAIN_OUTPUT         0x9
+#define MAIN_COLLECTION     0xA
+#define MAIN_FEATURE        0xB
+#define MAIN_END_COLLECTION 0xC
+
+#define GLOBAL_USAGE_PAGE   0x0
+#define GLOBAL_LOGICAL_MIN  0x1
+#define GLOBAL_LOGICAL_MAX  0x2
+#define GLOBAL_REPORT_SIZE  0x7
+#define GLOBAL_REPORT_ID    0x8
+#define GLOBAL_REPORT_COUNT 0x9
+#define GLOBAL_PUSH         0xA
+#define GLOBAL_POP          0xB
+
+#define LOCAL_USAGE         0x0
+#define LOCAL_USAGE_MIN     0x1
+#define LOCAL_USAGE_MAX     0x2
+
+#define INPUT_CONSTANT      0x01
+#define INPUT_VARIABLE      0x02
+#define INPUT_RELATIVE      0x04
+
+#define COLLECTION_APPLICATION 0x01
+
+#define LONG_ITEM_PREFIX    0xFE
+
+typedef struct {
+    uint16_t usage_page;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint8_t report_size;
+    uint8_t report_count;
+    uint8_t report_id;
+} global_state_t;
+
+typedef struct {
+    uint32_t usages[MAX_USAGES];    // (page << 16) | usage
+    uint8_t usage_count;
+    uint32_t usage_min;
+    uint32_t usage_max;
+    bool has_min;
+    bool has_max;
+} local_state_t;
+
+typedef struct {
+    global_state_t global;
+    global_state_t stack[MAX_GLOBAL_STACK];
+    uint8_t stack_depth;
+    local_state_t local;
+    uint32_t apps[MAX_COLLECTIONS];
+    uint8_t depth;
+    uint8_t report_ids[MAX_REPORT_IDS];
+    uint16_t report_bits[MAX_REPORT_IDS];
+    uint8_t report_id_count;
+} parser_t;
+
+// Usages without an explicit page take the current usage page
+static uint32_t full_usage(const parser_t *p, uint32_t value, uint8_t size)
+{
+    return (size == 4) ? value : (((uint32_t)p->global.usage_page << 16) | (value & 0xFFFF));
+}
+
+static uint16_t *report_offset(parser_t *p, uint8_t report_id)
+{
+    for (uint8_t i = 0; i < p->report_id_count; i++) {
+        if (p->report_ids[i] == report_id) {
+            return &p->report_bits[i];
+        }
+    }
+    if (p->report_id_count >= MAX_REPORT_IDS) {
+        return NULL;
+    }
+    p->report_ids[p->report_id_count] = report_id;
+    p->report_bits[p->report_id_count] = 0;
+    return &p->report_bits[p->report_id_count++];
+}
+
+static hal_hid_field_t *add_field(hal_hid_map_t *map, const parser_t *p, uint16_t bit_offset, uint8_t flags)
+{
+    if (map->field_count >= HAL_HID_MAX_FIELDS) {
+        map->truncated = true;
+        return NULL;
+    }
+
+    hal_hid_field_t *f = &map->fields[map->field_count++];
+    memset(f, 0, sizeof(*f));
+    f->app_usage = (p->depth > 0) ? p->apps[p->depth - 1] : 0;
+    f->report_id = p->global.report_id;
+    f->bit_offset = bit_offset;
+    f->bit_size = p->global.report_size;
+    f->count = 1;
+    f->flags = flags;
+    f->logical_min = p->global.logical_min;
+    f->logical_max = p->global.logical_max;
+    return f;
+}
+
+static void add_input(hal_hid_map_t *map, parser_t *p, uint32_t data)
+{
+    const global_state_t *g = &p->global;
+    const local_state_t *l = &p->local;
+    uint16_t *offset = report_offset(p, g->report_id);
+    uint32_t bits = (uint32_t)g->report_size * g->report_count;
+
+    if (offset == NULL) {
+        map->truncated = true;
+        return;
+    }
+
+    uint16_t start = *offset;
+    *offset += bits;
+
+    if ((data & INPUT_CONSTANT) || bits == 0 || g->report_size > 32) {
+        return;
+    }
+
+    uint8_t flags = ((data & INPUT_VARIABLE) ? HAL_HID_FIELD_VARIABLE : 0) |
+                    ((data & INPUT_RELATIVE) ? HAL_HID_FIELD_RELATIVE : 0);
+    bool has_range = l->has_min && l->has_max;
+
+    if ((flags & HAL_HID_FIELD_VARIABLE) && l->usage_count > 0) {
+        // Listed usages map one to one onto the elements, the last one repeats
+        for (uint8_t i = 0; i < g->report_count; i++) {
+            uint32_t usage = l->usages[(i < l->usage_count) ? i : l->usage_count - 1];
+            hal_hid_field_t *f = add_field(map, p, start + i * g->report_size, flags);
+            if (f == NULL) {
+                return;
+            }
+            f->usage_page = usage >> 16;
+            f->usage_min = usage & 0xFFFF;
+            f->usage_max = usage & 0xFFFF;
+        }
+        return;
+    }
+
+    uint32_t first;
+    uint32_t last;
+    if (has_range) {
+        first = l->usage_min;
+        last = l->usage_max;
+    } else if (l->usage_count > 0) {
+        first = l->usages[0];
+        last = l->usages[l->usage_count - 1];
+    } else {
+        return;
+    }
+
+    hal_hid_field_t *f = add_field(map, p, start, flags);
+    if (f == NULL) {
+        return;
+    }
+    f->usage_page = first >> 16;
+    f->usage_min = first & 0xFFFF;
+    f->usage_max = ((last >> 16) == (first >> 16) && (last & 0xFFFF) >= (first & 0xFFFF)) ? (last & 0xFFFF)
+                                                                                      : (first & 0xFFFF);
+    f->count = g->report_count;
+
+    if ((flags & HAL_HID_FIELD_VARIABLE) && (uint32_t)f->usage_max - f->usage_min + 1 > f->count) {
+        f->usage_max = f->usage_min + f->count - 1;
+    }
+}
+
+static int32_t sign_extend(uint32_t value, uint8_t size)
+{
+    switch (size) {
+        case 1: return (int8_t)value;
+        case 2: return (int16_t)value;
+        default: return (int32_t)value;
+    }
+}
+
+bool hal_hid_parse(const uint8_t *desc, size_t len, hal_hid_map_t *map)
+{
+    parser_t p;
+
+    memset(map, 0, sizeof(*map));
+    memset(&p, 0, sizeof(p));
+    if (desc == NULL) {
+        return false;
+    }
+
+    size_t pos = 0;
+    while (pos < len) {
+        uint8_t prefix = desc[pos++];
+
+        if (prefix == LONG_ITEM_PREFIX) {
+            // Long items carry nothing we use
+            if (pos >= len) {
+                return false;
+            }
+            pos += 2 + desc[pos];
+            continue;
+        }
+
+        uint8_t size = prefix & 0x03;
+        if (size == 3) {
+            size = 4;
+        }
+        uint8_t type = (prefix >> 2) & 0x03;
+        uint8_t tag = prefix >> 4;
+
+        if (pos + size > len) {
+            return false;
+        }
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < size; i++) {
+            value |= (uint32_t)desc[pos + i] << (8 * i);
+        }
+        pos += size;
+
+        if (type == ITEM_TYPE_GLOBAL) {
+            switch (tag) {
+                case GLOBAL_USAGE_PAGE:   p.global.usage_page = value; break;
+                case GLOBAL_LOGICAL_MIN:  p.global.logical_min = sign_extend(value, size); break;
+                case GLOBAL_LOGICAL_MAX:
+                    p.global.logical_max = sign_extend(value, size);
+                    // A positive range written without sign padding, e.g. 0..255 as 0xFF
+                    if (p.global.logical_max < p.global.logical_min) {
+                        p.global.logical_max = (int32_t)value;
+                    }
+                    break;
+                case GLOBAL_REPORT_SIZE:  p.global.report_size = value; break;
+                case GLOBAL_REPORT_COUNT: p.global.report_count = value; break;
+                case GLOBAL_REPORT_ID:
+                    p.global.report_id = value;
+                    map->uses_report_ids = true;
+                    break;
+                case GLOBAL_PUSH:
+                    if (p.stack_depth < MAX_GLOBAL_STACK) {
+                        p.stack[p.stack_depth++] = p.global;
+                    }
+                    break;
+                case GLOBAL_POP:
+                    if (p.stack_depth > 0) {
+                        p.global = p.stack[--p.stack_depth];
+                    }
+                    break;
+                default:
+                    break;
+            }
+        } else if (type == ITEM_TYPE_LOCAL) {
+            switch (tag) {
+                case LOCAL_USAGE:
+                    if (p.local.usage_count < MAX_USAGES) {
+                        p.local.usages[p.local.usage_count++] = full_usage(&p, value, size);
+                    }
+                    break;
+                case LOCAL_USAGE_MIN:
+                    p.local.usage_min = full_usage(&p, value, size);
+                    p.local.has_min = true;
+                    break;
+                case LOCAL_USAGE_MAX:
+                    p.local.usage_max = full_usage(&p, value, size);
+                    p.local.has_max = true;
+                    break;
+                default:
+                    break;
+            }
+        } else if (type == ITEM_TYPE_MAIN) {
+            switch (tag) {
+                case MAIN_INPUT:
+                    add_input(map, &p, value);
+                    break;
+                case MAIN_COLLECTION:
+                    if (p.depth < MAX_COLLECTIONS) {
+                        uint32_t parent = (p.depth > 0) ? p.apps[p.depth - 1] : 0;
+                        bool app = (value == COLLECTION_APPLICATION) && p.local.usage_count > 0;
+                        p.apps[p.depth] = app ? p.local.usages[0] : parent;
+                    }
+                    p.depth++;
+                    break;
+                case MAIN_END_COLLECTION:
+                    if (p.depth > 0) {
+                        p.depth--;
+                    }
+                    break;
+                case MAIN_OUTPUT:
+                case MAIN_FEATURE:
+                default:
+                    break;
+            }
+            memset(&p.local, 0, sizeof(p.local));
+        }
+    }
+
+    return map->field_count > 0;
+}
+
+const hal_hid_field_t *hal_hid_find(const hal_hid_map_t *map, uint32_t app_usage, uint16_t page,
+                                    uint16_t usage, uint8_t *index)
+{
+    for (uint8_t i = 0; i < map->field_count; i++) {
+        const hal_hid_field_t *f = &map->fields[i];
+
+        if (!(f->flags & HAL_HID_FIELD_VARIABLE) || f->usage_page != page ||
+            (app_usage != 0 && f->app_usage != app_usage)) {
+            continue;
+        }
+        if (usage >= f->usage_min && usage <= f->usage_max) {
+            if (index) {
+                *index = usage - f->usage_min;
+            }
+            return f;
+        }
+    }
+    return NULL;
+}
+
+const hal_hid_field_t *hal_hid_find_array(const hal_hid_map_t *map, uint32_t app_usage, uint16_t page,
+                                          const hal_hid_field_t *prev)
+{
+    uint8_t start = prev ? (uint8_t)(prev - map->fields) + 1 : 0;
+
+    for (uint8_t i = start; i < map->field_count; i++) {
+        const hal_hid_field_t *f = &map->fields[i];
+
+        if (!(f->flags & HAL_HID_FIELD_VARIABLE) && f->usage_page == page &&
+            (app_usage == 0 || f->app_usage == app_usage)) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+uint8_t hal_hid_report_id(const hal_hid_map_t *map, const uint8_t *report, size_t len)
+{
+    return (map->uses_report_ids && len > 0) ? report[0] : 0;
+}
+
+bool hal_hid_get(const hal_hid_map_t *map, const hal_hid_field_t *field, const uint8_t *report, size_t len,
+                 uint8_t index, int32_t *value)
+{
+    if (map->uses_report_ids) {
+        if (len == 0 || report[0] != field->report_id) {
+            return false;
+        }
+        report++;
+        len--;
+    }
+    if (index >= field->count) {
+        return false;
+    }
+
+    uint32_t bit = field->bit_offset + (uint32_t)index * field->bit_size;
+    uint8_t size = field->bit_size;
+    if (size == 0 || bit + size > len * 8) {
+        return false;
+    }
+
+    // Gather the bytes spanned by the element, at most 5 for a 32 bit value
+    uint32_t first = bit / 8;
+    uint32_t last = (bit + size - 1) / 8;
+    uint64_t raw = 0;
+    for (uint32_t i = first; i <= last; i++) {
+        raw |= (uint64_t)report[i] << (8 * (i - first));
+    }
+    raw >>= bit % 8;
+
+    uint32_t v = (size == 32) ? (uint32_t)raw : (uint32_t)(raw & ((1u << size) - 1));
+    if (field->logical_min < 0 && size < 32 && (v & (1u << (size - 1)))) {
+        v |= ~((1u << size) - 1);
+    }
+    *value = (int32_t)v;
+    return true;
+}
+
+const uint8_t hal_hid_boot_mouse_desc[] = {
+    0x05, 0x01,         // Usage Page (Generic Desktop)
+    0x09, 0x02,         // Usage (Mouse)
+    0xA1, 0x01,         // Collection (Application)
+    0x09, 0x01,         //   Usage (Pointer)
+    0xA1, 0x00,         //   Collection (Physical)
+    0x05, 0x09,         //     Usage Page (Button)
+    0x19, 0x01,         //     Usage Minimum (1)
+    0x29, 0x03,         //     Usage Maximum (3)
+    0x15, 0x00,         //     Logical Minimum (0)
+    0x25, 0x01,         //     Logical Maximum (1)
+    0x95, 0x03,         //     Report Count (3)
+    0x75, 0x01,         //     Report Size (1)
+    0x81, 0x02,         //     Input (Data, Variable, Absolute)
+    0x95, 0x01,         //     Report Count (1)
+    0x75, 0x05,         //     Report Size (5)
+    0x81, 0x01,         //     Input (Constant)
+    0x05, 0x01,         //     Usage Page (Generic Desktop)
+    0x09, 0x30,         //     Usage (X)
+    0x09, 0x31,         //     Usage (Y)
+    0x09, 0x38,         //     Usage (Wheel), sent by most boot mice as a 4th byte
+    0x15, 0x81,         //     Logical Minimum (-127)
+    0x25, 0x7F,         //     Logical Maximum (127)
+    0x75, 0x08,         //     Report Size (8)
+    0x95, 0x03,         //     Report Count (3)
+    0x81, 0x06,         //     Input (Data, Variable, Relative)
+    0xC0,               //   End Collection
+    0xC0,               // End Collection
+};
+const size_t hal_hid_boot_mouse_desc_len = sizeof(hal_hid_boot_mouse_desc);
+
+const uint8_t hal_hid_boot_keyboard_desc[] = {
+    0x05, 0x01,         // Usage Page (Generic Desktop)
+    0x09, 0x06,         // Usage (Keyboard)
+    0xA1, 0x01,         // Collection (Application)
+    0x05, 0x07,         //   Usage Page (Keyboard)
+    0x19, 0xE0,         //   Usage Minimum (Left Control)
+    0x29, 0xE7,         //   Usage Maximum (Right GUI)
+    0x15, 0x00,         //   Logical Minimum (0)
+    0x25, 0x01,         //   Logical Maximum (1)
+    0x75, 0x01,         //   Report Size (1)
+    0x95, 0x08,         //   Report Count (8)
+    0x81, 0x02,         //   Input (Data, Variable, Absolute)
+    0x95, 0x01,         //   Report Count (1)
+    0x75, 0x08,         //   Report Size (8)
+    0x81, 0x01,         //   Input (Constant)
+    0x95, 0x06,         //   Report Count (6)
+    0x75, 0x08,         //   Report Size (8)
+    0x15, 0x00,         //   Logical Minimum (0)
+    0x25, 0x65,         //   Logical Maximum (101)
+    0x05, 0x07,         //   Usage Page (Keyboard)
+    0x19, 0x00,         //   Usage Minimum (0)
+    0x29, 0x65,         //   Usage Maximum (101)
+    0x81, 0x00,         //   Input (Data, Array)
+    0xC0,               // End Collection
+};
+const size_t hal_hid_boot_keyboard_desc_len = sizeof(hal_hid_boot_keyboard_desc);
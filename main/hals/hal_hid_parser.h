@@ -0,0 +1,126 @@
+#ifndef HAL_HID_PARSER_H
+#define HAL_HID_PARSER_H
+
+// Plain C, no ESP-IDF dependencies and no dynamic memory
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Input fields kept per interface, descriptors with more are truncated
+#ifndef HAL_HID_MAX_FIELDS
+#define HAL_HID_MAX_FIELDS 32
+#endif
+
+// Usage pages
+#define HAL_HID_PAGE_GENERIC_DESKTOP    0x01
+#define HAL_HID_PAGE_KEYBOARD           0x07
+#define HAL_HID_PAGE_BUTTON             0x09
+#define HAL_HID_PAGE_CONSUMER           0x0C
+
+// Generic desktop usages
+#define HAL_HID_USAGE_POINTER           0x01
+#define HAL_HID_USAGE_MOUSE             0x02
+#define HAL_HID_USAGE_JOYSTICK          0x04
+#define HAL_HID_USAGE_GAMEPAD           0x05
+#define HAL_HID_USAGE_KEYBOARD          0x06
+#define HAL_HID_USAGE_X                 0x30
+#define HAL_HID_USAGE_Y                 0x31
+#define HAL_HID_USAGE_WHEEL             0x38
+#define HAL_HID_USAGE_HAT_SWITCH        0x39
+
+// Consumer usages
+#define HAL_HID_USAGE_AC_PAN            0x238
+
+// Application collection as (page << 16) | usage
+#define HAL_HID_APP(page, usage)        (((uint32_t)(page) << 16) | (usage))
+
+// Field flags, from the Input item
+#define HAL_HID_FIELD_VARIABLE          0x01    // One value per usage, otherwise an array of usage indices
+#define HAL_HID_FIELD_RELATIVE          0x02
+
+/**
+ * @brief One Input item, or one element of it when it lists its usages one by one
+ */
+typedef struct {
+    uint32_t app_usage;     // Enclosing application collection, HAL_HID_APP()
+    uint16_t usage_page;
+    uint16_t usage_min;     // Usage of the first element (variable) or of value logical_min (array)
+    uint16_t usage_max;
+    uint16_t bit_offset;    // From the first byte after the report ID
+    uint8_t report_id;      // 0 when the device doesn't use report IDs
+    uint8_t bit_size;
+    uint8_t count;
+    uint8_t flags;          // HAL_HID_FIELD_*
+    int32_t logical_min;
+    int32_t logical_max;
+} hal_hid_field_t;
+
+/**
+ * @brief Input report layout of one interface
+ */
+typedef struct {
+    hal_hid_field_t fields[HAL_HID_MAX_FIELDS];
+    uint8_t field_count;
+    bool uses_report_ids;
+    bool truncated;         // Some fields didn't fit
+} hal_hid_map_t;
+
+/**
+ * @brief Parse a report descriptor into the input fields it declares
+ *
+ * Done once at connect time, decoding a report afterwards is only bit
+ * extraction through the fields found here.
+ *
+ * @return false if the descriptor is malformed or declares no input
+ */
+bool hal_hid_parse(const uint8_t *desc, size_t len, hal_hid_map_t *map);
+
+/**
+ * @brief Find the variable field carrying a usage
+ *
+ * @param app_usage Application collection to look in, 0 for any
+ * @param index Element of the returned field holding the usage
+ * @return Field, or NULL if the usage isn't reported
+ */
+const hal_hid_field_t *hal_hid_find(const hal_hid_map_t *map, uint32_t app_usage, uint16_t page,
+                                    uint16_t usage, uint8_t *index);
+
+/**
+ * @brief Find the next array field of a usage page, starting after prev (NULL for the first)
+ */
+const hal_hid_field_t *hal_hid_find_array(const hal_hid_map_t *map, uint32_t app_usage, uint16_t page,
+                                          const hal_hid_field_t *prev);
+
+/**
+ * @brief Report ID of a raw input report, 0 when the device doesn't use them
+ */
+uint8_t hal_hid_report_id(const hal_hid_map_t *map, const uint8_t *report, size_t len);
+
+/**
+ * @brief Extract one element of a field from a raw input report
+ *
+ * Values are sign extended when the field's logical minimum is negative.
+ *
+ * @return false if the report is another report ID or too short
+ */
+bool hal_hid_get(const hal_hid_map_t *map, const hal_hid_field_t *field, const uint8_t *report, size_t len,
+                 uint8_t index, int32_t *value);
+
+/**
+ * @brief Boot protocol report descriptors from the HID specification, appendix B
+ */
+extern const uint8_t hal_hid_boot_mouse_desc[];
+extern const size_t hal_hid_boot_mouse_desc_len;
+extern const uint8_t hal_hid_boot_keyboard_desc[];
+extern const size_t hal_hid_boot_keyboard_desc_len;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_HID_PARSER_H
@@ -0,0 +1,581 @@
+#include "hals/hal_i2c_bus.h"
+#include "managers/metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+// Arbiter runs above the LVGL task (4) so queued touch reads start right away
+#ifndef HAL_I2C_BUS_TASK_PRIORITY
+#define HAL_I2C_BUS_TASK_PRIORITY 6
+#endif
+
+#ifndef HAL_I2C_BUS_JOB_POOL_SIZE
+#define HAL_I2C_BUS_JOB_POOL_SIZE 16
+#endif
+
+// Queued reads whose combined register range fits in this span become one burst
+#ifndef HAL_I2C_BUS_MERGE_SPAN
+#define HAL_I2C_BUS_MERGE_SPAN 16
+#endif
+
+#ifndef HAL_I2C_BUS_MERGE_MAX
+#define HAL_I2C_BUS_MERGE_MAX 8
+#endif
+
+// Print the occupancy report every N ms, 0 to disable
+#ifndef HAL_I2C_BUS_STATS_PERIOD_MS
+#define HAL_I2C_BUS_STATS_PERIOD_MS 0
+#endif
+
+#define HAL_I2C_BUS_TIMEOUT_MS 50
+
+typedef enum {
+    I2C_JOB_FN = 0,
+    I2C_JOB_READ,
+} i2c_job_type_t;
+
+typedef struct i2c_job {
+    struct i2c_job* next;
+    i2c_job_type_t type;
+    hal_i2c_dev_t dev;
+    hal_i2c_prio_t prio;
+    bool async;
+    uint32_t key;
+    // I2C_JOB_FN
+    hal_i2c_job_fn_t fn;
+    void* arg;
+    // I2C_JOB_READ
+    uint8_t reg;
+    uint8_t* buf;
+    size_t len;
+    // Completion
+    int64_t queued_us;
+    esp_err_t result;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buf;
+} i2c_job_t;
+
+typedef struct {
+    i2c_job_t* head;
+    i2c_job_t* tail;
+} i2c_job_queue_t;
+
+static i2c_job_t s_jobs[HAL_I2C_BUS_JOB_POOL_SIZE];
+static i2c_job_t* s_free_list = NULL;
+static SemaphoreHandle_t s_free_count = NULL;
+static i2c_job_queue_t s_queues[HAL_I2C_PRIO_MAX];
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_task_handle = NULL;
+
+static i2c_master_dev_handle_t s_dev_handles[HAL_I2C_DEV_MAX];
+static hal_i2c_dev_stats_t s_stats[HAL_I2C_DEV_MAX];
+static uint32_t s_prio_max_wait_us[HAL_I2C_PRIO_MAX];
+static int64_t s_stats_start_us = 0;
+
+// Registers a read changes, such as clear-on-read interrupt status. A merged
+// burst only covers one of them when a merged read asked for it.
+#define MAX_READ_SENSITIVE 2
+
+static const struct {
+    uint8_t count;
+    uint8_t regs[MAX_READ_SENSITIVE];
+} s_read_sensitive[HAL_I2C_DEV_MAX] = {
+    [HAL_I2C_DEV_EXPANDER1] = {1, {0x13}},     // PI4IOE5V6408 interrupt status
+    [HAL_I2C_DEV_EXPANDER2] = {1, {0x13}},
+};
+
+static const char* s_dev_names[HAL_I2C_DEV_MAX] = {
+    [HAL_I2C_DEV_TOUCH] = "touch",
+    [HAL_I2C_DEV_CODEC] = "codec",
+    [HAL_I2C_DEV_EXPANDER1] = "pi4ioe1",
+    [HAL_I2C_DEV_EXPANDER2] = "pi4ioe2",
+    [HAL_I2C_DEV_SENSOR] = "sensor",
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                Job pool                                    */
+/* -------------------------------------------------------------------------- */
+
+static i2c_job_t* job_alloc(TickType_t wait)
+{
+    if (xSemaphoreTake(s_free_count, wait) != pdTRUE) {
+        return NULL;
+    }
+
+    taskENTER_CRITICAL(&s_lock);
+    i2c_job_t* job = s_free_list;
+    s_free_list = job->next;
+    taskEXIT_CRITICAL(&s_lock);
+
+    job->next = NULL;
+    return job;
+}
+
+static void job_free(i2c_job_t* job)
+{
+    taskENTER_CRITICAL(&s_lock);
+    job->next = s_free_list;
+    s_free_list = job;
+    taskEXIT_CRITICAL(&s_lock);
+
+    xSemaphoreGive(s_free_count);
+}
+
+static void job_enqueue(i2c_job_t* job)
+{
+    i2c_job_queue_t* queue = &s_queues[job->prio];
+
+    job->next = NULL;
+    job->queued_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_lock);
+    if (queue->tail) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+    taskEXIT_CRITICAL(&s_lock);
+
+    xTaskNotifyGive(s_task_handle);
+}
+
+// Pop the oldest job of the highest non-empty priority
+static i2c_job_t* job_dequeue(void)
+{
+    i2c_job_t* job = NULL;
+
+    taskENTER_CRITICAL(&s_lock);
+    for (int prio = 0; prio < HAL_I2C_PRIO_MAX; prio++) {
+        i2c_job_queue_t* queue = &s_queues[prio];
+        if (queue->head) {
+            job = queue->head;
+            queue->head = job->next;
+            if (queue->head == NULL) {
+                queue->tail = NULL;
+            }
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    return job;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Execution                                    */
+/* -------------------------------------------------------------------------- */
+
+// Totals for the metrics registry; unlike s_stats these are never reset
+METRIC_COUNTER(s_transactions, "i2c.transactions", "transactions")
+METRIC_COUNTER(s_busy_us, "i2c.busy_time", "us")
+METRIC_HISTOGRAM(s_wait_us, "i2c.queue_wait", "us", 50, 100, 250, 500, 1000, 5000, 20000)
+
+static void job_complete(i2c_job_t* job, esp_err_t result, int64_t start_us)
+{
+    uint32_t wait_us = (start_us > job->queued_us) ? (uint32_t)(start_us - job->queued_us) : 0;
+    metric_observe(&s_wait_us, wait_us);
+
+    taskENTER_CRITICAL(&s_lock);
+    if (wait_us > s_stats[job->dev].max_wait_us) {
+        s_stats[job->dev].max_wait_us = wait_us;
+    }
+    if (wait_us > s_prio_max_wait_us[job->prio]) {
+        s_prio_max_wait_us[job->prio] = wait_us;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (job->async) {
+        job_free(job);
+    } else {
+        job->result = result;
+        xSemaphoreGive(job->done);
+    }
+}
+
+static void account_busy(hal_i2c_dev_t dev, int64_t start_us, uint32_t merged)
+{
+    int64_t busy_us = esp_timer_get_time() - start_us;
+
+    taskENTER_CRITICAL(&s_lock);
+    s_stats[dev].transactions++;
+    s_stats[dev].merged_reads += merged;
+    s_stats[dev].busy_us += busy_us;
+    taskEXIT_CRITICAL(&s_lock);
+
+    metric_inc(&s_transactions);
+    metric_add(&s_busy_us, (uint32_t)busy_us);
+}
+
+static esp_err_t read_regs_direct(hal_i2c_dev_t dev, uint8_t reg, uint8_t* buf, size_t len)
+{
+    if (s_dev_handles[dev] == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return i2c_master_transmit_receive(s_dev_handles[dev], &reg, 1, buf, len, HAL_I2C_BUS_TIMEOUT_MS);
+}
+
+static void run_fn_job(i2c_job_t* job)
+{
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t result = job->fn(job->arg);
+    account_busy(job->dev, start_us, 0);
+    job_complete(job, result, start_us);
+}
+
+static bool read_covers(const i2c_job_t* job, unsigned reg)
+{
+    return reg >= job->reg && reg < (unsigned)job->reg + job->len;
+}
+
+// Whether a burst over [lo, hi) only reads side-effect registers that one of
+// the reads in it, or the candidate, asked for
+static bool burst_is_safe(i2c_job_t* const* batch, int count, const i2c_job_t* candidate, unsigned lo, unsigned hi)
+{
+    hal_i2c_dev_t dev = candidate->dev;
+    for (int r = 0; r < s_read_sensitive[dev].count; r++) {
+        unsigned reg = s_read_sensitive[dev].regs[r];
+        if (reg < lo || reg >= hi || read_covers(candidate, reg)) {
+            continue;
+        }
+        bool asked = false;
+        for (int i = 0; i < count && !asked; i++) {
+            asked = read_covers(batch[i], reg);
+        }
+        if (!asked) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run a read and every queued read it can be merged with as one burst
+static void run_read_job(i2c_job_t* first)
+{
+    i2c_job_t* batch[HAL_I2C_BUS_MERGE_MAX];
+    int count = 0;
+    uint8_t lo = first->reg;
+    unsigned hi = first->reg + first->len;
+
+    batch[count++] = first;
+
+    if (first->len <= HAL_I2C_BUS_MERGE_SPAN) {
+        i2c_job_queue_t* queue = &s_queues[first->prio];
+
+        taskENTER_CRITICAL(&s_lock);
+        i2c_job_t* prev = NULL;
+        i2c_job_t* job = queue->head;
+        while (job && count < HAL_I2C_BUS_MERGE_MAX) {
+            i2c_job_t* next = job->next;
+            // Jobs of one device run in order: a read can't be pulled ahead of a write
+            if (job->dev == first->dev && job->type != I2C_JOB_READ) {
+                break;
+            }
+
+            uint8_t new_lo = (job->reg < lo) ? job->reg : lo;
+            unsigned job_hi = job->reg + job->len;
+            unsigned new_hi = (job_hi > hi) ? job_hi : hi;
+
+            if (job->type == I2C_JOB_READ && job->dev == first->dev &&
+                new_hi - new_lo <= HAL_I2C_BUS_MERGE_SPAN &&
+                burst_is_safe(batch, count, job, new_lo, new_hi)) {
+                // Unlink and take it into the burst
+                if (prev) {
+                    prev->next = next;
+                } else {
+                    queue->head = next;
+                }
+                if (queue->tail == job) {
+                    queue->tail = prev;
+                }
+                batch[count++] = job;
+                lo = new_lo;
+                hi = new_hi;
+            } else if (job->dev == first->dev) {
+                // Nor ahead of another read of the device that stays queued
+                break;
+            } else {
+                prev = job;
+            }
+            job = next;
+        }
+        taskEXIT_CRITICAL(&s_lock);
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t result;
+
+    if (count == 1) {
+        result = read_regs_direct(first->dev, first->reg, first->buf, first->len);
+    } else {
+        uint8_t burst[HAL_I2C_BUS_MERGE_SPAN];
+        result = read_regs_direct(first->dev, lo, burst, hi - lo);
+        if (result == ESP_OK) {
+            for (int i = 0; i < count; i++) {
+                memcpy(batch[i]->buf, &burst[batch[i]->reg - lo], batch[i]->len);
+            }
+        }
+    }
+
+    account_busy(first->dev, start_us, count - 1);
+    for (int i = 0; i < count; i++) {
+        job_complete(batch[i], result, start_us);
+    }
+}
+
+static void print_stats_if_due(void)
+{
+#if HAL_I2C_BUS_STATS_PERIOD_MS > 0
+    if (esp_timer_get_time() - s_stats_start_us >= (int64_t)HAL_I2C_BUS_STATS_PERIOD_MS * 1000) {
+        hal_i2c_bus_print_stats();
+        hal_i2c_bus_reset_stats();
+    }
+#endif
+}
+
+static void i2c_bus_task(void* arg)
+{
+#if HAL_I2C_BUS_STATS_PERIOD_MS > 0
+    const TickType_t idle_wait = pdMS_TO_TICKS(HAL_I2C_BUS_STATS_PERIOD_MS);
+#else
+    const TickType_t idle_wait = portMAX_DELAY;
+#endif
+
+    while (1) {
+        i2c_job_t* job = job_dequeue();
+        if (job == NULL) {
+            ulTaskNotifyTake(pdTRUE, idle_wait);
+            print_stats_if_due();
+            continue;
+        }
+
+        if (job->type == I2C_JOB_READ) {
+            run_read_job(job);
+        } else {
+            run_fn_job(job);
+        }
+    }
+}
+
+// Before the arbiter runs, and for jobs that queue more jobs, run in the caller
+static bool run_inline(void)
+{
+    return s_task_handle == NULL || xTaskGetCurrentTaskHandle() == s_task_handle;
+}
+
+static esp_err_t submit_and_wait(i2c_job_t* job)
+{
+    job_enqueue(job);
+    xSemaphoreTake(job->done, portMAX_DELAY);
+
+    esp_err_t result = job->result;
+    job_free(job);
+    return result;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Public API                                   */
+/* -------------------------------------------------------------------------- */
+
+void hal_i2c_bus_init(void)
+{
+    if (s_task_handle != NULL) {
+        return;
+    }
+
+    s_free_count = xSemaphoreCreateCounting(HAL_I2C_BUS_JOB_POOL_SIZE, HAL_I2C_BUS_JOB_POOL_SIZE);
+    if (s_free_count == NULL) {
+        printf("Failed to create I2C job pool semaphore\n");
+        return;
+    }
+
+    for (int i = 0; i < HAL_I2C_BUS_JOB_POOL_SIZE; i++) {
+        s_jobs[i].done = xSemaphoreCreateBinaryStatic(&s_jobs[i].done_buf);
+        s_jobs[i].next = s_free_list;
+        s_free_list = &s_jobs[i];
+    }
+
+    hal_i2c_bus_reset_stats();
+
+    if (xTaskCreate(i2c_bus_task, "i2c_bus", 4096, NULL, HAL_I2C_BUS_TASK_PRIORITY, &s_task_handle) != pdPASS) {
+        printf("Failed to create I2C bus task\n");
+        s_task_handle = NULL;
+        return;
+    }
+
+    printf("I2C bus arbiter started\n");
+}
+
+void hal_i2c_bus_set_device_handle(hal_i2c_dev_t dev, i2c_master_dev_handle_t handle)
+{
+    if (dev < HAL_I2C_DEV_MAX) {
+        s_dev_handles[dev] = handle;
+    }
+}
+
+esp_err_t hal_i2c_bus_run(hal_i2c_dev_t dev, hal_i2c_prio_t prio, hal_i2c_job_fn_t fn, void* arg)
+{
+    if (dev >= HAL_I2C_DEV_MAX || prio >= HAL_I2C_PRIO_MAX || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (run_inline()) {
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t result = fn(arg);
+        account_busy(dev, start_us, 0);
+        return result;
+    }
+
+    i2c_job_t* job = job_alloc(portMAX_DELAY);
+    job->type = I2C_JOB_FN;
+    job->dev = dev;
+    job->prio = prio;
+    job->async = false;
+    job->key = 0;
+    job->fn = fn;
+    job->arg = arg;
+
+    return submit_and_wait(job);
+}
+
+esp_err_t hal_i2c_bus_post(hal_i2c_dev_t dev, hal_i2c_prio_t prio, hal_i2c_job_fn_t fn, void* arg, uint32_t key)
+{
+    if (dev >= HAL_I2C_DEV_MAX || prio >= HAL_I2C_PRIO_MAX || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (run_inline()) {
+        return hal_i2c_bus_run(dev, prio, fn, arg);
+    }
+
+    // Replace a pending job with the same key instead of queueing another one
+    if (key != 0) {
+        bool replaced = false;
+
+        taskENTER_CRITICAL(&s_lock);
+        for (i2c_job_t* job = s_queues[prio].head; job; job = job->next) {
+            if (job->async && job->key == key) {
+                job->fn = fn;
+                job->arg = arg;
+                s_stats[dev].coalesced++;
+                replaced = true;
+                break;
+            }
+        }
+        taskEXIT_CRITICAL(&s_lock);
+
+        if (replaced) {
+            return ESP_OK;
+        }
+    }
+
+    i2c_job_t* job = job_alloc(0);
+    if (job == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    job->type = I2C_JOB_FN;
+    job->dev = dev;
+    job->prio = prio;
+    job->async = true;
+    job->key = key;
+    job->fn = fn;
+    job->arg = arg;
+    job_enqueue(job);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_i2c_bus_read_regs(hal_i2c_dev_t dev, hal_i2c_prio_t prio, uint8_t reg, uint8_t* buf, size_t len)
+{
+    if (dev >= HAL_I2C_DEV_MAX || prio >= HAL_I2C_PRIO_MAX || buf == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (run_inline()) {
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t result = read_regs_direct(dev, reg, buf, len);
+        account_busy(dev, start_us, 0);
+        return result;
+    }
+
+    i2c_job_t* job = job_alloc(portMAX_DELAY);
+    job->type = I2C_JOB_READ;
+    job->dev = dev;
+    job->prio = prio;
+    job->async = false;
+    job->key = 0;
+    job->reg = reg;
+    job->buf = buf;
+    job->len = len;
+
+    return submit_and_wait(job);
+}
+
+void hal_i2c_bus_get_stats(hal_i2c_dev_stats_t* stats, uint64_t* window_us)
+{
+    taskENTER_CRITICAL(&s_lock);
+    memcpy(stats, s_stats, sizeof(s_stats));
+    int64_t start_us = s_stats_start_us;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (window_us) {
+        *window_us = esp_timer_get_time() - start_us;
+    }
+}
+
+uint32_t hal_i2c_bus_get_max_wait_us(hal_i2c_prio_t prio)
+{
+    if (prio >= HAL_I2C_PRIO_MAX) {
+        return 0;
+    }
+    return s_prio_max_wait_us[prio];
+}
+
+void hal_i2c_bus_reset_stats(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    memset(s_stats, 0, sizeof(s_stats));
+    memset(s_prio_max_wait_us, 0, sizeof(s_prio_max_wait_us));
+    for (int i = 0; i < HAL_I2C_DEV_MAX; i++) {
+        s_stats[i].name = s_dev_names[i];
+    }
+    s_stats_start_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void hal_i2c_bus_print_stats(void)
+{
+    hal_i2c_dev_stats_t stats[HAL_I2C_DEV_MAX];
+    uint64_t window_us = 0;
+
+    hal_i2c_bus_get_stats(stats, &window_us);
+    if (window_us == 0) {
+        return;
+    }
+
+    uint64_t total_busy_us = 0;
+    printf("I2C bus occupancy over %llu ms:\n", window_us / 1000);
+    for (int i = 0; i < HAL_I2C_DEV_MAX; i++) {
+        if (stats[i].transactions == 0 && stats[i].coalesced == 0) {
+            continue;
+        }
+        total_busy_us += stats[i].busy_us;
+        printf("  %-8s tx %6lu  merged %4lu  coalesced %4lu  busy %8llu us (%5.2f%%)  max wait %6lu us\n",
+               stats[i].name,
+               (unsigned long)stats[i].transactions,
+               (unsigned long)stats[i].merged_reads,
+               (unsigned long)stats[i].coalesced,
+               stats[i].busy_us,
+               (double)stats[i].busy_us * 100.0 / (double)window_us,
+               (unsigned long)stats[i].max_wait_us);
+    }
+    printf("  total busy %.2f%%, max wait touch %lu us, normal %lu us, housekeeping %lu us\n",
+           (double)total_busy_us * 100.0 / (double)window_us,
+           (unsigned long)s_prio_max_wait_us[HAL_I2C_PRIO_TOUCH],
+           (unsigned long)s_prio_max_wait_us[HAL_I2C_PRIO_NORMAL],
+           (unsigned long)s_prio_max_wait_us[HAL_I2C_PRIO_HOUSEKEEPING]);
+}
@@ -0,0 +1,151 @@
+#ifndef HAL_I2C_BUS_H
+#define HAL_I2C_BUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Transaction priority on the internal I2C bus
+ *
+ * The arbiter always runs the oldest job of the highest non-empty priority,
+ * so a touch read waits for at most the one transaction already on the wire.
+ */
+typedef enum {
+    HAL_I2C_PRIO_TOUCH = 0,         // Touch controller reads, latency critical
+    HAL_I2C_PRIO_NORMAL,            // User triggered traffic (codec volume, route switching)
+    HAL_I2C_PRIO_HOUSEKEEPING,      // Expander flushes, sensor polling
+    HAL_I2C_PRIO_MAX
+} hal_i2c_prio_t;
+
+/**
+ * @brief Devices on the internal I2C bus, used for occupancy accounting
+ */
+typedef enum {
+    HAL_I2C_DEV_TOUCH = 0,          // GT911
+    HAL_I2C_DEV_CODEC,              // ES8388 / ES7210
+    HAL_I2C_DEV_EXPANDER1,          // PI4IOE5V6408 @ 0x43
+    HAL_I2C_DEV_EXPANDER2,          // PI4IOE5V6408 @ 0x44
+    HAL_I2C_DEV_SENSOR,             // RTC / INA226 / IMU
+    HAL_I2C_DEV_MAX
+} hal_i2c_dev_t;
+
+/**
+ * @brief Coalescing keys for hal_i2c_bus_post()
+ */
+enum {
+    HAL_I2C_KEY_NONE = 0,
+    HAL_I2C_KEY_EXPANDER1_FLUSH,
+    HAL_I2C_KEY_EXPANDER2_FLUSH,
+    HAL_I2C_KEY_CODEC_VOLUME,
+};
+
+/**
+ * @brief Bus job, runs on the arbiter task with exclusive use of the bus
+ */
+typedef esp_err_t (*hal_i2c_job_fn_t)(void *arg);
+
+/**
+ * @brief Per device bus statistics since the last reset
+ */
+typedef struct {
+    const char *name;
+    uint32_t transactions;          // Jobs and burst reads run for the device
+    uint32_t merged_reads;          // Register reads folded into another read's burst
+    uint32_t coalesced;             // Posted jobs replaced by a newer one before running
+    uint64_t busy_us;               // Time the bus was held for the device
+    uint32_t max_wait_us;           // Longest time a job sat in the queue
+} hal_i2c_dev_stats_t;
+
+/**
+ * @brief Start the bus arbiter task
+ *
+ * Until this is called every job runs inline in the caller.
+ */
+void hal_i2c_bus_init(void);
+
+/**
+ * @brief Attach the I2C device handle used for register reads of a device
+ *
+ * @param dev Device
+ * @param handle Device handle on the internal bus
+ */
+void hal_i2c_bus_set_device_handle(hal_i2c_dev_t dev, i2c_master_dev_handle_t handle);
+
+/**
+ * @brief Run a job on the bus and wait for it to finish
+ *
+ * @param dev Device the job talks to
+ * @param prio Queue priority
+ * @param fn Job function
+ * @param arg Job argument
+ * @return The job's return value
+ */
+esp_err_t hal_i2c_bus_run(hal_i2c_dev_t dev, hal_i2c_prio_t prio, hal_i2c_job_fn_t fn, void *arg);
+
+/**
+ * @brief Queue a job on the bus without waiting for it
+ *
+ * A non-zero key replaces a job with the same key that has not started yet,
+ * so a slider dragged across its range costs one transaction, not one per step.
+ *
+ * @param dev Device the job talks to
+ * @param prio Queue priority
+ * @param fn Job function
+ * @param arg Job argument
+ * @param key Coalescing key, 0 to always queue
+ * @return ESP_OK, or ESP_ERR_NO_MEM when the job pool is exhausted
+ */
+esp_err_t hal_i2c_bus_post(hal_i2c_dev_t dev, hal_i2c_prio_t prio, hal_i2c_job_fn_t fn, void *arg, uint32_t key);
+
+/**
+ * @brief Read consecutive registers of a device through the arbiter
+ *
+ * Reads of the same device queued at the same priority are merged into a
+ * single burst read when their register ranges are close together, up to
+ * the next other job for that device. A burst never reads a clear-on-read
+ * register that none of its reads asked for.
+ *
+ * @param dev Device, must have a handle set
+ * @param prio Queue priority
+ * @param reg First register
+ * @param buf Destination
+ * @param len Number of registers
+ * @return ESP_OK on success, otherwise the I2C error
+ */
+esp_err_t hal_i2c_bus_read_regs(hal_i2c_dev_t dev, hal_i2c_prio_t prio, uint8_t reg, uint8_t *buf, size_t len);
+
+/**
+ * @brief Copy the per device statistics
+ *
+ * @param stats Array of HAL_I2C_DEV_MAX entries
+ * @param window_us Optional, time since the statistics were reset
+ */
+void hal_i2c_bus_get_stats(hal_i2c_dev_stats_t *stats, uint64_t *window_us);
+
+/**
+ * @brief Get the longest queue wait seen at a priority since the last reset
+ */
+uint32_t hal_i2c_bus_get_max_wait_us(hal_i2c_prio_t prio);
+
+/**
+ * @brief Clear all statistics and start a new measurement window
+ */
+void hal_i2c_bus_reset_stats(void);
+
+/**
+ * @brief Print bus occupancy per device
+ */
+void hal_i2c_bus_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_I2C_BUS_H
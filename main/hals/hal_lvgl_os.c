@@ -0,0 +1,169 @@
+#include "lvgl.h"
+#include "hals/hal_lvgl_os.h"
+
+#if LV_USE_OS == LV_OS_CUSTOM
+
+#include <stdio.h>
+#include "esp_timer.h"
+
+// Threads created so far, for spreading them over the cores
+static int s_thread_count = 0;
+
+// Live threads, for hal_lvgl_os_get_threads()
+static TaskHandle_t s_threads[HAL_LVGL_OS_MAX_THREADS];
+static portMUX_TYPE s_threads_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void track_thread(TaskHandle_t task, TaskHandle_t replace)
+{
+    taskENTER_CRITICAL(&s_threads_lock);
+    for (int i = 0; i < HAL_LVGL_OS_MAX_THREADS; i++) {
+        if (s_threads[i] == replace) {
+            s_threads[i] = task;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_threads_lock);
+}
+
+static void thread_entry(void *arg)
+{
+    lv_thread_t *thread = arg;
+    thread->callback(thread->user_data);
+
+    // lv_thread_delete() deletes the task, it must still exist by then
+    vTaskSuspend(NULL);
+}
+
+// The only threads LVGL creates here are the software draw units. With two
+// units one runs on each core; the one sharing core 1 with the MP3 decoder
+// (priority 8) stays below it, so audio never waits for rendering and LVGL
+// hands more draw tasks to the unit on core 0 while the decoder runs.
+lv_result_t lv_thread_init(lv_thread_t *thread, const char *const name, lv_thread_prio_t prio,
+                           void (*callback)(void *), size_t stack_size, void *user_data)
+{
+    thread->callback = callback;
+    thread->user_data = user_data;
+
+    int core = (HAL_LVGL_OS_FIRST_CORE + s_thread_count) % portNUM_PROCESSORS;
+    if (xTaskCreatePinnedToCore(thread_entry, name, stack_size, thread, tskIDLE_PRIORITY + prio,
+                                &thread->task, core) != pdPASS) {
+        printf("LVGL: failed to create thread %s\n", name);
+        return LV_RESULT_INVALID;
+    }
+    s_thread_count++;
+    track_thread(thread->task, NULL);
+    return LV_RESULT_OK;
+}
+
+lv_result_t lv_thread_delete(lv_thread_t *thread)
+{
+    track_thread(NULL, thread->task);
+    vTaskDelete(thread->task);
+    thread->task = NULL;
+    return LV_RESULT_OK;
+}
+
+// Recursive, as LVGL's own FreeRTOS port: lv_lock() may nest
+lv_result_t lv_mutex_init(lv_mutex_t *mutex)
+{
+    mutex->handle = xSemaphoreCreateRecursiveMutexStatic(&mutex->storage);
+    return mutex->handle != NULL ? LV_RESULT_OK : LV_RESULT_INVALID;
+}
+
+lv_result_t lv_mutex_lock(lv_mutex_t *mutex)
+{
+    return xSemaphoreTakeRecursive(mutex->handle, portMAX_DELAY) == pdTRUE ? LV_RESULT_OK : LV_RESULT_INVALID;
+}
+
+lv_result_t lv_mutex_lock_isr(lv_mutex_t *mutex)
+{
+    // A mutex can't be taken from an interrupt; LVGL only calls this with
+    // interrupts enabled, where it is a plain lock
+    return lv_mutex_lock(mutex);
+}
+
+lv_result_t lv_mutex_unlock(lv_mutex_t *mutex)
+{
+    return xSemaphoreGiveRecursive(mutex->handle) == pdTRUE ? LV_RESULT_OK : LV_RESULT_INVALID;
+}
+
+lv_result_t lv_mutex_delete(lv_mutex_t *mutex)
+{
+    vSemaphoreDelete(mutex->handle);
+    mutex->handle = NULL;
+    return LV_RESULT_OK;
+}
+
+// A binary semaphore keeps a signal that arrives before the wait
+lv_result_t lv_thread_sync_init(lv_thread_sync_t *sync)
+{
+    sync->handle = xSemaphoreCreateBinaryStatic(&sync->storage);
+    return sync->handle != NULL ? LV_RESULT_OK : LV_RESULT_INVALID;
+}
+
+lv_result_t lv_thread_sync_wait(lv_thread_sync_t *sync)
+{
+    return xSemaphoreTake(sync->handle, portMAX_DELAY) == pdTRUE ? LV_RESULT_OK : LV_RESULT_INVALID;
+}
+
+lv_result_t lv_thread_sync_signal(lv_thread_sync_t *sync)
+{
+    xSemaphoreGive(sync->handle);
+    return LV_RESULT_OK;
+}
+
+lv_result_t lv_thread_sync_signal_isr(lv_thread_sync_t *sync)
+{
+    BaseType_t need_yield = pdFALSE;
+    xSemaphoreGiveFromISR(sync->handle, &need_yield);
+    portYIELD_FROM_ISR(need_yield);
+    return LV_RESULT_OK;
+}
+
+lv_result_t lv_thread_sync_delete(lv_thread_sync_t *sync)
+{
+    vSemaphoreDelete(sync->handle);
+    sync->handle = NULL;
+    return LV_RESULT_OK;
+}
+
+// For the system monitor: idle time of both cores since the previous call
+uint32_t lv_os_get_idle_percent(void)
+{
+    static uint32_t s_prev_idle = 0;
+    static int64_t s_prev_us = 0;
+
+    uint32_t idle = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        idle += ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(core));
+    }
+    int64_t now = esp_timer_get_time();
+
+    uint32_t elapsed = (uint32_t)(now - s_prev_us) * portNUM_PROCESSORS;
+    uint32_t percent = elapsed > 0 ? (uint32_t)((uint64_t)(idle - s_prev_idle) * 100 / elapsed) : 0;
+    s_prev_idle = idle;
+    s_prev_us = now;
+    return percent > 100 ? 100 : percent;
+}
+
+size_t hal_lvgl_os_get_threads(TaskHandle_t *tasks, size_t max)
+{
+    size_t count = 0;
+    taskENTER_CRITICAL(&s_threads_lock);
+    for (int i = 0; i < HAL_LVGL_OS_MAX_THREADS && count < max; i++) {
+        if (s_threads[i] != NULL) {
+            tasks[count++] = s_threads[i];
+        }
+    }
+    taskEXIT_CRITICAL(&s_threads_lock);
+    return count;
+}
+
+#else
+
+size_t hal_lvgl_os_get_threads(TaskHandle_t *tasks, size_t max)
+{
+    return 0;
+}
+
+#endif
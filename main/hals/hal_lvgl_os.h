@@ -0,0 +1,60 @@
+#ifndef HAL_LVGL_OS_H
+#define HAL_LVGL_OS_H
+
+/**
+ * @brief LVGL OS port on ESP-IDF FreeRTOS
+ *
+ * LVGL includes this file through CONFIG_LV_OS_CUSTOM_INCLUDE for the thread,
+ * mutex and sync types; hal_lvgl_os.c implements lv_os.h on top of them.
+ * LVGL's own FreeRTOS port creates its threads with xTaskCreate(), and IDF
+ * can't pin a task after the fact. This one spreads the software draw units
+ * over both cores instead, see HAL_LVGL_OS_FIRST_CORE.
+ *
+ * Included from LVGL's public headers, so only FreeRTOS may be pulled in here.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Core of the first thread LVGL creates; the next ones take the following cores in turn
+#ifndef HAL_LVGL_OS_FIRST_CORE
+#define HAL_LVGL_OS_FIRST_CORE 0
+#endif
+
+// Threads kept track of for hal_lvgl_os_get_threads()
+#ifndef HAL_LVGL_OS_MAX_THREADS
+#define HAL_LVGL_OS_MAX_THREADS 4
+#endif
+
+typedef struct {
+    void (*callback)(void *);
+    void *user_data;
+    TaskHandle_t task;
+} lv_thread_t;
+
+typedef struct {
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t storage;
+} lv_mutex_t;
+
+typedef struct {
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t storage;
+} lv_thread_sync_t;
+
+/**
+ * @brief Get the tasks of the threads LVGL created, the software draw units
+ *
+ * For diagnostics: while a frame is rendered the LVGL task only waits for
+ * these, so they are where a slow render actually runs.
+ *
+ * @param tasks Destination
+ * @param max Size of tasks
+ * @return Number of tasks copied, 0 without this port
+ */
+size_t hal_lvgl_os_get_threads(TaskHandle_t *tasks, size_t max);
+
+#endif // HAL_LVGL_OS_H
@@ -0,0 +1,93 @@
+#ifndef HAL_MUTEX_H
+#define HAL_MUTEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most mutexes that can be created, they are never freed
+#ifndef HAL_MUTEX_MAX
+#define HAL_MUTEX_MAX 8
+#endif
+
+// Upper bounds of the wait time histogram buckets in microseconds, the last bucket is everything above
+#define HAL_MUTEX_WAIT_BUCKET_LIMITS_US {10, 100, 1000, 5000, 20000, 100000, 500000}
+#define HAL_MUTEX_WAIT_BUCKETS 8
+
+/**
+ * @brief HAL mutex, a FreeRTOS mutex that keeps track of how it is used
+ */
+typedef struct hal_mutex hal_mutex_t;
+
+/**
+ * @brief Statistics of one mutex since the last reset
+ */
+typedef struct {
+    const char *name;
+    uint32_t acquisitions;
+    uint32_t contended;             // Acquisitions that had to wait for another task
+    uint32_t timeouts;              // Takes that gave up
+    uint64_t wait_us;               // Time spent waiting, including takes that timed out
+    uint32_t max_wait_us;
+    uint64_t hold_us;               // Time the mutex was held
+    uint32_t max_hold_us;
+    char max_hold_task[16];         // Task behind max_hold_us
+    char last_timeout_holder[16];   // Task holding the mutex when a take last timed out
+    char last_holder[16];           // Task that took the mutex last
+    bool held;                      // last_holder still holds it
+    uint32_t wait_hist[HAL_MUTEX_WAIT_BUCKETS];    // Waits of contended takes, see HAL_MUTEX_WAIT_BUCKET_LIMITS_US
+} hal_mutex_stats_t;
+
+/**
+ * @brief Create a mutex
+ *
+ * @param name Shown in the statistics, must stay valid
+ * @return The mutex, NULL if out of memory or HAL_MUTEX_MAX is reached
+ */
+hal_mutex_t *hal_mutex_create(const char *name);
+
+/**
+ * @brief Take the mutex, waiting at most timeout ticks
+ *
+ * A take that times out is logged with the task holding the mutex.
+ *
+ * @return true if the mutex was taken
+ */
+bool hal_mutex_take(hal_mutex_t *mutex, TickType_t timeout);
+
+/**
+ * @brief Release a mutex taken by the calling task
+ */
+void hal_mutex_give(hal_mutex_t *mutex);
+
+/**
+ * @brief Copy the statistics of every mutex
+ *
+ * @param stats Array of HAL_MUTEX_MAX entries
+ * @param count Number of entries filled in
+ * @param window_us Optional, time since the statistics were reset
+ */
+void hal_mutex_get_stats(hal_mutex_stats_t *stats, size_t *count, uint64_t *window_us);
+
+/**
+ * @brief Clear all statistics and start a new measurement window
+ */
+void hal_mutex_reset_stats(void);
+
+/**
+ * @brief Print waits, timeouts, hold times and the last holder per mutex
+ *
+ * Also shown live in the task manager, which can reset the statistics.
+ */
+void hal_mutex_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_MUTEX_H
@@ -0,0 +1,193 @@
+#ifndef HAL_ROTATE_H
+#define HAL_ROTATE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Cache-blocked 90° rotation of frame buffer areas
+ *
+ * Same mapping as lv_draw_sw_rotate() with LV_DISPLAY_ROTATION_90: source
+ * column (width - 1 - x) becomes destination row x, so the destination is
+ * height pixels wide and width pixels high. Strides are in bytes.
+ *
+ * A plain transpose reads one pixel per source line for each destination
+ * pixel and touches a new cache line almost every time. Here the area is
+ * walked in square tiles, a band of source columns at a time, so the lines a
+ * tile reads and writes stay in cache. Pixels are moved a word at a time
+ * when both buffers and strides are word aligned: 2x2 blocks in RGB565, 4x4
+ * blocks (three words a line) in RGB888.
+ *
+ * Header only, so LVGL's rotation hooks (hal_rotate_lvgl.h) and the host
+ * benchmark (tools/rotate_bench.c) build the same code. On the host, with
+ * 32 pixel tiles, RGB565 is about 1.5x LVGL's loop on a draw buffer stripe
+ * and 1.6x on a full frame. RGB888 is on par on a stripe but about 0.6x on
+ * a full frame, so only the RGB565 kernel is hooked into LVGL.
+ */
+
+// Side of the square tiles in pixels, a multiple of 4; a 32x32 RGB565 tile is 2 KB
+#ifndef HAL_ROTATE_TILE
+#define HAL_ROTATE_TILE 32
+#endif
+
+typedef uint32_t __attribute__((may_alias)) hal_rotate_word_t;
+
+static inline void hal_rotate90_rgb565_pixel(const uint8_t *src, uint8_t *dst, int32_t width,
+                                             int32_t x, int32_t y, int32_t src_stride, int32_t dst_stride)
+{
+    const uint16_t *s = (const uint16_t *)(src + y * src_stride) + x;
+    uint16_t *d = (uint16_t *)(dst + (width - 1 - x) * dst_stride) + y;
+    *d = *s;
+}
+
+// Source columns [x0, x1) of rows [y0, y1), one destination line at a time;
+// x0 and y0 even when words is set
+static inline void hal_rotate90_rgb565_block(const uint8_t *src, uint8_t *dst, int32_t width,
+                                             int32_t x0, int32_t x1, int32_t y0, int32_t y1,
+                                             int32_t src_stride, int32_t dst_stride, int words)
+{
+    int32_t x = x0;
+    if (words) {
+        for (; x + 1 < x1; x += 2) {
+            const uint8_t *s = src + y0 * src_stride + x * 2;
+            hal_rotate_word_t *d0 = (hal_rotate_word_t *)(dst + (width - 1 - x) * dst_stride + y0 * 2);
+            hal_rotate_word_t *d1 = (hal_rotate_word_t *)(dst + (width - 2 - x) * dst_stride + y0 * 2);
+            int32_t y = y0;
+            for (; y + 1 < y1; y += 2, s += 2 * src_stride) {
+                // a = (y, x) | (y, x + 1) << 16, b = the same one line down
+                uint32_t a = *(const hal_rotate_word_t *)s;
+                uint32_t b = *(const hal_rotate_word_t *)(s + src_stride);
+                *d0++ = (a & 0xFFFF) | (b << 16);
+                *d1++ = (a >> 16) | (b & 0xFFFF0000);
+            }
+            if (y < y1) {
+                hal_rotate90_rgb565_pixel(src, dst, width, x, y, src_stride, dst_stride);
+                hal_rotate90_rgb565_pixel(src, dst, width, x + 1, y, src_stride, dst_stride);
+            }
+        }
+    }
+    for (; x < x1; x++) {
+        for (int32_t y = y0; y < y1; y++) {
+            hal_rotate90_rgb565_pixel(src, dst, width, x, y, src_stride, dst_stride);
+        }
+    }
+}
+
+/**
+ * @brief Rotate a RGB565 area by 90° with a given tile size
+ * @param src Source pixels
+ * @param dst Destination, height x width pixels
+ * @param width Source width in pixels
+ * @param height Source height in pixels
+ * @param src_stride Source line length in bytes
+ * @param dst_stride Destination line length in bytes
+ * @param tile Tile side in pixels, a multiple of 4
+ */
+static inline void hal_rotate90_rgb565_tiled(const void *src, void *dst, int32_t width, int32_t height,
+                                             int32_t src_stride, int32_t dst_stride, int32_t tile)
+{
+    int words = (((uintptr_t)src | (uintptr_t)dst | (uint32_t)src_stride | (uint32_t)dst_stride) & 3) == 0;
+
+    for (int32_t x0 = 0; x0 < width; x0 += tile) {
+        int32_t x1 = x0 + tile < width ? x0 + tile : width;
+        for (int32_t y0 = 0; y0 < height; y0 += tile) {
+            int32_t y1 = y0 + tile < height ? y0 + tile : height;
+            hal_rotate90_rgb565_block(src, dst, width, x0, x1, y0, y1, src_stride, dst_stride, words);
+        }
+    }
+}
+
+static inline void hal_rotate90_rgb888_pixel(const uint8_t *src, uint8_t *dst, int32_t width,
+                                             int32_t x, int32_t y, int32_t src_stride, int32_t dst_stride)
+{
+    const uint8_t *s = src + y * src_stride + x * 3;
+    uint8_t *d = dst + (width - 1 - x) * dst_stride + y * 3;
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+}
+
+// As hal_rotate90_rgb565_block(), in 4x4 pixel blocks: four pixels are three
+// words, so x0 and y0 are multiples of 4 when words is set
+static inline void hal_rotate90_rgb888_block(const uint8_t *src, uint8_t *dst, int32_t width,
+                                             int32_t x0, int32_t x1, int32_t y0, int32_t y1,
+                                             int32_t src_stride, int32_t dst_stride, int words)
+{
+    int32_t x = x0;
+    if (words) {
+        for (; x + 3 < x1; x += 4) {
+            const uint8_t *s = src + y0 * src_stride + x * 3;
+            hal_rotate_word_t *d[4];
+            for (int i = 0; i < 4; i++) {
+                d[i] = (hal_rotate_word_t *)(dst + (width - 1 - x - i) * dst_stride + y0 * 3);
+            }
+            int32_t y = y0;
+            for (; y + 3 < y1; y += 4, s += 4 * src_stride) {
+                // p[line][column], unpacked from three words per line
+                uint32_t p[4][4];
+                for (int line = 0; line < 4; line++) {
+                    const hal_rotate_word_t *w = (const hal_rotate_word_t *)(s + line * src_stride);
+                    p[line][0] = w[0] & 0xFFFFFF;
+                    p[line][1] = (w[0] >> 24) | (w[1] & 0xFFFF) << 8;
+                    p[line][2] = (w[1] >> 16) | (w[2] & 0xFF) << 16;
+                    p[line][3] = w[2] >> 8;
+                }
+                // Column i of the block is destination line i, repacked
+                for (int i = 0; i < 4; i++) {
+                    d[i][0] = p[0][i] | p[1][i] << 24;
+                    d[i][1] = p[1][i] >> 8 | p[2][i] << 16;
+                    d[i][2] = p[2][i] >> 16 | p[3][i] << 8;
+                    d[i] += 3;
+                }
+            }
+            for (; y < y1; y++) {
+                for (int i = 0; i < 4; i++) {
+                    hal_rotate90_rgb888_pixel(src, dst, width, x + i, y, src_stride, dst_stride);
+                }
+            }
+        }
+    }
+    for (; x < x1; x++) {
+        for (int32_t y = y0; y < y1; y++) {
+            hal_rotate90_rgb888_pixel(src, dst, width, x, y, src_stride, dst_stride);
+        }
+    }
+}
+
+/**
+ * @brief Rotate a RGB888 area by 90° with a given tile size
+ *
+ * Parameters as hal_rotate90_rgb565_tiled(), the tile a multiple of 4.
+ */
+static inline void hal_rotate90_rgb888_tiled(const void *src, void *dst, int32_t width, int32_t height,
+                                             int32_t src_stride, int32_t dst_stride, int32_t tile)
+{
+    int words = (((uintptr_t)src | (uintptr_t)dst | (uint32_t)src_stride | (uint32_t)dst_stride) & 3) == 0;
+
+    for (int32_t x0 = 0; x0 < width; x0 += tile) {
+        int32_t x1 = x0 + tile < width ? x0 + tile : width;
+        for (int32_t y0 = 0; y0 < height; y0 += tile) {
+            int32_t y1 = y0 + tile < height ? y0 + tile : height;
+            hal_rotate90_rgb888_block(src, dst, width, x0, x1, y0, y1, src_stride, dst_stride, words);
+        }
+    }
+}
+
+/**
+ * @brief Rotate a RGB565 area by 90° with HAL_ROTATE_TILE tiles
+ */
+static inline void hal_rotate90_rgb565(const void *src, void *dst, int32_t width, int32_t height,
+                                       int32_t src_stride, int32_t dst_stride)
+{
+    hal_rotate90_rgb565_tiled(src, dst, width, height, src_stride, dst_stride, HAL_ROTATE_TILE);
+}
+
+/**
+ * @brief Rotate a RGB888 area by 90° with HAL_ROTATE_TILE tiles
+ */
+static inline void hal_rotate90_rgb888(const void *src, void *dst, int32_t width, int32_t height,
+                                       int32_t src_stride, int32_t dst_stride)
+{
+    hal_rotate90_rgb888_tiled(src, dst, width, height, src_stride, dst_stride, HAL_ROTATE_TILE);
+}
+
+#endif // HAL_ROTATE_H
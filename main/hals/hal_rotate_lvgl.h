@@ -0,0 +1,20 @@
+#ifndef HAL_ROTATE_LVGL_H
+#define HAL_ROTATE_LVGL_H
+
+/**
+ * @brief Rotation hooks for LVGL's software renderer
+ *
+ * LVGL includes this file through CONFIG_LV_DRAW_SW_ASM_CUSTOM_INCLUDE, so
+ * lv_draw_sw_rotate() uses the tiled RGB565 kernel of hal_rotate.h for 90°
+ * in place of its pixel-by-pixel loop. The LVGL port calls it on every
+ * flushed area while sw_rotate is on. The other rotations and formats keep
+ * LVGL's own code; on a full RGB888 frame the tiled kernel is slower than
+ * LVGL's loop (tools/rotate_bench.c), so it is not hooked in.
+ */
+
+#include "hals/hal_rotate.h"
+
+#define LV_DRAW_SW_ROTATE90_RGB565(src, dst, src_width, src_height, src_stride, dst_stride) \
+    (hal_rotate90_rgb565((src), (dst), (src_width), (src_height), (src_stride), (dst_stride)), LV_RESULT_OK)
+
+#endif // HAL_ROTATE_LVGL_H
@@ -1,10 +1,15 @@
+// fopencookie()
+#define _GNU_SOURCE
 #include "hal_sdcard.h"
+#include "hal_mutex.h"
+#include "managers/event_bus.h"
+#include "managers/metrics.h"
 #include <bsp/esp-bsp.h>
 #include <stdio.h>
 #include <string.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/semphr.h>
+#include <esp_timer.h>
 #include <esp_vfs_fat.h>
 #include <sdmmc_cmd.h>
 
@@ -15,7 +20,7 @@
 // SD card state
 typedef struct {
     bool is_mounted;
-    SemaphoreHandle_t mutex;
+    hal_mutex_t *mutex;
     char mount_point[32];
 } sdcard_state_t;
 
@@ -26,22 +31,38 @@ static sdcard_state_t g_sdcard_state = {
     .mount_point = SD_MOUNT_POINT
 };
 
+static int32_t sdcard_mounted(void)
+{
+    return g_sdcard_state.is_mounted;
+}
+
+METRIC_GAUGE_FN(s_mounted, "sd.mounted", "", sdcard_mounted)
+METRIC_COUNTER(s_read_bytes, "sd.read_bytes", "bytes")
+METRIC_COUNTER(s_write_bytes, "sd.write_bytes", "bytes")
+METRIC_HISTOGRAM(s_read_us, "sd.read_time", "us", 100, 500, 1000, 2000, 5000, 10000, 50000)
+
+static void sdcard_publish(bool mounted)
+{
+    const event_t event = {.topic = EVENT_SD_MOUNT, .sd.mounted = mounted};
+    event_bus_publish(&event);
+}
+
 bool hal_sdcard_init(void)
 {
     // Create mutex if not already created
     if (g_sdcard_state.mutex == NULL) {
-        g_sdcard_state.mutex = xSemaphoreCreateMutex();
+        g_sdcard_state.mutex = hal_mutex_create("sdcard");
         if (g_sdcard_state.mutex == NULL) {
             printf("Failed to create SD card mutex\n");
             return false;
         }
     }
 
-    if (xSemaphoreTake(g_sdcard_state.mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    if (hal_mutex_take(g_sdcard_state.mutex, pdMS_TO_TICKS(1000))) {
         // Check if already mounted
         if (g_sdcard_state.is_mounted) {
             printf("SD card already mounted\n");
-            xSemaphoreGive(g_sdcard_state.mutex);
+            hal_mutex_give(g_sdcard_state.mutex);
             return true;
         }
 
@@ -52,12 +73,14 @@ bool hal_sdcard_init(void)
         if (ret == ESP_OK) {
             g_sdcard_state.is_mounted = true;
             printf("SD card mounted successfully at %s\n", g_sdcard_state.mount_point);
-            xSemaphoreGive(g_sdcard_state.mutex);
+            hal_mutex_give(g_sdcard_state.mutex);
+            sdcard_publish(true);
             return true;
         } else {
             printf("Failed to mount SD card: %s\n", esp_err_to_name(ret));
             g_sdcard_state.is_mounted = false;
-            xSemaphoreGive(g_sdcard_state.mutex);
+            hal_mutex_give(g_sdcard_state.mutex);
+            sdcard_publish(false);
             return false;
         }
     } else {
@@ -72,7 +95,8 @@ void hal_sdcard_deinit(void)
         return;
     }
 
-    if (xSemaphoreTake(g_sdcard_state.mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    if (hal_mutex_take(g_sdcard_state.mutex, pdMS_TO_TICKS(1000))) {
+        bool was_mounted = g_sdcard_state.is_mounted;
         if (g_sdcard_state.is_mounted) {
             printf("Unmounting SD card...\n");
             
@@ -87,7 +111,10 @@ void hal_sdcard_deinit(void)
             g_sdcard_state.is_mounted = false;
         }
         
-        xSemaphoreGive(g_sdcard_state.mutex);
+        hal_mutex_give(g_sdcard_state.mutex);
+        if (was_mounted) {
+            sdcard_publish(false);
+        }
     }
 }
 
@@ -98,9 +125,9 @@ bool hal_sdcard_is_mounted(void)
     }
 
     bool mounted = false;
-    if (xSemaphoreTake(g_sdcard_state.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+    if (hal_mutex_take(g_sdcard_state.mutex, pdMS_TO_TICKS(100))) {
         mounted = g_sdcard_state.is_mounted;
-        xSemaphoreGive(g_sdcard_state.mutex);
+        hal_mutex_give(g_sdcard_state.mutex);
     }
     
     return mounted;
@@ -109,4 +136,57 @@ bool hal_sdcard_is_mounted(void)
 const char* hal_sdcard_get_mount_point(void)
 {
     return g_sdcard_state.mount_point;
-} 
\ No newline at end of file
+} 
+
+/* -------------------------------------------------------------------------- */
+/*                             Instrumented files                             */
+/* -------------------------------------------------------------------------- */
+
+static ssize_t sd_file_read(void *cookie, char *buf, size_t size)
+{
+    int64_t start = esp_timer_get_time();
+    size_t n = fread(buf, 1, size, (FILE *)cookie);
+    metric_observe(&s_read_us, (uint32_t)(esp_timer_get_time() - start));
+    metric_add(&s_read_bytes, n);
+    return (n == 0 && ferror((FILE *)cookie)) ? -1 : (ssize_t)n;
+}
+
+static ssize_t sd_file_write(void *cookie, const char *buf, size_t size)
+{
+    size_t n = fwrite(buf, 1, size, (FILE *)cookie);
+    metric_add(&s_write_bytes, n);
+    return (n == 0 && size > 0) ? -1 : (ssize_t)n;
+}
+
+static int sd_file_seek(void *cookie, off_t *offset, int whence)
+{
+    if (fseeko((FILE *)cookie, *offset, whence) != 0) {
+        return -1;
+    }
+    *offset = ftello((FILE *)cookie);
+    return 0;
+}
+
+static int sd_file_close(void *cookie)
+{
+    return fclose((FILE *)cookie);
+}
+
+FILE* hal_sdcard_fopen(const char* path, const char* mode)
+{
+    FILE* file = fopen(path, mode);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    // The wrapper has its own buffer, so every read below it is a real one
+    setvbuf(file, NULL, _IONBF, 0);
+    const cookie_io_functions_t io = {
+        .read = sd_file_read,
+        .write = sd_file_write,
+        .seek = sd_file_seek,
+        .close = sd_file_close,
+    };
+    FILE* wrapped = fopencookie(file, mode, io);
+    return wrapped ? wrapped : file;
+}
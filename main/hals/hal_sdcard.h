@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,15 @@ bool hal_sdcard_is_mounted(void);
  */
 const char* hal_sdcard_get_mount_point(void);
 
+/**
+ * @brief Open a file on the SD card, counting its traffic in the sd.* metrics
+ *
+ * Works like fopen() and is closed with fclose().
+ *
+ * @return The file, NULL on failure
+ */
+FILE* hal_sdcard_fopen(const char* path, const char* mode);
+
 #ifdef __cplusplus
 }
 #endif
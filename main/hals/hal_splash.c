@@ -0,0 +1,308 @@
+#include "hals/hal_splash.h"
+#include "hals/hal_display.h"
+#include "hals/hal_rotate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bsp/esp-bsp.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
+#include "esp_cache.h"
+#include "esp_timer.h"
+#include "esp_lcd_mipi_dsi.h"
+
+#define SPLASH_MAGIC        0x484C5053  // "SPLH"
+#define SPLASH_VERSION      1
+#define SPLASH_HEADER_SIZE  4096        // One flash sector, erased on its own to invalidate
+#define SPLASH_WRITE_CHUNK  (64 * 1024)
+
+// The snapshot is written behind everything else
+#ifndef HAL_SPLASH_TASK_PRIORITY
+#define HAL_SPLASH_TASK_PRIORITY 1
+#endif
+
+// Written last, so a snapshot cut short by a reset never looks valid
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t build_id[8];    // Start of the app ELF SHA-256, stale after any firmware change
+    uint32_t key;           // Caller's identity of the home screen
+    uint16_t width;         // In display (rotated) orientation, as LVGL draws it
+    uint16_t height;
+    uint32_t cf;
+    uint32_t stride;
+    uint32_t data_size;
+} splash_header_t;
+
+typedef struct {
+    splash_header_t header;
+    uint16_t *frame;        // PSRAM copy of the frame buffer, panel orientation
+    int32_t frame_w;
+    int32_t frame_h;
+    lv_display_rotation_t rotation;
+    uint8_t *pixels;        // Display orientation, made from frame by the write task
+} splash_job_t;
+
+static const esp_partition_t *s_part = NULL;
+static esp_partition_mmap_handle_t s_map;
+static lv_image_dsc_t s_dsc;
+static lv_obj_t *s_img = NULL;
+static bool s_writing = false;
+
+static const esp_partition_t *splash_partition(void)
+{
+    if (s_part == NULL) {
+        s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, HAL_SPLASH_PARTITION_SUBTYPE, "splash");
+    }
+    return s_part;
+}
+
+static void build_id(uint8_t id[8])
+{
+    memcpy(id, esp_app_get_description()->app_elf_sha256, 8);
+}
+
+// Read the header and check it belongs to this firmware and display
+static bool read_header(lv_display_t *disp, splash_header_t *hdr)
+{
+    const esp_partition_t *part = splash_partition();
+    if (part == NULL || esp_partition_read(part, 0, hdr, sizeof(*hdr)) != ESP_OK) {
+        return false;
+    }
+
+    uint8_t id[8];
+    build_id(id);
+    return hdr->magic == SPLASH_MAGIC && hdr->version == SPLASH_VERSION &&
+           memcmp(hdr->build_id, id, sizeof(id)) == 0 &&
+           hdr->width == lv_display_get_horizontal_resolution(disp) &&
+           hdr->height == lv_display_get_vertical_resolution(disp) &&
+           hdr->cf == LV_COLOR_FORMAT_RGB565 &&
+           hdr->data_size == hdr->stride * hdr->height &&
+           hdr->data_size <= part->size - SPLASH_HEADER_SIZE;
+}
+
+esp_err_t hal_splash_show(lv_display_t *disp)
+{
+    splash_header_t hdr;
+    if (disp == NULL || !read_header(disp, &hdr)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Drawn straight from flash, nothing is copied to RAM
+    const void *pixels = NULL;
+    esp_err_t ret = esp_partition_mmap(s_part, SPLASH_HEADER_SIZE, hdr.data_size, ESP_PARTITION_MMAP_DATA,
+                                       &pixels, &s_map);
+    if (ret != ESP_OK) {
+        printf("Splash: failed to map snapshot: %s\n", esp_err_to_name(ret));
+        return ret;
+    }
+
+    memset(&s_dsc, 0, sizeof(s_dsc));
+    s_dsc.header.magic = LV_IMAGE_HEADER_MAGIC;
+    s_dsc.header.cf = LV_COLOR_FORMAT_RGB565;
+    s_dsc.header.w = hdr.width;
+    s_dsc.header.h = hdr.height;
+    s_dsc.header.stride = hdr.stride;
+    s_dsc.data_size = hdr.data_size;
+    s_dsc.data = pixels;
+
+    // Above the screens and the top layer, so everything built meanwhile stays hidden.
+    // LVGL draws it from its own task from the next refresh on.
+    s_img = lv_image_create(lv_layer_sys());
+    lv_image_set_src(s_img, &s_dsc);
+    lv_obj_set_pos(s_img, 0, 0);
+
+    // The first frame goes straight into the frame buffer being scanned,
+    // rotated the way the flush would, without rendering anything here
+    uint8_t *fb = hal_display_get_frame_buffer();
+    if (fb != NULL) {
+        int64_t start = esp_timer_get_time();
+        int32_t pw = lv_display_get_physical_horizontal_resolution(disp);
+        int32_t ph = lv_display_get_physical_vertical_resolution(disp);
+        uint32_t fb_stride = pw * sizeof(uint16_t);
+        lv_display_rotation_t rot = lv_display_get_rotation(disp);
+        if (rot == LV_DISPLAY_ROTATION_0) {
+            for (uint32_t y = 0; y < hdr.height; y++) {
+                memcpy(fb + y * fb_stride, (const uint8_t *)pixels + y * hdr.stride, hdr.width * sizeof(uint16_t));
+            }
+        } else {
+            lv_draw_sw_rotate(pixels, fb, hdr.width, hdr.height, hdr.stride, fb_stride, rot, LV_COLOR_FORMAT_RGB565);
+        }
+        esp_cache_msync(fb, (size_t)fb_stride * ph, ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+        printf("Splash: snapshot drawn in %lld ms\n", (esp_timer_get_time() - start) / 1000);
+    }
+    return ESP_OK;
+}
+
+void hal_splash_finish(uint32_t key)
+{
+    if (s_img == NULL) {
+        return;
+    }
+
+    lv_obj_delete(s_img);
+    s_img = NULL;
+    lv_image_cache_drop(&s_dsc);
+    esp_partition_munmap(s_map);
+
+    if (!hal_splash_is_current(key)) {
+        printf("Splash: home screen changed since the snapshot\n");
+    }
+}
+
+bool hal_splash_is_current(uint32_t key)
+{
+    splash_header_t hdr;
+    return read_header(lv_display_get_default(), &hdr) && hdr.key == key;
+}
+
+// Undo the panel rotation so the snapshot can be drawn as a plain image.
+// Walked in tiles, so the column reads of the frame stay in cache.
+static void unrotate(const splash_job_t *job)
+{
+    const uint16_t *src = job->frame;
+    uint16_t *dst = (uint16_t *)job->pixels;
+    int32_t pw = job->frame_w;
+    int32_t ph = job->frame_h;
+    int32_t w = job->header.width;
+    int32_t h = job->header.height;
+
+    for (int32_t y0 = 0; y0 < h; y0 += HAL_ROTATE_TILE) {
+        int32_t y1 = y0 + HAL_ROTATE_TILE < h ? y0 + HAL_ROTATE_TILE : h;
+        for (int32_t x0 = 0; x0 < w; x0 += HAL_ROTATE_TILE) {
+            int32_t x1 = x0 + HAL_ROTATE_TILE < w ? x0 + HAL_ROTATE_TILE : w;
+            for (int32_t ly = y0; ly < y1; ly++) {
+                for (int32_t lx = x0; lx < x1; lx++) {
+                    int32_t px, py;
+                    switch (job->rotation) {
+                        case LV_DISPLAY_ROTATION_90:  px = ly;          py = ph - 1 - lx; break;
+                        case LV_DISPLAY_ROTATION_180: px = pw - 1 - lx; py = ph - 1 - ly; break;
+                        case LV_DISPLAY_ROTATION_270: px = pw - 1 - ly; py = lx;          break;
+                        default:                      px = lx;          py = ly;          break;
+                    }
+                    dst[ly * w + lx] = src[py * pw + px];
+                }
+            }
+        }
+    }
+}
+
+static void splash_write_task(void *arg)
+{
+    splash_job_t *job = (splash_job_t *)arg;
+    const esp_partition_t *part = s_part;
+    size_t total = (SPLASH_HEADER_SIZE + job->header.data_size + SPLASH_HEADER_SIZE - 1) & ~(SPLASH_HEADER_SIZE - 1);
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = ESP_OK;
+
+    if (job->rotation == LV_DISPLAY_ROTATION_0) {
+        job->pixels = (uint8_t *)job->frame;
+    } else {
+        unrotate(job);
+        heap_caps_free(job->frame);
+    }
+    job->frame = NULL;
+
+    // Small steps with a pause in between, flash operations stall the caches
+    for (size_t off = 0; off < total && ret == ESP_OK; off += SPLASH_WRITE_CHUNK) {
+        size_t len = total - off < SPLASH_WRITE_CHUNK ? total - off : SPLASH_WRITE_CHUNK;
+        ret = esp_partition_erase_range(part, off, len);
+        vTaskDelay(1);
+    }
+    for (size_t off = 0; off < job->header.data_size && ret == ESP_OK; off += SPLASH_WRITE_CHUNK) {
+        size_t len = job->header.data_size - off;
+        if (len > SPLASH_WRITE_CHUNK) {
+            len = SPLASH_WRITE_CHUNK;
+        }
+        ret = esp_partition_write(part, SPLASH_HEADER_SIZE + off, job->pixels + off, len);
+        vTaskDelay(1);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(part, 0, &job->header, sizeof(job->header));
+    }
+
+    if (ret == ESP_OK) {
+        printf("Splash: snapshot saved in %lld ms\n", (esp_timer_get_time() - start) / 1000);
+    } else {
+        printf("Splash: failed to save snapshot: %s\n", esp_err_to_name(ret));
+    }
+
+    heap_caps_free(job->pixels);
+    free(job);
+    s_writing = false;
+    vTaskDelete(NULL);
+}
+
+esp_err_t hal_splash_capture(uint32_t key)
+{
+    if (s_writing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const esp_partition_t *part = splash_partition();
+    lv_display_t *disp = lv_display_get_default();
+    if (part == NULL || disp == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    void *fb = hal_display_get_frame_buffer();
+    if (fb == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int32_t w = lv_display_get_horizontal_resolution(disp);
+    int32_t h = lv_display_get_vertical_resolution(disp);
+    int32_t pw = lv_display_get_physical_horizontal_resolution(disp);
+    int32_t ph = lv_display_get_physical_vertical_resolution(disp);
+    size_t size = (size_t)w * h * sizeof(uint16_t);
+    if (size > part->size - SPLASH_HEADER_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    lv_display_rotation_t rot = lv_display_get_rotation(disp);
+    splash_job_t *job = calloc(1, sizeof(*job));
+    uint16_t *frame = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    // Un-rotated into a buffer of its own, the frame copy is what it reads
+    uint8_t *pixels = (rot == LV_DISPLAY_ROTATION_0) ? NULL : heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (job == NULL || frame == NULL || (rot != LV_DISPLAY_ROTATION_0 && pixels == NULL)) {
+        free(job);
+        heap_caps_free(frame);
+        heap_caps_free(pixels);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The frame buffer is written by DMA2D, or in tear-free mode written back
+    // by the flush, behind the cache
+    esp_cache_msync(fb, (size_t)pw * ph * sizeof(uint16_t), ESP_CACHE_MSYNC_FLAG_DIR_M2C);
+
+    // Only the copy happens here, the un-rotation and the flash write run on the write task
+    memcpy(frame, fb, size);
+
+    job->frame = frame;
+    job->frame_w = pw;
+    job->frame_h = ph;
+    job->rotation = rot;
+    job->pixels = pixels;
+    job->header.magic = SPLASH_MAGIC;
+    job->header.version = SPLASH_VERSION;
+    build_id(job->header.build_id);
+    job->header.key = key;
+    job->header.width = w;
+    job->header.height = h;
+    job->header.cf = LV_COLOR_FORMAT_RGB565;
+    job->header.stride = w * sizeof(uint16_t);
+    job->header.data_size = size;
+
+    s_writing = true;
+    if (xTaskCreate(splash_write_task, "splash_wr", 4096, job, HAL_SPLASH_TASK_PRIORITY, NULL) != pdPASS) {
+        s_writing = false;
+        heap_caps_free(frame);
+        heap_caps_free(pixels);
+        free(job);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,64 @@
+#ifndef HAL_SPLASH_H
+#define HAL_SPLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Data partition subtype of the "splash" partition, see partitions.csv
+#define HAL_SPLASH_PARTITION_SUBTYPE 0x40
+
+/**
+ * @brief Show the saved home screen snapshot as the first frame
+ *
+ * Maps the snapshot straight from flash and copies it into the frame
+ * buffer being scanned, so it is on the panel before the backlight comes up.
+ * It also goes on the system layer, where LVGL keeps drawing it while the
+ * real screens are still being built underneath. Call with the display lock
+ * held, right after the display is started (and after
+ * hal_display_tear_free_init(), whose front buffer it draws into).
+ *
+ * @return ESP_OK if the splash is showing, ESP_ERR_NOT_FOUND if there is no
+ *         usable snapshot (none yet, or taken by another firmware build)
+ */
+esp_err_t hal_splash_show(lv_display_t *disp);
+
+/**
+ * @brief Drop the splash once the real screens are built, LVGL task only
+ *
+ * The next refresh draws the real home screen over it.
+ *
+ * @param key Identity of the home screen, see hal_splash_is_current()
+ */
+void hal_splash_finish(uint32_t key);
+
+/**
+ * @brief Whether the saved snapshot was taken of the home screen identified by key
+ *
+ * The key must change whenever the home screen would look different, e.g.
+ * with the list of apps. Snapshots from another firmware build never match,
+ * which covers the theme and anything else compiled in.
+ */
+bool hal_splash_is_current(uint32_t key);
+
+/**
+ * @brief Save what is on the panel as the new snapshot, LVGL task only
+ *
+ * Copies the frame buffer right away; a low priority task undoes the panel
+ * rotation and writes it to flash. The caller makes sure only the home
+ * screen is showing.
+ *
+ * @return ESP_OK if the write was started
+ */
+esp_err_t hal_splash_capture(uint32_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_SPLASH_H
@@ -0,0 +1,296 @@
+#include "hals/hal_touch.h"
+#include "hals/hal_i2c_bus.h"
+#include "hals/hal_touch_filter.h"
+#include "managers/metrics.h"
+#include "managers/refresh_governor.h"
+#include "perf/perf_latency.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_lcd_touch.h"
+
+// Above the I2C arbiter and LVGL so a report is picked up as soon as it is signalled
+#ifndef HAL_TOUCH_TASK_PRIORITY
+#define HAL_TOUCH_TASK_PRIORITY 7
+#endif
+
+// Must be a power of two
+#ifndef HAL_TOUCH_QUEUE_SIZE
+#define HAL_TOUCH_QUEUE_SIZE 32
+#endif
+
+// While pressed, read once more if no interrupt arrives for this long so a
+// missed release report can't leave the pointer stuck down
+#ifndef HAL_TOUCH_RELEASE_TIMEOUT_MS
+#define HAL_TOUCH_RELEASE_TIMEOUT_MS 50
+#endif
+
+// Smooth and predict the pointer between the raw samples and LVGL, off by
+// default, can be turned on at runtime with hal_touch_set_filter_enabled()
+#ifndef HAL_TOUCH_FILTER_ENABLE
+#define HAL_TOUCH_FILTER_ENABLE 0
+#endif
+
+// Print every raw sample as "TT,<timestamp_us>,<count>,<x>,<y>" for tools/touch_replay.c
+#ifndef HAL_TOUCH_TRACE
+#define HAL_TOUCH_TRACE 0
+#endif
+
+extern esp_lcd_touch_handle_t _lcd_touch_handle;
+
+// Lock-free single producer (touch task) / single consumer (LVGL task) ring
+static hal_touch_sample_t s_queue[HAL_TOUCH_QUEUE_SIZE];
+static uint32_t s_head = 0;  // Written by the producer
+static uint32_t s_tail = 0;  // Written by the consumer
+static uint32_t s_dropped = 0;
+static volatile bool s_release_lost = false;
+
+static TaskHandle_t s_touch_task_handle = NULL;
+static volatile int64_t s_irq_time_us = 0;
+
+static hal_touch_sample_cb_t s_sample_cb = NULL;
+
+// State reported to LVGL between samples
+static bool s_pressed = false;
+static lv_point_t s_point = {0, 0};
+static lv_point_t s_raw_point = {0, 0};  // Last point the panel actually reported
+
+// Filter stage, only touched from the LVGL task
+static hal_touch_filter_t s_filter;
+static bool s_filter_enabled = HAL_TOUCH_FILTER_ENABLE;
+static bool s_filter_measure = false;
+
+static bool queue_push(const hal_touch_sample_t* sample)
+{
+    uint32_t head = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= HAL_TOUCH_QUEUE_SIZE) {
+        return false;
+    }
+
+    s_queue[head & (HAL_TOUCH_QUEUE_SIZE - 1)] = *sample;
+    __atomic_store_n(&s_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool hal_touch_pop(hal_touch_sample_t* sample)
+{
+    uint32_t tail = __atomic_load_n(&s_tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *sample = s_queue[tail & (HAL_TOUCH_QUEUE_SIZE - 1)];
+    __atomic_store_n(&s_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool hal_touch_pending(void)
+{
+    return __atomic_load_n(&s_head, __ATOMIC_ACQUIRE) != __atomic_load_n(&s_tail, __ATOMIC_RELAXED);
+}
+
+uint32_t hal_touch_get_dropped(void)
+{
+    return s_dropped;
+}
+
+static int32_t touch_dropped(void)
+{
+    return (int32_t)s_dropped;
+}
+
+METRIC_COUNTER(s_samples, "touch.samples", "samples")
+METRIC_COUNTER_FN(s_dropped_metric, "touch.dropped", "samples", touch_dropped)
+// Interrupt to LVGL reading the sample
+METRIC_HISTOGRAM(s_sample_age_us, "touch.sample_age", "us", 1000, 2000, 5000, 10000, 20000, 50000, 100000)
+
+static void IRAM_ATTR touch_isr(esp_lcd_touch_handle_t tp)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    s_irq_time_us = esp_timer_get_time();
+    vTaskNotifyGiveFromISR(s_touch_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static esp_err_t touch_read_job(void* arg)
+{
+    return esp_lcd_touch_read_data((esp_lcd_touch_handle_t)arg);
+}
+
+static void touch_task(void* arg)
+{
+    bool pressed = false;
+
+    while (1) {
+        TickType_t wait = pressed ? pdMS_TO_TICKS(HAL_TOUCH_RELEASE_TIMEOUT_MS) : portMAX_DELAY;
+        bool from_irq = ulTaskNotifyTake(pdTRUE, wait) > 0;
+
+        hal_touch_sample_t sample = {0};
+        sample.timestamp_us = from_irq ? s_irq_time_us : esp_timer_get_time();
+
+        if (hal_i2c_bus_run(HAL_I2C_DEV_TOUCH, HAL_I2C_PRIO_TOUCH, touch_read_job, _lcd_touch_handle) != ESP_OK) {
+            continue;
+        }
+        if (!esp_lcd_touch_get_coordinates(_lcd_touch_handle, sample.x, sample.y, sample.strength, &sample.count,
+                                           HAL_TOUCH_MAX_POINTS)) {
+            sample.count = 0;
+        }
+
+        // Nothing to report while idle
+        if (sample.count == 0 && !pressed) {
+            continue;
+        }
+        pressed = (sample.count > 0);
+
+        metric_inc(&s_samples);
+        if (!queue_push(&sample)) {
+            s_dropped++;
+            if (!pressed) {
+                s_release_lost = true;
+            }
+        }
+        // Input polling stops while the UI is idle
+        refresh_governor_wake(REFRESH_REASON_INPUT);
+    }
+}
+
+void hal_touch_set_sample_cb(hal_touch_sample_cb_t cb)
+{
+    s_sample_cb = cb;
+}
+
+void hal_touch_set_filter_enabled(bool enable)
+{
+    s_filter_enabled = enable;
+    hal_touch_filter_reset(&s_filter);
+}
+
+bool hal_touch_get_filter_enabled(void)
+{
+    return s_filter_enabled;
+}
+
+void hal_touch_set_filter_params(const hal_touch_filter_params_t* params)
+{
+    bool measure = s_filter_measure;
+    hal_touch_filter_init(&s_filter, params);
+    hal_touch_filter_set_measure(&s_filter, measure);
+}
+
+void hal_touch_set_filter_measure(bool enable)
+{
+    s_filter_measure = enable;
+    hal_touch_filter_set_measure(&s_filter, enable);
+}
+
+static void print_filter_stats(void)
+{
+    hal_touch_filter_stats_t stats;
+    hal_touch_filter_get_stats(&s_filter, &stats);
+    if (stats.count == 0) {
+        return;
+    }
+    printf("Touch prediction error: n=%lu mean %.1f px rms %.1f px max %.1f px\n",
+           (unsigned long)stats.count, stats.mean_px, stats.rms_px, stats.max_px);
+}
+
+static lv_coord_t clamp_coord(float v, int32_t max)
+{
+    if (v < 0.0f) return 0;
+    if (v > (float)(max - 1)) return max - 1;
+    return (lv_coord_t)(v + 0.5f);
+}
+
+// Apply the filter stage to the primary point of a sample
+static void update_point(const hal_touch_sample_t* sample)
+{
+    if (sample->count == 0) {
+        // Release where the finger was lifted, not where the prediction ran on to
+        s_point = s_raw_point;
+        if (s_filter_measure) {
+            // Report per stroke, then start a fresh measurement
+            print_filter_stats();
+            hal_touch_filter_set_measure(&s_filter, true);
+        }
+        hal_touch_filter_reset(&s_filter);
+        return;
+    }
+
+    s_raw_point.x = sample->x[0];
+    s_raw_point.y = sample->y[0];
+    if (!s_filter_enabled) {
+        s_point = s_raw_point;
+        return;
+    }
+
+    lv_display_t* disp = lv_display_get_default();
+    float fx, fy;
+    hal_touch_filter_update(&s_filter, sample->timestamp_us, sample->x[0], sample->y[0], &fx, &fy);
+    s_point.x = clamp_coord(fx, lv_display_get_physical_horizontal_resolution(disp));
+    s_point.y = clamp_coord(fy, lv_display_get_physical_vertical_resolution(disp));
+}
+
+void lvgl_touch_read_cb(lv_indev_t* indev, lv_indev_data_t* data)
+{
+    hal_touch_sample_t sample;
+
+    if (hal_touch_pop(&sample)) {
+        metric_observe(&s_sample_age_us, (uint32_t)(esp_timer_get_time() - sample.timestamp_us));
+#if HAL_TOUCH_TRACE
+        printf("TT,%lld,%u,%u,%u\n", sample.timestamp_us, sample.count, sample.x[0], sample.y[0]);
+#endif
+        s_pressed = (sample.count > 0);
+        if (s_pressed) {
+            perf_latency_input(sample.timestamp_us);
+        }
+        update_point(&sample);
+        if (s_sample_cb) {
+            s_sample_cb(&sample);
+        }
+        // Let LVGL see every queued sample in this read cycle
+        data->continue_reading = hal_touch_pending();
+    } else if (s_release_lost) {
+        s_release_lost = false;
+        s_pressed = false;
+        s_point = s_raw_point;
+        hal_touch_filter_reset(&s_filter);
+        if (s_sample_cb) {
+            hal_touch_sample_t release = {.timestamp_us = esp_timer_get_time(), .count = 0};
+            s_sample_cb(&release);
+        }
+    }
+
+    data->state = s_pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+    data->point = s_point;
+}
+
+void hal_touch_init(void)
+{
+    if (_lcd_touch_handle == NULL) {
+        printf("Touch controller not initialized\n");
+        return;
+    }
+
+    hal_touch_filter_init(&s_filter, NULL);
+
+    if (xTaskCreate(touch_task, "touch", 3072, NULL, HAL_TOUCH_TASK_PRIORITY, &s_touch_task_handle) != pdPASS) {
+        printf("Failed to create touch task\n");
+        return;
+    }
+
+    esp_err_t ret = esp_lcd_touch_register_interrupt_callback(_lcd_touch_handle, touch_isr);
+    if (ret != ESP_OK) {
+        printf("Failed to register touch interrupt: %s\n", esp_err_to_name(ret));
+        return;
+    }
+
+    printf("Touch input interrupt driven\n");
+}
@@ -0,0 +1,99 @@
+#ifndef HAL_TOUCH_H
+#define HAL_TOUCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+#include "hals/hal_touch_filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GT911 reports up to five points
+#define HAL_TOUCH_MAX_POINTS 5
+
+/**
+ * @brief One touch controller report
+ */
+typedef struct {
+    int64_t timestamp_us;                   // Time of the interrupt that produced the report
+    uint8_t count;                          // Number of points, 0 on release
+    uint16_t x[HAL_TOUCH_MAX_POINTS];
+    uint16_t y[HAL_TOUCH_MAX_POINTS];
+    uint16_t strength[HAL_TOUCH_MAX_POINTS];
+} hal_touch_sample_t;
+
+/**
+ * @brief Sample consumer, called from the LVGL task for every sample drained
+ */
+typedef void (*hal_touch_sample_cb_t)(const hal_touch_sample_t *sample);
+
+/**
+ * @brief Start interrupt driven touch sampling
+ *
+ * The touch controller must already exist (bsp_display_start_with_config()).
+ * Samples are read by a high priority task on the controller's interrupt
+ * and queued with their timestamp; nothing touches the bus while idle.
+ */
+void hal_touch_init(void);
+
+/**
+ * @brief Take the oldest queued sample
+ *
+ * Single consumer: call from the LVGL task only.
+ *
+ * @param sample Destination
+ * @return true if a sample was taken
+ */
+bool hal_touch_pop(hal_touch_sample_t *sample);
+
+/**
+ * @brief Check whether samples are waiting
+ */
+bool hal_touch_pending(void);
+
+/**
+ * @brief Number of samples dropped because the queue was full
+ */
+uint32_t hal_touch_get_dropped(void);
+
+/**
+ * @brief Set the consumer that sees every sample, with all points
+ *
+ * @param cb Callback, NULL to remove
+ */
+void hal_touch_set_sample_cb(hal_touch_sample_cb_t cb);
+
+/**
+ * @brief Turn the smoothing/prediction stage on or off
+ */
+void hal_touch_set_filter_enabled(bool enable);
+
+/**
+ * @brief Check whether the smoothing/prediction stage is on
+ */
+bool hal_touch_get_filter_enabled(void);
+
+/**
+ * @brief Retune the filter stage, NULL restores the defaults
+ */
+void hal_touch_set_filter_params(const hal_touch_filter_params_t *params);
+
+/**
+ * @brief Measure predicted against actual positions
+ *
+ * When enabled, the prediction error of each stroke is printed on release.
+ */
+void hal_touch_set_filter_measure(bool enable);
+
+/**
+ * @brief LVGL pointer read callback, drains the sample queue
+ */
+void lvgl_touch_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_TOUCH_H
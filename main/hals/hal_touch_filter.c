@@ -0,0 +1,171 @@
+#include "hals/hal_touch_filter.h"
+#include <math.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Smoothing factor of a first order low-pass at the given cutoff and step
+static float lowpass_alpha(float cutoff_hz, float dt_s)
+{
+    float tau = 1.0f / (2.0f * (float)M_PI * cutoff_hz);
+    return 1.0f / (1.0f + tau / dt_s);
+}
+
+// One 1€ step on a single axis (Casiez et al., CHI 2012)
+static void one_euro_step(hal_touch_filter_axis_t *axis, const hal_touch_filter_params_t *p,
+                          float raw, float raw_prev, float dt_s)
+{
+    float d_raw = (raw - raw_prev) / dt_s;
+    axis->dx += lowpass_alpha(p->d_cutoff, dt_s) * (d_raw - axis->dx);
+
+    float cutoff = p->min_cutoff + p->beta * fabsf(axis->dx);
+    axis->x += lowpass_alpha(cutoff, dt_s) * (raw - axis->x);
+}
+
+static void measure_sample(hal_touch_filter_t *f, int64_t timestamp_us, float x, float y)
+{
+    uint8_t kept = 0;
+
+    for (uint8_t i = 0; i < f->pending_count; i++) {
+        hal_touch_filter_prediction_t *pred = &f->pending[i];
+
+        if (pred->target_us > timestamp_us) {
+            f->pending[kept++] = *pred;
+            continue;
+        }
+
+        // Actual position at the predicted time, interpolated between the raw samples around it
+        float span = (float)(timestamp_us - f->prev_us);
+        float t = (span > 0.0f) ? (float)(pred->target_us - f->prev_us) / span : 1.0f;
+        if (t < 0.0f) t = 0.0f;
+        float ax = f->prev_raw_x + (x - f->prev_raw_x) * t;
+        float ay = f->prev_raw_y + (y - f->prev_raw_y) * t;
+
+        float err = sqrtf((pred->x - ax) * (pred->x - ax) + (pred->y - ay) * (pred->y - ay));
+        f->err_count++;
+        f->err_sum += err;
+        f->err_sq_sum += (double)err * err;
+        if (err > f->err_max) {
+            f->err_max = err;
+        }
+    }
+
+    f->pending_count = kept;
+}
+
+static void measure_push(hal_touch_filter_t *f, int64_t target_us, float x, float y)
+{
+    if (f->pending_count >= HAL_TOUCH_FILTER_PENDING) {
+        // Drop the oldest, it will never be matched at this rate anyway
+        memmove(&f->pending[0], &f->pending[1], sizeof(f->pending[0]) * (HAL_TOUCH_FILTER_PENDING - 1));
+        f->pending_count--;
+    }
+    f->pending[f->pending_count].target_us = target_us;
+    f->pending[f->pending_count].x = x;
+    f->pending[f->pending_count].y = y;
+    f->pending_count++;
+}
+
+void hal_touch_filter_default_params(hal_touch_filter_params_t *params)
+{
+    params->min_cutoff = 1.5f;
+    params->beta = 0.05f;
+    params->d_cutoff = 8.0f;
+    params->predict_ms = 16.0f;
+    params->max_predict_px = 40.0f;
+}
+
+void hal_touch_filter_init(hal_touch_filter_t *filter, const hal_touch_filter_params_t *params)
+{
+    memset(filter, 0, sizeof(*filter));
+    if (params) {
+        filter->params = *params;
+    } else {
+        hal_touch_filter_default_params(&filter->params);
+    }
+}
+
+void hal_touch_filter_reset(hal_touch_filter_t *filter)
+{
+    filter->has_prev = false;
+    filter->pending_count = 0;
+}
+
+void hal_touch_filter_update(hal_touch_filter_t *filter, int64_t timestamp_us, float x, float y,
+                             float *out_x, float *out_y)
+{
+    const hal_touch_filter_params_t *p = &filter->params;
+
+    if (!filter->has_prev) {
+        // First sample of a stroke passes through unchanged
+        filter->ax.x = x;
+        filter->ax.dx = 0.0f;
+        filter->ay.x = y;
+        filter->ay.dx = 0.0f;
+        filter->has_prev = true;
+    } else {
+        if (filter->measure) {
+            measure_sample(filter, timestamp_us, x, y);
+        }
+
+        float dt_s = (float)(timestamp_us - filter->prev_us) * 1e-6f;
+        if (dt_s <= 0.0f) {
+            dt_s = 1e-3f;
+        }
+        one_euro_step(&filter->ax, p, x, filter->prev_raw_x, dt_s);
+        one_euro_step(&filter->ay, p, y, filter->prev_raw_y, dt_s);
+    }
+
+    filter->prev_us = timestamp_us;
+    filter->prev_raw_x = x;
+    filter->prev_raw_y = y;
+
+    float px = filter->ax.x;
+    float py = filter->ay.x;
+
+    if (p->predict_ms > 0.0f) {
+        float h = p->predict_ms * 1e-3f;
+        float vx = filter->ax.dx * h;
+        float vy = filter->ay.dx * h;
+        float len = sqrtf(vx * vx + vy * vy);
+
+        if (len > p->max_predict_px && len > 0.0f) {
+            vx *= p->max_predict_px / len;
+            vy *= p->max_predict_px / len;
+        }
+        px += vx;
+        py += vy;
+
+        if (filter->measure) {
+            measure_push(filter, timestamp_us + (int64_t)(p->predict_ms * 1000.0f), px, py);
+        }
+    }
+
+    *out_x = px;
+    *out_y = py;
+}
+
+void hal_touch_filter_set_measure(hal_touch_filter_t *filter, bool enable)
+{
+    filter->measure = enable;
+    filter->pending_count = 0;
+    filter->err_count = 0;
+    filter->err_sum = 0.0;
+    filter->err_sq_sum = 0.0;
+    filter->err_max = 0.0f;
+}
+
+void hal_touch_filter_get_stats(const hal_touch_filter_t *filter, hal_touch_filter_stats_t *stats)
+{
+    stats->count = filter->err_count;
+    stats->max_px = filter->err_max;
+    if (filter->err_count > 0) {
+        stats->mean_px = (float)(filter->err_sum / filter->err_count);
+        stats->rms_px = (float)sqrt(filter->err_sq_sum / filter->err_count);
+    } else {
+        stats->mean_px = 0.0f;
+        stats->rms_px = 0.0f;
+    }
+}
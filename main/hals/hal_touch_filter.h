@@ -0,0 +1,118 @@
+#ifndef HAL_TOUCH_FILTER_H
+#define HAL_TOUCH_FILTER_H
+
+// Plain C, no ESP-IDF dependencies: also built on host by tools/touch_replay.c
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of outstanding predictions tracked in measurement mode
+#define HAL_TOUCH_FILTER_PENDING 8
+
+/**
+ * @brief Filter tuning
+ */
+typedef struct {
+    float min_cutoff;       // 1€ cutoff at rest (Hz), lower removes more jitter when still
+    float beta;             // 1€ speed coefficient, higher reduces lag when moving fast
+    float d_cutoff;         // Cutoff of the velocity estimate (Hz)
+    float predict_ms;       // Prediction horizon from the sample time, 0 disables prediction
+    float max_predict_px;   // Upper bound of the predicted displacement
+} hal_touch_filter_params_t;
+
+/**
+ * @brief Prediction error collected in measurement mode
+ */
+typedef struct {
+    uint32_t count;
+    float mean_px;
+    float rms_px;
+    float max_px;
+} hal_touch_filter_stats_t;
+
+typedef struct {
+    float x;                // Filtered value
+    float dx;               // Filtered derivative (px/s)
+} hal_touch_filter_axis_t;
+
+typedef struct {
+    int64_t target_us;
+    float x;
+    float y;
+} hal_touch_filter_prediction_t;
+
+/**
+ * @brief Filter state for one pointer, no dynamic memory
+ */
+typedef struct {
+    hal_touch_filter_params_t params;
+    hal_touch_filter_axis_t ax;
+    hal_touch_filter_axis_t ay;
+    bool has_prev;
+    int64_t prev_us;
+    float prev_raw_x;
+    float prev_raw_y;
+
+    // Measurement mode
+    bool measure;
+    hal_touch_filter_prediction_t pending[HAL_TOUCH_FILTER_PENDING];
+    uint8_t pending_count;
+    uint32_t err_count;
+    double err_sum;
+    double err_sq_sum;
+    float err_max;
+} hal_touch_filter_t;
+
+/**
+ * @brief Default parameters for the Tab5 panel at its native resolution
+ */
+void hal_touch_filter_default_params(hal_touch_filter_params_t *params);
+
+/**
+ * @brief Initialize a filter
+ *
+ * @param filter Filter state
+ * @param params Tuning, NULL for defaults
+ */
+void hal_touch_filter_init(hal_touch_filter_t *filter, const hal_touch_filter_params_t *params);
+
+/**
+ * @brief Forget the current stroke, call when the finger lifts
+ */
+void hal_touch_filter_reset(hal_touch_filter_t *filter);
+
+/**
+ * @brief Feed one raw position and get the smoothed, predicted position
+ *
+ * @param filter Filter state
+ * @param timestamp_us Sample time
+ * @param x Raw x
+ * @param y Raw y
+ * @param out_x Output x
+ * @param out_y Output y
+ */
+void hal_touch_filter_update(hal_touch_filter_t *filter, int64_t timestamp_us, float x, float y,
+                             float *out_x, float *out_y);
+
+/**
+ * @brief Enable measurement of predicted against actual positions
+ *
+ * Each prediction is compared with the raw position interpolated at the
+ * predicted time once a later sample arrives. Enabling clears the statistics.
+ */
+void hal_touch_filter_set_measure(hal_touch_filter_t *filter, bool enable);
+
+/**
+ * @brief Get the prediction error statistics
+ */
+void hal_touch_filter_get_stats(const hal_touch_filter_t *filter, hal_touch_filter_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAL_TOUCH_FILTER_H
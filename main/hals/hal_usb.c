@@ -1,10 +1,113 @@
 #include "hals/hal_usb.h"
+#include "hals/hal_hid_parser.h"
+#include "hals/hal_cursor.h"
+#include "managers/dlog.h"
+#include "managers/event_bus.h"
+#include "managers/metrics.h"
+#include "managers/refresh_governor.h"
+#include "perf/perf_trace.h"
 #include "esp_log.h"
 #include "esp_err.h"
 #include <string.h>
 
 static const char *TAG = "HAL_USB";
 
+// Must be a power of two
+#ifndef HAL_USB_MOUSE_QUEUE_SIZE
+#define HAL_USB_MOUSE_QUEUE_SIZE 64
+#endif
+
+// How long a button change may wait for room in a full queue before it is dropped
+#ifndef HAL_USB_MOUSE_PUSH_WAIT_MS
+#define HAL_USB_MOUSE_PUSH_WAIT_MS 20
+#endif
+
+// Must be a power of two
+#ifndef HAL_USB_KEY_QUEUE_SIZE
+#define HAL_USB_KEY_QUEUE_SIZE 32
+#endif
+
+// Pixels scrolled per wheel detent
+#ifndef HAL_USB_WHEEL_STEP_PX
+#define HAL_USB_WHEEL_STEP_PX 48
+#endif
+
+// HID interfaces handled at once, e.g. a keyboard and a mouse on one receiver count as two
+#ifndef HAL_USB_HID_MAX_DEVICES
+#define HAL_USB_HID_MAX_DEVICES 4
+#endif
+
+typedef enum {
+    USB_MOUSE_EVT_REPORT = 0,
+    USB_MOUSE_EVT_CONNECTED,
+    USB_MOUSE_EVT_DISCONNECTED,
+} usb_mouse_event_type_t;
+
+// One mouse report or connection change, in screen (native panel) axes
+typedef struct {
+    uint8_t type;
+    uint8_t buttons;
+    int8_t wheel;
+    int16_t dx;
+    int16_t dy;
+} usb_mouse_event_t;
+
+// Key press or release for the keypad indev
+typedef struct {
+    uint32_t key;       // LV_KEY_* or a character
+    bool pressed;
+} usb_key_event_t;
+
+// What an interface was recognised as from its report descriptor, as reported on the event bus
+#define USB_HID_KIND_MOUSE      EVENT_USB_MOUSE
+#define USB_HID_KIND_KEYBOARD   EVENT_USB_KEYBOARD
+#define USB_HID_KIND_GAMEPAD    EVENT_USB_GAMEPAD
+
+#define USB_MOUSE_BUTTONS       8
+
+// Gamepad controls, as bits of usb_hid_slot_t.pad_state
+#define PAD_UP      0x01
+#define PAD_DOWN    0x02
+#define PAD_LEFT    0x04
+#define PAD_RIGHT   0x08
+#define PAD_ENTER   0x10
+#define PAD_ESC     0x20
+#define PAD_PREV    0x40
+#define PAD_NEXT    0x80
+#define PAD_COUNT   8
+#define PAD_BUTTONS 4
+
+// Element of a field holding one usage
+typedef struct {
+    const hal_hid_field_t *field;
+    uint8_t index;
+} usb_hid_ref_t;
+
+// One opened HID interface and its decoding tables, only touched by the HID task
+typedef struct {
+    hid_host_device_handle_t handle;
+    uint8_t kinds;
+    hal_hid_map_t map;
+    
+    usb_hid_ref_t mouse_buttons[USB_MOUSE_BUTTONS];
+    usb_hid_ref_t mouse_x;
+    usb_hid_ref_t mouse_y;
+    usb_hid_ref_t mouse_wheel;
+    
+    uint32_t kb_app;
+    uint32_t kb_keys[8];        // Usages held in the last keyboard report, one bit each
+    
+    usb_hid_ref_t pad_x;
+    usb_hid_ref_t pad_y;
+    usb_hid_ref_t pad_hat;
+    usb_hid_ref_t pad_buttons[PAD_BUTTONS];
+    uint8_t pad_state;
+    
+    // The single key reported to LVGL as held, keypads have one at a time
+    uint32_t held_key;
+    uint16_t held_usage;
+} usb_hid_slot_t;
+
 // Global USB mouse data
 usb_mouse_data_t g_usb_mouse_data = {0};
 // Remove this line - lvUsbMouse is already defined in hal.c:
@@ -14,24 +117,691 @@ usb_mouse_data_t g_usb_mouse_data = {0};
 static TaskHandle_t usb_host_task_handle = NULL;
 static QueueHandle_t app_event_queue = NULL;
 
+// Lock-free single producer (HID task) / single consumer (LVGL task) ring
+static usb_mouse_event_t s_mouse_queue[HAL_USB_MOUSE_QUEUE_SIZE];
+static uint32_t s_mouse_head = 0;  // Written by the producer
+static uint32_t s_mouse_tail = 0;  // Written by the consumer
+static uint32_t s_mouse_dropped = 0;
+
+// Motion that didn't fit while the queue was full, only touched by the producer
+static int32_t s_overflow_dx = 0;
+static int32_t s_overflow_dy = 0;
+static uint8_t s_last_buttons = 0;
+static uint8_t s_mice_connected = 0;
+
+// Same for the keyboard and gamepad keys
+static usb_key_event_t s_key_queue[HAL_USB_KEY_QUEUE_SIZE];
+static uint32_t s_key_head = 0;
+static uint32_t s_key_tail = 0;
+static uint32_t s_key_dropped = 0;
+
+// Keypad state reported to LVGL between events
+static uint32_t s_key_last = 0;
+static bool s_key_pressed = false;
+
+static usb_hid_slot_t s_hid_slots[HAL_USB_HID_MAX_DEVICES];
+
 // HID device handle
 // Remove or comment out this line since it's not used:
 // static hid_host_device_handle_t hid_device_handle = NULL;
 
-void hal_usb_init(void)
+// Center of the panel, in the native orientation the indev reports in
+static void mouse_recenter(void)
 {
-    ESP_LOGI(TAG, "Initializing USB HAL");
+    lv_display_t *disp = lv_display_get_default();
+    g_usb_mouse_data.x = lv_display_get_physical_horizontal_resolution(disp) / 2;
+    g_usb_mouse_data.y = lv_display_get_physical_vertical_resolution(disp) / 2;
+}
+
+static bool mouse_push(const usb_mouse_event_t *evt)
+{
+    uint32_t head = __atomic_load_n(&s_mouse_head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&s_mouse_tail, __ATOMIC_ACQUIRE);
+    
+    if (head - tail >= HAL_USB_MOUSE_QUEUE_SIZE) {
+        return false;
+    }
+    
+    s_mouse_queue[head & (HAL_USB_MOUSE_QUEUE_SIZE - 1)] = *evt;
+    __atomic_store_n(&s_mouse_head, head + 1, __ATOMIC_RELEASE);
+    refresh_governor_wake(REFRESH_REASON_INPUT);
+    return true;
+}
+
+static int16_t clamp_delta(int32_t v)
+{
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < INT16_MIN) return INT16_MIN;
+    return (int16_t)v;
+}
+
+// Queue the motion parked during an overflow ahead of anything newer
+static bool mouse_push_overflow(void)
+{
+    if (s_overflow_dx == 0 && s_overflow_dy == 0) {
+        return true;
+    }
+    
+    const usb_mouse_event_t evt = {
+        .type = USB_MOUSE_EVT_REPORT,
+        .buttons = s_last_buttons,
+        .dx = clamp_delta(s_overflow_dx),
+        .dy = clamp_delta(s_overflow_dy),
+    };
+    if (!mouse_push(&evt)) {
+        return false;
+    }
+    s_overflow_dx = 0;
+    s_overflow_dy = 0;
+    return true;
+}
+
+static bool mouse_push_motion(const usb_mouse_event_t *evt)
+{
+    return mouse_push_overflow() && mouse_push(evt);
+}
+
+// Events that must not be lost wait for the LVGL task to make room
+static bool mouse_push_wait(const usb_mouse_event_t *evt)
+{
+    TickType_t start = xTaskGetTickCount();
+    
+    while (!mouse_push_motion(evt)) {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(HAL_USB_MOUSE_PUSH_WAIT_MS)) {
+            s_mouse_dropped++;
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    return true;
+}
+
+static bool mouse_pop(usb_mouse_event_t *evt)
+{
+    uint32_t tail = __atomic_load_n(&s_mouse_tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&s_mouse_head, __ATOMIC_ACQUIRE);
+    
+    if (head == tail) {
+        return false;
+    }
+    
+    *evt = s_mouse_queue[tail & (HAL_USB_MOUSE_QUEUE_SIZE - 1)];
+    __atomic_store_n(&s_mouse_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool mouse_pending(void)
+{
+    return __atomic_load_n(&s_mouse_head, __ATOMIC_ACQUIRE) != __atomic_load_n(&s_mouse_tail, __ATOMIC_RELAXED);
+}
+
+static void set_cursor_visible(bool visible)
+{
+    if (hal_cursor_is_active()) {
+        hal_cursor_set_pos(g_usb_mouse_data.x, g_usb_mouse_data.y);
+        hal_cursor_set_visible(visible);
+        return;
+    }
     
-    // Create mutex for thread-safe access to mouse data
-    g_usb_mouse_data.mutex = xSemaphoreCreateMutex();
-    if (g_usb_mouse_data.mutex == NULL) {
-        ESP_LOGE(TAG, "Failed to create mouse data mutex");
+    lv_obj_t *cursor_obj = lvUsbMouse ? lv_indev_get_cursor(lvUsbMouse) : NULL;
+    if (cursor_obj == NULL) {
         return;
     }
+    if (visible) {
+        lv_obj_remove_flag(cursor_obj, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_add_flag(cursor_obj, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+// Scroll whatever is under the pointer that still has room in the wheel's direction; LVGL task only
+static void mouse_wheel_scroll(int8_t wheel)
+{
+    if (lvUsbMouse == NULL) {
+        return;
+    }
+    
+    // Last processed point, already in the rotated screen coordinates
+    lv_point_t point;
+    lv_indev_get_point(lvUsbMouse, &point);
+    lv_obj_t *obj = lv_indev_search_obj(lv_layer_top(), &point);
+    if (obj == NULL) {
+        obj = lv_indev_search_obj(lv_screen_active(), &point);
+    }
     
-    // Initialize mouse position to center of screen using proper LVGL API
-    g_usb_mouse_data.x = lv_display_get_horizontal_resolution(NULL) / 2;
-    g_usb_mouse_data.y = lv_display_get_vertical_resolution(NULL) / 2;
+    // Wheel up (positive) reveals what is above
+    int32_t dy = wheel * HAL_USB_WHEEL_STEP_PX;
+    for (; obj != NULL; obj = lv_obj_get_parent(obj)) {
+        if (!lv_obj_has_flag(obj, LV_OBJ_FLAG_SCROLLABLE)) {
+            continue;
+        }
+        if ((dy > 0 && lv_obj_get_scroll_top(obj) > 0) || (dy < 0 && lv_obj_get_scroll_bottom(obj) > 0)) {
+            lv_obj_scroll_by_bounded(obj, 0, dy, LV_ANIM_ON);
+            return;
+        }
+    }
+}
+
+// Fold one event into the pointer state; LVGL task only
+static void mouse_apply(const usb_mouse_event_t *evt)
+{
+    switch (evt->type) {
+        case USB_MOUSE_EVT_CONNECTED:
+            g_usb_mouse_data.device_connected = true;
+            set_cursor_visible(true);
+            ESP_LOGI(TAG, "USB mouse cursor shown");
+            return;
+            
+        case USB_MOUSE_EVT_DISCONNECTED:
+            mouse_recenter();
+            g_usb_mouse_data.left_button = false;
+            g_usb_mouse_data.right_button = false;
+            g_usb_mouse_data.middle_button = false;
+            g_usb_mouse_data.wheel = 0;
+            g_usb_mouse_data.device_connected = false;
+            set_cursor_visible(false);
+            ESP_LOGI(TAG, "USB mouse cursor hidden");
+            return;
+            
+        default:
+            break;
+    }
+    
+    g_usb_mouse_data.left_button = (evt->buttons & 0x01) != 0;
+    g_usb_mouse_data.right_button = (evt->buttons & 0x02) != 0;
+    g_usb_mouse_data.middle_button = (evt->buttons & 0x04) != 0;
+    g_usb_mouse_data.wheel = evt->wheel;
+    if (evt->wheel != 0 && g_usb_mouse_data.device_connected) {
+        mouse_wheel_scroll(evt->wheel);
+    }
+    
+    // Clamp to the panel in its native orientation, the indev is rotated with the display
+    lv_display_t *disp = lv_display_get_default();
+    int32_t max_x = lv_display_get_physical_horizontal_resolution(disp) - 1;
+    int32_t max_y = lv_display_get_physical_vertical_resolution(disp) - 1;
+    int32_t x = g_usb_mouse_data.x + evt->dx;
+    int32_t y = g_usb_mouse_data.y + evt->dy;
+    
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x > max_x) x = max_x;
+    if (y > max_y) y = max_y;
+    g_usb_mouse_data.x = x;
+    g_usb_mouse_data.y = y;
+    
+    // The overlay cursor isn't an LVGL object, LVGL won't move it
+    if (hal_cursor_is_active() && g_usb_mouse_data.device_connected) {
+        hal_cursor_set_pos(x, y);
+    }
+}
+
+static bool key_push(const usb_key_event_t *evt)
+{
+    uint32_t head = __atomic_load_n(&s_key_head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&s_key_tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= HAL_USB_KEY_QUEUE_SIZE) {
+        return false;
+    }
+
+    s_key_queue[head & (HAL_USB_KEY_QUEUE_SIZE - 1)] = *evt;
+    __atomic_store_n(&s_key_head, head + 1, __ATOMIC_RELEASE);
+    refresh_governor_wake(REFRESH_REASON_INPUT);
+    return true;
+}
+
+// Key changes are never merged, wait for room like mouse button changes
+static void key_push_wait(uint32_t key, bool pressed)
+{
+    const usb_key_event_t evt = {.key = key, .pressed = pressed};
+    TickType_t start = xTaskGetTickCount();
+
+    while (!key_push(&evt)) {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(HAL_USB_MOUSE_PUSH_WAIT_MS)) {
+            s_key_dropped++;
+            return;
+        }
+        vTaskDelay(1);
+    }
+}
+
+static bool key_pop(usb_key_event_t *evt)
+{
+    uint32_t tail = __atomic_load_n(&s_key_tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&s_key_head, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *evt = s_key_queue[tail & (HAL_USB_KEY_QUEUE_SIZE - 1)];
+    __atomic_store_n(&s_key_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool key_pending(void)
+{
+    return __atomic_load_n(&s_key_head, __ATOMIC_ACQUIRE) != __atomic_load_n(&s_key_tail, __ATOMIC_RELAXED);
+}
+
+// Characters of keyboard usages 0x1E..0x38, plain and with shift (US layout)
+static const char s_usage_chars[][2] = {
+    {'1', '!'}, {'2', '@'}, {'3', '#'}, {'4', '$'}, {'5', '%'}, {'6', '^'}, {'7', '&'}, {'8', '*'},
+    {'9', '('}, {'0', ')'}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {' ', ' '}, {'-', '_'},
+    {'=', '+'}, {'[', '{'}, {']', '}'}, {'\\', '|'}, {'#', '~'}, {';', ':'}, {'\'', '"'}, {'`', '~'},
+    {',', '<'}, {'.', '>'}, {'/', '?'},
+};
+
+// Keypad usages 0x54..0x63
+static const char s_keypad_chars[] = "/*-+\n1234567890.";
+
+// LVGL key of a keyboard usage, 0 for keys LVGL has no use for
+static uint32_t usage_to_lv_key(uint16_t usage, bool shift)
+{
+    if (usage >= 0x04 && usage <= 0x1D) {
+        return (shift ? 'A' : 'a') + (usage - 0x04);
+    }
+    if (usage >= 0x1E && usage <= 0x38 && s_usage_chars[usage - 0x1E][0] != 0) {
+        return s_usage_chars[usage - 0x1E][shift ? 1 : 0];
+    }
+    if (usage >= 0x54 && usage <= 0x63) {
+        char c = s_keypad_chars[usage - 0x54];
+        return (c == '\n') ? LV_KEY_ENTER : (uint32_t)c;
+    }
+
+    switch (usage) {
+        case 0x28: return LV_KEY_ENTER;
+        case 0x29: return LV_KEY_ESC;
+        case 0x2A: return LV_KEY_BACKSPACE;
+        case 0x2B: return shift ? LV_KEY_PREV : LV_KEY_NEXT;
+        case 0x4A: return LV_KEY_HOME;
+        case 0x4C: return LV_KEY_DEL;
+        case 0x4D: return LV_KEY_END;
+        case 0x4F: return LV_KEY_RIGHT;
+        case 0x50: return LV_KEY_LEFT;
+        case 0x51: return LV_KEY_DOWN;
+        case 0x52: return LV_KEY_UP;
+        default: return 0;
+    }
+}
+
+static usb_hid_slot_t *slot_find(hid_host_device_handle_t handle)
+{
+    for (int i = 0; i < HAL_USB_HID_MAX_DEVICES; i++) {
+        if (s_hid_slots[i].handle == handle) {
+            return &s_hid_slots[i];
+        }
+    }
+    return NULL;
+}
+
+static usb_hid_slot_t *slot_alloc(hid_host_device_handle_t handle)
+{
+    usb_hid_slot_t *slot = slot_find(NULL);
+    if (slot) {
+        memset(slot, 0, sizeof(*slot));
+        slot->handle = handle;
+    }
+    return slot;
+}
+
+static bool ref_find(const hal_hid_map_t *map, uint32_t app, uint16_t page, uint16_t usage, usb_hid_ref_t *ref)
+{
+    ref->field = hal_hid_find(map, app, page, usage, &ref->index);
+    return ref->field != NULL;
+}
+
+static bool ref_get(const usb_hid_slot_t *slot, const usb_hid_ref_t *ref, const uint8_t *report, size_t len,
+                    int32_t *value)
+{
+    return ref->field && hal_hid_get(&slot->map, ref->field, report, len, ref->index, value);
+}
+
+// Gamepad buttons turned into keys: A, B and the shoulder buttons on most pads
+static const struct {
+    uint8_t button;     // Usage on the button page
+    uint8_t bit;
+} s_pad_buttons[PAD_BUTTONS] = {
+    {1, PAD_ENTER}, {2, PAD_ESC}, {5, PAD_PREV}, {6, PAD_NEXT},
+};
+
+// Work out from the parsed descriptor what the interface is, once at connect
+static uint8_t slot_classify(usb_hid_slot_t *slot)
+{
+    const hal_hid_map_t *map = &slot->map;
+    static const uint32_t mouse_apps[] = {
+        HAL_HID_APP(HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_MOUSE),
+        HAL_HID_APP(HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_POINTER),
+    };
+    static const uint32_t pad_apps[] = {
+        HAL_HID_APP(HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_GAMEPAD),
+        HAL_HID_APP(HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_JOYSTICK),
+    };
+
+    slot->kinds = 0;
+
+    for (int i = 0; i < 2 && !(slot->kinds & USB_HID_KIND_MOUSE); i++) {
+        uint32_t app = mouse_apps[i];
+        if (ref_find(map, app, HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_X, &slot->mouse_x) &&
+            ref_find(map, app, HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_Y, &slot->mouse_y) &&
+            (slot->mouse_x.field->flags & HAL_HID_FIELD_RELATIVE)) {
+            for (int b = 0; b < USB_MOUSE_BUTTONS; b++) {
+                ref_find(map, app, HAL_HID_PAGE_BUTTON, b + 1, &slot->mouse_buttons[b]);
+            }
+            ref_find(map, app, HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_WHEEL, &slot->mouse_wheel);
+            slot->kinds |= USB_HID_KIND_MOUSE;
+        }
+    }
+
+    slot->kb_app = HAL_HID_APP(HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_KEYBOARD);
+    if (hal_hid_find_array(map, slot->kb_app, HAL_HID_PAGE_KEYBOARD, NULL) ||
+        hal_hid_find(map, slot->kb_app, HAL_HID_PAGE_KEYBOARD, 0x04, NULL)) {
+        slot->kinds |= USB_HID_KIND_KEYBOARD;
+    }
+
+    for (int i = 0; i < 2 && !(slot->kinds & USB_HID_KIND_GAMEPAD); i++) {
+        uint32_t app = pad_apps[i];
+        bool axes = ref_find(map, app, HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_X, &slot->pad_x) &&
+                    ref_find(map, app, HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_Y, &slot->pad_y);
+        bool hat = ref_find(map, app, HAL_HID_PAGE_GENERIC_DESKTOP, HAL_HID_USAGE_HAT_SWITCH, &slot->pad_hat);
+        if (axes || hat) {
+            if (!axes) {
+                slot->pad_x.field = NULL;
+                slot->pad_y.field = NULL;
+            }
+            for (int b = 0; b < PAD_BUTTONS; b++) {
+                ref_find(map, app, HAL_HID_PAGE_BUTTON, s_pad_buttons[b].button, &slot->pad_buttons[b]);
+            }
+            slot->kinds |= USB_HID_KIND_GAMEPAD;
+        }
+    }
+
+    return slot->kinds;
+}
+
+// Hand a key change of an interface to LVGL, keeping one key held at a time
+static void slot_key(usb_hid_slot_t *slot, uint16_t usage, uint32_t key, bool pressed)
+{
+    if (pressed) {
+        if (slot->held_key != 0) {
+            key_push_wait(slot->held_key, false);
+        }
+        key_push_wait(key, true);
+        slot->held_key = key;
+        slot->held_usage = usage;
+    } else if (slot->held_key != 0 && slot->held_usage == usage) {
+        key_push_wait(slot->held_key, false);
+        slot->held_key = 0;
+    }
+}
+
+static void slot_release_keys(usb_hid_slot_t *slot)
+{
+    if (slot->held_key != 0) {
+        key_push_wait(slot->held_key, false);
+        slot->held_key = 0;
+    }
+}
+
+// Report in HID axes, the panel is mounted rotated so X and Y swap and Y inverts
+static void mouse_post(uint8_t buttons, int32_t x, int32_t y, int32_t wheel)
+{
+    usb_mouse_event_t evt = {
+        .type = USB_MOUSE_EVT_REPORT,
+        .buttons = buttons,
+        .wheel = (wheel > INT8_MAX) ? INT8_MAX : (wheel < INT8_MIN) ? INT8_MIN : wheel,
+        .dx = clamp_delta(y),
+        .dy = clamp_delta(-x),
+    };
+
+    if (evt.buttons == s_last_buttons) {
+        // Pure motion never has to wait; park it while the queue is full
+        if (!mouse_push_motion(&evt)) {
+            s_overflow_dx += evt.dx;
+            s_overflow_dy += evt.dy;
+        }
+    } else {
+        // A button change is ordered after every earlier motion and never merged
+        if (!mouse_push_wait(&evt)) {
+            ESP_LOGW(TAG, "Mouse queue full, button change dropped");
+        }
+    }
+    s_last_buttons = evt.buttons;
+
+    // Once per report, so deferred: nothing is formatted on the USB task
+    DLOG_D("usb: Mouse: dx=%d, dy=%d, buttons=0x%02X, wheel=%d", evt.dx, evt.dy, evt.buttons, evt.wheel);
+}
+
+static void decode_mouse(usb_hid_slot_t *slot, const uint8_t *report, size_t len)
+{
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t wheel = 0;
+    int32_t v;
+
+    // Other report IDs of the interface don't carry the pointer
+    if (!ref_get(slot, &slot->mouse_x, report, len, &x)) {
+        return;
+    }
+    ref_get(slot, &slot->mouse_y, report, len, &y);
+    ref_get(slot, &slot->mouse_wheel, report, len, &wheel);
+
+    uint8_t buttons = 0;
+    for (int i = 0; i < USB_MOUSE_BUTTONS; i++) {
+        if (ref_get(slot, &slot->mouse_buttons[i], report, len, &v) && v) {
+            buttons |= 1 << i;
+        }
+    }
+
+    mouse_post(buttons, x, y, wheel);
+}
+
+static void decode_keyboard(usb_hid_slot_t *slot, const uint8_t *report, size_t len)
+{
+    const hal_hid_map_t *map = &slot->map;
+    uint8_t report_id = hal_hid_report_id(map, report, len);
+    uint32_t keys[8] = {0};
+    bool matched = false;
+    int32_t v;
+
+    for (uint8_t i = 0; i < map->field_count; i++) {
+        const hal_hid_field_t *f = &map->fields[i];
+
+        if (f->usage_page != HAL_HID_PAGE_KEYBOARD || f->app_usage != slot->kb_app || f->report_id != report_id) {
+            continue;
+        }
+        matched = true;
+
+        for (uint8_t n = 0; n < f->count; n++) {
+            if (!hal_hid_get(map, f, report, len, n, &v)) {
+                break;
+            }
+
+            uint32_t usage;
+            if (f->flags & HAL_HID_FIELD_VARIABLE) {
+                if (!v) {
+                    continue;
+                }
+                usage = f->usage_min + n;
+            } else {
+                if (v < f->logical_min || v > f->logical_max) {
+                    continue;
+                }
+                usage = f->usage_min + (v - f->logical_min);
+                if (usage == 0x01) {
+                    // Too many keys down, the report says nothing about which
+                    return;
+                }
+            }
+            if (usage > 0x03 && usage < 256) {
+                keys[usage / 32] |= 1u << (usage % 32);
+            }
+        }
+    }
+    if (!matched) {
+        return;
+    }
+
+    bool shift = (keys[0xE0 / 32] & ((1u << (0xE1 % 32)) | (1u << (0xE5 % 32)))) != 0;
+
+    // Releases first so a fast roll from one key to the next reads in order
+    for (int pass = 0; pass < 2; pass++) {
+        bool pressed = (pass == 1);
+
+        for (uint16_t usage = 0x04; usage < 0xE0; usage++) {
+            uint32_t bit = 1u << (usage % 32);
+            bool was = (slot->kb_keys[usage / 32] & bit) != 0;
+            bool now = (keys[usage / 32] & bit) != 0;
+
+            if (was != now && now == pressed) {
+                uint32_t key = usage_to_lv_key(usage, shift);
+                if (key != 0 || !pressed) {
+                    slot_key(slot, usage, key, pressed);
+                }
+            }
+        }
+    }
+
+    memcpy(slot->kb_keys, keys, sizeof(keys));
+}
+
+// Stick position as -1, 0 or 1, with a dead zone over the middle half of the range
+static int axis_direction(const hal_hid_field_t *f, int32_t v)
+{
+    int32_t quarter = (f->logical_max - f->logical_min) / 4;
+
+    if (v < f->logical_min + quarter) return -1;
+    if (v > f->logical_max - quarter) return 1;
+    return 0;
+}
+
+static void decode_gamepad(usb_hid_slot_t *slot, const uint8_t *report, size_t len)
+{
+    static const uint8_t hat_dirs[8] = {
+        PAD_UP, PAD_UP | PAD_RIGHT, PAD_RIGHT, PAD_DOWN | PAD_RIGHT,
+        PAD_DOWN, PAD_DOWN | PAD_LEFT, PAD_LEFT, PAD_UP | PAD_LEFT,
+    };
+    static const uint32_t pad_keys[PAD_COUNT] = {
+        LV_KEY_UP, LV_KEY_DOWN, LV_KEY_LEFT, LV_KEY_RIGHT, LV_KEY_ENTER, LV_KEY_ESC, LV_KEY_PREV, LV_KEY_NEXT,
+    };
+    uint8_t state = 0;
+    bool matched = false;
+    int32_t v;
+
+    if (ref_get(slot, &slot->pad_hat, report, len, &v)) {
+        matched = true;
+        const hal_hid_field_t *f = slot->pad_hat.field;
+        if (v >= f->logical_min && v - f->logical_min < 8) {
+            state |= hat_dirs[v - f->logical_min];
+        }
+    }
+    if (ref_get(slot, &slot->pad_x, report, len, &v)) {
+        matched = true;
+        int dir = axis_direction(slot->pad_x.field, v);
+        state |= (dir < 0) ? PAD_LEFT : (dir > 0) ? PAD_RIGHT : 0;
+    }
+    if (ref_get(slot, &slot->pad_y, report, len, &v)) {
+        matched = true;
+        int dir = axis_direction(slot->pad_y.field, v);
+        state |= (dir < 0) ? PAD_UP : (dir > 0) ? PAD_DOWN : 0;
+    }
+    for (int i = 0; i < PAD_BUTTONS; i++) {
+        if (ref_get(slot, &slot->pad_buttons[i], report, len, &v)) {
+            matched = true;
+            if (v) {
+                state |= s_pad_buttons[i].bit;
+            }
+        }
+    }
+    if (!matched) {
+        return;
+    }
+
+    uint8_t changed = state ^ slot->pad_state;
+    for (int pass = 0; pass < 2; pass++) {
+        bool pressed = (pass == 1);
+        for (int i = 0; i < PAD_COUNT; i++) {
+            uint8_t bit = 1 << i;
+            if ((changed & bit) && ((state & bit) != 0) == pressed) {
+                // Gamepad controls use usages above the keyboard range
+                slot_key(slot, 0x100 + i, pad_keys[i], pressed);
+            }
+        }
+    }
+    slot->pad_state = state;
+}
+
+METRIC_COUNTER(s_hid_reports, "usb.hid_reports", "reports")
+METRIC_GAUGE(s_hid_devices, "usb.hid_devices", "devices")
+
+static void usb_publish(bool attached, uint8_t kinds)
+{
+    uint8_t devices = 0;
+    for (int i = 0; i < HAL_USB_HID_MAX_DEVICES; i++) {
+        if (s_hid_slots[i].handle != NULL) {
+            devices++;
+        }
+    }
+
+    metric_set(&s_hid_devices, devices);
+
+    const event_t event = {
+        .topic = EVENT_USB_DEVICE,
+        .usb = {.attached = attached, .kinds = kinds, .devices = devices},
+    };
+    event_bus_publish(&event);
+}
+
+static void mouse_connected(void)
+{
+    if (s_mice_connected++ == 0) {
+        // The LVGL read callback marks it connected and shows the cursor
+        const usb_mouse_event_t evt = {.type = USB_MOUSE_EVT_CONNECTED};
+        mouse_push_wait(&evt);
+    }
+}
+
+static void mouse_disconnected(void)
+{
+    if (s_mice_connected > 0 && --s_mice_connected == 0) {
+        // The LVGL read callback releases the buttons, resets the mouse and hides the cursor
+        const usb_mouse_event_t evt = {.type = USB_MOUSE_EVT_DISCONNECTED};
+        mouse_push_wait(&evt);
+        s_last_buttons = 0;
+    }
+}
+
+// Map the interface from its own descriptor, or from the boot layout if that can't be used
+static bool slot_setup(usb_hid_slot_t *slot, const hid_host_dev_params_t *params, bool *boot)
+{
+    size_t desc_len = 0;
+    const uint8_t *desc = hid_host_get_report_descriptor(slot->handle, &desc_len);
+
+    *boot = false;
+    if (desc && hal_hid_parse(desc, desc_len, &slot->map) && slot_classify(slot)) {
+        if (slot->map.truncated) {
+            ESP_LOGW(TAG, "HID report descriptor has more fields than %d, some are ignored", HAL_HID_MAX_FIELDS);
+        }
+        return true;
+    }
+
+    if (params->sub_class != HID_SUBCLASS_BOOT_INTERFACE) {
+        return false;
+    }
+    if (params->proto == HID_PROTOCOL_MOUSE) {
+        hal_hid_parse(hal_hid_boot_mouse_desc, hal_hid_boot_mouse_desc_len, &slot->map);
+    } else if (params->proto == HID_PROTOCOL_KEYBOARD) {
+        hal_hid_parse(hal_hid_boot_keyboard_desc, hal_hid_boot_keyboard_desc_len, &slot->map);
+    } else {
+        return false;
+    }
+    *boot = true;
+    return slot_classify(slot) != 0;
+}
+
+void hal_usb_init(void)
+{
+    ESP_LOGI(TAG, "Initializing USB HAL");
     
     // Create event queue
     app_event_queue = xQueueCreate(10, sizeof(app_event_queue_t));
@@ -95,12 +865,6 @@ void hal_usb_deinit(void)
         app_event_queue = NULL;
     }
     
-    // Clean up mouse data mutex
-    if (g_usb_mouse_data.mutex != NULL) {
-        vSemaphoreDelete(g_usb_mouse_data.mutex);
-        g_usb_mouse_data.mutex = NULL;
-    }
-    
     ESP_LOGI(TAG, "USB HAL deinitialized");
 }
 
@@ -113,8 +877,19 @@ void hal_usb_mouse_init(void)
     lv_indev_set_type(lvUsbMouse, LV_INDEV_TYPE_POINTER);
     lv_indev_set_read_cb(lvUsbMouse, lvgl_mouse_read_cb);
     
-    // Create cursor object from image
+    // Start at the center of the screen; runs under the display lock, unlike hal_usb_init()
+    mouse_recenter();
+    
+    // Prefer the frame buffer overlay, moving it doesn't re-render what's below
     extern const lv_image_dsc_t cursor;
+    esp_err_t err = hal_cursor_init(lv_display_get_default(), &cursor);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "USB mouse input device initialized with overlay cursor");
+        return;
+    }
+    ESP_LOGW(TAG, "Cursor overlay unavailable (%s), using an LVGL object", esp_err_to_name(err));
+    
+    // Create cursor object from image
     lv_obj_t *cursor_obj = lv_image_create(lv_screen_active());
     lv_image_set_src(cursor_obj, &cursor);
     lv_obj_add_flag(cursor_obj, LV_OBJ_FLAG_IGNORE_LAYOUT);
@@ -129,6 +904,25 @@ void hal_usb_mouse_init(void)
     ESP_LOGI(TAG, "USB mouse input device initialized");
 }
 
+void hal_usb_keyboard_init(void)
+{
+    ESP_LOGI(TAG, "Initializing USB keyboard input device");
+    
+    lvUsbKeyboard = lv_indev_create();
+    lv_indev_set_type(lvUsbKeyboard, LV_INDEV_TYPE_KEYPAD);
+    lv_indev_set_read_cb(lvUsbKeyboard, lvgl_keyboard_read_cb);
+    
+    // Widgets created from now on join the default group and become reachable by keys
+    lv_group_t *group = lv_group_get_default();
+    if (group == NULL) {
+        group = lv_group_create();
+        lv_group_set_default(group);
+    }
+    lv_indev_set_group(lvUsbKeyboard, group);
+    
+    ESP_LOGI(TAG, "USB keyboard input device initialized");
+}
+
 void usb_host_task(void *arg)
 {
     ESP_LOGI(TAG, "USB host task started");
@@ -159,47 +953,64 @@ void hid_host_device_event(hid_host_device_handle_t hid_device_handle, const hid
     }
 
     switch (event) {
-        case HID_HOST_DRIVER_EVENT_CONNECTED:
+        case HID_HOST_DRIVER_EVENT_CONNECTED: {
             ESP_LOGI(TAG, "HID device connected, sub_class: %d, proto: %d", dev_params.sub_class, dev_params.proto);
             
-            // Only handle mouse devices
-            if (dev_params.sub_class == HID_SUBCLASS_BOOT_INTERFACE && dev_params.proto == HID_PROTOCOL_MOUSE) {
-                const hid_host_device_config_t dev_config = {
-                    .callback = hid_host_interface_callback,
-                    .callback_arg = NULL
-                };
-                
-                err = hid_host_device_open(hid_device_handle, &dev_config);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to open HID device: %s", esp_err_to_name(err));
-                    break;
-                }
-                
-                // Set boot protocol for mouse
-                err = hid_class_request_set_protocol(hid_device_handle, HID_REPORT_PROTOCOL_BOOT);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to set boot protocol: %s", esp_err_to_name(err));
-                }
-                
-                err = hid_host_device_start(hid_device_handle);
+            usb_hid_slot_t *slot = slot_alloc(hid_device_handle);
+            if (slot == NULL) {
+                ESP_LOGW(TAG, "Too many HID devices, ignoring this one");
+                break;
+            }
+            
+            const hid_host_device_config_t dev_config = {
+                .callback = hid_host_interface_callback,
+                .callback_arg = NULL
+            };
+            
+            err = hid_host_device_open(hid_device_handle, &dev_config);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to open HID device: %s", esp_err_to_name(err));
+                slot->handle = NULL;
+                break;
+            }
+            
+            // The report descriptor is fetched on open
+            bool boot = false;
+            if (!slot_setup(slot, &dev_params, &boot)) {
+                ESP_LOGI(TAG, "HID device is not a keyboard, mouse or gamepad, ignoring it");
+                hid_host_device_close(hid_device_handle);
+                slot->handle = NULL;
+                break;
+            }
+            
+            // Boot interfaces may come up in either protocol, ask for the one the tables were built for
+            if (dev_params.sub_class == HID_SUBCLASS_BOOT_INTERFACE) {
+                err = hid_class_request_set_protocol(hid_device_handle,
+                                                     boot ? HID_REPORT_PROTOCOL_BOOT : HID_REPORT_PROTOCOL_REPORT);
                 if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to start HID device: %s", esp_err_to_name(err));
-                } else {
-                    // Mark device as connected and show cursor
-                    if (xSemaphoreTake(g_usb_mouse_data.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                        g_usb_mouse_data.device_connected = true;
-                        xSemaphoreGive(g_usb_mouse_data.mutex);
-                    }
-                    
-                    // Show cursor
-                    lv_obj_t *cursor_obj = lv_indev_get_cursor(lvUsbMouse);
-                    if (cursor_obj) {
-                        lv_obj_remove_flag(cursor_obj, LV_OBJ_FLAG_HIDDEN);
-                    }
-                    ESP_LOGI(TAG, "USB mouse cursor shown");
+                    ESP_LOGE(TAG, "Failed to set %s protocol: %s", boot ? "boot" : "report", esp_err_to_name(err));
                 }
             }
+            
+            err = hid_host_device_start(hid_device_handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to start HID device: %s", esp_err_to_name(err));
+                hid_host_device_close(hid_device_handle);
+                slot->handle = NULL;
+                break;
+            }
+            
+            ESP_LOGI(TAG, "HID device started as%s%s%s (%s protocol, %d fields)",
+                     (slot->kinds & USB_HID_KIND_MOUSE) ? " mouse" : "",
+                     (slot->kinds & USB_HID_KIND_KEYBOARD) ? " keyboard" : "",
+                     (slot->kinds & USB_HID_KIND_GAMEPAD) ? " gamepad" : "",
+                     boot ? "boot" : "report", slot->map.field_count);
+            if (slot->kinds & USB_HID_KIND_MOUSE) {
+                mouse_connected();
+            }
+            usb_publish(true, slot->kinds);
             break;
+        }
             
         default:
             ESP_LOGW(TAG, "Unknown HID device event: %d", event);
@@ -211,17 +1022,25 @@ void hid_host_interface_callback(hid_host_device_handle_t hid_device_handle, con
 {
     uint8_t data[64] = {0};
     size_t data_length = 0;
-    hid_host_dev_params_t dev_params;
+    usb_hid_slot_t *slot = slot_find(hid_device_handle);
     esp_err_t err;
 
     switch (event) {
         case HID_HOST_INTERFACE_EVENT_INPUT_REPORT:
             err = hid_host_device_get_raw_input_report_data(hid_device_handle, data, sizeof(data), &data_length);
-            if (err == ESP_OK && data_length > 0) {
-                err = hid_host_device_get_params(hid_device_handle, &dev_params);
-                if (err == ESP_OK && dev_params.sub_class == HID_SUBCLASS_BOOT_INTERFACE && dev_params.proto == HID_PROTOCOL_MOUSE) {
-                    hid_host_mouse_report_callback(data, data_length);
+            if (err == ESP_OK && data_length > 0 && slot != NULL) {
+                metric_inc(&s_hid_reports);
+                PERF_TRACE_BEGIN_ARG("hid_report", (int32_t)data_length);
+                if (slot->kinds & USB_HID_KIND_MOUSE) {
+                    decode_mouse(slot, data, data_length);
+                }
+                if (slot->kinds & USB_HID_KIND_KEYBOARD) {
+                    decode_keyboard(slot, data, data_length);
                 }
+                if (slot->kinds & USB_HID_KIND_GAMEPAD) {
+                    decode_gamepad(slot, data, data_length);
+                }
+                PERF_TRACE_END("hid_report");
             }
             break;
             
@@ -232,24 +1051,14 @@ void hid_host_interface_callback(hid_host_device_handle_t hid_device_handle, con
                 ESP_LOGE(TAG, "Failed to close HID device: %s", esp_err_to_name(err));
             }
             
-            // Reset mouse data safely and hide cursor
-            if (xSemaphoreTake(g_usb_mouse_data.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                g_usb_mouse_data.x = lv_display_get_horizontal_resolution(NULL) / 2;
-                g_usb_mouse_data.y = lv_display_get_vertical_resolution(NULL) / 2;
-                g_usb_mouse_data.left_button = false;
-                g_usb_mouse_data.right_button = false;
-                g_usb_mouse_data.middle_button = false;
-                g_usb_mouse_data.wheel = 0;
-                g_usb_mouse_data.device_connected = false;  // Mark as disconnected
-                xSemaphoreGive(g_usb_mouse_data.mutex);
-            }
-            
-            // Hide cursor
-            lv_obj_t *cursor_obj = lv_indev_get_cursor(lvUsbMouse);
-            if (cursor_obj) {
-                lv_obj_add_flag(cursor_obj, LV_OBJ_FLAG_HIDDEN);
+            if (slot != NULL) {
+                if (slot->kinds & USB_HID_KIND_MOUSE) {
+                    mouse_disconnected();
+                }
+                slot_release_keys(slot);
+                slot->handle = NULL;
+                usb_publish(false, slot->kinds);
             }
-            ESP_LOGI(TAG, "USB mouse cursor hidden");
             break;
             
         case HID_HOST_INTERFACE_EVENT_TRANSFER_ERROR:
@@ -262,67 +1071,49 @@ void hid_host_interface_callback(hid_host_device_handle_t hid_device_handle, con
     }
 }
 
-void hid_host_mouse_report_callback(const uint8_t *const data, const int length)
+void lvgl_mouse_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
 {
-    if (data == NULL || length < 3) {
-        return;
+    usb_mouse_event_t evt;
+    
+    // One event per read so every press, release and the motion between them reaches LVGL
+    if (mouse_pop(&evt)) {
+        mouse_apply(&evt);
+        data->continue_reading = mouse_pending();
     }
     
-    // Parse mouse report (standard HID mouse report format)
-    // Byte 0: Button states
-    // Byte 1: X movement (signed)
-    // Byte 2: Y movement (signed)
-    // Byte 3: Wheel movement (signed, optional)
+    data->point.x = g_usb_mouse_data.x;
+    data->point.y = g_usb_mouse_data.y;
     
-    if (xSemaphoreTake(g_usb_mouse_data.mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-        // Update button states
-        g_usb_mouse_data.left_button = (data[0] & 0x01) != 0;
-        g_usb_mouse_data.right_button = (data[0] & 0x02) != 0;
-        g_usb_mouse_data.middle_button = (data[0] & 0x04) != 0;
-        
-        // Fix: Swap X and Y, and invert Y axis for proper screen mapping
-        // Original: X += data[1], Y += data[2]
-        // Fixed: X += data[2], Y -= data[1] (inverted Y)
-        g_usb_mouse_data.x += (int8_t)data[2];  // Use Y movement for X
-        g_usb_mouse_data.y -= (int8_t)data[1];  // Use X movement for Y (inverted)
-        
-        // Clamp coordinates to screen bounds using proper LVGL API
-        // IMPORTANT: Since we swapped X/Y axes, we need to clamp accordingly:
-        // - g_usb_mouse_data.x (which uses data[2]/Y movement) should be clamped to screen HEIGHT
-        // - g_usb_mouse_data.y (which uses data[1]/X movement) should be clamped to screen WIDTH
-        lv_coord_t screen_width = lv_display_get_horizontal_resolution(NULL);
-        lv_coord_t screen_height = lv_display_get_vertical_resolution(NULL);
-        
-        if (g_usb_mouse_data.x < 0) g_usb_mouse_data.x = 0;
-        if (g_usb_mouse_data.y < 0) g_usb_mouse_data.y = 0;
-        if (g_usb_mouse_data.x >= screen_height) g_usb_mouse_data.x = screen_height - 1;  // X uses height bounds
-        if (g_usb_mouse_data.y >= screen_width) g_usb_mouse_data.y = screen_width - 1;    // Y uses width bounds
-        
-        // Update wheel if available
-        if (length > 3) {
-            g_usb_mouse_data.wheel = (int8_t)data[3];
-        }
-        
-        xSemaphoreGive(g_usb_mouse_data.mutex);
-        
-        ESP_LOGD(TAG, "Mouse: x=%d, y=%d, buttons=0x%02X, wheel=%d", 
-                 g_usb_mouse_data.x, g_usb_mouse_data.y, data[0], g_usb_mouse_data.wheel);
-    }
+    // Set button state (LVGL uses left button for primary input)
+    data->state = g_usb_mouse_data.left_button ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
 }
 
-void lvgl_mouse_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+uint32_t hal_usb_mouse_get_dropped(void)
 {
-    if (xSemaphoreTake(g_usb_mouse_data.mutex, pdMS_TO_TICKS(1)) == pdTRUE) {
-        // Set cursor position
-        data->point.x = g_usb_mouse_data.x;
-        data->point.y = g_usb_mouse_data.y;
-        
-        // Set button state (LVGL uses left button for primary input)
-        data->state = g_usb_mouse_data.left_button ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
-        
-        xSemaphoreGive(g_usb_mouse_data.mutex);
-    } else {
-        // Fallback if mutex is not available
-        data->state = LV_INDEV_STATE_REL;
+    return s_mouse_dropped;
+}
+
+bool hal_usb_mouse_is_connected(void)
+{
+    return g_usb_mouse_data.device_connected;
+}
+
+void lvgl_keyboard_read_cb(lv_indev_t *indev, lv_indev_data_t *data)
+{
+    usb_key_event_t evt;
+    
+    // One change per read so a quick tap is still seen pressed, then released
+    if (key_pop(&evt)) {
+        s_key_last = evt.key;
+        s_key_pressed = evt.pressed;
+        data->continue_reading = key_pending();
     }
-}
\ No newline at end of file
+    
+    data->key = s_key_last;
+    data->state = s_key_pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+}
+
+uint32_t hal_usb_keyboard_get_dropped(void)
+{
+    return s_key_dropped;
+}
@@ -15,7 +15,7 @@
 extern "C" {
 #endif
 
-// USB mouse data structure
+// USB mouse pointer state, owned by the LVGL task and updated from lvgl_mouse_read_cb
 typedef struct {
     int16_t x;
     int16_t y;
@@ -24,7 +24,6 @@ typedef struct {
     bool middle_button;
     int8_t wheel;
     bool device_connected;  // Add connection state tracking
-    SemaphoreHandle_t mutex;
 } usb_mouse_data_t;
 
 // Event queue structure for USB events
@@ -36,18 +35,23 @@ typedef struct {
 // Global USB mouse data
 extern usb_mouse_data_t g_usb_mouse_data;
 extern lv_indev_t *lvUsbMouse;
+extern lv_indev_t *lvUsbKeyboard;
 
 // USB HAL functions
 void hal_usb_init(void);
 void hal_usb_deinit(void);
 void hal_usb_mouse_init(void);
+uint32_t hal_usb_mouse_get_dropped(void);  // Button changes lost to a full report queue
+bool hal_usb_mouse_is_connected(void);      // Cursor on screen, LVGL task only
+void hal_usb_keyboard_init(void);          // Keypad indev for USB keyboards and gamepads, bound to the default group
+uint32_t hal_usb_keyboard_get_dropped(void);
 
 // Internal USB functions
 void usb_host_task(void *arg);
 void hid_host_interface_callback(hid_host_device_handle_t hid_device_handle, const hid_host_interface_event_t event, void *arg);
 void hid_host_device_event(hid_host_device_handle_t hid_device_handle, const hid_host_driver_event_t event, void *arg);
-void hid_host_mouse_report_callback(const uint8_t *const data, const int length);
 void lvgl_mouse_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
+void lvgl_keyboard_read_cb(lv_indev_t *indev, lv_indev_data_t *data);
 
 #ifdef __cplusplus
 }
@@ -2,16 +2,32 @@
 #include <stdio.h>
 #include "gui.h"
 #include "hals/hal.h"
+#include "managers/dlog.h"
+#include "perf/perf_watchdog.h"
+#include "perf/perf_bench.h"
 
 void app_main(void) {
-    // Initialize hardware
+    // Deferred logging first, so what the HALs log while starting gets out
+    dlog_init();
+
+    // Initialize hardware; audio, SD card and USB keep starting in the background
     hal_init();
     
+    // The LVGL task is already running
+    bsp_display_lock(0);
+
     // Initialize touchpad
     hal_touchpad_init();
 
     // Initialize our GUI
     gui_init(lvDisp);
+    hal_boot_mark("launcher");
+#if PERF_WATCHDOG_ENABLE
+    perf_watchdog_init(lvDisp);
+#endif
+#if PERF_BENCH_ENABLE
+    perf_bench_init(lvDisp);
+#endif
 
     bsp_display_unlock();
 }
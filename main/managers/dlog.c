@@ -0,0 +1,405 @@
+#include "managers/dlog.h"
+#include "managers/metrics.h"
+#include "hals/hal_sdcard.h"
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#if (DLOG_QUEUE_SIZE & (DLOG_QUEUE_SIZE - 1)) != 0
+#error "DLOG_QUEUE_SIZE must be a power of two"
+#endif
+
+// Below everything else, logging only runs when the system has time for it
+#ifndef DLOG_TASK_PRIORITY
+#define DLOG_TASK_PRIORITY 1
+#endif
+
+// How often the task looks for new records
+#ifndef DLOG_FLUSH_MS
+#define DLOG_FLUSH_MS 50
+#endif
+
+#define QUEUE_MASK (DLOG_QUEUE_SIZE - 1)
+#define LINE_SIZE 256
+
+// Same bounded multi-producer ring as ui_dispatch: producers claim a cell with
+// a CAS on s_head and publish it by bumping its sequence, the log task is the
+// only consumer. A cell at position pos is free when its sequence is pos,
+// filled when pos + 1.
+typedef struct {
+    uint32_t seq;           // Stored minus the cell index so the zeroed array starts out free
+    const char *fmt;
+    uint32_t time_ms;
+    uint8_t level;
+    uint8_t count;
+    uint8_t types[DLOG_MAX_ARGS];
+    uint64_t args[DLOG_MAX_ARGS];   // Strings hold their offset in str
+    char str[DLOG_STR_SIZE];
+} dlog_cell_t;
+
+static dlog_cell_t s_cells[DLOG_QUEUE_SIZE];
+static uint32_t s_head;     // Next position to claim, shared by producers
+static uint32_t s_tail;     // Next position to format, log task only
+static uint32_t s_dropped;
+
+static int32_t stat_dropped(void)
+{
+    return (int32_t)dlog_get_dropped();
+}
+
+METRIC_COUNTER(s_written, "log.records", "records")
+METRIC_COUNTER_FN(s_dropped_metric, "log.dropped", "records", stat_dropped)
+
+static inline uint32_t cell_seq(uint32_t index)
+{
+    return __atomic_load_n(&s_cells[index].seq, __ATOMIC_ACQUIRE) + index;
+}
+
+static inline void cell_set_seq(uint32_t index, uint32_t seq)
+{
+    __atomic_store_n(&s_cells[index].seq, seq - index, __ATOMIC_RELEASE);
+}
+
+static void store_args(dlog_cell_t *cell, const dlog_arg_t *args, size_t count)
+{
+    size_t used = 0;
+
+    cell->count = count < DLOG_MAX_ARGS ? count : DLOG_MAX_ARGS;
+    for (size_t i = 0; i < cell->count; i++) {
+        cell->types[i] = args[i].type;
+        switch (args[i].type) {
+        case DLOG_ARG_WORD:
+            cell->args[i] = args[i].word;
+            break;
+        case DLOG_ARG_LONG_LONG:
+            cell->args[i] = args[i].ll;
+            break;
+        case DLOG_ARG_DOUBLE:
+            memcpy(&cell->args[i], &args[i].d, sizeof(double));
+            break;
+        case DLOG_ARG_STR: {
+            // Copied now, the caller's buffer may be gone by the time it is formatted.
+            // used stays below DLOG_STR_SIZE, later strings come out cut or empty.
+            const char *s = args[i].str ? args[i].str : "(null)";
+            size_t len = strnlen(s, DLOG_STR_SIZE - 1 - used);
+            memcpy(&cell->str[used], s, len);
+            cell->str[used + len] = '\0';
+            cell->args[i] = used;
+            used += len;
+            if (used < DLOG_STR_SIZE - 1) {
+                used++;
+            }
+            break;
+        }
+        }
+    }
+}
+
+bool dlog_write(uint8_t level, const char *fmt, const dlog_arg_t *args, size_t count)
+{
+    if (!fmt) {
+        return false;
+    }
+
+    uint32_t pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    uint32_t index;
+    for (;;) {
+        index = pos & QUEUE_MASK;
+        int32_t diff = (int32_t)(cell_seq(index) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&s_head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    dlog_cell_t *cell = &s_cells[index];
+    cell->fmt = fmt;
+    cell->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    cell->level = level;
+    store_args(cell, args, count);
+    cell_set_seq(index, pos + 1);
+
+    metric_inc(&s_written);
+    return true;
+}
+
+uint32_t dlog_get_dropped(void)
+{
+    return __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Formatting                                  */
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+} line_t;
+
+static void line_putc(line_t *line, char c)
+{
+    if (line->len + 1 < line->size) {
+        line->buf[line->len++] = c;
+        line->buf[line->len] = '\0';
+    }
+}
+
+static void line_printf(line_t *line, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void line_printf(line_t *line, const char *fmt, ...)
+{
+    if (line->len + 1 >= line->size) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(&line->buf[line->len], line->size - line->len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        line->len += (size_t)n < line->size - line->len ? (size_t)n : line->size - line->len - 1;
+    }
+}
+
+// The format is walked one conversion at a time, each printed on its own
+// with the argument widened to what the stored type holds.
+static void format_record(const dlog_cell_t *cell, line_t *line)
+{
+    static const char s_level_chars[] = "?EWIDV";
+    line_printf(line, "%c (%lu) ", s_level_chars[cell->level <= DLOG_LEVEL_VERBOSE ? cell->level : 0],
+                (unsigned long)cell->time_ms);
+
+    size_t next = 0;
+    for (const char *p = cell->fmt; *p; p++) {
+        if (*p != '%') {
+            line_putc(line, *p);
+            continue;
+        }
+        if (p[1] == '%') {
+            line_putc(line, '%');
+            p++;
+            continue;
+        }
+
+        // Flags, width and precision are kept, length modifiers are replaced
+        char spec[24];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0", *p) && n < 8) {
+            spec[n++] = *p++;
+        }
+        while (*p && (strchr("0123456789.", *p) || *p == '*') && n < 16) {
+            if (*p == '*') {
+                // Width or precision from the arguments
+                int32_t v = next < cell->count ? (int32_t)cell->args[next++] : 0;
+                snprintf(&spec[n], sizeof(spec) - n - 4, "%ld", (long)v);
+                n += strlen(&spec[n]);
+                p++;
+            } else {
+                spec[n++] = *p++;
+            }
+        }
+        while (*p && strchr("hlLqjzt", *p)) {
+            p++;
+        }
+        char conv = *p;
+        if (conv == '\0') {
+            break;
+        }
+
+        if (next >= cell->count) {
+            line_putc(line, '?');
+            continue;
+        }
+        uint8_t type = cell->types[next];
+        uint64_t raw = cell->args[next++];
+
+        switch (conv) {
+        case 'd':
+        case 'i':
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conv;
+            spec[n] = '\0';
+            line_printf(line, spec, type == DLOG_ARG_LONG_LONG ? (long long)raw : (long long)(int32_t)raw);
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = conv;
+            spec[n] = '\0';
+            line_printf(line, spec, type == DLOG_ARG_LONG_LONG ? (unsigned long long)raw
+                                                               : (unsigned long long)(uint32_t)raw);
+            break;
+        case 'c':
+            spec[n++] = conv;
+            spec[n] = '\0';
+            line_printf(line, spec, (int)raw);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            double d = 0;
+            if (type == DLOG_ARG_DOUBLE) {
+                memcpy(&d, &raw, sizeof(d));
+            }
+            spec[n++] = conv;
+            spec[n] = '\0';
+            line_printf(line, spec, d);
+            break;
+        }
+        case 's':
+            spec[n++] = conv;
+            spec[n] = '\0';
+            line_printf(line, spec, type == DLOG_ARG_STR ? &cell->str[raw < DLOG_STR_SIZE ? raw : 0] : "?");
+            break;
+        case 'p':
+            spec[n++] = conv;
+            spec[n] = '\0';
+            line_printf(line, spec, (void *)(uintptr_t)raw);
+            break;
+        default:
+            line_putc(line, '?');
+            break;
+        }
+    }
+    line_putc(line, '\n');
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Output                                    */
+/* -------------------------------------------------------------------------- */
+
+static FILE *s_file = NULL;
+static size_t s_file_size = 0;
+
+static void file_close(void)
+{
+    if (s_file) {
+        fclose(s_file);
+        s_file = NULL;
+    }
+}
+
+static void file_open(void)
+{
+    struct stat st;
+    s_file_size = stat(DLOG_FILE_PATH, &st) == 0 ? (size_t)st.st_size : 0;
+    s_file = hal_sdcard_fopen(DLOG_FILE_PATH, "a");
+}
+
+// system.log -> system.log.1 -> ... -> system.log.DLOG_FILE_KEEP, the oldest is deleted
+static void file_rotate(void)
+{
+    char from[64];
+    char to[64];
+
+    file_close();
+    snprintf(to, sizeof(to), "%s.%d", DLOG_FILE_PATH, DLOG_FILE_KEEP);
+    remove(to);
+    for (int i = DLOG_FILE_KEEP - 1; i >= 0; i--) {
+        if (i == 0) {
+            snprintf(from, sizeof(from), "%s", DLOG_FILE_PATH);
+        } else {
+            snprintf(from, sizeof(from), "%s.%d", DLOG_FILE_PATH, i);
+        }
+        rename(from, to);
+        memcpy(to, from, sizeof(to));
+    }
+    file_open();
+}
+
+static void file_write(const line_t *line)
+{
+    if (!s_file) {
+        return;
+    }
+    if (s_file_size + line->len > DLOG_FILE_MAX_BYTES) {
+        file_rotate();
+        if (!s_file) {
+            return;
+        }
+    }
+    fwrite(line->buf, 1, line->len, s_file);
+    s_file_size += line->len;
+}
+
+static void dlog_task(void *arg)
+{
+    static char buf[LINE_SIZE];
+    const bool use_file = DLOG_FILE_PATH[0] != '\0';
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DLOG_FLUSH_MS));
+
+        if (use_file) {
+            bool mounted = hal_sdcard_is_mounted();
+            if (mounted && !s_file) {
+                file_open();
+            } else if (!mounted && s_file) {
+                file_close();
+            }
+        }
+
+        bool wrote = false;
+        for (;;) {
+            uint32_t pos = s_tail;
+            uint32_t index = pos & QUEUE_MASK;
+            if ((int32_t)(cell_seq(index) - (pos + 1)) < 0) {
+                break;
+            }
+
+            line_t line = {.buf = buf, .len = 0, .size = sizeof(buf)};
+            buf[0] = '\0';
+            format_record(&s_cells[index], &line);
+
+            // Hand the cell back before the slow part
+            cell_set_seq(index, pos + DLOG_QUEUE_SIZE);
+            __atomic_store_n(&s_tail, pos + 1, __ATOMIC_RELAXED);
+
+            fwrite(line.buf, 1, line.len, stdout);
+            file_write(&line);
+            wrote = true;
+        }
+
+        if (wrote) {
+            fflush(stdout);
+            if (s_file) {
+                fflush(s_file);
+            }
+        }
+    }
+}
+
+void dlog_init(void)
+{
+    static bool s_started = false;
+    if (s_started) {
+        return;
+    }
+
+    if (xTaskCreate(dlog_task, "dlog", 4096, NULL, DLOG_TASK_PRIORITY, NULL) != pdPASS) {
+        printf("Failed to create log task\n");
+        return;
+    }
+    s_started = true;
+}
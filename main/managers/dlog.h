@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Deferred logging. A call site stores its format string pointer and raw
+// arguments in a lock-free ring; a low-priority task formats them later for
+// the console and the SD card log. Levels above DLOG_LEVEL are compiled out,
+// arguments and all.
+
+#define DLOG_LEVEL_NONE     0
+#define DLOG_LEVEL_ERROR    1
+#define DLOG_LEVEL_WARN     2
+#define DLOG_LEVEL_INFO     3
+#define DLOG_LEVEL_DEBUG    4
+#define DLOG_LEVEL_VERBOSE  5
+
+// Most detailed level compiled in
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+
+// Records waiting to be formatted; writes fail once this many are waiting (power of two)
+#ifndef DLOG_QUEUE_SIZE
+#define DLOG_QUEUE_SIZE 128
+#endif
+
+// Arguments kept per record, the rest print as "?"
+#ifndef DLOG_MAX_ARGS
+#define DLOG_MAX_ARGS 6
+#endif
+
+// Bytes for copies of string arguments per record, longer strings are cut
+#ifndef DLOG_STR_SIZE
+#define DLOG_STR_SIZE 48
+#endif
+
+// SD card log, appended while the card is mounted; "" to log to the console only
+#ifndef DLOG_FILE_PATH
+#define DLOG_FILE_PATH "/sdcard/system.log"
+#endif
+
+// Size at which the SD log moves to DLOG_FILE_PATH.1, pushing older files up to .DLOG_FILE_KEEP
+#ifndef DLOG_FILE_MAX_BYTES
+#define DLOG_FILE_MAX_BYTES (256 * 1024)
+#endif
+
+#ifndef DLOG_FILE_KEEP
+#define DLOG_FILE_KEEP 3
+#endif
+
+typedef enum {
+    DLOG_ARG_WORD,          // Anything up to 32 bits, pointers included
+    DLOG_ARG_LONG_LONG,
+    DLOG_ARG_DOUBLE,
+    DLOG_ARG_STR,           // Copied when the record is written
+} dlog_arg_type_t;
+
+typedef struct {
+    dlog_arg_type_t type;
+    union {
+        uint32_t word;
+        uint64_t ll;
+        double d;
+        const char *str;
+    };
+} dlog_arg_t;
+
+static inline dlog_arg_t dlog_arg_word(uint32_t v) { return (dlog_arg_t){.type = DLOG_ARG_WORD, .word = v}; }
+static inline dlog_arg_t dlog_arg_ll(uint64_t v) { return (dlog_arg_t){.type = DLOG_ARG_LONG_LONG, .ll = v}; }
+static inline dlog_arg_t dlog_arg_double(double v) { return (dlog_arg_t){.type = DLOG_ARG_DOUBLE, .d = v}; }
+static inline dlog_arg_t dlog_arg_str(const char *v) { return (dlog_arg_t){.type = DLOG_ARG_STR, .str = v}; }
+static inline dlog_arg_t dlog_arg_ptr(const void *v) { return dlog_arg_word((uint32_t)(uintptr_t)v); }
+
+// Start the task that formats records; records written before this wait in the ring
+void dlog_init(void);
+
+// Store a record, see the DLOG_* macros. Never blocks and never formats;
+// callable from any task, not from ISRs. Returns false if the ring is full.
+bool dlog_write(uint8_t level, const char *fmt, const dlog_arg_t *args, size_t count);
+
+// Records lost because the ring was full
+uint32_t dlog_get_dropped(void);
+
+// Pick how each argument is stored from its type. Pointers other than
+// strings must be cast to void * to be logged, as %p expects anyway.
+#define DLOG_ARG_(x) _Generic((x),                                  \
+        char *: dlog_arg_str, const char *: dlog_arg_str,           \
+        void *: dlog_arg_ptr, const void *: dlog_arg_ptr,           \
+        float: dlog_arg_double, double: dlog_arg_double,            \
+        long long: dlog_arg_ll, unsigned long long: dlog_arg_ll,    \
+        default: dlog_arg_word)(x)
+
+#define DLOG_NARGS_(...) DLOG_NARGS_N_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_N_(_, a1, a2, a3, a4, a5, a6, a7, a8, n, ...) n
+#define DLOG_CAT_(a, b) DLOG_CAT2_(a, b)
+#define DLOG_CAT2_(a, b) a##b
+#define DLOG_MAP_(...) DLOG_CAT_(DLOG_MAP_, DLOG_NARGS_(__VA_ARGS__))(__VA_ARGS__)
+#define DLOG_MAP_0()
+#define DLOG_MAP_1(a) DLOG_ARG_(a)
+#define DLOG_MAP_2(a, ...) DLOG_ARG_(a), DLOG_MAP_1(__VA_ARGS__)
+#define DLOG_MAP_3(a, ...) DLOG_ARG_(a), DLOG_MAP_2(__VA_ARGS__)
+#define DLOG_MAP_4(a, ...) DLOG_ARG_(a), DLOG_MAP_3(__VA_ARGS__)
+#define DLOG_MAP_5(a, ...) DLOG_ARG_(a), DLOG_MAP_4(__VA_ARGS__)
+#define DLOG_MAP_6(a, ...) DLOG_ARG_(a), DLOG_MAP_5(__VA_ARGS__)
+#define DLOG_MAP_7(a, ...) DLOG_ARG_(a), DLOG_MAP_6(__VA_ARGS__)
+#define DLOG_MAP_8(a, ...) DLOG_ARG_(a), DLOG_MAP_7(__VA_ARGS__)
+
+// The dead printf() only lets the compiler check the format against the arguments
+#define DLOG_WRITE_(level, fmt, ...) do {                                           \
+        if (0) {                                                                    \
+            printf(fmt, ##__VA_ARGS__);                                             \
+        }                                                                           \
+        const dlog_arg_t dlog_args_[] = {DLOG_MAP_(__VA_ARGS__)};                   \
+        dlog_write((level), (fmt), dlog_args_, sizeof(dlog_args_) / sizeof(dlog_arg_t)); \
+    } while (0)
+
+#define DLOG_NOTHING_() do { } while (0)
+
+// fmt must be a string literal (it is kept by pointer) and carries no newline
+#if DLOG_LEVEL >= DLOG_LEVEL_ERROR
+#define DLOG_E(fmt, ...) DLOG_WRITE_(DLOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define DLOG_E(fmt, ...) DLOG_NOTHING_()
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_WARN
+#define DLOG_W(fmt, ...) DLOG_WRITE_(DLOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define DLOG_W(fmt, ...) DLOG_NOTHING_()
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_INFO
+#define DLOG_I(fmt, ...) DLOG_WRITE_(DLOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define DLOG_I(fmt, ...) DLOG_NOTHING_()
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_DEBUG
+#define DLOG_D(fmt, ...) DLOG_WRITE_(DLOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define DLOG_D(fmt, ...) DLOG_NOTHING_()
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_VERBOSE
+#define DLOG_V(fmt, ...) DLOG_WRITE_(DLOG_LEVEL_VERBOSE, fmt, ##__VA_ARGS__)
+#else
+#define DLOG_V(fmt, ...) DLOG_NOTHING_()
+#endif
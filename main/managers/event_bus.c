@@ -0,0 +1,163 @@
+#include "managers/event_bus.h"
+#include "managers/ui_dispatch.h"
+#include "managers/metrics.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+typedef struct {
+    event_cb_t cb;
+    void *ctx;
+} subscriber_t;
+
+// Everything below is guarded by s_lock, a spinlock held only for copies of a
+// few dozen bytes; callbacks always run after it is released, on copies.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static subscriber_t s_ui_subs[EVENT_TOPIC_MAX][EVENT_BUS_MAX_SUBSCRIBERS];
+static subscriber_t s_direct_subs[EVENT_TOPIC_MAX][EVENT_BUS_MAX_SUBSCRIBERS];
+static event_t s_last[EVENT_TOPIC_MAX];
+static uint32_t s_seq[EVENT_TOPIC_MAX];
+
+// Topics with a delivery queued on the LVGL task, one bit each
+static uint32_t s_pending;
+static uint32_t s_dropped;
+
+_Static_assert(EVENT_TOPIC_MAX <= 32, "s_pending has one bit per topic");
+
+static int32_t stat_dropped(void)
+{
+    return (int32_t)event_bus_get_dropped();
+}
+
+METRIC_COUNTER(s_published, "events.published", "events")
+METRIC_COUNTER_FN(s_dropped_metric, "events.dropped", "events", stat_dropped)
+
+static bool table_add(subscriber_t *row, event_cb_t cb, void *ctx)
+{
+    bool added = false;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+        if (row[i].cb == NULL) {
+            row[i].cb = cb;
+            row[i].ctx = ctx;
+            added = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return added;
+}
+
+static void table_remove(subscriber_t *row, event_cb_t cb, void *ctx)
+{
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+        if (row[i].cb == cb && row[i].ctx == ctx) {
+            row[i].cb = NULL;
+            row[i].ctx = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void table_call(const subscriber_t *subs, const event_t *event)
+{
+    for (int i = 0; i < EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+        if (subs[i].cb) {
+            subs[i].cb(event, subs[i].ctx);
+        }
+    }
+}
+
+bool event_bus_subscribe(event_topic_t topic, event_cb_t cb, void *ctx)
+{
+    if (topic >= EVENT_TOPIC_MAX || !cb) {
+        return false;
+    }
+    return table_add(s_ui_subs[topic], cb, ctx);
+}
+
+bool event_bus_subscribe_direct(event_topic_t topic, event_cb_t cb, void *ctx)
+{
+    if (topic >= EVENT_TOPIC_MAX || !cb) {
+        return false;
+    }
+    return table_add(s_direct_subs[topic], cb, ctx);
+}
+
+void event_bus_unsubscribe(event_topic_t topic, event_cb_t cb, void *ctx)
+{
+    if (topic >= EVENT_TOPIC_MAX) {
+        return;
+    }
+    table_remove(s_ui_subs[topic], cb, ctx);
+    table_remove(s_direct_subs[topic], cb, ctx);
+}
+
+// Runs on the LVGL task through ui_dispatch. The pending bit is cleared before
+// the value is read, so a publish racing with this queues a fresh delivery
+// rather than being lost.
+static void deliver_ui(void *arg, const void *msg)
+{
+    (void)msg;
+    event_topic_t topic = (event_topic_t)(uintptr_t)arg;
+    subscriber_t subs[EVENT_BUS_MAX_SUBSCRIBERS];
+    event_t event;
+
+    __atomic_fetch_and(&s_pending, ~(1u << topic), __ATOMIC_ACQ_REL);
+
+    portENTER_CRITICAL(&s_lock);
+    event = s_last[topic];
+    memcpy(subs, s_ui_subs[topic], sizeof(subs));
+    portEXIT_CRITICAL(&s_lock);
+
+    table_call(subs, &event);
+}
+
+void event_bus_publish(const event_t *event)
+{
+    if (!event || event->topic >= EVENT_TOPIC_MAX) {
+        return;
+    }
+
+    event_topic_t topic = event->topic;
+    subscriber_t subs[EVENT_BUS_MAX_SUBSCRIBERS];
+    event_t stamped = *event;
+    stamped.timestamp_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    stamped.seq = ++s_seq[topic];
+    s_last[topic] = stamped;
+    memcpy(subs, s_direct_subs[topic], sizeof(subs));
+    portEXIT_CRITICAL(&s_lock);
+
+    metric_inc(&s_published);
+    table_call(subs, &stamped);
+
+    // Coalesce: while a delivery is queued, newer values just replace s_last
+    uint32_t bit = 1u << topic;
+    if (!(__atomic_fetch_or(&s_pending, bit, __ATOMIC_ACQ_REL) & bit)) {
+        if (!ui_dispatch_post(deliver_ui, (void *)(uintptr_t)topic)) {
+            // Let the next publish try again
+            __atomic_fetch_and(&s_pending, ~bit, __ATOMIC_ACQ_REL);
+            __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+bool event_bus_get_last(event_topic_t topic, event_t *event)
+{
+    if (topic >= EVENT_TOPIC_MAX || !event) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    *event = s_last[topic];
+    portEXIT_CRITICAL(&s_lock);
+    return event->seq != 0;
+}
+
+uint32_t event_bus_get_dropped(void)
+{
+    return __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+}
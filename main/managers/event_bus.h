@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Subscribers per topic, for each of the two delivery modes
+#ifndef EVENT_BUS_MAX_SUBSCRIBERS
+#define EVENT_BUS_MAX_SUBSCRIBERS 6
+#endif
+
+// State changes published by the HALs. Every topic carries the new state,
+// not a delta, so skipping all but the latest publish loses nothing.
+typedef enum {
+    EVENT_SD_MOUNT,         // sd: card mounted or unmounted
+    EVENT_VOLUME,           // volume: output volume of the active route changed
+    EVENT_BRIGHTNESS,       // brightness: backlight level changed
+    EVENT_PLAYBACK,         // playback: MP3 playback started or stopped, including end of file
+    EVENT_USB_DEVICE,       // usb: HID device attached or detached
+    EVENT_HEADPHONE,        // headphone: jack plugged or unplugged
+    EVENT_TOPIC_MAX
+} event_topic_t;
+
+// usb.kinds
+#define EVENT_USB_MOUSE     0x01
+#define EVENT_USB_KEYBOARD  0x02
+#define EVENT_USB_GAMEPAD   0x04
+
+typedef struct {
+    event_topic_t topic;
+    uint32_t seq;           // Publishes of this topic so far; gaps show coalesced updates
+    int64_t timestamp_us;   // Set by event_bus_publish()
+    union {
+        struct { bool mounted; } sd;
+        struct { uint8_t percent; bool headphone; } volume;
+        struct { uint8_t percent; } brightness;
+        struct { bool playing; } playback;
+        struct { bool attached; uint8_t kinds; uint8_t devices; } usb;  // kinds of the device that changed, devices still attached
+        struct { bool connected; } headphone;
+    };
+} event_t;
+
+// The event is only valid during the call
+typedef void (*event_cb_t)(const event_t *event, void *ctx);
+
+// Deliver a topic on the LVGL task, at most once per refresh with the latest
+// value; the callback may use LVGL freely. LVGL task only.
+bool event_bus_subscribe(event_topic_t topic, event_cb_t cb, void *ctx);
+
+// Deliver every publish of a topic synchronously in the publisher's task.
+// The callback must be short and must not block or touch LVGL.
+bool event_bus_subscribe_direct(event_topic_t topic, event_cb_t cb, void *ctx);
+
+// Remove a subscription made with either function
+void event_bus_unsubscribe(event_topic_t topic, event_cb_t cb, void *ctx);
+
+// Record the new state of event->topic and notify subscribers. Never blocks
+// and allocates nothing; callable from any task, not from ISRs.
+void event_bus_publish(const event_t *event);
+
+// Latest published state of a topic without asking the owning HAL.
+// Returns false if the topic was never published.
+bool event_bus_get_last(event_topic_t topic, event_t *event);
+
+// LVGL deliveries lost because the UI dispatch queue was full
+uint32_t event_bus_get_dropped(void);
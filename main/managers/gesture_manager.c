@@ -0,0 +1,318 @@
+#include "managers/gesture_manager.h"
+#include "managers/window_manager.h"
+#include "managers/metrics.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Minimum travel for swipes, in display pixels
+#ifndef GESTURE_SWIPE_MIN_PX
+#define GESTURE_SWIPE_MIN_PX 80
+#endif
+
+// Width of the band along each screen edge where edge swipes start
+#ifndef GESTURE_EDGE_PX
+#define GESTURE_EDGE_PX 24
+#endif
+
+// A finger that moved less than this still counts as held in place
+#ifndef GESTURE_MOVE_SLOP_PX
+#define GESTURE_MOVE_SLOP_PX 16
+#endif
+
+#ifndef GESTURE_LONG_PRESS_MS
+#define GESTURE_LONG_PRESS_MS 600
+#endif
+
+// Finger distance change (1/1000) that starts a pinch
+#ifndef GESTURE_PINCH_START_PERMILLE
+#define GESTURE_PINCH_START_PERMILLE 100
+#endif
+
+// Angle change (1/10 degree) that starts a rotation
+#ifndef GESTURE_ROTATE_START_DECIDEG
+#define GESTURE_ROTATE_START_DECIDEG 120
+#endif
+
+typedef enum {
+    GS_IDLE,
+    GS_ONE,         // One finger down, waiting for long press or movement
+    GS_EDGE,        // One finger down inside an edge band
+    GS_TWO,         // Two fingers down, nothing decided yet
+    GS_TRANSFORM,   // Pinch and/or rotate in progress
+    GS_WAIT_UP,     // Gesture done or rejected, ignore until all fingers lift
+} gesture_state_t;
+
+// The whole recognizer state; nothing is allocated per sample
+typedef struct {
+    gesture_state_t state;
+    lv_point_t start;
+    lv_point_t start_center;
+    float start_dist;
+    float start_angle;
+    int64_t start_us;
+    lv_dir_t edge;
+    bool pinch_active;
+    bool rotate_active;
+    gesture_info_t info;
+} gesture_ctx_t;
+
+static gesture_ctx_t s_ctx;
+static lv_event_code_t s_event_code = LV_EVENT_ALL;
+
+// Same mapping LVGL applies to pointer input on a rotated display
+static lv_point_t to_display(uint16_t x, uint16_t y)
+{
+    lv_display_t *disp = lv_display_get_default();
+    int32_t hor = lv_display_get_physical_horizontal_resolution(disp);
+    int32_t ver = lv_display_get_physical_vertical_resolution(disp);
+    lv_point_t p;
+
+    switch(lv_display_get_rotation(disp)) {
+        case LV_DISPLAY_ROTATION_90:
+            p.x = ver - y - 1;
+            p.y = x;
+            break;
+        case LV_DISPLAY_ROTATION_180:
+            p.x = hor - x - 1;
+            p.y = ver - y - 1;
+            break;
+        case LV_DISPLAY_ROTATION_270:
+            p.x = y;
+            p.y = hor - x - 1;
+            break;
+        default:
+            p.x = x;
+            p.y = y;
+            break;
+    }
+    return p;
+}
+
+static lv_dir_t edge_of(lv_point_t p)
+{
+    lv_display_t *disp = lv_display_get_default();
+    int32_t w = lv_display_get_horizontal_resolution(disp);
+    int32_t h = lv_display_get_vertical_resolution(disp);
+
+    if(p.x < GESTURE_EDGE_PX) return LV_DIR_LEFT;
+    if(p.x >= w - GESTURE_EDGE_PX) return LV_DIR_RIGHT;
+    if(p.y < GESTURE_EDGE_PX) return LV_DIR_TOP;
+    if(p.y >= h - GESTURE_EDGE_PX) return LV_DIR_BOTTOM;
+    return LV_DIR_NONE;
+}
+
+static lv_dir_t dir_of(int32_t dx, int32_t dy)
+{
+    if(abs(dx) >= abs(dy)) return dx > 0 ? LV_DIR_RIGHT : LV_DIR_LEFT;
+    return dy > 0 ? LV_DIR_BOTTOM : LV_DIR_TOP;
+}
+
+// Wrap an angle difference in radians into tenths of a degree in (-1800, 1800]
+static int32_t angle_delta_decideg(float from, float to)
+{
+    float d = (to - from) * (1800.0f / (float)M_PI);
+    while(d > 1800.0f) d -= 3600.0f;
+    while(d <= -1800.0f) d += 3600.0f;
+    return (int32_t)d;
+}
+
+// Every gesture ends exactly once
+METRIC_COUNTER(s_gestures, "gesture.recognized", "gestures")
+
+static void emit(gesture_type_t type, gesture_phase_t phase)
+{
+    s_ctx.info.type = type;
+    s_ctx.info.phase = phase;
+    if (phase == GESTURE_PHASE_END) {
+        metric_inc(&s_gestures);
+    }
+
+    // Deliver to the focused (top) window, or the screen when no window is open
+    lv_obj_t *target = NULL;
+    wm_window_t *top = wm_top();
+    if(top) target = wm_get_content(top);
+    if(!target) target = lv_screen_active();
+
+    lv_obj_send_event(target, s_event_code, &s_ctx.info);
+}
+
+static void two_finger_measure(const lv_point_t *p, lv_point_t *center, float *dist, float *angle)
+{
+    float dx = (float)(p[1].x - p[0].x);
+    float dy = (float)(p[1].y - p[0].y);
+
+    center->x = (p[0].x + p[1].x) / 2;
+    center->y = (p[0].y + p[1].y) / 2;
+    *dist = sqrtf(dx * dx + dy * dy);
+    *angle = atan2f(dy, dx);
+}
+
+static void start_two(const lv_point_t *p)
+{
+    two_finger_measure(p, &s_ctx.start_center, &s_ctx.start_dist, &s_ctx.start_angle);
+    if(s_ctx.start_dist < 1.0f) s_ctx.start_dist = 1.0f;
+    s_ctx.pinch_active = false;
+    s_ctx.rotate_active = false;
+    s_ctx.state = GS_TWO;
+}
+
+static void end_transform(void)
+{
+    if(s_ctx.pinch_active) emit(GESTURE_PINCH, GESTURE_PHASE_END);
+    if(s_ctx.rotate_active) emit(GESTURE_ROTATE, GESTURE_PHASE_END);
+    s_ctx.pinch_active = false;
+    s_ctx.rotate_active = false;
+}
+
+// Update the two finger measurements and decide between swipe and pinch/rotate
+static void track_two(const lv_point_t *p)
+{
+    lv_point_t center;
+    float dist, angle;
+    two_finger_measure(p, &center, &dist, &angle);
+
+    s_ctx.info.center = center;
+    s_ctx.info.scale = (int32_t)(dist * 1000.0f / s_ctx.start_dist);
+    s_ctx.info.angle = angle_delta_decideg(s_ctx.start_angle, angle);
+
+    bool pinch = abs(s_ctx.info.scale - 1000) >= GESTURE_PINCH_START_PERMILLE;
+    bool rotate = abs(s_ctx.info.angle) >= GESTURE_ROTATE_START_DECIDEG;
+
+    if(s_ctx.state == GS_TWO) {
+        int32_t dx = center.x - s_ctx.start_center.x;
+        int32_t dy = center.y - s_ctx.start_center.y;
+
+        if(pinch || rotate) {
+            s_ctx.state = GS_TRANSFORM;
+        } else if(abs(dx) >= GESTURE_SWIPE_MIN_PX || abs(dy) >= GESTURE_SWIPE_MIN_PX) {
+            s_ctx.info.dir = dir_of(dx, dy);
+            emit(GESTURE_SWIPE, GESTURE_PHASE_END);
+            s_ctx.state = GS_WAIT_UP;
+            return;
+        } else {
+            return;
+        }
+    }
+
+    // Pinch and rotate start independently and then both follow every sample
+    if(pinch && !s_ctx.pinch_active) {
+        s_ctx.pinch_active = true;
+        emit(GESTURE_PINCH, GESTURE_PHASE_BEGIN);
+    } else if(s_ctx.pinch_active) {
+        emit(GESTURE_PINCH, GESTURE_PHASE_UPDATE);
+    }
+
+    if(rotate && !s_ctx.rotate_active) {
+        s_ctx.rotate_active = true;
+        emit(GESTURE_ROTATE, GESTURE_PHASE_BEGIN);
+    } else if(s_ctx.rotate_active) {
+        emit(GESTURE_ROTATE, GESTURE_PHASE_UPDATE);
+    }
+}
+
+static void track_one(lv_point_t p, int64_t now_us)
+{
+    int32_t dx = p.x - s_ctx.start.x;
+    int32_t dy = p.y - s_ctx.start.y;
+
+    s_ctx.info.center = p;
+
+    if(s_ctx.state == GS_EDGE) {
+        // Only travel away from the edge counts
+        int32_t inward = 0;
+        switch(s_ctx.edge) {
+            case LV_DIR_LEFT:   inward = dx;  break;
+            case LV_DIR_RIGHT:  inward = -dx; break;
+            case LV_DIR_TOP:    inward = dy;  break;
+            case LV_DIR_BOTTOM: inward = -dy; break;
+            default: break;
+        }
+        if(inward >= GESTURE_SWIPE_MIN_PX) {
+            s_ctx.info.dir = s_ctx.edge;
+            emit(GESTURE_EDGE_SWIPE, GESTURE_PHASE_END);
+            s_ctx.state = GS_WAIT_UP;
+        }
+        return;
+    }
+
+    if(abs(dx) > GESTURE_MOVE_SLOP_PX || abs(dy) > GESTURE_MOVE_SLOP_PX) {
+        // A plain drag, LVGL's own scrolling handles it
+        s_ctx.state = GS_WAIT_UP;
+    } else if(now_us - s_ctx.start_us >= (int64_t)GESTURE_LONG_PRESS_MS * 1000) {
+        emit(GESTURE_LONG_PRESS, GESTURE_PHASE_END);
+        s_ctx.state = GS_WAIT_UP;
+    }
+}
+
+void gesture_manager_feed(const hal_touch_sample_t *sample)
+{
+    if(s_event_code == LV_EVENT_ALL || !sample) return;
+
+    uint8_t n = sample->count;
+    lv_point_t p[2];
+    for(uint8_t i = 0; i < n && i < 2; i++) {
+        p[i] = to_display(sample->x[i], sample->y[i]);
+    }
+
+    s_ctx.info.fingers = n;
+    s_ctx.info.timestamp_us = sample->timestamp_us;
+
+    switch(s_ctx.state) {
+        case GS_IDLE:
+            if(n >= 2) {
+                start_two(p);
+            } else if(n == 1) {
+                s_ctx.start = p[0];
+                s_ctx.start_us = sample->timestamp_us;
+                s_ctx.edge = edge_of(p[0]);
+                s_ctx.state = (s_ctx.edge != LV_DIR_NONE) ? GS_EDGE : GS_ONE;
+            }
+            break;
+
+        case GS_ONE:
+        case GS_EDGE:
+            if(n == 0) {
+                s_ctx.state = GS_IDLE;
+            } else if(n >= 2) {
+                // Second finger landed: start over as a two finger gesture
+                start_two(p);
+            } else {
+                track_one(p[0], sample->timestamp_us);
+            }
+            break;
+
+        case GS_TWO:
+        case GS_TRANSFORM:
+            if(n < 2) {
+                end_transform();
+                s_ctx.state = (n == 0) ? GS_IDLE : GS_WAIT_UP;
+            } else {
+                track_two(p);
+            }
+            break;
+
+        case GS_WAIT_UP:
+            if(n == 0) s_ctx.state = GS_IDLE;
+            break;
+    }
+}
+
+void gesture_manager_init(void)
+{
+    if(s_event_code == LV_EVENT_ALL) {
+        s_event_code = (lv_event_code_t)lv_event_register_id();
+    }
+    s_ctx.state = GS_IDLE;
+    hal_touch_set_sample_cb(gesture_manager_feed);
+}
+
+lv_event_code_t gesture_manager_event_code(void)
+{
+    return s_event_code;
+}
+
+const gesture_info_t* gesture_get_info(lv_event_t *e)
+{
+    if(!e || lv_event_get_code(e) != s_event_code) return NULL;
+    return (const gesture_info_t*)lv_event_get_param(e);
+}
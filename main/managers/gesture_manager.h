@@ -0,0 +1,46 @@
+#pragma once
+
+#include "lvgl.h"
+#include <stdint.h>
+#include "hals/hal_touch.h"
+
+// Gestures recognized from the raw multi-touch samples
+typedef enum {
+    GESTURE_PINCH,          // Two fingers moving apart/together, see scale
+    GESTURE_ROTATE,         // Two fingers turning around their center, see angle
+    GESTURE_SWIPE,          // Two fingers moving together in one direction, see dir
+    GESTURE_EDGE_SWIPE,     // One finger dragged in from a screen edge, dir is the edge
+    GESTURE_LONG_PRESS,     // One finger held still
+    GESTURE_MAX
+} gesture_type_t;
+
+// Pinch and rotate run BEGIN, UPDATE..., END; the others are sent once with END
+typedef enum {
+    GESTURE_PHASE_BEGIN,
+    GESTURE_PHASE_UPDATE,
+    GESTURE_PHASE_END
+} gesture_phase_t;
+
+// Event parameter, valid only during the event callback
+typedef struct {
+    gesture_type_t type;
+    gesture_phase_t phase;
+    lv_point_t center;      // Gesture center in display (rotated) coordinates
+    int32_t scale;          // Pinch: finger distance relative to the start, 1000 = unchanged
+    int32_t angle;          // Rotate: tenths of a degree since the start, clockwise positive
+    lv_dir_t dir;           // Swipe direction, or the edge an edge swipe started from
+    uint8_t fingers;
+    int64_t timestamp_us;   // Timestamp of the touch sample that produced the event
+} gesture_info_t;
+
+// Register the gesture event and start consuming touch samples
+void gesture_manager_init(void);
+
+// Event code gestures are sent with to the top window's content (or the active screen)
+lv_event_code_t gesture_manager_event_code(void);
+
+// Feed one touch sample; normally called through the hal_touch sample hook
+void gesture_manager_feed(const hal_touch_sample_t *sample);
+
+// Get the gesture of a gesture_manager_event_code() event
+const gesture_info_t* gesture_get_info(lv_event_t *e);
@@ -0,0 +1,437 @@
+#include "managers/metrics.h"
+#include "hals/hal_sdcard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#ifndef METRICS_TASK_PRIORITY
+#define METRICS_TASK_PRIORITY 2
+#endif
+
+// Refresh period of metrics_view_create()
+#define VIEW_PERIOD_MS 1000
+
+// Registered metrics, newest first. Only ever grows, by CAS on the head, so
+// readers can walk it at any time without a lock.
+static metric_t *s_metrics = NULL;
+static uint32_t s_generation = 0;
+
+void metrics_register(metric_t *metric)
+{
+    if (!metric || __atomic_exchange_n(&metric->registered, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    metric_t *head = __atomic_load_n(&s_metrics, __ATOMIC_ACQUIRE);
+    do {
+        metric->next = head;
+    } while (!__atomic_compare_exchange_n(&s_metrics, &head, metric, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    __atomic_fetch_add(&s_generation, 1, __ATOMIC_RELAXED);
+}
+
+void metric_add(metric_t *metric, uint32_t n)
+{
+    // Atomic as the task may move to the other core between the two reads
+    __atomic_fetch_add(&metric->count[esp_cpu_get_core_id()], n, __ATOMIC_RELAXED);
+}
+
+void metric_set(metric_t *metric, int32_t level)
+{
+    __atomic_store_n(&metric->level, level, __ATOMIC_RELAXED);
+}
+
+void metric_observe(metric_t *metric, uint32_t sample)
+{
+    int bucket = 0;
+    while (bucket < METRICS_HIST_BUCKETS - 1 && sample > metric->limits[bucket]) {
+        bucket++;
+    }
+
+    int core = esp_cpu_get_core_id();
+    __atomic_fetch_add(&metric->buckets[core][bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->sum[core], sample, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Snapshots                                  */
+/* -------------------------------------------------------------------------- */
+
+static void read_metric(const metric_t *metric, metric_value_t *value)
+{
+    memset(value, 0, sizeof(*value));
+    value->metric = metric;
+
+    if (metric->sample) {
+        value->value = metric->sample();
+        return;
+    }
+
+    switch (metric->type) {
+    case METRIC_COUNTER:
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            value->value += (int32_t)__atomic_load_n(&metric->count[core], __ATOMIC_RELAXED);
+        }
+        break;
+    case METRIC_GAUGE:
+        value->value = __atomic_load_n(&metric->level, __ATOMIC_RELAXED);
+        break;
+    case METRIC_HISTOGRAM:
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+                value->buckets[b] += __atomic_load_n(&metric->buckets[core][b], __ATOMIC_RELAXED);
+            }
+            value->sum += __atomic_load_n(&metric->sum[core], __ATOMIC_RELAXED);
+        }
+        for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            value->value += (int32_t)value->buckets[b];
+        }
+        break;
+    }
+}
+
+void metrics_snapshot(metrics_snapshot_t *snap)
+{
+    snap->time_us = esp_timer_get_time();
+    snap->generation = __atomic_load_n(&s_generation, __ATOMIC_RELAXED);
+    snap->count = 0;
+
+    for (const metric_t *m = __atomic_load_n(&s_metrics, __ATOMIC_ACQUIRE); m && snap->count < METRICS_MAX;
+         m = m->next) {
+        // Insertion sort by name, there are a few dozen at most
+        size_t i = snap->count++;
+        while (i > 0 && strcmp(snap->values[i - 1].metric->name, m->name) > 0) {
+            snap->values[i] = snap->values[i - 1];
+            i--;
+        }
+        read_metric(m, &snap->values[i]);
+    }
+}
+
+bool metrics_read(const char *name, metric_value_t *value)
+{
+    for (const metric_t *m = __atomic_load_n(&s_metrics, __ATOMIC_ACQUIRE); m; m = m->next) {
+        if (strcmp(m->name, name) == 0) {
+            read_metric(m, value);
+            return true;
+        }
+    }
+    return false;
+}
+
+void metrics_diff(const metrics_snapshot_t *prev, const metrics_snapshot_t *cur, metrics_snapshot_t *out)
+{
+    out->time_us = cur->time_us - (prev ? prev->time_us : 0);
+    out->generation = cur->generation;
+    out->count = cur->count;
+
+    size_t p = 0;
+    for (size_t i = 0; i < cur->count; i++) {
+        const metric_value_t *c = &cur->values[i];
+        metric_value_t *o = &out->values[i];
+        *o = *c;
+        if (c->metric->type == METRIC_GAUGE || !prev) {
+            continue;
+        }
+
+        // Both sorted by name, so matches come in order; a new metric has no match
+        while (p < prev->count && strcmp(prev->values[p].metric->name, c->metric->name) < 0) {
+            p++;
+        }
+        if (p == prev->count || prev->values[p].metric != c->metric) {
+            continue;
+        }
+        const metric_value_t *old = &prev->values[p];
+        o->value = (int32_t)((uint32_t)c->value - (uint32_t)old->value);
+        o->sum = c->sum - old->sum;
+        for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            o->buckets[b] = c->buckets[b] - old->buckets[b];
+        }
+    }
+}
+
+uint32_t metrics_percentile(const metric_value_t *value, uint32_t percent)
+{
+    uint32_t n = (uint32_t)value->value;
+    if (n == 0 || value->metric->type != METRIC_HISTOGRAM) {
+        return 0;
+    }
+
+    const uint32_t *limits = value->metric->limits;
+    uint32_t target = (uint32_t)(((uint64_t)n * percent + 99) / 100);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint32_t seen = 0;
+    for (int b = 0; b < METRICS_HIST_BUCKETS - 1; b++) {
+        uint32_t in_bucket = value->buckets[b];
+        if (seen + in_bucket >= target) {
+            // Assume the samples are spread evenly over the bucket
+            uint32_t lower = b ? limits[b - 1] : 0;
+            return lower + (uint32_t)((uint64_t)(limits[b] - lower) * (target - seen) / in_bucket);
+        }
+        seen += in_bucket;
+    }
+    // Open-ended last bucket, all that is known is the lower bound
+    return limits[METRICS_HIST_BUCKETS - 2];
+}
+
+void metrics_format(const metric_value_t *value, int64_t window_us, char *buf, size_t len)
+{
+    const metric_t *m = value->metric;
+
+    switch (m->type) {
+    case METRIC_COUNTER: {
+        uint64_t rate10 = window_us > 0 ? (uint64_t)(uint32_t)value->value * 10000000ULL / window_us : 0;
+        snprintf(buf, len, "%llu.%llu %s/s", rate10 / 10, rate10 % 10, m->unit);
+        break;
+    }
+    case METRIC_GAUGE:
+        snprintf(buf, len, "%ld %s", (long)value->value, m->unit);
+        break;
+    case METRIC_HISTOGRAM: {
+        uint32_t n = (uint32_t)value->value;
+        if (n == 0) {
+            snprintf(buf, len, "-");
+            break;
+        }
+        snprintf(buf, len, "n %lu  avg %lu  p50 %lu  p99 %lu %s", (unsigned long)n,
+                 (unsigned long)(value->sum / n), (unsigned long)metrics_percentile(value, 50),
+                 (unsigned long)metrics_percentile(value, 99), m->unit);
+        break;
+    }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Exporters                                  */
+/* -------------------------------------------------------------------------- */
+
+// Each exporter reports what changed since its own previous export
+typedef struct {
+    metrics_snapshot_t prev;
+    metrics_snapshot_t cur;
+    metrics_snapshot_t diff;
+    bool primed;
+} exporter_t;
+
+static exporter_t *exporter_new(void)
+{
+    exporter_t *x = heap_caps_calloc(1, sizeof(exporter_t), MALLOC_CAP_SPIRAM);
+    if (!x) {
+        x = calloc(1, sizeof(exporter_t));
+    }
+    return x;
+}
+
+static const metrics_snapshot_t *exporter_step(exporter_t *x)
+{
+    metrics_snapshot(&x->cur);
+    metrics_diff(x->primed ? &x->prev : NULL, &x->cur, &x->diff);
+    x->prev = x->cur;
+    x->primed = true;
+    return &x->diff;
+}
+
+void metrics_print(void)
+{
+    static exporter_t *s_console = NULL;
+    if (!s_console && !(s_console = exporter_new())) {
+        return;
+    }
+
+    const metrics_snapshot_t *d = exporter_step(s_console);
+    char line[96];
+    printf("Metrics over %lld ms:\n", d->time_us / 1000);
+    for (size_t i = 0; i < d->count; i++) {
+        metrics_format(&d->values[i], d->time_us, line, sizeof(line));
+        printf("  %-24s %s\n", d->values[i].metric->name, line);
+    }
+}
+
+// Counters as the change over the row's window, histograms as count and percentiles
+static void csv_write(FILE *f, const metrics_snapshot_t *d, const metrics_snapshot_t *cur, bool header)
+{
+    if (header) {
+        fprintf(f, "time_ms,window_ms");
+        for (size_t i = 0; i < d->count; i++) {
+            const metric_t *m = d->values[i].metric;
+            if (m->type == METRIC_HISTOGRAM) {
+                fprintf(f, ",%s.n,%s.p50,%s.p99", m->name, m->name, m->name);
+            } else {
+                fprintf(f, ",%s", m->name);
+            }
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "%lld,%lld", cur->time_us / 1000, d->time_us / 1000);
+    for (size_t i = 0; i < d->count; i++) {
+        const metric_value_t *v = &d->values[i];
+        switch (v->metric->type) {
+        case METRIC_COUNTER:
+            fprintf(f, ",%lu", (unsigned long)(uint32_t)v->value);
+            break;
+        case METRIC_GAUGE:
+            fprintf(f, ",%ld", (long)v->value);
+            break;
+        case METRIC_HISTOGRAM:
+            fprintf(f, ",%lu,%lu,%lu", (unsigned long)(uint32_t)v->value,
+                    (unsigned long)metrics_percentile(v, 50), (unsigned long)metrics_percentile(v, 99));
+            break;
+        }
+    }
+    fprintf(f, "\n");
+}
+
+static void export_task(void *arg)
+{
+    exporter_t *csv = arg;
+    uint32_t header_generation = 0;
+    bool header_written = false;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(METRICS_EXPORT_PERIOD_MS));
+
+        if (METRICS_EXPORT_CONSOLE) {
+            metrics_print();
+        }
+        if (METRICS_CSV_PATH[0] == '\0') {
+            continue;
+        }
+
+        const metrics_snapshot_t *d = exporter_step(csv);
+        if (!hal_sdcard_is_mounted()) {
+            continue;
+        }
+
+        // A new header row whenever the columns change, and at the top of a new file
+        struct stat st;
+        bool header = !header_written || d->generation != header_generation ||
+                      stat(METRICS_CSV_PATH, &st) != 0 || st.st_size == 0;
+        FILE *f = hal_sdcard_fopen(METRICS_CSV_PATH, "a");
+        if (!f) {
+            continue;
+        }
+        csv_write(f, d, &csv->cur, header);
+        fclose(f);
+        header_written = true;
+        header_generation = d->generation;
+    }
+}
+
+void metrics_init(void)
+{
+    static bool s_started = false;
+    if (s_started || (!METRICS_EXPORT_CONSOLE && METRICS_CSV_PATH[0] == '\0')) {
+        return;
+    }
+
+    exporter_t *csv = exporter_new();
+    if (!csv) {
+        printf("Metrics: out of memory\n");
+        return;
+    }
+    exporter_step(csv);
+
+    if (xTaskCreate(export_task, "metrics", 4096, csv, METRICS_TASK_PRIORITY, NULL) != pdPASS) {
+        printf("Failed to create metrics task\n");
+        free(csv);
+        return;
+    }
+    s_started = true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 On screen                                  */
+/* -------------------------------------------------------------------------- */
+
+static void view_refresh(lv_obj_t *table, exporter_t *x)
+{
+    const metrics_snapshot_t *d = exporter_step(x);
+    char line[96];
+
+    lv_table_set_row_count(table, d->count);
+    for (size_t i = 0; i < d->count; i++) {
+        metrics_format(&d->values[i], d->time_us, line, sizeof(line));
+        lv_table_set_cell_value(table, i, 0, d->values[i].metric->name);
+        lv_table_set_cell_value(table, i, 1, line);
+    }
+}
+
+static void view_timer_cb(lv_timer_t *timer)
+{
+    lv_obj_t *table = lv_timer_get_user_data(timer);
+    // Hidden menu pages stay alive; the next refresh just covers a longer window
+    if (!lv_obj_is_visible(table)) {
+        return;
+    }
+    view_refresh(table, lv_obj_get_user_data(table));
+}
+
+static void view_delete_cb(lv_event_t *e)
+{
+    lv_timer_delete(lv_event_get_user_data(e));
+    free(lv_obj_get_user_data(lv_event_get_target(e)));
+}
+
+lv_obj_t *metrics_view_create(lv_obj_t *parent)
+{
+    exporter_t *x = exporter_new();
+    if (!x) {
+        return NULL;
+    }
+
+    lv_obj_t *table = lv_table_create(parent);
+    lv_obj_set_width(table, LV_PCT(100));
+    lv_table_set_column_count(table, 2);
+    lv_table_set_column_width(table, 0, 220);
+    lv_table_set_column_width(table, 1, 360);
+    lv_obj_set_user_data(table, x);
+
+    // First view covers everything since boot, then each refresh the last second
+    view_refresh(table, x);
+    lv_timer_t *timer = lv_timer_create(view_timer_cb, VIEW_PERIOD_MS, table);
+    lv_obj_add_event_cb(table, view_delete_cb, LV_EVENT_DELETE, timer);
+    return table;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               System metrics                               */
+/* -------------------------------------------------------------------------- */
+
+static int32_t heap_internal_free(void)
+{
+    return (int32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+static int32_t heap_internal_min(void)
+{
+    return (int32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+}
+
+static int32_t heap_internal_largest(void)
+{
+    return (int32_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+}
+
+static int32_t heap_dma_free(void)
+{
+    return (int32_t)heap_caps_get_free_size(MALLOC_CAP_DMA);
+}
+
+static int32_t heap_psram_free(void)
+{
+    return (int32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+}
+
+METRIC_GAUGE_FN(s_heap_internal, "heap.internal_free", "bytes", heap_internal_free)
+METRIC_GAUGE_FN(s_heap_internal_min, "heap.internal_min", "bytes", heap_internal_min)
+METRIC_GAUGE_FN(s_heap_internal_largest, "heap.internal_largest", "bytes", heap_internal_largest)
+METRIC_GAUGE_FN(s_heap_dma, "heap.dma_free", "bytes", heap_dma_free)
+METRIC_GAUGE_FN(s_heap_psram, "heap.psram_free", "bytes", heap_psram_free)
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "lvgl.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+// Most metrics a snapshot holds; later registrations are left out of snapshots
+#ifndef METRICS_MAX
+#define METRICS_MAX 64
+#endif
+
+// Buckets of every histogram, the last one takes everything above the last limit
+#define METRICS_HIST_BUCKETS 8
+
+// How often the exporter task writes the CSV log and, if enabled, the console
+#ifndef METRICS_EXPORT_PERIOD_MS
+#define METRICS_EXPORT_PERIOD_MS 5000
+#endif
+
+// CSV log, appended while the SD card is mounted; "" to turn it off
+#ifndef METRICS_CSV_PATH
+#define METRICS_CSV_PATH "/sdcard/metrics.csv"
+#endif
+
+// Also print every export period to the console
+#ifndef METRICS_EXPORT_CONSOLE
+#define METRICS_EXPORT_CONSOLE 0
+#endif
+
+typedef enum {
+    METRIC_COUNTER,     // Only goes up; totals wrap, exporters show the rate
+    METRIC_GAUGE,       // Current level
+    METRIC_HISTOGRAM,   // Distribution of samples over fixed buckets
+} metric_type_t;
+
+// Reads a value kept elsewhere when a snapshot is taken: the level of a gauge
+// or the running total of a counter. Runs on the snapshotting task.
+typedef int32_t (*metric_sample_fn_t)(void);
+
+typedef struct metric metric_t;
+
+// Define with the METRIC_* macros below, which register it before app_main().
+// Updates go to a slot of the calling core with a single atomic add, so they
+// never take a lock and never wait for the other core.
+struct metric {
+    const char *name;               // "subsystem.what"
+    const char *unit;
+    metric_type_t type;
+    metric_sample_fn_t sample;
+    uint32_t limits[METRICS_HIST_BUCKETS - 1];  // Histogram bucket upper bounds, ascending
+    metric_t *next;
+    bool registered;
+    int32_t level;                  // Gauges set with metric_set()
+    uint32_t count[portNUM_PROCESSORS];         // Counter total per core
+    uint32_t sum[portNUM_PROCESSORS];           // Histogram sample sum per core
+    uint32_t buckets[portNUM_PROCESSORS][METRICS_HIST_BUCKETS];
+};
+
+// One metric in a snapshot. Counter and histogram fields are running totals
+// in a snapshot and differences after metrics_diff().
+typedef struct {
+    const metric_t *metric;
+    int32_t value;                  // Gauge level, counter total, histogram sample count
+    uint32_t sum;                   // Histogram sample sum
+    uint32_t buckets[METRICS_HIST_BUCKETS];
+} metric_value_t;
+
+typedef struct {
+    int64_t time_us;                // When it was taken; the window length after metrics_diff()
+    uint32_t generation;            // Changes whenever a metric is registered
+    size_t count;
+    metric_value_t values[METRICS_MAX];     // Sorted by name
+} metrics_snapshot_t;
+
+void metrics_register(metric_t *metric);
+
+#define METRIC_DEFINE_(var, name_, unit_, type_, sample_, ...)                 \
+    static metric_t var = {                                                     \
+        .name = (name_), .unit = (unit_), .type = (type_), .sample = (sample_), \
+        .limits = {__VA_ARGS__},                                                \
+    };                                                                          \
+    static void __attribute__((constructor)) var##_register(void)              \
+    {                                                                           \
+        metrics_register(&var);                                                 \
+    }
+
+// Updated with metric_add()
+#define METRIC_COUNTER(var, name, unit)             METRIC_DEFINE_(var, name, unit, METRIC_COUNTER, NULL, 0)
+// Running total read from fn, for counts a subsystem already keeps
+#define METRIC_COUNTER_FN(var, name, unit, fn)      METRIC_DEFINE_(var, name, unit, METRIC_COUNTER, fn, 0)
+// Updated with metric_set()
+#define METRIC_GAUGE(var, name, unit)               METRIC_DEFINE_(var, name, unit, METRIC_GAUGE, NULL, 0)
+// Level read from fn
+#define METRIC_GAUGE_FN(var, name, unit, fn)        METRIC_DEFINE_(var, name, unit, METRIC_GAUGE, fn, 0)
+// Updated with metric_observe(); takes METRICS_HIST_BUCKETS - 1 ascending bucket limits
+#define METRIC_HISTOGRAM(var, name, unit, ...)      METRIC_DEFINE_(var, name, unit, METRIC_HISTOGRAM, NULL, __VA_ARGS__)
+
+void metric_add(metric_t *metric, uint32_t n);
+void metric_set(metric_t *metric, int32_t level);
+void metric_observe(metric_t *metric, uint32_t sample);
+
+static inline void metric_inc(metric_t *metric)
+{
+    metric_add(metric, 1);
+}
+
+// Start the exporter task; metrics work before this, they just aren't exported
+void metrics_init(void);
+
+// Read every registered metric. Not a single instant: each metric is read
+// on its own while updates carry on.
+void metrics_snapshot(metrics_snapshot_t *snap);
+
+// Read one metric by name; false if nothing by that name is registered
+bool metrics_read(const char *name, metric_value_t *value);
+
+// What happened between two snapshots; gauges keep their level in cur
+void metrics_diff(const metrics_snapshot_t *prev, const metrics_snapshot_t *cur, metrics_snapshot_t *out);
+
+// Estimate a percentile (0-100) of a histogram value from its buckets
+uint32_t metrics_percentile(const metric_value_t *value, uint32_t percent);
+
+// One line summary of a value from metrics_diff(): rate, level or distribution
+void metrics_format(const metric_value_t *value, int64_t window_us, char *buf, size_t len);
+
+// Print every metric since the previous call (since boot the first time)
+void metrics_print(void);
+
+// Table of every metric, refreshed once a second while it exists
+lv_obj_t *metrics_view_create(lv_obj_t *parent);
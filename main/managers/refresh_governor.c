@@ -0,0 +1,403 @@
+#include "managers/refresh_governor.h"
+#include "managers/dlog.h"
+#include "managers/metrics.h"
+#include "managers/ui_dispatch.h"
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_lvgl_port.h"
+#include <bsp/esp-bsp.h>
+
+// The governor decides on the LVGL task, from a timer that runs at the
+// refresh period while not idle. Going idle stops that timer and the input
+// devices' read timers, so with nothing invalidated the LVGL task sleeps
+// until an app timer is due. Leaving idle needs the display lock, which the
+// producers calling refresh_governor_wake() may not be able to take; a small
+// task takes it for them and then wakes the LVGL task.
+
+typedef struct {
+    int64_t time_us;
+    uint32_t idle;          // Run time of both idle tasks
+    uint32_t lvgl;          // Run time of the LVGL task
+} cpu_sample_t;
+
+static lv_display_t *s_disp = NULL;
+static lv_timer_t *s_timer = NULL;
+static TaskHandle_t s_task = NULL;
+static TaskHandle_t s_lvgl_task = NULL;
+
+// LVGL task only
+static refresh_mode_t s_mode = REFRESH_MODE_NORMAL;
+static cpu_sample_t s_entered;
+static int64_t s_last_active_us = 0;
+static int64_t s_last_draw_us = 0;
+static bool s_dirty = false;
+static bool s_rendered = false;
+
+// Shared with the producers
+static volatile bool s_idle = false;
+static volatile bool s_wake_pending = false;
+static volatile uint8_t s_wake_reason = REFRESH_REASON_MAX;
+
+static refresh_change_t s_log[REFRESH_GOVERNOR_LOG_SIZE];
+static uint32_t s_log_count = 0;
+static portMUX_TYPE s_log_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const s_mode_names[REFRESH_MODE_MAX] = {"idle", "normal", "active"};
+static const char *const s_reason_names[REFRESH_REASON_MAX] = {
+    "start", "input", "scroll", "anim", "settled", "quiet", "invalidate", "post",
+};
+
+static int32_t current_mode(void)
+{
+    return (int32_t)s_mode;
+}
+
+METRIC_GAUGE_FN(s_mode_metric, "refresh.mode", "mode", current_mode)
+METRIC_COUNTER(s_changes, "refresh.changes", "changes")
+METRIC_COUNTER(s_wakeups, "refresh.wakeups", "wakeups")
+METRIC_COUNTER(s_idle_ms, "refresh.idle_time", "ms")
+METRIC_COUNTER(s_normal_ms, "refresh.normal_time", "ms")
+METRIC_COUNTER(s_active_ms, "refresh.active_time", "ms")
+
+static metric_t *const s_mode_time[REFRESH_MODE_MAX] = {&s_idle_ms, &s_normal_ms, &s_active_ms};
+
+static void sample_cpu(cpu_sample_t *sample)
+{
+    sample->time_us = esp_timer_get_time();
+    sample->idle = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        sample->idle += ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(core));
+    }
+    sample->lvgl = s_lvgl_task ? ulTaskGetRunTimeCounter(s_lvgl_task) : 0;
+}
+
+static uint16_t permille(uint32_t part, int64_t whole)
+{
+    if (whole <= 0) {
+        return 0;
+    }
+    int64_t value = (int64_t)part * 1000 / whole;
+    return value > 1000 ? 1000 : (uint16_t)value;
+}
+
+static void record(const refresh_change_t *change)
+{
+    portENTER_CRITICAL(&s_log_lock);
+    s_log[s_log_count % REFRESH_GOVERNOR_LOG_SIZE] = *change;
+    s_log_count++;
+    portEXIT_CRITICAL(&s_log_lock);
+}
+
+static void set_timers(uint32_t period, bool resume)
+{
+    lv_timer_t *refr = lv_display_get_refr_timer(s_disp);
+    if (refr) {
+        lv_timer_set_period(refr, period);
+        if (resume) {
+            // Also gives ui_dispatch its REFR_START for work posted while idle
+            lv_timer_resume(refr);
+            lv_timer_ready(refr);
+        }
+    }
+
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev)) {
+        lv_timer_t *read = lv_indev_get_read_timer(indev);
+        if (read == NULL) {
+            continue;
+        }
+        lv_timer_set_period(read, period);
+        if (resume) {
+            lv_timer_resume(read);
+            lv_timer_ready(read);
+        }
+    }
+
+    lv_timer_set_period(s_timer, period);
+    lv_timer_resume(s_timer);
+}
+
+static void set_mode(refresh_mode_t mode, refresh_reason_t reason)
+{
+    if (mode == s_mode) {
+        return;
+    }
+
+    cpu_sample_t now;
+    sample_cpu(&now);
+    int64_t elapsed = now.time_us - s_entered.time_us;
+    uint16_t busy = 1000 - permille(now.idle - s_entered.idle, elapsed * portNUM_PROCESSORS);
+    const refresh_change_t change = {
+        .time_us = now.time_us,
+        .from = s_mode,
+        .to = mode,
+        .reason = reason,
+        .dwell_ms = (uint32_t)(elapsed / 1000),
+        .cpu_permille = busy,
+        .lvgl_permille = permille(now.lvgl - s_entered.lvgl, elapsed),
+    };
+    record(&change);
+    metric_add(s_mode_time[s_mode], change.dwell_ms);
+    metric_inc(&s_changes);
+    DLOG_D("refresh: %s -> %s (%s) after %lu ms, CPU %u permille",
+           s_mode_names[s_mode], s_mode_names[mode], s_reason_names[reason],
+           (unsigned long)change.dwell_ms, busy);
+
+    bool was_idle = s_mode == REFRESH_MODE_IDLE;
+    s_mode = mode;
+    s_entered = now;
+
+    switch (mode) {
+    case REFRESH_MODE_ACTIVE:
+        s_last_active_us = now.time_us;
+        set_timers(REFRESH_GOVERNOR_ACTIVE_PERIOD_MS, was_idle);
+        break;
+    case REFRESH_MODE_NORMAL:
+        // Counts as drawn, or it would go straight back to idle
+        s_last_draw_us = now.time_us;
+        set_timers(LV_DEF_REFR_PERIOD, was_idle);
+        break;
+    default:
+        break;
+    }
+    if (was_idle) {
+        __atomic_store_n(&s_idle, false, __ATOMIC_SEQ_CST);
+    }
+}
+
+// What keeps the UI busy right now, REFRESH_REASON_MAX if nothing
+static refresh_reason_t interaction(void)
+{
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev)) {
+        if (lv_indev_get_scroll_obj(indev) != NULL) {
+            return REFRESH_REASON_SCROLL;
+        }
+        if (lv_indev_get_state(indev) == LV_INDEV_STATE_PRESSED) {
+            return REFRESH_REASON_INPUT;
+        }
+    }
+    return lv_anim_count_running() > 0 ? REFRESH_REASON_ANIM : REFRESH_REASON_MAX;
+}
+
+static void enter_idle(void)
+{
+    set_mode(REFRESH_MODE_IDLE, REFRESH_REASON_QUIET);
+
+    // From here on producers wake the governor task. Whatever they queued
+    // before they could see that is read now, before input polling stops.
+    __atomic_store_n(&s_idle, true, __ATOMIC_SEQ_CST);
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev)) {
+        lv_timer_t *read = lv_indev_get_read_timer(indev);
+        if (read) {
+            lv_indev_read(indev);
+            lv_timer_pause(read);
+        }
+    }
+    lv_timer_pause(s_timer);
+
+    refresh_reason_t busy = interaction();
+    if (busy != REFRESH_REASON_MAX) {
+        set_mode(REFRESH_MODE_ACTIVE, busy);
+    } else if (s_dirty || ui_dispatch_pending() > 0) {
+        set_mode(REFRESH_MODE_NORMAL, s_dirty ? REFRESH_REASON_INVALIDATE : REFRESH_REASON_POST);
+    }
+}
+
+static void governor_timer_cb(lv_timer_t *timer)
+{
+    LV_UNUSED(timer);
+    int64_t now = esp_timer_get_time();
+    if (s_lvgl_task == NULL) {
+        // First run on the LVGL task; until now its share reads as zero
+        s_lvgl_task = xTaskGetCurrentTaskHandle();
+        sample_cpu(&s_entered);
+    }
+
+    // The refresh timer pauses itself when nothing is invalidated. Outside
+    // idle it keeps running: ui_dispatch drains and the UI watchdog's
+    // heartbeat both come from the start of a refresh.
+    lv_timer_t *refr = lv_display_get_refr_timer(s_disp);
+    if (refr) {
+        lv_timer_resume(refr);
+    }
+
+    refresh_reason_t busy = interaction();
+    if (busy != REFRESH_REASON_MAX) {
+        s_last_active_us = now;
+        set_mode(REFRESH_MODE_ACTIVE, busy);
+        return;
+    }
+
+    if (s_mode == REFRESH_MODE_ACTIVE) {
+        if (now - s_last_active_us >= REFRESH_GOVERNOR_ACTIVE_HOLD_MS * 1000) {
+            set_mode(REFRESH_MODE_NORMAL, REFRESH_REASON_SETTLED);
+        }
+    } else if (s_mode == REFRESH_MODE_NORMAL) {
+        if (!s_dirty && ui_dispatch_pending() == 0 &&
+            now - s_last_draw_us >= REFRESH_GOVERNOR_IDLE_AFTER_MS * 1000) {
+            enter_idle();
+        }
+    }
+}
+
+static void display_event_cb(lv_event_t *e)
+{
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_INVALIDATE_AREA:
+        // Any task holding the display lock may invalidate
+        s_dirty = true;
+        refresh_governor_wake(REFRESH_REASON_INVALIDATE);
+        break;
+    case LV_EVENT_REFR_START:
+        s_dirty = false;
+        s_rendered = false;
+        break;
+    case LV_EVENT_RENDER_START:
+        s_rendered = true;
+        break;
+    case LV_EVENT_REFR_READY:
+        if (s_rendered) {
+            s_last_draw_us = esp_timer_get_time();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void governor_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Cleared first: a producer arriving from here on notifies again
+        __atomic_store_n(&s_wake_pending, false, __ATOMIC_SEQ_CST);
+        refresh_reason_t reason = __atomic_exchange_n(&s_wake_reason, REFRESH_REASON_MAX, __ATOMIC_ACQ_REL);
+        if (reason >= REFRESH_REASON_MAX) {
+            reason = REFRESH_REASON_POST;
+        }
+
+        metric_inc(&s_wakeups);
+        bsp_display_lock(0);
+        if (s_mode == REFRESH_MODE_IDLE) {
+            set_mode(reason == REFRESH_REASON_INPUT ? REFRESH_MODE_ACTIVE : REFRESH_MODE_NORMAL, reason);
+        }
+        bsp_display_unlock();
+
+        // It may be asleep for up to task_max_sleep_ms
+        lvgl_port_task_wake(LVGL_PORT_EVENT_USER, NULL);
+    }
+}
+
+void refresh_governor_wake(refresh_reason_t reason)
+{
+    if (!__atomic_load_n(&s_idle, __ATOMIC_SEQ_CST) || s_task == NULL) {
+        return;
+    }
+
+    // Input wins, it goes straight to the active rate
+    if (reason == REFRESH_REASON_INPUT || __atomic_load_n(&s_wake_reason, __ATOMIC_RELAXED) == REFRESH_REASON_MAX) {
+        __atomic_store_n(&s_wake_reason, (uint8_t)reason, __ATOMIC_RELEASE);
+    }
+    if (__atomic_exchange_n(&s_wake_pending, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    if (xPortInIsrContext()) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_task, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    } else {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+void refresh_governor_init(lv_display_t *disp)
+{
+    if (s_disp != NULL) {
+        return;
+    }
+    if (!disp) {
+        disp = lv_display_get_default();
+    }
+    if (!disp) {
+        printf("refresh_governor: no display\n");
+        return;
+    }
+
+    if (xTaskCreate(governor_task, "refresh_gov", 3072, NULL, REFRESH_GOVERNOR_TASK_PRIORITY, &s_task) != pdPASS) {
+        printf("Failed to create refresh governor task\n");
+        return;
+    }
+
+    s_disp = disp;
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_INVALIDATE_AREA, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_RENDER_START, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_REFR_READY, NULL);
+
+    sample_cpu(&s_entered);
+    s_last_draw_us = s_entered.time_us;
+    s_timer = lv_timer_create(governor_timer_cb, LV_DEF_REFR_PERIOD, NULL);
+
+    const refresh_change_t start = {
+        .time_us = s_entered.time_us,
+        .from = REFRESH_MODE_NORMAL,
+        .to = REFRESH_MODE_NORMAL,
+        .reason = REFRESH_REASON_START,
+    };
+    record(&start);
+    printf("refresh_governor: %d ms active, %d ms normal, idle after %d ms\n",
+           REFRESH_GOVERNOR_ACTIVE_PERIOD_MS, LV_DEF_REFR_PERIOD, REFRESH_GOVERNOR_IDLE_AFTER_MS);
+}
+
+refresh_mode_t refresh_governor_get_mode(void)
+{
+    return s_mode;
+}
+
+const char *refresh_governor_mode_name(refresh_mode_t mode)
+{
+    return mode < REFRESH_MODE_MAX ? s_mode_names[mode] : "?";
+}
+
+const char *refresh_governor_reason_name(refresh_reason_t reason)
+{
+    return reason < REFRESH_REASON_MAX ? s_reason_names[reason] : "?";
+}
+
+size_t refresh_governor_get_log(refresh_change_t *changes, size_t max)
+{
+    if (!changes) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&s_log_lock);
+    uint32_t count = s_log_count < REFRESH_GOVERNOR_LOG_SIZE ? s_log_count : REFRESH_GOVERNOR_LOG_SIZE;
+    if (count > max) {
+        count = max;
+    }
+    uint32_t first = s_log_count - count;
+    for (uint32_t i = 0; i < count; i++) {
+        changes[i] = s_log[(first + i) % REFRESH_GOVERNOR_LOG_SIZE];
+    }
+    portEXIT_CRITICAL(&s_log_lock);
+    return count;
+}
+
+void refresh_governor_print_log(void)
+{
+    static refresh_change_t changes[REFRESH_GOVERNOR_LOG_SIZE];
+    size_t count = refresh_governor_get_log(changes, REFRESH_GOVERNOR_LOG_SIZE);
+
+    printf("Refresh mode changes (%u):\n", (unsigned)count);
+    printf("  %10s  %-6s    %-6s  %-10s  %8s  %6s  %6s\n", "time ms", "from", "to", "reason", "dwell ms", "cpu %", "lvgl %");
+    for (size_t i = 0; i < count; i++) {
+        const refresh_change_t *c = &changes[i];
+        printf("  %10lld  %-6s -> %-6s  %-10s  %8lu  %4u.%u  %4u.%u\n",
+               c->time_us / 1000, refresh_governor_mode_name(c->from), refresh_governor_mode_name(c->to),
+               refresh_governor_reason_name(c->reason), (unsigned long)c->dwell_ms,
+               c->cpu_permille / 10, c->cpu_permille % 10, c->lvgl_permille / 10, c->lvgl_permille % 10);
+    }
+}
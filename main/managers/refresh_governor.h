@@ -0,0 +1,83 @@
+#pragma once
+
+#include "lvgl.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Refresh period while the user is interacting. The DPI timing runs the panel
+// at 60 MHz / (940 x 1324) = 48 Hz, so faster than this only draws frames
+// that are never shown.
+#ifndef REFRESH_GOVERNOR_ACTIVE_PERIOD_MS
+#define REFRESH_GOVERNOR_ACTIVE_PERIOD_MS 20
+#endif
+
+// Stay at the active rate this long after the last touch, scroll or animation
+#ifndef REFRESH_GOVERNOR_ACTIVE_HOLD_MS
+#define REFRESH_GOVERNOR_ACTIVE_HOLD_MS 300
+#endif
+
+// Go idle once nothing has been drawn for this long
+#ifndef REFRESH_GOVERNOR_IDLE_AFTER_MS
+#define REFRESH_GOVERNOR_IDLE_AFTER_MS 500
+#endif
+
+// Mode changes kept for refresh_governor_get_log(), the oldest is overwritten
+#ifndef REFRESH_GOVERNOR_LOG_SIZE
+#define REFRESH_GOVERNOR_LOG_SIZE 64
+#endif
+
+// Above the LVGL task, so leaving idle doesn't wait behind it
+#ifndef REFRESH_GOVERNOR_TASK_PRIORITY
+#define REFRESH_GOVERNOR_TASK_PRIORITY 5
+#endif
+
+typedef enum {
+    REFRESH_MODE_IDLE,      // Input polling and the governor stopped; only wakeups and app timers run LVGL
+    REFRESH_MODE_NORMAL,    // LV_DEF_REFR_PERIOD, something is being drawn without interaction
+    REFRESH_MODE_ACTIVE,    // REFRESH_GOVERNOR_ACTIVE_PERIOD_MS for touch, scrolling and animations
+    REFRESH_MODE_MAX
+} refresh_mode_t;
+
+typedef enum {
+    REFRESH_REASON_START,       // Governor started
+    REFRESH_REASON_INPUT,       // Input device pressed, or input arrived while idle
+    REFRESH_REASON_SCROLL,      // An object is scrolling, including after release
+    REFRESH_REASON_ANIM,        // Animations running
+    REFRESH_REASON_SETTLED,     // Interaction over, still drawing
+    REFRESH_REASON_QUIET,       // Nothing drawn for REFRESH_GOVERNOR_IDLE_AFTER_MS
+    REFRESH_REASON_INVALIDATE,  // Something was invalidated while idle
+    REFRESH_REASON_POST,        // Work posted to the LVGL task while idle
+    REFRESH_REASON_MAX
+} refresh_reason_t;
+
+// One mode change, with what the mode being left cost
+typedef struct {
+    int64_t time_us;            // When the change happened
+    uint8_t from;               // refresh_mode_t
+    uint8_t to;
+    uint8_t reason;             // refresh_reason_t
+    uint32_t dwell_ms;          // Time spent in from
+    uint16_t cpu_permille;      // Both cores busy during from
+    uint16_t lvgl_permille;     // LVGL task's share of one core during from
+} refresh_change_t;
+
+// Pick the refresh rate from what the UI is doing. Call with the display lock
+// held once the input devices exist.
+void refresh_governor_init(lv_display_t *disp);
+
+// Make the LVGL task run again if it went idle. Lock-free and callable from
+// any task or ISR; cheap when not idle, so input and work producers call it
+// for everything they queue.
+void refresh_governor_wake(refresh_reason_t reason);
+
+refresh_mode_t refresh_governor_get_mode(void);
+
+const char *refresh_governor_mode_name(refresh_mode_t mode);
+const char *refresh_governor_reason_name(refresh_reason_t reason);
+
+// Copy up to max of the recorded mode changes, oldest first; returns how many
+size_t refresh_governor_get_log(refresh_change_t *changes, size_t max);
+
+// Print the recorded mode changes
+void refresh_governor_print_log(void);
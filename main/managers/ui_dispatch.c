@@ -0,0 +1,191 @@
+#include "managers/ui_dispatch.h"
+#include "managers/metrics.h"
+#include "managers/refresh_governor.h"
+#include "perf/perf_watchdog.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+
+#if (UI_DISPATCH_QUEUE_SIZE & (UI_DISPATCH_QUEUE_SIZE - 1)) != 0
+#error "UI_DISPATCH_QUEUE_SIZE must be a power of two"
+#endif
+
+#define QUEUE_MASK (UI_DISPATCH_QUEUE_SIZE - 1)
+
+// Bounded multi-producer ring with a sequence number per cell. A producer
+// claims a slot by advancing s_head with a CAS, fills it, then publishes it by
+// bumping the cell's sequence; the single consumer (LVGL task) only reads cells
+// whose sequence says they are published, so nobody ever waits on a lock.
+// A cell at position pos is free when its sequence is pos, filled when pos + 1.
+typedef struct {
+    uint32_t seq;           // Stored minus the cell index so the zeroed array starts out free
+    ui_dispatch_fn_t fn;
+    void *arg;
+    uint8_t len;
+    uint8_t msg[UI_DISPATCH_MSG_SIZE] __attribute__((aligned(8)));
+} dispatch_cell_t;
+
+static dispatch_cell_t s_cells[UI_DISPATCH_QUEUE_SIZE];
+static uint32_t s_head;     // Next position to claim, shared by producers
+static uint32_t s_tail;     // Next position to run, LVGL task only
+static ui_dispatch_stats_t s_stats;
+static bool s_initialized = false;
+
+static int32_t stat_posted(void)
+{
+    return (int32_t)__atomic_load_n(&s_stats.posted, __ATOMIC_RELAXED);
+}
+
+static int32_t stat_dropped(void)
+{
+    return (int32_t)__atomic_load_n(&s_stats.dropped, __ATOMIC_RELAXED);
+}
+
+static int32_t stat_pending(void)
+{
+    return (int32_t)ui_dispatch_pending();
+}
+
+METRIC_COUNTER_FN(s_posted_metric, "ui.posted", "items", stat_posted)
+METRIC_COUNTER_FN(s_dropped_metric, "ui.dropped", "items", stat_dropped)
+METRIC_GAUGE_FN(s_pending_metric, "ui.pending", "items", stat_pending)
+// Time spent running queued work in refreshes that had any
+METRIC_HISTOGRAM(s_drain_us, "ui.drain_time", "us", 100, 500, 1000, 2000, 4000, 8000, 16000)
+
+static inline uint32_t cell_seq(uint32_t index)
+{
+    return __atomic_load_n(&s_cells[index].seq, __ATOMIC_ACQUIRE) + index;
+}
+
+static inline void cell_set_seq(uint32_t index, uint32_t seq)
+{
+    __atomic_store_n(&s_cells[index].seq, seq - index, __ATOMIC_RELEASE);
+}
+
+bool ui_dispatch_post_msg(ui_dispatch_fn_t fn, void *arg, const void *msg, size_t len)
+{
+    if (!fn || len > UI_DISPATCH_MSG_SIZE || (len && !msg)) {
+        return false;
+    }
+
+    uint32_t pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    uint32_t index;
+    for (;;) {
+        index = pos & QUEUE_MASK;
+        int32_t diff = (int32_t)(cell_seq(index) - pos);
+        if (diff == 0) {
+            // Free cell, claim it; on failure pos holds the new head
+            if (__atomic_compare_exchange_n(&s_head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Still holds an item from one lap ago: full
+            __atomic_fetch_add(&s_stats.dropped, 1, __ATOMIC_RELAXED);
+            return false;
+        } else {
+            // Another producer claimed it first
+            pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    dispatch_cell_t *cell = &s_cells[index];
+    cell->fn = fn;
+    cell->arg = arg;
+    cell->len = (uint8_t)len;
+    if (len) {
+        memcpy(cell->msg, msg, len);
+    }
+    cell_set_seq(index, pos + 1);
+
+    __atomic_fetch_add(&s_stats.posted, 1, __ATOMIC_RELAXED);
+    // The LVGL task may be idle with no refresh coming
+    refresh_governor_wake(REFRESH_REASON_POST);
+    return true;
+}
+
+bool ui_dispatch_post(ui_dispatch_fn_t fn, void *arg)
+{
+    return ui_dispatch_post_msg(fn, arg, NULL, 0);
+}
+
+uint32_t ui_dispatch_pending(void)
+{
+    return __atomic_load_n(&s_head, __ATOMIC_RELAXED) - __atomic_load_n(&s_tail, __ATOMIC_RELAXED);
+}
+
+// Run queued work at the start of each refresh so whatever it invalidates is
+// drawn in the same frame. Stops once the budget is spent and leaves the rest
+// for the next refresh, always making progress by at least one item.
+static void refr_start_cb(lv_event_t *e)
+{
+    LV_UNUSED(e);
+
+    uint32_t pending = ui_dispatch_pending();
+    if (pending == 0) {
+        return;
+    }
+    if (pending > s_stats.max_pending) {
+        s_stats.max_pending = pending;
+    }
+
+    int64_t start = esp_timer_get_time();
+    int64_t now = start;
+    while (now - start < UI_DISPATCH_BUDGET_US || now == start) {
+        uint32_t pos = s_tail;
+        uint32_t index = pos & QUEUE_MASK;
+        if ((int32_t)(cell_seq(index) - (pos + 1)) < 0) {
+            // Empty, or the next producer hasn't published yet
+            break;
+        }
+
+        dispatch_cell_t *cell = &s_cells[index];
+        PERF_WATCHDOG_ENTER("ui_dispatch", cell->fn);
+        cell->fn(cell->arg, cell->len ? cell->msg : NULL);
+        PERF_WATCHDOG_LEAVE();
+
+        // Hand the cell back to producers for the next lap
+        cell_set_seq(index, pos + UI_DISPATCH_QUEUE_SIZE);
+        __atomic_store_n(&s_tail, pos + 1, __ATOMIC_RELAXED);
+        now = esp_timer_get_time();
+    }
+
+    if (ui_dispatch_pending() != 0) {
+        s_stats.deferred++;
+    }
+    uint32_t elapsed = (uint32_t)(now - start);
+    metric_observe(&s_drain_us, elapsed);
+    if (elapsed > s_stats.max_drain_us) {
+        s_stats.max_drain_us = elapsed;
+    }
+}
+
+void ui_dispatch_init(lv_display_t *disp)
+{
+    if (s_initialized) {
+        return;
+    }
+    if (!disp) {
+        disp = lv_display_get_default();
+    }
+    if (!disp) {
+        printf("ui_dispatch: no display\n");
+        return;
+    }
+
+    lv_display_add_event_cb(disp, refr_start_cb, LV_EVENT_REFR_START, NULL);
+    s_initialized = true;
+    printf("ui_dispatch: %d slots, %d us per refresh\n", UI_DISPATCH_QUEUE_SIZE, UI_DISPATCH_BUDGET_US);
+}
+
+void ui_dispatch_get_stats(ui_dispatch_stats_t *stats)
+{
+    if (!stats) {
+        return;
+    }
+    stats->posted = __atomic_load_n(&s_stats.posted, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&s_stats.dropped, __ATOMIC_RELAXED);
+    stats->deferred = s_stats.deferred;
+    stats->max_pending = s_stats.max_pending;
+    stats->max_drain_us = s_stats.max_drain_us;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "lvgl.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Queued work items; posts fail once this many are waiting (power of two)
+#ifndef UI_DISPATCH_QUEUE_SIZE
+#define UI_DISPATCH_QUEUE_SIZE 64
+#endif
+
+// Largest message ui_dispatch_post_msg() copies into the queue
+#ifndef UI_DISPATCH_MSG_SIZE
+#define UI_DISPATCH_MSG_SIZE 32
+#endif
+
+// Time the LVGL task spends running queued work per refresh; at least one item always runs
+#ifndef UI_DISPATCH_BUDGET_US
+#define UI_DISPATCH_BUDGET_US 4000
+#endif
+
+// Runs on the LVGL task with the display lock held. msg is the copy made by
+// ui_dispatch_post_msg() (NULL for ui_dispatch_post()) and is only valid during the call.
+typedef void (*ui_dispatch_fn_t)(void *arg, const void *msg);
+
+typedef struct {
+    uint32_t posted;
+    uint32_t dropped;       // Posts refused because the queue was full
+    uint32_t deferred;      // Refreshes that ran out of budget with work left over
+    uint32_t max_pending;   // Most items waiting at the start of a refresh
+    uint32_t max_drain_us;  // Longest time spent draining in one refresh
+} ui_dispatch_stats_t;
+
+// Start draining the queue at every refresh of the display; LVGL task only.
+// Posting before this is allowed, the work just waits until the first refresh.
+void ui_dispatch_init(lv_display_t *disp);
+
+// Queue fn(arg, NULL) to run on the LVGL task. Lock-free, never blocks, callable
+// from any task or ISR and without the display lock. Returns false if the queue is full.
+bool ui_dispatch_post(ui_dispatch_fn_t fn, void *arg);
+
+// Same, with len bytes of msg copied into the queue so the caller's buffer can go away
+bool ui_dispatch_post_msg(ui_dispatch_fn_t fn, void *arg, const void *msg, size_t len);
+
+// Number of items waiting, approximate while other tasks are posting
+uint32_t ui_dispatch_pending(void);
+
+void ui_dispatch_get_stats(ui_dispatch_stats_t *stats);
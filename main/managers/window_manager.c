@@ -1,4 +1,5 @@
 #include "managers/window_manager.h"
+#include "managers/metrics.h"
 #include <string.h>
 
 #ifndef WM_MAX_WINDOWS
@@ -15,6 +16,13 @@ typedef struct wm_window_t {
 static wm_window_t* s_stack[WM_MAX_WINDOWS];
 static int s_stack_sz = 0;
 
+static int32_t open_windows(void)
+{
+    return s_stack_sz;
+}
+
+METRIC_GAUGE_FN(s_windows, "wm.windows", "windows", open_windows)
+
 static void panel_click_handler(lv_event_t *e)
 {
     // Stop bubbling so overlay won't receive click if panel was clicked
@@ -1,26 +1,96 @@
 #include "os.h"
+#include <stdio.h>
 #include "managers/app_manager.h"
+#include "managers/gesture_manager.h"
+#include "managers/metrics.h"
+#include "managers/refresh_governor.h"
+#include "managers/ui_dispatch.h"
+#include "managers/window_manager.h"
+#include "hals/hal_splash.h"
+#include "hals/hal_usb.h"
 #include "apps/launcher/launcher.h"
 #include "apps/settings/settings.h"
 #include "apps/music/music.h"
 #include "apps/file_manager/file_manager.h"
+#include "apps/task_manager/task_manager.h"
 #include "control_center/control_center.h"
 
+// How often to try saving the boot splash until the home screen is left alone long enough
+#ifndef OS_SPLASH_CAPTURE_MS
+#define OS_SPLASH_CAPTURE_MS 3000
+#endif
+
+static uint32_t s_home_key;
+
+// Identity of the home screen for the boot splash. The splash HAL already
+// rejects snapshots from other firmware builds, which covers theme changes;
+// this adds what the launcher shows, and the display geometry.
+static uint32_t home_screen_key(lv_disp_t *disp)
+{
+    uint32_t hash = 2166136261u;    // FNV-1a
+    size_t count = 0;
+    const app_t **apps = app_manager_list(&count);
+    for (size_t i = 0; i < count; i++) {
+        for (const char *c = apps[i]->id; *c; c++) {
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+        }
+        hash = (hash ^ 0xFF) * 16777619u;
+    }
+    hash = (hash ^ (uint32_t)lv_display_get_horizontal_resolution(disp)) * 16777619u;
+    hash = (hash ^ (uint32_t)lv_display_get_vertical_resolution(disp)) * 16777619u;
+    return hash;
+}
+
+static void splash_capture_timer_cb(lv_timer_t *timer)
+{
+    // Only the launcher and control center may be on the panel, and no cursor
+    if (wm_count() > 1 || hal_usb_mouse_is_connected()) {
+        return;
+    }
+
+    esp_err_t ret = hal_splash_capture(s_home_key);
+    if (ret != ESP_ERR_INVALID_STATE) {
+        if (ret != ESP_OK) {
+            printf("Boot splash not saved: %s\n", esp_err_to_name(ret));
+        }
+        lv_timer_delete(timer);
+    }
+}
+
 void os_init(lv_disp_t *disp)
 {
-    LV_UNUSED(disp);
+    // Run work posted by other tasks on the LVGL task, once per refresh
+    ui_dispatch_init(disp);
+
+    // Refresh at the panel rate while interacting, and not at all when nothing changes
+    refresh_governor_init(disp);
 
     // Initialize app manager and register apps (Launcher is system-managed)
     app_manager_init();
 
+    // Recognize multi-touch gestures and deliver them to the top window
+    gesture_manager_init();
+
+    // Log the metrics every subsystem publishes to SD
+    metrics_init();
+
     // Register user apps shown in Launcher
     app_manager_register(&APP_SETTINGS);
     app_manager_register(&APP_MUSIC);
     app_manager_register(&APP_FILE_MANAGER);
+    app_manager_register(&APP_TASK_MANAGER);
 
     // Start launcher (non-closable, always present underneath)
     launcher_open();
     
     // Initialize control center system AFTER launcher to ensure it's on top
     control_center_init();
+
+    // Home screen is built: let the next refresh replace the boot splash, and
+    // save a new one if it no longer matches
+    s_home_key = home_screen_key(disp);
+    hal_splash_finish(s_home_key);
+    if (!hal_splash_is_current(s_home_key)) {
+        lv_timer_create(splash_capture_timer_cb, OS_SPLASH_CAPTURE_MS, NULL);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "perf/perf_bench.h"
+
+#if PERF_BENCH_ENABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include "managers/app_manager.h"
+#include "managers/window_manager.h"
+
+// Time for a window to finish opening, and the file manager to list the card
+#define SETTLE_MS 1000
+
+typedef struct {
+    const char *name;
+    const char *app_id;
+} scene_t;
+
+static const scene_t s_scenes[] = {
+    {"settings", "settings"},
+    {"file_list", "file_manager"},
+};
+
+#define SCENE_COUNT (sizeof(s_scenes) / sizeof(s_scenes[0]))
+
+typedef enum {
+    STATE_IDLE,
+    STATE_SETTLE,
+    STATE_RUN,
+    STATE_DONE,
+} state_t;
+
+static lv_display_t *s_disp = NULL;
+static lv_timer_t *s_timer = NULL;
+static state_t s_state = STATE_IDLE;
+static uint32_t s_scene = 0;
+static lv_obj_t *s_target = NULL;
+static int32_t s_direction = -1;
+
+static uint32_t s_samples[PERF_BENCH_FRAMES];
+static uint32_t s_sample_count = 0;
+static int64_t s_refr_start_us = 0;
+static bool s_rendered = false;
+
+static perf_bench_result_t s_results[SCENE_COUNT];
+static bool s_have_result[SCENE_COUNT];
+
+// Same frame definition as the display.frame_time metric
+static void display_event_cb(lv_event_t *e)
+{
+    switch (lv_event_get_code(e)) {
+    case LV_EVENT_REFR_START:
+        s_refr_start_us = esp_timer_get_time();
+        s_rendered = false;
+        break;
+    case LV_EVENT_RENDER_START:
+        s_rendered = true;
+        break;
+    case LV_EVENT_REFR_READY:
+        if (s_state == STATE_RUN && s_rendered && s_sample_count < PERF_BENCH_FRAMES) {
+            s_samples[s_sample_count++] = (uint32_t)(esp_timer_get_time() - s_refr_start_us);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static const app_t *find_app(const char *id)
+{
+    size_t count = 0;
+    const app_t **apps = app_manager_list(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(apps[i]->id, id) == 0) {
+            return apps[i];
+        }
+    }
+    return NULL;
+}
+
+static int32_t scroll_range(lv_obj_t *obj)
+{
+    return lv_obj_get_scroll_top(obj) + lv_obj_get_scroll_bottom(obj);
+}
+
+// The scrollable object with the most to scroll, depth first
+static lv_obj_t *find_scroll_target(lv_obj_t *obj)
+{
+    lv_obj_t *best = NULL;
+    if (lv_obj_has_flag(obj, LV_OBJ_FLAG_SCROLLABLE) && scroll_range(obj) > 0) {
+        best = obj;
+    }
+    uint32_t count = lv_obj_get_child_count(obj);
+    for (uint32_t i = 0; i < count; i++) {
+        lv_obj_t *found = find_scroll_target(lv_obj_get_child(obj, i));
+        if (found != NULL && (best == NULL || scroll_range(found) > scroll_range(best))) {
+            best = found;
+        }
+    }
+    return best;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(void)
+{
+    perf_bench_result_t *r = &s_results[s_scene];
+    uint32_t n = s_sample_count;
+    uint64_t sum = 0;
+
+    qsort(s_samples, n, sizeof(s_samples[0]), compare_u32);
+    for (uint32_t i = 0; i < n; i++) {
+        sum += s_samples[i];
+    }
+    *r = (perf_bench_result_t){
+        .scene = s_scenes[s_scene].name,
+        .frames = n,
+        .mean_us = (uint32_t)(sum / n),
+        .p50_us = s_samples[n / 2],
+        .p95_us = s_samples[n * 95 / 100],
+        .max_us = s_samples[n - 1],
+    };
+    s_have_result[s_scene] = true;
+
+    printf("Bench: %-10s %4lu frames  mean %6.2f  p50 %6.2f  p95 %6.2f  max %6.2f ms  (%d draw units)\n",
+           r->scene, (unsigned long)r->frames, r->mean_us / 1000.0, r->p50_us / 1000.0, r->p95_us / 1000.0,
+           r->max_us / 1000.0, CONFIG_LV_DRAW_SW_DRAW_UNIT_CNT);
+}
+
+static void start_scene(void)
+{
+    if (s_scene >= SCENE_COUNT) {
+        s_state = STATE_DONE;
+        lv_timer_delete(s_timer);
+        s_timer = NULL;
+        printf("Bench: done\n");
+        return;
+    }
+
+    const app_t *app = find_app(s_scenes[s_scene].app_id);
+    if (app == NULL) {
+        printf("Bench: %s: app %s not registered, skipped\n", s_scenes[s_scene].name, s_scenes[s_scene].app_id);
+        s_scene++;
+        start_scene();
+        return;
+    }
+
+    app->launch();
+    s_state = STATE_SETTLE;
+    lv_timer_set_period(s_timer, SETTLE_MS);
+}
+
+static void end_scene(void)
+{
+    wm_close_top();
+    s_target = NULL;
+    s_scene++;
+    start_scene();
+}
+
+// Runs on the LVGL task: one step per refresh period while timing
+static void bench_timer_cb(lv_timer_t *timer)
+{
+    switch (s_state) {
+    case STATE_IDLE:
+        printf("Bench: %u scenes, %d frames each\n", (unsigned)SCENE_COUNT, PERF_BENCH_FRAMES);
+        start_scene();
+        break;
+
+    case STATE_SETTLE: {
+        wm_window_t *win = wm_top();
+        s_target = win != NULL ? find_scroll_target(wm_get_content(win)) : NULL;
+        if (s_target == NULL) {
+            printf("Bench: %s: nothing to scroll, skipped\n", s_scenes[s_scene].name);
+            end_scene();
+            break;
+        }
+        s_direction = -1;
+        s_sample_count = 0;
+        s_state = STATE_RUN;
+        lv_timer_set_period(timer, LV_DEF_REFR_PERIOD);
+        break;
+    }
+
+    case STATE_RUN:
+        if (s_sample_count >= PERF_BENCH_FRAMES) {
+            report();
+            end_scene();
+            break;
+        }
+        // Down to the end and back up again
+        if (s_direction < 0 && lv_obj_get_scroll_bottom(s_target) <= 0) {
+            s_direction = 1;
+        } else if (s_direction > 0 && lv_obj_get_scroll_top(s_target) <= 0) {
+            s_direction = -1;
+        }
+        lv_obj_scroll_by_bounded(s_target, 0, s_direction * PERF_BENCH_SCROLL_STEP, LV_ANIM_OFF);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void perf_bench_init(lv_display_t *disp)
+{
+    if (disp == NULL || s_disp != NULL) {
+        return;
+    }
+    s_disp = disp;
+
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_RENDER_START, NULL);
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_REFR_READY, NULL);
+    s_timer = lv_timer_create(bench_timer_cb, PERF_BENCH_START_MS, NULL);
+    printf("Bench: starting in %d ms\n", PERF_BENCH_START_MS);
+}
+
+bool perf_bench_get(uint32_t index, perf_bench_result_t *result)
+{
+    if (index >= SCENE_COUNT || !s_have_result[index]) {
+        return false;
+    }
+    *result = s_results[index];
+    return true;
+}
+
+#endif // PERF_BENCH_ENABLE
@@ -0,0 +1,71 @@
+#ifndef PERF_BENCH_H
+#define PERF_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build with PERF_BENCH_ENABLE=1 to time frames on scripted heavy screens after boot
+#ifndef PERF_BENCH_ENABLE
+#define PERF_BENCH_ENABLE 0
+#endif
+
+// Delay after the launcher is up, so the background boot stages are done
+#ifndef PERF_BENCH_START_MS
+#define PERF_BENCH_START_MS 5000
+#endif
+
+// Frames timed per scene
+#ifndef PERF_BENCH_FRAMES
+#define PERF_BENCH_FRAMES 200
+#endif
+
+// Pixels scrolled per frame; large enough that every frame redraws most of the window
+#ifndef PERF_BENCH_SCROLL_STEP
+#define PERF_BENCH_SCROLL_STEP 24
+#endif
+
+/**
+ * @brief Frame times of one scene, in microseconds
+ *
+ * A frame is one refresh cycle that drew something, from the start of the
+ * refresh to the last area flushed.
+ */
+typedef struct {
+    const char *scene;
+    uint32_t frames;
+    uint32_t mean_us;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t max_us;
+} perf_bench_result_t;
+
+/**
+ * @brief Run the benchmark scenes once, a while after boot
+ *
+ * Each scene opens an app the way the launcher does, scrolls its biggest
+ * scrollable view back and forth one step per frame and closes it again:
+ * the Settings menu, and the file manager's list of the SD card root.
+ * Results are printed with the number of draw units, so runs of builds
+ * with a different CONFIG_LV_DRAW_SW_DRAW_UNIT_CNT compare directly.
+ * Call with the display lock held once the UI is up.
+ *
+ * @param disp LVGL display
+ */
+void perf_bench_init(lv_display_t *disp);
+
+/**
+ * @brief Get the result of a finished scene
+ * @return false if the scene hasn't run (yet)
+ */
+bool perf_bench_get(uint32_t index, perf_bench_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_BENCH_H
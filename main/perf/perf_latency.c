@@ -0,0 +1,252 @@
+#include "perf/perf_latency.h"
+#include "hals/hal_display.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+
+// Measurements kept per stage for the distribution
+#ifndef PERF_LATENCY_HISTORY
+#define PERF_LATENCY_HISTORY 128
+#endif
+
+// Print the distribution after this many complete measurements, 0 to never print
+#ifndef PERF_LATENCY_REPORT_EVERY
+#define PERF_LATENCY_REPORT_EVERY 100
+#endif
+
+// An input that changes nothing on screen is dropped after this long
+#ifndef PERF_LATENCY_TIMEOUT_MS
+#define PERF_LATENCY_TIMEOUT_MS 250
+#endif
+
+typedef enum {
+    TRACK_IDLE = 0,
+    TRACK_WAIT_INVALIDATE,
+    TRACK_WAIT_RENDER,
+    TRACK_WAIT_FLUSH,
+    TRACK_DONE,
+} track_state_t;
+
+static const char* s_stage_names[PERF_LAT_STAGE_MAX] = {
+    [PERF_LAT_INPUT] = "input",
+    [PERF_LAT_DISPATCH] = "dispatch",
+    [PERF_LAT_RENDER] = "render",
+    [PERF_LAT_FLUSH] = "flush",
+    [PERF_LAT_TOTAL] = "total",
+};
+
+static bool s_enabled = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// The input currently in flight; state and flush fields are shared with the DPI ISR
+static volatile track_state_t s_state = TRACK_IDLE;
+static int64_t s_t_irq = 0;
+static int64_t s_t_read = 0;
+static int64_t s_t_inval = 0;
+static int64_t s_t_render = 0;
+static volatile int64_t s_t_flush = 0;
+static volatile bool s_last_flush_started = false;
+static volatile bool s_flush_done = false;
+
+// Recent measurements per stage
+static uint32_t s_history[PERF_LAT_STAGE_MAX][PERF_LATENCY_HISTORY];
+static uint32_t s_history_count = 0;
+static uint32_t s_since_report = 0;
+
+static uint32_t us_between(int64_t from, int64_t to)
+{
+    return (to > from) ? (uint32_t)(to - from) : 0;
+}
+
+static void commit(void)
+{
+    uint32_t slot = s_history_count % PERF_LATENCY_HISTORY;
+
+    s_history[PERF_LAT_INPUT][slot] = us_between(s_t_irq, s_t_read);
+    s_history[PERF_LAT_DISPATCH][slot] = us_between(s_t_read, s_t_inval);
+    s_history[PERF_LAT_RENDER][slot] = us_between(s_t_inval, s_t_render);
+    s_history[PERF_LAT_FLUSH][slot] = us_between(s_t_render, s_t_flush);
+    s_history[PERF_LAT_TOTAL][slot] = us_between(s_t_irq, s_t_flush);
+    s_history_count++;
+
+#if PERF_LATENCY_REPORT_EVERY > 0
+    if (++s_since_report >= PERF_LATENCY_REPORT_EVERY) {
+        s_since_report = 0;
+        perf_latency_print();
+    }
+#endif
+}
+
+// Finish or expire the tracked input; LVGL task only
+static void poll_tracked(void)
+{
+    track_state_t state = s_state;
+
+    if (state == TRACK_DONE) {
+        commit();
+        s_state = TRACK_IDLE;
+    } else if (state != TRACK_IDLE &&
+               esp_timer_get_time() - s_t_read > (int64_t)PERF_LATENCY_TIMEOUT_MS * 1000) {
+        taskENTER_CRITICAL(&s_lock);
+        s_state = TRACK_IDLE;
+        taskEXIT_CRITICAL(&s_lock);
+    }
+}
+
+static void IRAM_ATTR flush_done_cb(void* user_ctx)
+{
+    taskENTER_CRITICAL_ISR(&s_lock);
+    if (s_last_flush_started && !s_flush_done &&
+        (s_state == TRACK_WAIT_RENDER || s_state == TRACK_WAIT_FLUSH)) {
+        s_t_flush = esp_timer_get_time();
+        s_flush_done = true;
+        if (s_state == TRACK_WAIT_FLUSH) {
+            s_state = TRACK_DONE;
+        }
+    }
+    taskEXIT_CRITICAL_ISR(&s_lock);
+}
+
+static void display_event_cb(lv_event_t* e)
+{
+    lv_display_t* disp = (lv_display_t*)lv_event_get_current_target(e);
+    int64_t now = esp_timer_get_time();
+
+    switch (lv_event_get_code(e)) {
+        case LV_EVENT_INVALIDATE_AREA:
+            // First redraw request after the input is attributed to it
+            if (s_state == TRACK_WAIT_INVALIDATE) {
+                s_t_inval = now;
+                s_state = TRACK_WAIT_RENDER;
+            }
+            break;
+
+        case LV_EVENT_RENDER_START:
+            if (s_state == TRACK_WAIT_RENDER) {
+                taskENTER_CRITICAL(&s_lock);
+                s_last_flush_started = false;
+                s_flush_done = false;
+                taskEXIT_CRITICAL(&s_lock);
+            }
+            break;
+
+        case LV_EVENT_FLUSH_START:
+            if (s_state == TRACK_WAIT_RENDER && lv_display_flush_is_last(disp)) {
+                s_last_flush_started = true;
+            }
+            break;
+
+        case LV_EVENT_RENDER_READY:
+            if (s_state == TRACK_WAIT_RENDER) {
+                // The last area may already be on the panel
+                taskENTER_CRITICAL(&s_lock);
+                s_t_render = now;
+                s_state = s_flush_done ? TRACK_DONE : TRACK_WAIT_FLUSH;
+                taskEXIT_CRITICAL(&s_lock);
+            }
+            break;
+
+        case LV_EVENT_REFR_READY:
+            poll_tracked();
+            break;
+
+        default:
+            break;
+    }
+}
+
+void perf_latency_init(lv_display_t* disp)
+{
+    if (disp == NULL) {
+        return;
+    }
+
+    esp_err_t ret = hal_display_add_flush_done_cb(flush_done_cb, NULL);
+    if (ret != ESP_OK) {
+        printf("Latency instrumentation unavailable: %s\n", esp_err_to_name(ret));
+        return;
+    }
+
+    lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_ALL, NULL);
+    perf_latency_reset();
+    s_enabled = true;
+    printf("Touch-to-photon latency instrumentation enabled\n");
+}
+
+void perf_latency_input(int64_t sample_us)
+{
+    if (!s_enabled) {
+        return;
+    }
+
+    poll_tracked();
+    if (s_state != TRACK_IDLE) {
+        return;
+    }
+
+    s_t_irq = sample_us;
+    s_t_read = esp_timer_get_time();
+    s_state = TRACK_WAIT_INVALIDATE;
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void perf_latency_get(perf_lat_stage_t stage, perf_lat_dist_t* dist)
+{
+    memset(dist, 0, sizeof(*dist));
+    if (stage >= PERF_LAT_STAGE_MAX) {
+        return;
+    }
+
+    uint32_t n = (s_history_count < PERF_LATENCY_HISTORY) ? s_history_count : PERF_LATENCY_HISTORY;
+    if (n == 0) {
+        return;
+    }
+
+    uint32_t sorted[PERF_LATENCY_HISTORY];
+    uint64_t sum = 0;
+    memcpy(sorted, s_history[stage], n * sizeof(uint32_t));
+    qsort(sorted, n, sizeof(uint32_t), compare_u32);
+    for (uint32_t i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+
+    dist->count = n;
+    dist->min_us = sorted[0];
+    dist->p50_us = sorted[n * 50 / 100];
+    dist->p90_us = sorted[n * 90 / 100];
+    dist->p99_us = sorted[n * 99 / 100];
+    dist->max_us = sorted[n - 1];
+    dist->mean_us = (uint32_t)(sum / n);
+}
+
+void perf_latency_print(void)
+{
+    printf("Touch-to-photon latency (us), last %lu inputs:\n",
+           (unsigned long)((s_history_count < PERF_LATENCY_HISTORY) ? s_history_count : PERF_LATENCY_HISTORY));
+    printf("  %-9s %7s %7s %7s %7s %7s %7s\n", "stage", "min", "p50", "p90", "p99", "max", "mean");
+
+    for (int stage = 0; stage < PERF_LAT_STAGE_MAX; stage++) {
+        perf_lat_dist_t d;
+        perf_latency_get((perf_lat_stage_t)stage, &d);
+        printf("  %-9s %7lu %7lu %7lu %7lu %7lu %7lu\n", s_stage_names[stage],
+               (unsigned long)d.min_us, (unsigned long)d.p50_us, (unsigned long)d.p90_us,
+               (unsigned long)d.p99_us, (unsigned long)d.max_us, (unsigned long)d.mean_us);
+    }
+}
+
+void perf_latency_reset(void)
+{
+    memset(s_history, 0, sizeof(s_history));
+    s_history_count = 0;
+    s_since_report = 0;
+    s_state = TRACK_IDLE;
+}
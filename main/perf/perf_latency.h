@@ -0,0 +1,81 @@
+#ifndef PERF_LATENCY_H
+#define PERF_LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build with PERF_LATENCY_ENABLE=1 to measure touch-to-photon latency
+#ifndef PERF_LATENCY_ENABLE
+#define PERF_LATENCY_ENABLE 0
+#endif
+
+/**
+ * @brief Latency stages, in the order an input travels through them
+ */
+typedef enum {
+    PERF_LAT_INPUT = 0,     // Touch interrupt -> sample read by LVGL
+    PERF_LAT_DISPATCH,      // Sample read -> first area invalidated by the resulting events
+    PERF_LAT_RENDER,        // Invalidation -> rendering of the frame finished
+    PERF_LAT_FLUSH,         // Rendering finished -> DSI transfer of the last area done
+    PERF_LAT_TOTAL,         // Touch interrupt -> DSI transfer done
+    PERF_LAT_STAGE_MAX
+} perf_lat_stage_t;
+
+/**
+ * @brief Latency distribution of one stage, in microseconds
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t mean_us;
+} perf_lat_dist_t;
+
+/**
+ * @brief Hook the display's refresh events and flush completion
+ *
+ * Flush completion comes from hal_display_add_flush_done_cb(), so it is
+ * unavailable when the BSP runs in avoid-tear mode.
+ *
+ * @param disp LVGL display
+ */
+void perf_latency_init(lv_display_t *disp);
+
+/**
+ * @brief Tag an input sample as it is read into LVGL
+ *
+ * Call from the indev read callback. Only one input is tracked at a time;
+ * samples arriving while one is in flight are not tagged.
+ *
+ * @param sample_us Timestamp of the sample at the touch interrupt
+ */
+void perf_latency_input(int64_t sample_us);
+
+/**
+ * @brief Get the distribution of one stage over the recent inputs
+ */
+void perf_latency_get(perf_lat_stage_t stage, perf_lat_dist_t *dist);
+
+/**
+ * @brief Print the distribution of every stage
+ */
+void perf_latency_print(void);
+
+/**
+ * @brief Drop all recorded measurements
+ */
+void perf_latency_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_LATENCY_H
@@ -0,0 +1,296 @@
+#include "perf/perf_profile.h"
+
+#if PERF_PROFILE_ENABLE
+
+#include "hals/hal_sdcard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "riscv/csr.h"
+#include "riscv/rvruntime-frames.h"
+
+#if !CONFIG_IDF_TARGET_ARCH_RISCV
+#error "perf_profile reads the RISC-V interrupt frame"
+#endif
+
+#define PROFILE_TIMER_HZ (1000 * 1000)
+
+// Writes the capture from a task of its own, after the sampled window
+#ifndef PERF_PROFILE_TASK_PRIORITY
+#define PERF_PROFILE_TASK_PRIORITY 1
+#endif
+
+// Each core samples itself: its timer interrupt is allocated on that core
+static gptimer_handle_t s_timers[portNUM_PROCESSORS];
+static perf_profile_sample_t *s_samples[portNUM_PROCESSORS];
+static volatile uint32_t s_count[portNUM_PROCESSORS];
+static volatile uint32_t s_missed[portNUM_PROCESSORS];
+static bool s_running = false;
+static volatile bool s_capturing = false;
+
+typedef struct {
+    int core;
+    SemaphoreHandle_t done;
+    esp_err_t result;
+} timer_setup_t;
+
+typedef struct {
+    char label[16];
+    uint32_t duration_ms;
+} capture_job_t;
+
+static bool IRAM_ATTR sample_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    int core = xPortGetCoreID();
+    uint32_t n = s_count[core];
+    if (n >= PERF_PROFILE_MAX_SAMPLES) {
+        s_missed[core]++;
+        return false;
+    }
+
+    perf_profile_sample_t *sample = &s_samples[core][n];
+    if (xPortInterruptedFromISRContext()) {
+        // Interrupted another handler, which doesn't leave a frame where we can find it
+        sample->pc = RV_READ_CSR(mepc);
+        sample->ra = 0;
+        sample->task = PERF_PROFILE_TASK_ISR;
+    } else {
+        // Interrupt entry saved the task's registers on its stack and the stack pointer
+        // in pxTopOfStack, the first member of the TCB
+        TaskHandle_t task = xTaskGetCurrentTaskHandleForCore(core);
+        const RvExcFrame *frame = *(RvExcFrame *const *)task;
+        sample->pc = frame->mepc;
+        sample->ra = frame->ra;
+        sample->task = (uint32_t)task;
+    }
+    s_count[core] = n + 1;
+    return false;
+}
+
+static void timer_setup_task(void *arg)
+{
+    timer_setup_t *setup = (timer_setup_t *)arg;
+    gptimer_handle_t timer = NULL;
+
+    gptimer_config_t config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = PROFILE_TIMER_HZ,
+    };
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = PROFILE_TIMER_HZ / PERF_PROFILE_HZ,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = sample_cb,
+    };
+
+    // The interrupt goes to the core that registers the callback
+    esp_err_t ret = gptimer_new_timer(&config, &timer);
+    if (ret == ESP_OK) {
+        ret = gptimer_set_alarm_action(timer, &alarm);
+    }
+    if (ret == ESP_OK) {
+        ret = gptimer_register_event_callbacks(timer, &cbs, NULL);
+    }
+    if (ret == ESP_OK) {
+        ret = gptimer_enable(timer);
+    }
+    if (ret != ESP_OK && timer != NULL) {
+        gptimer_del_timer(timer);
+        timer = NULL;
+    }
+
+    s_timers[setup->core] = timer;
+    setup->result = ret;
+    xSemaphoreGive(setup->done);
+    vTaskDelete(NULL);
+}
+
+void perf_profile_init(void)
+{
+    if (s_samples[0] != NULL) {
+        return;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_samples[core] = heap_caps_malloc(PERF_PROFILE_MAX_SAMPLES * sizeof(perf_profile_sample_t),
+                                           MALLOC_CAP_SPIRAM);
+        if (s_samples[core] == NULL) {
+            printf("Profiler: not enough memory for the samples\n");
+            for (int i = 0; i < core; i++) {
+                heap_caps_free(s_samples[i]);
+                s_samples[i] = NULL;
+            }
+            return;
+        }
+    }
+
+    timer_setup_t setup = {.done = xSemaphoreCreateBinary()};
+    if (setup.done == NULL) {
+        return;
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        setup.core = core;
+        setup.result = ESP_FAIL;
+        if (xTaskCreatePinnedToCore(timer_setup_task, "prof_setup", 3072, &setup, PERF_PROFILE_TASK_PRIORITY,
+                                    NULL, core) == pdPASS) {
+            xSemaphoreTake(setup.done, portMAX_DELAY);
+        }
+        if (setup.result != ESP_OK) {
+            printf("Profiler: no sampling timer on core %d: %s\n", core, esp_err_to_name(setup.result));
+        }
+    }
+    vSemaphoreDelete(setup.done);
+    printf("Profiler ready, %d Hz per core\n", PERF_PROFILE_HZ);
+}
+
+void perf_profile_start(void)
+{
+    if (s_running) {
+        return;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_count[core] = 0;
+        s_missed[core] = 0;
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (s_timers[core]) {
+            gptimer_set_raw_count(s_timers[core], 0);
+            gptimer_start(s_timers[core]);
+        }
+    }
+    s_running = true;
+}
+
+void perf_profile_stop(void)
+{
+    if (!s_running) {
+        return;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (s_timers[core]) {
+            gptimer_stop(s_timers[core]);
+        }
+    }
+    s_running = false;
+}
+
+static bool write_tasks(FILE *f, uint32_t *count)
+{
+    UBaseType_t n = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *status = malloc(n * sizeof(*status));
+    if (status == NULL) {
+        *count = 0;
+        return true;
+    }
+
+    n = uxTaskGetSystemState(status, n, NULL);
+    bool ok = true;
+    for (UBaseType_t i = 0; i < n && ok; i++) {
+        perf_profile_task_t task = {.task = (uint32_t)status[i].xHandle};
+        strncpy(task.name, status[i].pcTaskName, sizeof(task.name) - 1);
+        ok = fwrite(&task, sizeof(task), 1, f) == 1;
+    }
+    free(status);
+    *count = n;
+    return ok;
+}
+
+int perf_profile_dump(const char *path)
+{
+    if (s_running || s_samples[0] == NULL) {
+        return -1;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        printf("Profiler: failed to open %s\n", path);
+        return -1;
+    }
+
+    perf_profile_file_header_t header = {
+        .magic = PERF_PROFILE_MAGIC,
+        .version = PERF_PROFILE_VERSION,
+        .core_count = portNUM_PROCESSORS,
+        .sample_hz = PERF_PROFILE_HZ,
+    };
+    uint32_t total = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        header.missed += s_missed[core];
+    }
+
+    // The task count is patched in once the table is written
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && write_tasks(f, &header.task_count);
+    for (int core = 0; core < portNUM_PROCESSORS && ok; core++) {
+        uint32_t count = s_count[core];
+        ok = fwrite(&count, sizeof(count), 1, f) == 1 &&
+             fwrite(s_samples[core], sizeof(perf_profile_sample_t), count, f) == count;
+        total += count;
+    }
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) {
+        printf("Profiler: %lu samples (%lu missed) written to %s\n", (unsigned long)total,
+               (unsigned long)header.missed, path);
+    } else {
+        printf("Profiler: failed to write %s\n", path);
+    }
+    return ok ? 0 : -1;
+}
+
+static void capture_task(void *arg)
+{
+    capture_job_t *job = (capture_job_t *)arg;
+
+    vTaskDelay(pdMS_TO_TICKS(job->duration_ms));
+    perf_profile_stop();
+
+    if (hal_sdcard_is_mounted()) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/prof_%s.bin", hal_sdcard_get_mount_point(), job->label);
+        perf_profile_dump(path);
+    } else {
+        printf("Profiler: no SD card, capture not written\n");
+    }
+
+    free(job);
+    s_capturing = false;
+    vTaskDelete(NULL);
+}
+
+void perf_profile_capture(const char *label, uint32_t duration_ms)
+{
+    if (s_capturing || s_running || s_samples[0] == NULL) {
+        return;
+    }
+
+    capture_job_t *job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return;
+    }
+    strncpy(job->label, label, sizeof(job->label) - 1);
+    job->duration_ms = duration_ms;
+
+    s_capturing = true;
+    perf_profile_start();
+    if (xTaskCreate(capture_task, "prof_capture", 4096, job, PERF_PROFILE_TASK_PRIORITY, NULL) != pdPASS) {
+        perf_profile_stop();
+        free(job);
+        s_capturing = false;
+    }
+}
+
+#endif // PERF_PROFILE_ENABLE
@@ -0,0 +1,112 @@
+#ifndef PERF_PROFILE_H
+#define PERF_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build with PERF_PROFILE_ENABLE=1 for the sampling profiler
+#ifndef PERF_PROFILE_ENABLE
+#define PERF_PROFILE_ENABLE 0
+#endif
+
+// Samples per second on each core; prime, so it never runs in step with the tick or LVGL's timers
+#ifndef PERF_PROFILE_HZ
+#define PERF_PROFILE_HZ 997
+#endif
+
+// Samples kept per core in PSRAM, sampling stops when they are used up
+#ifndef PERF_PROFILE_MAX_SAMPLES
+#define PERF_PROFILE_MAX_SAMPLES 32768
+#endif
+
+// Profile this app (by app id, e.g. "settings") each time it is launched, "" for none
+#ifndef PERF_PROFILE_APP
+#define PERF_PROFILE_APP ""
+#endif
+
+// How long a launch is profiled for
+#ifndef PERF_PROFILE_WINDOW_MS
+#define PERF_PROFILE_WINDOW_MS 3000
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                 Dump file format, shared with tools/profile_fold.c         */
+/* -------------------------------------------------------------------------- */
+
+#define PERF_PROFILE_MAGIC    0x464F5250  // "PROF"
+#define PERF_PROFILE_VERSION  1
+
+// Task recorded for samples that interrupted another interrupt handler
+#define PERF_PROFILE_TASK_ISR 0
+
+typedef struct {
+    uint32_t pc;            // Interrupted instruction
+    uint32_t ra;            // Return address at that point, 0 if unknown
+    uint32_t task;          // Interrupted task, PERF_PROFILE_TASK_ISR for nested interrupts
+} perf_profile_sample_t;
+
+/*
+ * File layout, little endian:
+ *   perf_profile_file_header_t
+ *   task_count x perf_profile_task_t
+ *   core_count x { uint32_t count; perf_profile_sample_t samples[count]; }
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t core_count;
+    uint32_t sample_hz;
+    uint32_t task_count;
+    uint32_t missed;        // Samples not taken because the buffer was full
+} perf_profile_file_header_t;
+
+typedef struct {
+    uint32_t task;
+    char name[16];
+} perf_profile_task_t;
+
+#if PERF_PROFILE_ENABLE
+
+/**
+ * @brief Set up a sampling timer on each core, stopped
+ */
+void perf_profile_init(void);
+
+/**
+ * @brief Throw away earlier samples and start sampling
+ */
+void perf_profile_start(void);
+
+/**
+ * @brief Stop sampling, the samples are kept for perf_profile_dump()
+ */
+void perf_profile_stop(void);
+
+/**
+ * @brief Write the samples of the last run to a file
+ *
+ * @return 0 on success, -1 if the file could not be written
+ */
+int perf_profile_dump(const char *path);
+
+/**
+ * @brief Profile the next duration_ms and write it to the SD card
+ *
+ * Returns at once; the samples go to <mount point>/prof_<label>.bin from a
+ * low priority task. Ignored while a capture is running.
+ *
+ * @param label Short name for the file, e.g. the app id
+ */
+void perf_profile_capture(const char *label, uint32_t duration_ms);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_PROFILE_H
@@ -0,0 +1,268 @@
+#include "perf/perf_trace.h"
+
+#if PERF_TRACE_ENABLE
+
+#include "hals/hal_display.h"
+#include "hals/hal_sdcard.h"
+#include "managers/ui_dispatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+#define TRACE_RING_MASK (PERF_TRACE_RING_SIZE - 1)
+
+#if (PERF_TRACE_RING_SIZE & TRACE_RING_MASK) != 0
+#error "PERF_TRACE_RING_SIZE must be a power of two"
+#endif
+
+// Writes the trace from a task of its own, file I/O has no place on the recording tasks
+#ifndef PERF_TRACE_DUMP_TASK_PRIORITY
+#define PERF_TRACE_DUMP_TASK_PRIORITY 1
+#endif
+
+volatile bool g_perf_trace_on = false;
+
+// One ring per core, so the cores never contend for a slot.
+// A task and an interrupt on the same core still can, hence the atomic claim.
+static perf_trace_event_t *s_events[portNUM_PROCESSORS];
+static uint32_t s_head[portNUM_PROCESSORS];
+
+// Name 0 stands for a name that didn't fit in the table
+static const char *s_names[PERF_TRACE_MAX_NAMES] = {"?"};
+static uint16_t s_name_count = 1;
+static portMUX_TYPE s_names_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint16_t perf_trace_intern(const char *name)
+{
+    uint16_t id = 0;
+
+    // The first event of a trace point may come from an interrupt
+    portENTER_CRITICAL_SAFE(&s_names_lock);
+    for (uint16_t i = 1; i < s_name_count; i++) {
+        if (s_names[i] == name || strcmp(s_names[i], name) == 0) {
+            id = i;
+            break;
+        }
+    }
+    if (id == 0 && s_name_count < PERF_TRACE_MAX_NAMES) {
+        id = s_name_count++;
+        s_names[id] = name;
+    }
+    portEXIT_CRITICAL_SAFE(&s_names_lock);
+    return id;
+}
+
+void IRAM_ATTR perf_trace_record(perf_trace_ev_type_t type, uint16_t name, int32_t value)
+{
+    uint32_t core = xPortGetCoreID();
+    uint32_t index = __atomic_fetch_add(&s_head[core], 1, __ATOMIC_RELAXED);
+    perf_trace_event_t *ev = &s_events[core][index & TRACE_RING_MASK];
+
+    ev->timestamp_us = esp_timer_get_time();
+    ev->task = xPortInIsrContext() ? PERF_TRACE_TASK_ISR : (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+    ev->value = value;
+    ev->name = name;
+    ev->type = type;
+    ev->core = core;
+    ev->reserved = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Display refresh                               */
+/* -------------------------------------------------------------------------- */
+
+// Runs in the DPI interrupt, when the panel has taken the last area
+static void IRAM_ATTR flush_done_cb(void *user_ctx)
+{
+    PERF_TRACE_INSTANT("dsi_done", 0);
+}
+
+static void display_event_cb(lv_event_t *e)
+{
+    switch (lv_event_get_code(e)) {
+        case LV_EVENT_REFR_START:
+            PERF_TRACE_COUNTER("ui_pending", ui_dispatch_pending());
+            PERF_TRACE_BEGIN("refresh");
+            break;
+        case LV_EVENT_REFR_READY:
+            PERF_TRACE_END("refresh");
+            break;
+        case LV_EVENT_RENDER_START:
+            PERF_TRACE_BEGIN("render");
+            break;
+        case LV_EVENT_RENDER_READY:
+            PERF_TRACE_END("render");
+            break;
+        case LV_EVENT_FLUSH_START:
+            PERF_TRACE_BEGIN("flush");
+            break;
+        case LV_EVENT_FLUSH_FINISH:
+            PERF_TRACE_END("flush");
+            break;
+        case LV_EVENT_FLUSH_WAIT_START:
+            PERF_TRACE_BEGIN("flush_wait");
+            break;
+        case LV_EVENT_FLUSH_WAIT_FINISH:
+            PERF_TRACE_END("flush_wait");
+            break;
+        default:
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Dump                                    */
+/* -------------------------------------------------------------------------- */
+
+static bool write_tasks(FILE *f, uint32_t *count)
+{
+    UBaseType_t n = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *status = malloc(n * sizeof(*status));
+    if (status == NULL) {
+        *count = 0;
+        return true;
+    }
+
+    // Only tasks alive now get a name, events of tasks gone since show up by handle
+    n = uxTaskGetSystemState(status, n, NULL);
+    bool ok = true;
+    for (UBaseType_t i = 0; i < n && ok; i++) {
+        perf_trace_task_t task = {.task = (uint32_t)(uintptr_t)status[i].xHandle};
+        strncpy(task.name, status[i].pcTaskName, sizeof(task.name) - 1);
+        ok = fwrite(&task, sizeof(task), 1, f) == 1;
+    }
+    free(status);
+    *count = n;
+    return ok;
+}
+
+int perf_trace_dump(const char *path)
+{
+    bool was_on = g_perf_trace_on;
+    g_perf_trace_on = false;
+    // Let events being written on either core land
+    vTaskDelay(pdMS_TO_TICKS(2));
+
+    int64_t start = esp_timer_get_time();
+    uint32_t heads[portNUM_PROCESSORS];
+    uint32_t total = 0;
+    perf_trace_file_header_t header = {
+        .magic = PERF_TRACE_MAGIC,
+        .version = PERF_TRACE_VERSION,
+        .event_size = sizeof(perf_trace_event_t),
+        .core_count = portNUM_PROCESSORS,
+    };
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        heads[core] = __atomic_load_n(&s_head[core], __ATOMIC_ACQUIRE);
+        if (heads[core] > PERF_TRACE_RING_SIZE) {
+            header.dropped += heads[core] - PERF_TRACE_RING_SIZE;
+        }
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        printf("Trace: failed to open %s\n", path);
+        g_perf_trace_on = was_on;
+        return -1;
+    }
+
+    taskENTER_CRITICAL(&s_names_lock);
+    header.name_count = s_name_count;
+    taskEXIT_CRITICAL(&s_names_lock);
+
+    // The task count is patched in once the table is written
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (uint16_t i = 0; i < header.name_count && ok; i++) {
+        size_t len = strlen(s_names[i]);
+        uint8_t len8 = len > 255 ? 255 : len;
+        ok = fwrite(&len8, 1, 1, f) == 1 && fwrite(s_names[i], 1, len8, f) == len8;
+    }
+    ok = ok && write_tasks(f, &header.task_count);
+
+    for (int core = 0; core < portNUM_PROCESSORS && ok; core++) {
+        uint32_t head = heads[core];
+        uint32_t count = head < PERF_TRACE_RING_SIZE ? head : PERF_TRACE_RING_SIZE;
+        uint32_t first = (head - count) & TRACE_RING_MASK;
+        uint32_t tail_count = count < PERF_TRACE_RING_SIZE - first ? count : PERF_TRACE_RING_SIZE - first;
+
+        // Oldest first: from the oldest slot to the end of the ring, then the wrapped part
+        ok = fwrite(&count, sizeof(count), 1, f) == 1 &&
+             fwrite(&s_events[core][first], sizeof(perf_trace_event_t), tail_count, f) == tail_count &&
+             fwrite(&s_events[core][0], sizeof(perf_trace_event_t), count - tail_count, f) == count - tail_count;
+        total += count;
+    }
+
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) {
+        printf("Trace: %lu events (%lu dropped) written to %s in %lld ms\n", (unsigned long)total,
+               (unsigned long)header.dropped, path, (esp_timer_get_time() - start) / 1000);
+    } else {
+        printf("Trace: failed to write %s\n", path);
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        __atomic_store_n(&s_head[core], 0, __ATOMIC_RELEASE);
+    }
+    g_perf_trace_on = was_on;
+    return ok ? 0 : -1;
+}
+
+#if PERF_TRACE_DUMP_AFTER_MS > 0
+static void dump_task(void *arg)
+{
+    vTaskDelay(pdMS_TO_TICKS(PERF_TRACE_DUMP_AFTER_MS));
+    if (hal_sdcard_is_mounted()) {
+        perf_trace_dump(PERF_TRACE_DUMP_PATH);
+    } else {
+        printf("Trace: no SD card, trace not written\n");
+    }
+    vTaskDelete(NULL);
+}
+#endif
+
+void perf_trace_set_enabled(bool enabled)
+{
+    g_perf_trace_on = enabled && s_events[0] != NULL;
+}
+
+void perf_trace_init(lv_display_t *disp)
+{
+    if (s_events[0] != NULL) {
+        return;
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_events[core] = heap_caps_calloc(PERF_TRACE_RING_SIZE, sizeof(perf_trace_event_t), MALLOC_CAP_SPIRAM);
+        if (s_events[core] == NULL) {
+            printf("Trace: not enough memory for the rings\n");
+            for (int i = 0; i < core; i++) {
+                heap_caps_free(s_events[i]);
+                s_events[i] = NULL;
+            }
+            return;
+        }
+    }
+
+    if (disp != NULL) {
+        lv_display_add_event_cb(disp, display_event_cb, LV_EVENT_ALL, NULL);
+        if (hal_display_add_flush_done_cb(flush_done_cb, NULL) != ESP_OK) {
+            printf("Trace: DSI completion not traced\n");
+        }
+    }
+
+#if PERF_TRACE_DUMP_AFTER_MS > 0
+    xTaskCreate(dump_task, "trace_dump", 4096, NULL, PERF_TRACE_DUMP_TASK_PRIORITY, NULL);
+#endif
+
+    g_perf_trace_on = true;
+    printf("Trace: recording, %d events per core\n", PERF_TRACE_RING_SIZE);
+}
+
+#endif // PERF_TRACE_ENABLE
@@ -0,0 +1,154 @@
+#ifndef PERF_TRACE_H
+#define PERF_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Build with PERF_TRACE_ENABLE=1 to compile the trace points in
+#ifndef PERF_TRACE_ENABLE
+#define PERF_TRACE_ENABLE 0
+#endif
+
+#if PERF_TRACE_ENABLE
+#include "lvgl.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Events kept per core in PSRAM, oldest ones are overwritten (power of two)
+#ifndef PERF_TRACE_RING_SIZE
+#define PERF_TRACE_RING_SIZE 8192
+#endif
+
+// Distinct event names
+#ifndef PERF_TRACE_MAX_NAMES
+#define PERF_TRACE_MAX_NAMES 128
+#endif
+
+// Where the trace is written PERF_TRACE_DUMP_AFTER_MS after start (0: never)
+#ifndef PERF_TRACE_DUMP_PATH
+#define PERF_TRACE_DUMP_PATH "/sdcard/trace.bin"
+#endif
+#ifndef PERF_TRACE_DUMP_AFTER_MS
+#define PERF_TRACE_DUMP_AFTER_MS 20000
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                 Dump file format, shared with tools/trace_to_chrome.c      */
+/* -------------------------------------------------------------------------- */
+
+#define PERF_TRACE_MAGIC    0x43525450  // "PTRC"
+#define PERF_TRACE_VERSION  1
+
+typedef enum {
+    PERF_TRACE_EV_BEGIN = 0,    // Span start on the recording task
+    PERF_TRACE_EV_END,          // End of the innermost span of that name on the task
+    PERF_TRACE_EV_INSTANT,
+    PERF_TRACE_EV_COUNTER,      // value is the new counter value
+} perf_trace_ev_type_t;
+
+// Task ID recorded for events from interrupt handlers
+#define PERF_TRACE_TASK_ISR 0
+
+/**
+ * @brief One recorded event, 24 bytes
+ */
+typedef struct {
+    uint64_t timestamp_us;
+    uint32_t task;          // Task handle, PERF_TRACE_TASK_ISR in interrupts
+    int32_t value;          // Counter value, or an argument shown with the event
+    uint16_t name;          // Interned name, index into the file's name table
+    uint8_t type;           // perf_trace_ev_type_t
+    uint8_t core;
+    uint32_t reserved;
+} perf_trace_event_t;
+
+/*
+ * File layout, little endian:
+ *   perf_trace_file_header_t
+ *   name_count x { uint8_t len; char name[len]; }
+ *   task_count x perf_trace_task_t
+ *   core_count x { uint32_t count; perf_trace_event_t events[count]; }  oldest first
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;
+    uint16_t core_count;
+    uint16_t name_count;
+    uint32_t task_count;
+    uint32_t dropped;       // Events overwritten before the dump
+} perf_trace_file_header_t;
+
+typedef struct {
+    uint32_t task;
+    char name[16];
+} perf_trace_task_t;
+
+/* -------------------------------------------------------------------------- */
+/*                                  Recording                                 */
+/* -------------------------------------------------------------------------- */
+
+#if PERF_TRACE_ENABLE
+
+extern volatile bool g_perf_trace_on;
+
+uint16_t perf_trace_intern(const char *name);
+void perf_trace_record(perf_trace_ev_type_t type, uint16_t name, int32_t value);
+
+// Each trace point interns its name once; when tracing is off it costs one branch
+#define PERF_TRACE_EVENT_(type, name, value) do {                       \
+        if (g_perf_trace_on) {                                          \
+            static uint16_t s_trace_name_;                              \
+            if (s_trace_name_ == 0) {                                   \
+                s_trace_name_ = perf_trace_intern(name);                \
+            }                                                           \
+            perf_trace_record((type), s_trace_name_, (value));          \
+        }                                                               \
+    } while (0)
+
+/**
+ * @brief Allocate the rings, hook the display's refresh events and start recording
+ *
+ * With PERF_TRACE_DUMP_AFTER_MS set, the trace is written to PERF_TRACE_DUMP_PATH
+ * that long after the call.
+ *
+ * @param disp LVGL display whose refresh and flush are traced, may be NULL
+ */
+void perf_trace_init(lv_display_t *disp);
+
+/**
+ * @brief Pause or resume recording
+ */
+void perf_trace_set_enabled(bool enabled);
+
+/**
+ * @brief Write everything recorded so far to a file, then start over
+ *
+ * Recording is paused while the file is written. Does file I/O, so call it
+ * from a task that may block for a while.
+ *
+ * @return 0 on success, -1 if the file could not be written
+ */
+int perf_trace_dump(const char *path);
+
+#else
+
+#define PERF_TRACE_EVENT_(type, name, value) do { } while (0)
+
+#endif
+
+// Names must be string literals (or otherwise live forever)
+#define PERF_TRACE_BEGIN(name)              PERF_TRACE_EVENT_(PERF_TRACE_EV_BEGIN, name, 0)
+#define PERF_TRACE_BEGIN_ARG(name, arg)     PERF_TRACE_EVENT_(PERF_TRACE_EV_BEGIN, name, arg)
+#define PERF_TRACE_END(name)                PERF_TRACE_EVENT_(PERF_TRACE_EV_END, name, 0)
+#define PERF_TRACE_INSTANT(name, arg)       PERF_TRACE_EVENT_(PERF_TRACE_EV_INSTANT, name, arg)
+#define PERF_TRACE_COUNTER(name, value)     PERF_TRACE_EVENT_(PERF_TRACE_EV_COUNTER, name, value)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_TRACE_H
@@ -0,0 +1,378 @@
+#include "perf/perf_watchdog.h"
+
+#if PERF_WATCHDOG_ENABLE
+
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_memory_utils.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "riscv/rvruntime-frames.h"
+#include "managers/refresh_governor.h"
+#include "hals/hal_lvgl_os.h"
+#include <bsp/esp-bsp.h>
+
+#if !CONFIG_IDF_TARGET_ARCH_RISCV
+#error "perf_watchdog reads the RISC-V context of the LVGL task"
+#endif
+
+// How often the monitor looks at the refresh heartbeat
+#ifndef PERF_WATCHDOG_POLL_MS
+#define PERF_WATCHDOG_POLL_MS 50
+#endif
+
+// Above the LVGL task, so a busy LVGL task on the same core can't hold the monitor off
+#ifndef PERF_WATCHDOG_TASK_PRIORITY
+#define PERF_WATCHDOG_TASK_PRIORITY 6
+#endif
+
+// Words of a task's stack searched for return addresses
+#define STACK_SCAN_WORDS 512
+
+// How long the LVGL task may take to be switched out once suspended
+#define SUSPEND_WAIT_US 2000
+
+#define NVS_NAMESPACE "perf_wdt"
+#define NVS_KEY_NEXT "next"
+
+typedef struct {
+    const char *what;
+    const void *fn;
+} activity_t;
+
+static bool s_started = false;
+static TaskHandle_t volatile s_lvgl_task = NULL;
+static volatile int64_t s_last_refresh_us = 0;
+
+// Written by the LVGL task only; the monitor reads it while the LVGL task is stalled
+static activity_t s_activity[PERF_WATCHDOG_ACTIVITY_DEPTH];
+static volatile uint32_t s_activity_depth = 0;
+
+static nvs_handle_t s_nvs = 0;
+static uint32_t s_next_seq = 0;
+
+static configRUN_TIME_COUNTER_TYPE s_idle_prev[portNUM_PROCESSORS];
+static int64_t s_load_prev_us = 0;
+
+static void refresh_event_cb(lv_event_t *e)
+{
+    s_last_refresh_us = esp_timer_get_time();
+    // Refresh runs on the LVGL task, which is the one to watch
+    if (s_lvgl_task == NULL) {
+        s_lvgl_task = xTaskGetCurrentTaskHandle();
+    }
+}
+
+void perf_watchdog_enter(const char *what, const void *fn)
+{
+    uint32_t depth = s_activity_depth;
+    if (depth < PERF_WATCHDOG_ACTIVITY_DEPTH) {
+        s_activity[depth].what = what;
+        s_activity[depth].fn = fn;
+    }
+    s_activity_depth = depth + 1;
+}
+
+void perf_watchdog_leave(void)
+{
+    if (s_activity_depth > 0) {
+        s_activity_depth--;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Capture                                   */
+/* -------------------------------------------------------------------------- */
+
+// Busy share of each core since the previous call, from the idle tasks' run time
+static void sample_load(int64_t now, uint8_t load[portNUM_PROCESSORS])
+{
+    int64_t window_us = now - s_load_prev_us;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        configRUN_TIME_COUNTER_TYPE idle = ulTaskGetRunTimeCounter(xTaskGetIdleTaskHandleForCore(core));
+        configRUN_TIME_COUNTER_TYPE idle_us = idle - s_idle_prev[core];
+        s_idle_prev[core] = idle;
+
+        load[core] = 0;
+        if (window_us > 0 && idle_us < window_us) {
+            load[core] = (uint8_t)(100 - idle_us * 100 / window_us);
+        }
+    }
+    s_load_prev_us = now;
+}
+
+static bool task_is_running(TaskHandle_t task)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (xTaskGetCurrentTaskHandleForCore(core) == task) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stop a task for a moment and read its registers and stack; pc stays 0 if
+// it didn't get switched out in time
+static void capture_task(TaskHandle_t task, uint32_t *pc, uint32_t *ra, uint32_t *stack, int depth)
+{
+    vTaskSuspend(task);
+    int64_t deadline = esp_timer_get_time() + SUSPEND_WAIT_US;
+    while (task_is_running(task) && esp_timer_get_time() < deadline) {
+    }
+
+    if (!task_is_running(task)) {
+        // Switched out through an interrupt, which left its registers on its stack and
+        // the stack pointer in pxTopOfStack, the first member of the TCB
+        const RvExcFrame *frame = *(RvExcFrame *const *)task;
+        *pc = frame->mepc;
+        *ra = frame->ra;
+
+        // No frame pointers, so words pointing into code are the best guess at the callers
+        const uint32_t *sp = (const uint32_t *)frame->sp;
+        int found = 0;
+        for (int i = 0; i < STACK_SCAN_WORDS && found < depth; i++) {
+            if (!esp_ptr_internal(&sp[i])) {
+                break;
+            }
+            if (esp_ptr_executable((const void *)sp[i])) {
+                stack[found++] = sp[i];
+            }
+        }
+    }
+    vTaskResume(task);
+}
+
+static void capture_stack(perf_watchdog_incident_t *incident)
+{
+    TaskHandle_t task = s_lvgl_task;
+    capture_task(task, &incident->pc, &incident->ra, incident->stack, PERF_WATCHDOG_STACK_DEPTH);
+    incident->stack_free = uxTaskGetStackHighWaterMark(task) * sizeof(StackType_t);
+
+    // During a render the LVGL task sits in lv_thread_sync_wait(), the draw units do the work
+    TaskHandle_t draw[PERF_WATCHDOG_DRAW_UNITS];
+    size_t count = hal_lvgl_os_get_threads(draw, PERF_WATCHDOG_DRAW_UNITS);
+    for (size_t i = 0; i < count; i++) {
+        perf_watchdog_thread_t *thread = &incident->draw[i];
+        capture_task(draw[i], &thread->pc, &thread->ra, thread->stack, PERF_WATCHDOG_DRAW_STACK_DEPTH);
+    }
+    incident->draw_count = count;
+}
+
+static void capture(perf_watchdog_incident_t *incident, int64_t since_us, int64_t now, const uint8_t *load)
+{
+    memset(incident, 0, sizeof(*incident));
+    incident->seq = s_next_seq++;
+    incident->boot_ms = since_us / 1000;
+    incident->stall_ms = (now - since_us) / 1000;
+    incident->load[0] = load[0];
+    incident->load[1] = portNUM_PROCESSORS > 1 ? load[portNUM_PROCESSORS - 1] : 0;
+
+    uint32_t depth = s_activity_depth;
+    uint32_t count = depth < PERF_WATCHDOG_ACTIVITY_DEPTH ? depth : PERF_WATCHDOG_ACTIVITY_DEPTH;
+    for (uint32_t i = 0; i < count; i++) {
+        const char *what = s_activity[i].what;
+        strncpy(incident->activity[i], what ? what : "?", sizeof(incident->activity[i]) - 1);
+    }
+    incident->activity_count = count;
+    incident->activity_fn = count ? (uint32_t)s_activity[count - 1].fn : 0;
+
+    capture_stack(incident);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                NVS ring                                    */
+/* -------------------------------------------------------------------------- */
+
+static void incident_key(uint32_t seq, char key[8])
+{
+    snprintf(key, 8, "inc%lu", (unsigned long)(seq % PERF_WATCHDOG_INCIDENTS));
+}
+
+static void save(const perf_watchdog_incident_t *incident)
+{
+    if (s_nvs == 0) {
+        return;
+    }
+
+    char key[8];
+    incident_key(incident->seq, key);
+    esp_err_t ret = nvs_set_blob(s_nvs, key, incident, sizeof(*incident));
+    if (ret == ESP_OK) {
+        ret = nvs_set_u32(s_nvs, NVS_KEY_NEXT, incident->seq + 1);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(s_nvs);
+    }
+    if (ret != ESP_OK) {
+        printf("Watchdog: failed to save incident: %s\n", esp_err_to_name(ret));
+    }
+}
+
+size_t perf_watchdog_get_incidents(perf_watchdog_incident_t *incidents, size_t max)
+{
+    if (s_nvs == 0) {
+        return 0;
+    }
+
+    uint32_t next = 0;
+    nvs_get_u32(s_nvs, NVS_KEY_NEXT, &next);
+    uint32_t first = next > PERF_WATCHDOG_INCIDENTS ? next - PERF_WATCHDOG_INCIDENTS : 0;
+
+    size_t count = 0;
+    for (uint32_t seq = first; seq < next && count < max; seq++) {
+        char key[8];
+        size_t len = sizeof(perf_watchdog_incident_t);
+        incident_key(seq, key);
+        if (nvs_get_blob(s_nvs, key, &incidents[count], &len) == ESP_OK &&
+            len == sizeof(perf_watchdog_incident_t) && incidents[count].seq == seq) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void print_incident(const perf_watchdog_incident_t *incident)
+{
+    printf("UI stall #%lu at %lu ms: %lu ms%s, load %u%%/%u%%, in ",
+           (unsigned long)incident->seq, (unsigned long)incident->boot_ms, (unsigned long)incident->stall_ms,
+           incident->recovered ? "" : " and counting", incident->load[0], incident->load[1]);
+    if (incident->activity_count == 0) {
+        printf("LVGL");
+    }
+    for (int i = 0; i < incident->activity_count; i++) {
+        printf("%s%s", i ? " > " : "", incident->activity[i]);
+    }
+    if (incident->activity_fn) {
+        printf(" (0x%08lx)", (unsigned long)incident->activity_fn);
+    }
+    printf("\n  pc 0x%08lx ra 0x%08lx stack", (unsigned long)incident->pc, (unsigned long)incident->ra);
+    for (int i = 0; i < PERF_WATCHDOG_STACK_DEPTH && incident->stack[i]; i++) {
+        printf(" 0x%08lx", (unsigned long)incident->stack[i]);
+    }
+    printf(", %lu bytes of stack never used\n", (unsigned long)incident->stack_free);
+
+    for (int i = 0; i < incident->draw_count && i < PERF_WATCHDOG_DRAW_UNITS; i++) {
+        const perf_watchdog_thread_t *thread = &incident->draw[i];
+        printf("  draw unit %d: pc 0x%08lx ra 0x%08lx stack", i, (unsigned long)thread->pc, (unsigned long)thread->ra);
+        for (int j = 0; j < PERF_WATCHDOG_DRAW_STACK_DEPTH && thread->stack[j]; j++) {
+            printf(" 0x%08lx", (unsigned long)thread->stack[j]);
+        }
+        printf("\n");
+    }
+}
+
+void perf_watchdog_print_incidents(void)
+{
+    static perf_watchdog_incident_t incidents[PERF_WATCHDOG_INCIDENTS];
+    size_t count = perf_watchdog_get_incidents(incidents, PERF_WATCHDOG_INCIDENTS);
+
+    printf("UI stalls kept: %u\n", (unsigned)count);
+    for (size_t i = 0; i < count; i++) {
+        print_incident(&incidents[i]);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Monitor                                   */
+/* -------------------------------------------------------------------------- */
+
+// Idle means no refresh is due, not that the LVGL task is fine: a timer or
+// event running long while idle holds the display lock, and the mode only
+// leaves idle once the governor gets that lock. So idle only counts as a
+// heartbeat while the LVGL task is asleep between two lv_timer_handler() runs.
+static bool lvgl_task_asleep(void)
+{
+    if (refresh_governor_get_mode() != REFRESH_MODE_IDLE || eTaskGetState(s_lvgl_task) != eBlocked) {
+        return false;
+    }
+    // 0 would wait forever
+    if (!bsp_display_lock(1)) {
+        return false;
+    }
+    bsp_display_unlock();
+    return true;
+}
+
+static void watchdog_task(void *arg)
+{
+    static perf_watchdog_incident_t incident;
+    bool stalled = false;
+    int64_t stall_start = 0;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(PERF_WATCHDOG_POLL_MS));
+
+        int64_t now = esp_timer_get_time();
+        if (!stalled && s_lvgl_task != NULL && lvgl_task_asleep()) {
+            // No refresh is due; the heartbeat resumes on wakeup
+            s_last_refresh_us = now;
+        }
+        int64_t last = s_last_refresh_us;
+        uint8_t load[portNUM_PROCESSORS];
+        sample_load(now, load);
+
+        if (!stalled && s_lvgl_task != NULL && now - last >= (int64_t)PERF_WATCHDOG_THRESHOLD_MS * 1000) {
+            // Saved right away, in case the UI never comes back
+            stalled = true;
+            stall_start = last;
+            capture(&incident, last, now, load);
+            print_incident(&incident);
+            save(&incident);
+        } else if (stalled && last != stall_start) {
+            incident.stall_ms = (last - stall_start) / 1000;
+            incident.recovered = true;
+            printf("UI stall #%lu over after %lu ms\n", (unsigned long)incident.seq,
+                   (unsigned long)incident.stall_ms);
+            save(&incident);
+            stalled = false;
+        }
+    }
+}
+
+static void open_nvs(void)
+{
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase();
+        ret = nvs_flash_init();
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &s_nvs);
+    }
+    if (ret != ESP_OK) {
+        printf("Watchdog: incidents won't be kept: %s\n", esp_err_to_name(ret));
+        s_nvs = 0;
+        return;
+    }
+    nvs_get_u32(s_nvs, NVS_KEY_NEXT, &s_next_seq);
+}
+
+void perf_watchdog_init(lv_display_t *disp)
+{
+    if (disp == NULL || s_started) {
+        return;
+    }
+    s_started = true;
+
+    open_nvs();
+    if (s_next_seq > 0) {
+        perf_watchdog_print_incidents();
+    }
+
+    uint8_t load[portNUM_PROCESSORS];
+    s_last_refresh_us = esp_timer_get_time();
+    sample_load(s_last_refresh_us, load);
+    lv_display_add_event_cb(disp, refresh_event_cb, LV_EVENT_REFR_START, NULL);
+
+    if (xTaskCreate(watchdog_task, "ui_watchdog", 3072, NULL, PERF_WATCHDOG_TASK_PRIORITY, NULL) != pdPASS) {
+        printf("Failed to create UI watchdog task\n");
+        return;
+    }
+    printf("UI watchdog: stalls over %d ms are recorded\n", PERF_WATCHDOG_THRESHOLD_MS);
+}
+
+#endif // PERF_WATCHDOG_ENABLE
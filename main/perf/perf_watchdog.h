@@ -0,0 +1,115 @@
+#ifndef PERF_WATCHDOG_H
+#define PERF_WATCHDOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "lvgl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build with PERF_WATCHDOG_ENABLE=1 to catch long frames; the monitor task
+// suspends the LVGL task and draw units during a stall and writes NVS
+#ifndef PERF_WATCHDOG_ENABLE
+#define PERF_WATCHDOG_ENABLE 0
+#endif
+
+// A gap this long between two LVGL refresh cycles is an incident
+#ifndef PERF_WATCHDOG_THRESHOLD_MS
+#define PERF_WATCHDOG_THRESHOLD_MS 500
+#endif
+
+// Incidents kept in NVS, the oldest is overwritten
+#ifndef PERF_WATCHDOG_INCIDENTS
+#define PERF_WATCHDOG_INCIDENTS 8
+#endif
+
+#define PERF_WATCHDOG_ACTIVITY_DEPTH 3      // Nested activities recorded per incident
+#define PERF_WATCHDOG_STACK_DEPTH 12        // Code addresses found on the LVGL task's stack
+#define PERF_WATCHDOG_DRAW_UNITS 2          // Draw unit threads captured along with the LVGL task
+#define PERF_WATCHDOG_DRAW_STACK_DEPTH 4    // Code addresses found on each draw unit's stack
+
+/**
+ * @brief Where a draw unit thread was when the stall was caught
+ */
+typedef struct {
+    uint32_t pc;                    // 0 if it couldn't be stopped in time
+    uint32_t ra;
+    uint32_t stack[PERF_WATCHDOG_DRAW_STACK_DEPTH];
+} perf_watchdog_thread_t;
+
+/**
+ * @brief What the LVGL task was doing when a refresh cycle ran long
+ *
+ * Addresses are left for the host to resolve:
+ *   riscv32-esp-elf-addr2line -pfe build/ImOS2.elf <addresses>
+ */
+typedef struct {
+    uint32_t seq;                   // Incident number since the NVS ring was created
+    uint32_t boot_ms;               // Time since boot the stall started
+    uint32_t stall_ms;              // How long the refresh was held up; still growing if the UI never recovered
+    uint8_t load[2];                // CPU load of each core in percent when the stall was caught
+    uint8_t activity_count;
+    bool recovered;
+    char activity[PERF_WATCHDOG_ACTIVITY_DEPTH][24];   // Outermost first, see perf_watchdog_enter()
+    uint32_t activity_fn;           // Callback of the innermost activity, 0 if none
+    uint32_t pc;                    // Where the LVGL task was interrupted
+    uint32_t ra;
+    uint32_t stack[PERF_WATCHDOG_STACK_DEPTH];  // Likely return addresses, innermost first
+    uint32_t stack_free;            // LVGL task stack never used, in bytes
+    uint8_t draw_count;
+    perf_watchdog_thread_t draw[PERF_WATCHDOG_DRAW_UNITS];  // A slow render runs here while the LVGL task waits
+} perf_watchdog_incident_t;
+
+#if PERF_WATCHDOG_ENABLE
+
+/**
+ * @brief Watch the refresh cycles of a display
+ *
+ * Prints the incidents kept from earlier boots, then starts a monitor task.
+ * Call with the display lock held once the UI is up, so building it doesn't
+ * count as a stall.
+ */
+void perf_watchdog_init(lv_display_t *disp);
+
+/**
+ * @brief Label work done on the LVGL task, shown when it stalls the UI
+ *
+ * Calls nest up to PERF_WATCHDOG_ACTIVITY_DEPTH deep and must be paired with
+ * perf_watchdog_leave(). LVGL task only.
+ *
+ * @param what Label, must stay valid
+ * @param fn Callback being run, or NULL
+ */
+void perf_watchdog_enter(const char *what, const void *fn);
+void perf_watchdog_leave(void);
+
+/**
+ * @brief Copy the kept incidents, oldest first
+ *
+ * @return Number of incidents copied
+ */
+size_t perf_watchdog_get_incidents(perf_watchdog_incident_t *incidents, size_t max);
+
+/**
+ * @brief Print the kept incidents
+ */
+void perf_watchdog_print_incidents(void);
+
+#define PERF_WATCHDOG_ENTER(what, fn)   perf_watchdog_enter((what), (const void *)(fn))
+#define PERF_WATCHDOG_LEAVE()           perf_watchdog_leave()
+
+#else
+
+#define PERF_WATCHDOG_ENTER(what, fn)   do { } while (0)
+#define PERF_WATCHDOG_LEAVE()           do { } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_WATCHDOG_H
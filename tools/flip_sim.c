@@ -0,0 +1,201 @@
+/*
+ * Drive hals/hal_flip.c the way the display HAL does and check that what
+ * reaches the screen is right.
+ *
+ *   cc -O2 -I main -o flip_sim tools/flip_sim.c main/hals/hal_flip.c
+ *   ./flip_sim [frames] [buffers] [seed]
+ *
+ * A 1280x720 logical display, rotated by 90° onto 720x1280 frame buffers as
+ * LVGL does on the Tab5. Every frame redraws a few random rectangles in draw
+ * buffer stripes, rotates them into the back buffer with hal_rotate.h and
+ * queues it; vsyncs land at random points in between. The simulator fails if
+ * a stripe is written into a buffer that is on screen, queued or retired, or
+ * if the buffer on screen after a vsync differs from the frame queued last.
+ * At the end it prints how many pixels were synced between buffers against
+ * copying whole frames.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hals/hal_flip.h"
+#include "hals/hal_rotate.h"
+
+#define LOGICAL_W 1280
+#define LOGICAL_H 720
+#define PANEL_W LOGICAL_H
+#define PANEL_H LOGICAL_W
+#define STRIPE_PIXELS (720 * 50)
+
+typedef struct {
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+} rect_t;
+
+static hal_flip_t s_flip;
+static uint16_t* s_logical;     // The frame as LVGL sees it
+static uint16_t* s_expected;    // Rotated copy of the last finished frame
+static uint16_t s_stripe[STRIPE_PIXELS];
+static int s_pending_check;     // A frame was queued and not yet checked on screen
+
+static void copy_area(void* dst, const void* src, const hal_flip_area_t* area, void* user_ctx)
+{
+    (void)user_ctx;
+    for (int32_t y = area->y1; y <= area->y2; y++) {
+        size_t offset = ((size_t)y * PANEL_W + area->x1) * 2;
+        memcpy((uint8_t*)dst + offset, (const uint8_t*)src + offset, (size_t)(area->x2 - area->x1 + 1) * 2);
+    }
+}
+
+static int check(int condition, const char* what, uint32_t frame)
+{
+    if (!condition) {
+        fprintf(stderr, "frame %u: %s\n", frame, what);
+    }
+    return condition;
+}
+
+static int vsync(void)
+{
+    hal_flip_vsync(&s_flip);
+    if (s_pending_check && s_flip.queued < 0) {
+        s_pending_check = 0;
+        size_t size = (size_t)PANEL_W * PANEL_H * 2;
+        return check(memcmp(hal_flip_front_buffer(&s_flip), s_expected, size) == 0,
+                     "front buffer differs from the frame queued last", s_flip.frame);
+    }
+    return 1;
+}
+
+// Rotate one stripe of the logical frame into the back buffer, the way
+// tear_free_flush_cb() does
+static int flush(const rect_t* area)
+{
+    int back = s_flip.back;
+    if (!check(back != s_flip.front && back != s_flip.queued && back != s_flip.retired,
+               "drawing into a buffer that may be scanned out", s_flip.frame)) {
+        return 0;
+    }
+
+    int32_t w = area->x2 - area->x1 + 1;
+    int32_t h = area->y2 - area->y1 + 1;
+    for (int32_t y = 0; y < h; y++) {
+        memcpy(&s_stripe[y * w], &s_logical[(area->y1 + y) * LOGICAL_W + area->x1], (size_t)w * 2);
+    }
+
+    // Logical (x, y) is panel (y, LOGICAL_W - 1 - x)
+    const hal_flip_area_t native = {area->y1, LOGICAL_W - 1 - area->x2, area->y2, LOGICAL_W - 1 - area->x1};
+    uint16_t* dst = (uint16_t*)hal_flip_back_buffer(&s_flip) + native.y1 * PANEL_W + native.x1;
+    hal_rotate90_rgb565(s_stripe, dst, w, h, w * 2, PANEL_W * 2);
+    hal_flip_add_damage(&s_flip, &native);
+    return 1;
+}
+
+static void random_rect(rect_t* r)
+{
+    // Mostly small widgets, now and then a full screen change
+    if (rand() % 20 == 0) {
+        *r = (rect_t){0, 0, LOGICAL_W - 1, LOGICAL_H - 1};
+        return;
+    }
+    int32_t w = 1 + rand() % 400;
+    int32_t h = 1 + rand() % 200;
+    r->x1 = rand() % (LOGICAL_W - w + 1);
+    r->y1 = rand() % (LOGICAL_H - h + 1);
+    r->x2 = r->x1 + w - 1;
+    r->y2 = r->y1 + h - 1;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    int count = argc > 2 ? atoi(argv[2]) : 2;
+    srand(argc > 3 ? atoi(argv[3]) : 1);
+    if (count < 2 || count > HAL_FLIP_MAX_BUFFERS) {
+        fprintf(stderr, "buffers must be 2 to %d\n", HAL_FLIP_MAX_BUFFERS);
+        return 1;
+    }
+
+    size_t size = (size_t)PANEL_W * PANEL_H * 2;
+    void* buffers[HAL_FLIP_MAX_BUFFERS] = {NULL};
+    for (int i = 0; i < count; i++) {
+        buffers[i] = calloc(1, size);
+    }
+    s_logical = calloc(1, (size_t)LOGICAL_W * LOGICAL_H * 2);
+    s_expected = calloc(1, size);
+    if (!buffers[count - 1] || !s_logical || !s_expected) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Buffer 0 is on screen with the boot frame, the others hold garbage
+    for (int i = 1; i < count; i++) {
+        memset(buffers[i], 0xA5, size);
+    }
+    hal_flip_init(&s_flip, buffers, count, PANEL_W, PANEL_H, copy_area, NULL);
+
+    size_t synced = 0;
+    size_t drawn = 0;
+    int waits = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        rect_t dirty[4];
+        int n = 1 + rand() % 4;
+        for (int i = 0; i < n; i++) {
+            random_rect(&dirty[i]);
+            uint16_t color = (uint16_t)rand();
+            for (int32_t y = dirty[i].y1; y <= dirty[i].y2; y++) {
+                for (int32_t x = dirty[i].x1; x <= dirty[i].x2; x++) {
+                    s_logical[y * LOGICAL_W + x] = color ^ (uint16_t)(x * 31 + y);
+                }
+            }
+        }
+
+        while (!hal_flip_begin(&s_flip)) {
+            waits++;
+            if (!vsync()) {
+                return 1;
+            }
+        }
+        synced += hal_flip_sync(&s_flip);
+
+        // Each area goes out in stripes of at most one draw buffer
+        for (int i = 0; i < n; i++) {
+            int32_t w = dirty[i].x2 - dirty[i].x1 + 1;
+            int32_t rows = STRIPE_PIXELS / w;
+            for (int32_t y = dirty[i].y1; y <= dirty[i].y2; y += rows) {
+                rect_t stripe = {dirty[i].x1, y, dirty[i].x2, y + rows - 1};
+                if (stripe.y2 > dirty[i].y2) {
+                    stripe.y2 = dirty[i].y2;
+                }
+                if (!flush(&stripe)) {
+                    return 1;
+                }
+                drawn += (size_t)w * (stripe.y2 - stripe.y1 + 1);
+                // The panel keeps scanning while LVGL renders
+                if (rand() % 8 == 0 && !vsync()) {
+                    return 1;
+                }
+            }
+        }
+
+        hal_flip_end(&s_flip);
+        hal_rotate90_rgb565(s_logical, s_expected, LOGICAL_W, LOGICAL_H, LOGICAL_W * 2, PANEL_W * 2);
+        s_pending_check = 1;
+        if (rand() % 2 == 0 && !vsync()) {
+            return 1;
+        }
+    }
+
+    double full = (double)frames * PANEL_W * PANEL_H;
+    printf("%d frames, %d buffers: %d waits for vsync\n", frames, count, waits);
+    printf("drawn  %12zu px\n", drawn);
+    printf("synced %12zu px, %.1f%% of copying every frame whole\n", synced, 100.0 * synced / full);
+
+    for (int i = 0; i < count; i++) {
+        free(buffers[i]);
+    }
+    free(s_logical);
+    free(s_expected);
+    return 0;
+}
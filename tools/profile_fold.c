@@ -0,0 +1,249 @@
+/*
+ * Symbolize samples from the sampling profiler and fold them into stacks
+ * for flame graphs.
+ *
+ * Build the firmware with PERF_PROFILE_ENABLE=1 and PERF_PROFILE_APP set to
+ * the app to look at; each launch of it leaves prof_<app>.bin on the SD card.
+ *
+ *   cc -O2 -I main -o profile_fold tools/profile_fold.c
+ *   ./profile_fold build/ImOS2.elf prof_settings.bin [addr2line] > settings.folded
+ *   flamegraph.pl settings.folded > settings.svg
+ *
+ * addr2line defaults to riscv32-esp-elf-addr2line from the IDF toolchain.
+ * Each line is "task;caller;function count": the caller comes from the
+ * return address and is only a hint, it is left out when it points back
+ * into the sampled function. The busiest functions are listed on stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "perf/perf_profile.h"
+
+typedef struct {
+    uint32_t addr;
+    char* func;
+} symbol_t;
+
+typedef struct {
+    char* stack;
+    uint32_t count;
+} folded_t;
+
+static symbol_t* s_symbols = NULL;
+static size_t s_symbol_count = 0;
+
+static int read_exact(FILE* f, void* buf, size_t len)
+{
+    return fread(buf, 1, len, f) == len ? 0 : -1;
+}
+
+static int compare_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_symbol(const void* a, const void* b)
+{
+    return compare_u32(&((const symbol_t*)a)->addr, &((const symbol_t*)b)->addr);
+}
+
+static int compare_str(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int compare_folded_count(const void* a, const void* b)
+{
+    const folded_t* x = (const folded_t*)a;
+    const folded_t* y = (const folded_t*)b;
+    return (y->count > x->count) - (y->count < x->count);
+}
+
+static const char* lookup(uint32_t addr)
+{
+    symbol_t key = {.addr = addr};
+    symbol_t* sym = bsearch(&key, s_symbols, s_symbol_count, sizeof(symbol_t), compare_symbol);
+    return sym ? sym->func : "??";
+}
+
+// Return addresses point after the call, look up the call itself
+static uint32_t call_site(uint32_t ra)
+{
+    return ra - 2;
+}
+
+// Resolve every distinct address with one addr2line run
+static int symbolize(const char* addr2line, const char* elf, uint32_t* addrs, size_t count)
+{
+    qsort(addrs, count, sizeof(uint32_t), compare_u32);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique == 0 || addrs[unique - 1] != addrs[i]) {
+            addrs[unique++] = addrs[i];
+        }
+    }
+
+    char list_path[] = "/tmp/profile_fold_XXXXXX";
+    int fd = mkstemp(list_path);
+    FILE* list = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!list) {
+        perror("temporary file");
+        return -1;
+    }
+    for (size_t i = 0; i < unique; i++) {
+        fprintf(list, "0x%08x\n", addrs[i]);
+    }
+    fclose(list);
+
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "%s -f -e '%s' < %s", addr2line, elf, list_path);
+    FILE* out = popen(cmd, "r");
+    if (!out) {
+        perror(addr2line);
+        remove(list_path);
+        return -1;
+    }
+
+    // Two lines per address: function, then file:line
+    s_symbols = calloc(unique + 1, sizeof(symbol_t));
+    char func[512];
+    char location[1024];
+    while (s_symbol_count < unique && fgets(func, sizeof(func), out) && fgets(location, sizeof(location), out)) {
+        func[strcspn(func, "\r\n")] = '\0';
+        s_symbols[s_symbol_count].addr = addrs[s_symbol_count];
+        s_symbols[s_symbol_count].func = strdup(func);
+        s_symbol_count++;
+    }
+    int status = pclose(out);
+    remove(list_path);
+
+    if (s_symbol_count != unique || status != 0) {
+        fprintf(stderr, "%s failed on %s\n", addr2line, elf);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s firmware.elf profile.bin [addr2line] > out.folded\n", argv[0]);
+        return 1;
+    }
+    const char* addr2line = argc > 3 ? argv[3] : "riscv32-esp-elf-addr2line";
+
+    FILE* f = fopen(argv[2], "rb");
+    if (!f) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    perf_profile_file_header_t header;
+    if (read_exact(f, &header, sizeof(header)) != 0 || header.magic != PERF_PROFILE_MAGIC ||
+        header.version != PERF_PROFILE_VERSION) {
+        fprintf(stderr, "%s: not a profile of this version\n", argv[2]);
+        return 1;
+    }
+
+    perf_profile_task_t* tasks = calloc(header.task_count + 1, sizeof(perf_profile_task_t));
+    if (read_exact(f, tasks, header.task_count * sizeof(perf_profile_task_t)) != 0) {
+        fprintf(stderr, "%s: truncated task table\n", argv[2]);
+        return 1;
+    }
+
+    perf_profile_sample_t* samples = NULL;
+    size_t total = 0;
+    for (uint32_t core = 0; core < header.core_count; core++) {
+        uint32_t count;
+        if (read_exact(f, &count, sizeof(count)) != 0) {
+            fprintf(stderr, "%s: truncated samples\n", argv[2]);
+            return 1;
+        }
+        samples = realloc(samples, (total + count + 1) * sizeof(perf_profile_sample_t));
+        if (read_exact(f, &samples[total], count * sizeof(perf_profile_sample_t)) != 0) {
+            fprintf(stderr, "%s: truncated samples of core %u\n", argv[2], core);
+            return 1;
+        }
+        total += count;
+    }
+    fclose(f);
+
+    uint32_t* addrs = malloc((2 * total + 1) * sizeof(uint32_t));
+    size_t addr_count = 0;
+    for (size_t i = 0; i < total; i++) {
+        addrs[addr_count++] = samples[i].pc;
+        if (samples[i].ra) {
+            addrs[addr_count++] = call_site(samples[i].ra);
+        }
+    }
+    if (symbolize(addr2line, argv[1], addrs, addr_count) != 0) {
+        return 1;
+    }
+
+    // One string per sample, sorted so equal stacks end up next to each other
+    char** stacks = malloc((total + 1) * sizeof(char*));
+    for (size_t i = 0; i < total; i++) {
+        const perf_profile_sample_t* s = &samples[i];
+        char task[24];
+        snprintf(task, sizeof(task), s->task == PERF_PROFILE_TASK_ISR ? "[isr]" : "task_%08x", s->task);
+        for (uint32_t t = 0; t < header.task_count; t++) {
+            if (tasks[t].task == s->task) {
+                snprintf(task, sizeof(task), "%.15s", tasks[t].name);
+                break;
+            }
+        }
+
+        const char* func = lookup(s->pc);
+        const char* caller = s->ra ? lookup(call_site(s->ra)) : NULL;
+        char line[1200];
+        if (caller && strcmp(caller, func) != 0 && strcmp(caller, "??") != 0) {
+            snprintf(line, sizeof(line), "%s;%s;%s", task, caller, func);
+        } else {
+            snprintf(line, sizeof(line), "%s;%s", task, func);
+        }
+        stacks[i] = strdup(line);
+    }
+    qsort(stacks, total, sizeof(char*), compare_str);
+
+    folded_t* folded = calloc(total + 1, sizeof(folded_t));
+    size_t folded_count = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (folded_count > 0 && strcmp(folded[folded_count - 1].stack, stacks[i]) == 0) {
+            folded[folded_count - 1].count++;
+        } else {
+            folded[folded_count].stack = stacks[i];
+            folded[folded_count].count = 1;
+            folded_count++;
+        }
+    }
+    for (size_t i = 0; i < folded_count; i++) {
+        printf("%s %u\n", folded[i].stack, folded[i].count);
+    }
+
+    // Self time per function across all tasks
+    char** funcs = malloc((total + 1) * sizeof(char*));
+    for (size_t i = 0; i < total; i++) {
+        funcs[i] = (char*)lookup(samples[i].pc);
+    }
+    qsort(funcs, total, sizeof(char*), compare_str);
+    folded_t* self = calloc(total + 1, sizeof(folded_t));
+    size_t self_count = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (self_count > 0 && strcmp(self[self_count - 1].stack, funcs[i]) == 0) {
+            self[self_count - 1].count++;
+        } else {
+            self[self_count].stack = funcs[i];
+            self[self_count].count = 1;
+            self_count++;
+        }
+    }
+    qsort(self, self_count, sizeof(folded_t), compare_folded_count);
+
+    fprintf(stderr, "%zu samples at %u Hz per core, %u missed\n", total, header.sample_hz, header.missed);
+    for (size_t i = 0; i < self_count && i < 20; i++) {
+        fprintf(stderr, "%6.2f%%  %6u  %s\n", 100.0 * self[i].count / total, self[i].count, self[i].stack);
+    }
+    return 0;
+}
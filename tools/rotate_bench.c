@@ -0,0 +1,150 @@
+/*
+ * Benchmark the 90° rotation kernels of hals/hal_rotate.h against LVGL's
+ * pixel-by-pixel loop, for each tile size.
+ *
+ *   cc -O2 -I main -o rotate_bench tools/rotate_bench.c
+ *   ./rotate_bench [milliseconds per case]
+ *
+ * Areas are the rotated-space sizes the LVGL port hands over while sw_rotate
+ * is on: one draw buffer stripe (BSP_LCD_DRAW_BUFF_SIZE pixels, 1280 wide)
+ * and a full 1280x720 frame. MB/s counts source bytes of the fastest run.
+ * Every result is checked against the reference loop before it is timed.
+ * Host numbers only compare kernels with each other; cache sizes and the
+ * cost of byte accesses differ on the P4.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hals/hal_rotate.h"
+
+typedef void (*rotate_fn_t)(const void *src, void *dst, int32_t width, int32_t height,
+                            int32_t src_stride, int32_t dst_stride, int32_t tile);
+
+typedef struct {
+    const char *name;
+    int32_t width;
+    int32_t height;
+} area_t;
+
+static const area_t s_areas[] = {
+    {"stripe", 1280, 720 * 50 / 1280},
+    {"frame", 1280, 720},
+};
+
+static const int32_t s_tiles[] = {8, 16, 32, 64};
+
+// The loops of lv_draw_sw.c's rotate90_rgb565() and rotate90_rgb888()
+static void reference_rgb565(const void *src, void *dst, int32_t width, int32_t height,
+                             int32_t src_stride, int32_t dst_stride, int32_t tile)
+{
+    const uint16_t *s = src;
+    uint16_t *d = dst;
+    (void)tile;
+    src_stride /= 2;
+    dst_stride /= 2;
+    for (int32_t x = 0; x < width; ++x) {
+        int32_t dst_index = x * dst_stride;
+        int32_t src_index = width - 1 - x;
+        for (int32_t y = 0; y < height; ++y) {
+            d[dst_index + y] = s[src_index];
+            src_index += src_stride;
+        }
+    }
+}
+
+static void reference_rgb888(const void *src, void *dst, int32_t width, int32_t height,
+                             int32_t src_stride, int32_t dst_stride, int32_t tile)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+    (void)tile;
+    for (int32_t x = 0; x < width; ++x) {
+        for (int32_t y = 0; y < height; ++y) {
+            int32_t src_index = y * src_stride + (width - x - 1) * 3;
+            int32_t dst_index = x * dst_stride + y * 3;
+            d[dst_index] = s[src_index];
+            d[dst_index + 1] = s[src_index + 1];
+            d[dst_index + 2] = s[src_index + 2];
+        }
+    }
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fastest of as many runs as fit in the time given, which keeps the numbers
+// steady on a busy host
+static double bench(rotate_fn_t fn, const area_t *area, int32_t bpp, int32_t tile,
+                    const uint8_t *src, uint8_t *dst, double seconds)
+{
+    int32_t src_stride = area->width * bpp;
+    int32_t dst_stride = area->height * bpp;
+    double bytes = (double)area->width * area->height * bpp;
+    double best = 1e9;
+
+    double end = now_s() + seconds;
+    double start;
+    do {
+        start = now_s();
+        fn(src, dst, area->width, area->height, src_stride, dst_stride, tile);
+        double run = now_s() - start;
+        if (run < best) {
+            best = run;
+        }
+    } while (start < end);
+
+    return bytes / best / 1e6;
+}
+
+static int run_format(const char *format, int32_t bpp, rotate_fn_t reference, rotate_fn_t tiled, double seconds)
+{
+    for (size_t a = 0; a < sizeof(s_areas) / sizeof(s_areas[0]); a++) {
+        const area_t *area = &s_areas[a];
+        size_t size = (size_t)area->width * area->height * bpp;
+        uint8_t *src = malloc(size);
+        uint8_t *expected = malloc(size);
+        uint8_t *dst = malloc(size);
+        if (!src || !expected || !dst) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        for (size_t i = 0; i < size; i++) {
+            src[i] = (uint8_t)(i * 2654435761u >> 24);
+        }
+        reference(src, expected, area->width, area->height, area->width * bpp, area->height * bpp, 0);
+
+        printf("%-7s %-6s %4dx%-4d  reference %8.1f MB/s\n", format, area->name, area->width, area->height,
+               bench(reference, area, bpp, 0, src, dst, seconds));
+        for (size_t t = 0; t < sizeof(s_tiles) / sizeof(s_tiles[0]); t++) {
+            memset(dst, 0, size);
+            tiled(src, dst, area->width, area->height, area->width * bpp, area->height * bpp, s_tiles[t]);
+            if (memcmp(dst, expected, size) != 0) {
+                fprintf(stderr, "%s %s: tile %d differs from the reference\n", format, area->name, s_tiles[t]);
+                return 1;
+            }
+            printf("%-7s %-6s %4dx%-4d  tile %-4d %8.1f MB/s\n", format, area->name, area->width, area->height,
+                   s_tiles[t], bench(tiled, area, bpp, s_tiles[t], src, dst, seconds));
+        }
+
+        free(src);
+        free(expected);
+        free(dst);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = (argc > 1 ? atoi(argv[1]) : 500) / 1000.0;
+
+    if (run_format("RGB565", 2, reference_rgb565, hal_rotate90_rgb565_tiled, seconds) != 0 ||
+        run_format("RGB888", 3, reference_rgb888, hal_rotate90_rgb888_tiled, seconds) != 0) {
+        return 1;
+    }
+    return 0;
+}
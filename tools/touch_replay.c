@@ -0,0 +1,99 @@
+/*
+ * Replay a recorded touch trace through the touch filter on the host.
+ *
+ * Record a trace by building with HAL_TOUCH_TRACE=1 and saving the serial
+ * log; lines that don't start with "TT," are ignored, so the raw monitor
+ * output can be fed in directly.
+ *
+ *   cc -O2 -I main -o touch_replay tools/touch_replay.c main/hals/hal_touch_filter.c -lm
+ *   ./touch_replay trace.log [min_cutoff beta d_cutoff predict_ms max_predict_px] > out.csv
+ *
+ * Prints "timestamp_us,raw_x,raw_y,out_x,out_y" for every pressed sample
+ * and the prediction error per stroke and overall on stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hals/hal_touch_filter.h"
+
+static void print_stats(const char* label, const hal_touch_filter_t* filter)
+{
+    hal_touch_filter_stats_t stats;
+    hal_touch_filter_get_stats(filter, &stats);
+    fprintf(stderr, "%s: n=%u mean %.2f px rms %.2f px max %.2f px\n",
+            label, stats.count, stats.mean_px, stats.rms_px, stats.max_px);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.log [min_cutoff beta d_cutoff predict_ms max_predict_px]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    hal_touch_filter_params_t params;
+    hal_touch_filter_default_params(&params);
+    if (argc > 2) params.min_cutoff = strtof(argv[2], NULL);
+    if (argc > 3) params.beta = strtof(argv[3], NULL);
+    if (argc > 4) params.d_cutoff = strtof(argv[4], NULL);
+    if (argc > 5) params.predict_ms = strtof(argv[5], NULL);
+    if (argc > 6) params.max_predict_px = strtof(argv[6], NULL);
+
+    fprintf(stderr, "min_cutoff %.3f beta %.4f d_cutoff %.2f predict %.1f ms max %.1f px\n",
+            params.min_cutoff, params.beta, params.d_cutoff, params.predict_ms, params.max_predict_px);
+
+    // One filter per stroke like the device, plus totals over the whole trace
+    hal_touch_filter_t filter;
+    hal_touch_filter_init(&filter, &params);
+    hal_touch_filter_set_measure(&filter, true);
+
+    uint32_t total_n = 0;
+    double total_sum = 0.0, total_sq = 0.0;
+    float total_max = 0.0f;
+    int stroke = 0;
+
+    char line[256];
+    printf("timestamp_us,raw_x,raw_y,out_x,out_y\n");
+    while (fgets(line, sizeof(line), in)) {
+        const char* p = strstr(line, "TT,");
+        long long ts;
+        unsigned count, x, y;
+
+        if (!p || sscanf(p, "TT,%lld,%u,%u,%u", &ts, &count, &x, &y) != 4) {
+            continue;
+        }
+
+        if (count == 0) {
+            char label[32];
+            snprintf(label, sizeof(label), "stroke %d", ++stroke);
+            print_stats(label, &filter);
+
+            total_n += filter.err_count;
+            total_sum += filter.err_sum;
+            total_sq += filter.err_sq_sum;
+            if (filter.err_max > total_max) total_max = filter.err_max;
+
+            hal_touch_filter_reset(&filter);
+            hal_touch_filter_set_measure(&filter, true);
+            continue;
+        }
+
+        float ox, oy;
+        hal_touch_filter_update(&filter, ts, (float)x, (float)y, &ox, &oy);
+        printf("%lld,%u,%u,%.1f,%.1f\n", ts, x, y, ox, oy);
+    }
+    fclose(in);
+
+    if (total_n > 0) {
+        fprintf(stderr, "total: n=%u mean %.2f px rms %.2f px max %.2f px\n",
+                total_n, total_sum / total_n, sqrt(total_sq / total_n), total_max);
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Convert a trace written by perf_trace_dump() to Chrome trace JSON.
+ *
+ * Build the firmware with PERF_TRACE_ENABLE=1; the trace lands on the SD card
+ * as trace.bin (see PERF_TRACE_DUMP_PATH). Open the output in
+ * chrome://tracing or https://ui.perfetto.dev.
+ *
+ *   cc -O2 -I main -o trace_to_chrome tools/trace_to_chrome.c
+ *   ./trace_to_chrome trace.bin > trace.json
+ *
+ * Each task is a thread, interrupts get one thread per core. Events of both
+ * cores are merged by time, so spans of tasks that moved cores still match.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "perf/perf_trace.h"
+
+typedef struct {
+    perf_trace_event_t ev;
+    uint32_t order;         // Position in the file, keeps equal timestamps in recording order
+} merged_event_t;
+
+static char** s_names = NULL;
+static uint32_t s_name_count = 0;
+static perf_trace_task_t* s_tasks = NULL;
+static uint32_t s_task_count = 0;
+
+static bool s_first_event = true;
+
+// Separates the events, JSON has no room for a trailing comma
+static void next_event(void)
+{
+    printf(s_first_event ? "" : ",\n");
+    s_first_event = false;
+}
+
+static int read_exact(FILE* f, void* buf, size_t len)
+{
+    return fread(buf, 1, len, f) == len ? 0 : -1;
+}
+
+static void print_json_string(const char* s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            putchar('\\');
+            putchar(*s);
+        } else if ((unsigned char)*s < 0x20) {
+            printf("\\u%04x", *s);
+        } else {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static const char* event_name(uint16_t id)
+{
+    return id < s_name_count ? s_names[id] : "?";
+}
+
+// Interrupts have no task handle, give each core's interrupts a thread of their own
+static uint32_t thread_id(const perf_trace_event_t* ev)
+{
+    return ev->task == PERF_TRACE_TASK_ISR ? (uint32_t)ev->core + 1 : ev->task;
+}
+
+static int compare_events(const void* a, const void* b)
+{
+    const merged_event_t* x = (const merged_event_t*)a;
+    const merged_event_t* y = (const merged_event_t*)b;
+    if (x->ev.timestamp_us != y->ev.timestamp_us) {
+        return x->ev.timestamp_us < y->ev.timestamp_us ? -1 : 1;
+    }
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+static void print_thread_names(const merged_event_t* events, uint32_t count)
+{
+    uint32_t* seen = calloc(count + 1, sizeof(uint32_t));
+    uint32_t seen_count = 0;
+
+    for (uint32_t i = 0; i < count && seen; i++) {
+        uint32_t tid = thread_id(&events[i].ev);
+        uint32_t j;
+        for (j = 0; j < seen_count && seen[j] != tid; j++) {
+        }
+        if (j < seen_count) {
+            continue;
+        }
+        seen[seen_count++] = tid;
+
+        char name[32];
+        if (events[i].ev.task == PERF_TRACE_TASK_ISR) {
+            snprintf(name, sizeof(name), "ISR core %u", events[i].ev.core);
+        } else {
+            snprintf(name, sizeof(name), "task 0x%08x", tid);
+            for (uint32_t t = 0; t < s_task_count; t++) {
+                if (s_tasks[t].task == tid) {
+                    snprintf(name, sizeof(name), "%.15s", s_tasks[t].name);
+                    break;
+                }
+            }
+        }
+        next_event();
+        printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":", tid);
+        print_json_string(name);
+        printf("}}");
+    }
+    free(seen);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.bin > trace.json\n", argv[0]);
+        return 1;
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    perf_trace_file_header_t header;
+    if (read_exact(f, &header, sizeof(header)) != 0 || header.magic != PERF_TRACE_MAGIC ||
+        header.version != PERF_TRACE_VERSION || header.event_size != sizeof(perf_trace_event_t)) {
+        fprintf(stderr, "%s: not a trace of this version\n", argv[1]);
+        return 1;
+    }
+
+    s_name_count = header.name_count;
+    s_names = calloc(s_name_count, sizeof(char*));
+    for (uint32_t i = 0; i < s_name_count; i++) {
+        uint8_t len;
+        s_names[i] = NULL;
+        if (read_exact(f, &len, 1) != 0 || (s_names[i] = calloc(1, len + 1)) == NULL ||
+            read_exact(f, s_names[i], len) != 0) {
+            fprintf(stderr, "%s: truncated name table\n", argv[1]);
+            return 1;
+        }
+    }
+
+    s_task_count = header.task_count;
+    s_tasks = calloc(s_task_count + 1, sizeof(perf_trace_task_t));
+    if (read_exact(f, s_tasks, s_task_count * sizeof(perf_trace_task_t)) != 0) {
+        fprintf(stderr, "%s: truncated task table\n", argv[1]);
+        return 1;
+    }
+
+    merged_event_t* events = NULL;
+    uint32_t total = 0;
+    for (uint32_t core = 0; core < header.core_count; core++) {
+        uint32_t count;
+        if (read_exact(f, &count, sizeof(count)) != 0) {
+            fprintf(stderr, "%s: truncated events\n", argv[1]);
+            return 1;
+        }
+        events = realloc(events, (size_t)(total + count + 1) * sizeof(merged_event_t));
+        for (uint32_t i = 0; i < count; i++) {
+            if (read_exact(f, &events[total].ev, sizeof(perf_trace_event_t)) != 0) {
+                fprintf(stderr, "%s: truncated events of core %u\n", argv[1], core);
+                return 1;
+            }
+            events[total].order = total;
+            total++;
+        }
+    }
+    fclose(f);
+
+    qsort(events, total, sizeof(merged_event_t), compare_events);
+
+    printf("{\"traceEvents\":[\n");
+    print_thread_names(events, total);
+    for (uint32_t i = 0; i < total; i++) {
+        const perf_trace_event_t* ev = &events[i].ev;
+        const char* name = event_name(ev->name);
+        uint32_t tid = thread_id(ev);
+
+        next_event();
+        printf("{\"name\":");
+        print_json_string(name);
+        printf(",\"pid\":0,\"tid\":%u,\"ts\":%llu,", tid, (unsigned long long)ev->timestamp_us);
+        switch (ev->type) {
+            case PERF_TRACE_EV_BEGIN:
+                printf("\"ph\":\"B\",\"args\":{\"value\":%d,\"core\":%u}", ev->value, ev->core);
+                break;
+            case PERF_TRACE_EV_END:
+                printf("\"ph\":\"E\"");
+                break;
+            case PERF_TRACE_EV_INSTANT:
+                printf("\"ph\":\"i\",\"s\":\"t\",\"args\":{\"value\":%d,\"core\":%u}", ev->value, ev->core);
+                break;
+            case PERF_TRACE_EV_COUNTER:
+            default:
+                printf("\"ph\":\"C\",\"args\":{");
+                print_json_string(name);
+                printf(":%d}", ev->value);
+                break;
+        }
+        printf("}");
+    }
+    printf("\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%u}}\n", header.dropped);
+
+    fprintf(stderr, "%u events, %u names, %u tasks, %u dropped on the device\n",
+            total, s_name_count, s_task_count, header.dropped);
+    return 0;
+}